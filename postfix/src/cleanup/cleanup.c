@@ -330,6 +330,14 @@
 /*	Available in Postfix version 3.0 and later:
 /* .IP "\fBvirtual_alias_address_length_limit (1000)\fR"
 /*	The maximal length of an email address after virtual alias expansion.
+/* .PP
+/*	Available in Postfix version 3.5 and later:
+/* .IP "\fBcleanup_group_sync (no)\fR"
+/*	Let concurrent cleanup processes share one file system
+/*	synchronization, instead of running fsync() for each queue file.
+/* .IP "\fBcleanup_group_sync_delay (2)\fR"
+/*	The time in milliseconds that a cleanup process waits for other
+/*	cleanup processes to join a file system synchronization.
 /* SMTPUTF8 CONTROLS
 /* .ad
 /* .fi
@@ -20,6 +20,7 @@
 #include <vstream.h>
 #include <argv.h>
 #include <nvtable.h>
+#include <arena.h>
 
  /*
   * Global library.
@@ -52,6 +53,7 @@ typedef struct CLEANUP_STATE {
     VSTREAM *src;			/* current input stream */
     VSTREAM *dst;			/* current output stream */
     MAIL_STREAM *handle;		/* mail stream handle */
+    ARENA  *arena;			/* per-message strings */
     char   *queue_name;			/* queue name */
     char   *queue_id;			/* queue file basename */
     struct timeval arrival_time;	/* arrival time */
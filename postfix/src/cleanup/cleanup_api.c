@@ -152,12 +152,12 @@ CLEANUP_STATE *cleanup_open(VSTREAM *src)
      * XXX For now, a lot of detail is frozen that could be more useful if it
      * were made configurable.
      */
-    state->queue_name = mystrdup(MAIL_QUEUE_INCOMING);
+    state->queue_name = arena_strdup(state->arena, MAIL_QUEUE_INCOMING);
     state->handle = mail_stream_file(state->queue_name,
 				   MAIL_CLASS_PUBLIC, var_queue_service, 0);
     state->dst = state->handle->stream;
     cleanup_path = mystrdup(VSTREAM_PATH(state->dst));
-    state->queue_id = mystrdup(state->handle->id);
+    state->queue_id = arena_strdup(state->arena, state->handle->id);
     if (msg_verbose)
 	msg_info("cleanup_open: open %s", cleanup_path);
 
@@ -296,12 +296,12 @@ int     cleanup_flush(CLEANUP_STATE *state)
 	    || state->defer_delay > 0
 #endif
 	    ) {
-	    myfree(state->queue_name);
 #ifdef DELAY_ACTION
-	    state->queue_name = mystrdup((state->flags & CLEANUP_FLAG_HOLD) ?
-				     MAIL_QUEUE_HOLD : MAIL_QUEUE_DEFERRED);
+	    state->queue_name = arena_strdup(state->arena,
+				    (state->flags & CLEANUP_FLAG_HOLD) ?
+				    MAIL_QUEUE_HOLD : MAIL_QUEUE_DEFERRED);
 #else
-	    state->queue_name = mystrdup(MAIL_QUEUE_HOLD);
+	    state->queue_name = arena_strdup(state->arena, MAIL_QUEUE_HOLD);
 #endif
 	    mail_stream_ctl(state->handle,
 			    CA_MAIL_STREAM_CTL_QUEUE(state->queue_name),
@@ -379,7 +379,7 @@ static void cleanup_envelope_process(CLEANUP_STATE *state, int type,
     if (type == REC_TYPE_FULL) {
 	/* First instance wins. */
 	if (state->fullname == 0) {
-	    state->fullname = mystrdup(buf);
+	    state->fullname = arena_strdup(state->arena, buf);
 	    cleanup_out(state, type, buf, len);
 	}
 	return;
@@ -418,9 +418,7 @@ static void cleanup_envelope_process(CLEANUP_STATE *state, int type,
 	    state->errs |= CLEANUP_STAT_BAD;
 	    return;
 	}
-	if (state->dsn_envid != 0)
-	    myfree(state->dsn_envid);
-	state->dsn_envid = mystrdup(mapped_buf);
+	state->dsn_envid = arena_strdup(state->arena, mapped_buf);
 	cleanup_out(state, type, buf, len);
 	return;
     }
@@ -455,7 +453,7 @@ static void cleanup_envelope_process(CLEANUP_STATE *state, int type,
 		msg_warn("%s: ignoring bad VERP request: \"%.100s\"",
 			 state->queue_id, buf);
 	    } else {
-		state->verp_delims = mystrdup(buf);
+		state->verp_delims = arena_strdup(state->arena, buf);
 		cleanup_out(state, type, buf, len);
 	    }
 	}
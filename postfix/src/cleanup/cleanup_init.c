@@ -91,6 +91,7 @@
 #include <name_code.h>
 #include <name_mask.h>
 #include <stringops.h>
+#include <set_eugid.h>
 
 /* Global library. */
 
@@ -99,11 +100,17 @@
 #include <mail_version.h>		/* milter_macro_v */
 #include <ext_prop.h>
 #include <flush_clnt.h>
+#include <mail_group_sync.h>
 
 /* Application-specific. */
 
 #include "cleanup.h"
 
+ /*
+  * Group commit lock file, in the data directory.
+  */
+#define CLEANUP_GROUP_SYNC_LOCK	"cleanup_sync.lock"
+
  /*
   * Global state: any queue files that we have open, so that the error
   * handler can clean up in case of trouble.
@@ -172,6 +179,8 @@ int     var_auto_8bit_enc_hdr;		/* auto-detect 8bit encoding header */
 int     var_always_add_hdrs;		/* always add missing headers */
 int     var_virt_addrlen_limit;		/* stop exponential growth */
 char   *var_hfrom_format;		/* header_from_format */
+bool    var_cleanup_group_sync;		/* share file system sync */
+int     var_cleanup_sync_delay;		/* group sync delay (ms) */
 
 const CONFIG_INT_TABLE cleanup_int_table[] = {
     VAR_HOPCOUNT_LIMIT, DEF_HOPCOUNT_LIMIT, &var_hopcount_limit, 1, 0,
@@ -181,6 +190,7 @@ const CONFIG_INT_TABLE cleanup_int_table[] = {
     VAR_VIRT_EXPAN_LIMIT, DEF_VIRT_EXPAN_LIMIT, &var_virt_expan_limit, 1, 0,
     VAR_VIRT_ADDRLEN_LIMIT, DEF_VIRT_ADDRLEN_LIMIT, &var_virt_addrlen_limit, 1, 0,
     VAR_BODY_CHECK_LEN, DEF_BODY_CHECK_LEN, &var_body_check_len, 0, 0,
+    VAR_CLEANUP_SYNC_DELAY, DEF_CLEANUP_SYNC_DELAY, &var_cleanup_sync_delay, 0, 1000,
     0,
 };
 
@@ -188,6 +198,7 @@ const CONFIG_BOOL_TABLE cleanup_bool_table[] = {
     VAR_VERP_BOUNCE_OFF, DEF_VERP_BOUNCE_OFF, &var_verp_bounce_off,
     VAR_AUTO_8BIT_ENC_HDR, DEF_AUTO_8BIT_ENC_HDR, &var_auto_8bit_enc_hdr,
     VAR_ALWAYS_ADD_HDRS, DEF_ALWAYS_ADD_HDRS, &var_always_add_hdrs,
+    VAR_CLEANUP_GROUP_SYNC, DEF_CLEANUP_GROUP_SYNC, &var_cleanup_group_sync,
     0,
 };
 
@@ -426,6 +437,21 @@ void    cleanup_pre_jail(char *unused_name, char **unused_argv)
 					var_milt_unk_macros,
 					var_milt_macro_deflts);
 
+    /*
+     * Optionally, share file system syncs with other cleanup processes. The
+     * lock file lives outside the queue directory, so it must be opened
+     * before entering the chroot jail.
+     */
+    if (var_cleanup_group_sync) {
+	VSTRING *lock_path = vstring_alloc(100);
+
+	vstring_sprintf(lock_path, "%s/%s", var_data_dir,
+			CLEANUP_GROUP_SYNC_LOCK);
+	SAVE_AND_SET_EUGID(var_owner_uid, var_owner_gid);
+	mail_group_sync_init(vstring_str(lock_path), var_cleanup_sync_delay);
+	RESTORE_SAVED_EUGID();
+	vstring_free(lock_path);
+    }
     flush_init();
 }
 
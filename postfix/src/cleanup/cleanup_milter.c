@@ -1371,9 +1371,8 @@ static const char *cleanup_chg_from(void *context, const char *ext_from,
 		    msg_warn("Ignoring bad ESMTP parameter \"%s\" in "
 			     "SMFI_CHGFROM request", arg);
 		} else {
-		    if (state->dsn_envid)
-			myfree(state->dsn_envid);
-		    state->dsn_envid = mystrdup(STR(state->milter_dsn_buf));
+		    state->dsn_envid = arena_strdup(state->arena,
+						STR(state->milter_dsn_buf));
 		}
 	    } else {
 		msg_warn("Ignoring bad ESMTP parameter \"%s\" in "
@@ -2487,7 +2486,7 @@ int     main(int unused_argc, char **argv)
     CLEANUP_STATE *state = cleanup_state_alloc((VSTREAM *) 0);
     const char *parens = "{}";
 
-    state->queue_id = mystrdup("NOQUEUE");
+    state->queue_id = arena_strdup(state->arena, "NOQUEUE");
     state->sender = mystrdup("sender");
     state->recip = mystrdup("recipient");
     state->client_name = "client_name";
@@ -74,6 +74,7 @@ CLEANUP_STATE *cleanup_state_alloc(VSTREAM *src)
     state->src = src;
     state->dst = 0;
     state->handle = 0;
+    state->arena = arena_create(ARENA_CHUNK_SIZE);
     state->queue_name = 0;
     state->queue_id = 0;
     state->arrival_time.tv_sec = state->arrival_time.tv_usec = 0;
@@ -150,8 +151,6 @@ void    cleanup_state_free(CLEANUP_STATE *state)
     vstring_free(state->temp2);
     if (cleanup_strip_chars)
 	vstring_free(state->stripped_buf);
-    if (state->fullname)
-	myfree(state->fullname);
     if (state->sender)
 	myfree(state->sender);
     if (state->recip)
@@ -165,10 +164,6 @@ void    cleanup_state_free(CLEANUP_STATE *state)
     argv_free(state->auto_hdrs);
     if (state->hbc_rcpt)
 	argv_free(state->hbc_rcpt);
-    if (state->queue_name)
-	myfree(state->queue_name);
-    if (state->queue_id)
-	myfree(state->queue_id);
     been_here_free(state->dups);
     if (state->reason)
 	myfree(state->reason);
@@ -181,12 +176,8 @@ void    cleanup_state_free(CLEANUP_STATE *state)
 	myfree(state->filter);
     if (state->redirect)
 	myfree(state->redirect);
-    if (state->dsn_envid)
-	myfree(state->dsn_envid);
     if (state->dsn_orcpt)
 	myfree(state->dsn_orcpt);
-    if (state->verp_delims)
-	myfree(state->verp_delims);
     if (state->milters)
 	milter_free(state->milters);
     if (state->milter_ext_from)
@@ -198,5 +189,6 @@ void    cleanup_state_free(CLEANUP_STATE *state)
     if (state->milter_dsn_buf)
 	vstring_free(state->milter_dsn_buf);
     cleanup_region_done(state);
+    arena_free(state->arena);
     myfree((void *) state);
 }
@@ -226,6 +226,14 @@ extern int dns_lookup_rl(const char *, unsigned, DNS_RR **, VSTRING *,
 extern int dns_lookup_rv(const char *, unsigned, DNS_RR **, VSTRING *,
 			         VSTRING *, int *, int, unsigned *);
 
+#ifdef LIBDNS_INTERNAL
+extern int dns_lookup_reply(const char *, const char *, unsigned, unsigned,
+			            unsigned char *, size_t, DNS_RR **,
+			            VSTRING *, VSTRING *, int *, unsigned,
+			            char *, int, int *);
+
+#endif
+
 #define dns_lookup(name, type, rflags, list, fqdn, why) \
     dns_lookup_x((name), (type), (rflags), (list), (fqdn), (why), (int *) 0, \
 	(unsigned) 0)
@@ -239,6 +247,19 @@ extern int dns_lookup_rv(const char *, unsigned, DNS_RR **, VSTRING *,
     dns_lookup_rv((name), (rflags), (list), (fqdn), (why), (int *) 0, \
 	(lflags), (ltype))
 
+ /*
+  * dns_async.c
+  */
+typedef struct DNS_ASYNC DNS_ASYNC;
+typedef void (*DNS_ASYNC_FN) (int, DNS_RR *, int, const char *, void *);
+
+extern DNS_ASYNC *dns_async_lookup(const char *, unsigned, unsigned,
+				           unsigned, DNS_ASYNC_FN, void *);
+extern void dns_async_cancel(DNS_ASYNC *);
+extern int dns_async_pending(void);
+extern int dns_async_wait(int);
+extern void dns_async_cache_flush(void);
+
  /*
   * Request flags.
   */
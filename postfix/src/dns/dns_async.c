@@ -0,0 +1,1246 @@
+/*++
+/* NAME
+/*	dns_async 3
+/* SUMMARY
+/*	non-blocking domain name service lookup
+/* SYNOPSIS
+/*	#include <dns.h>
+/*
+/*	DNS_ASYNC *dns_async_lookup(name, type, rflags, lflags,
+/*					callback, context)
+/*	const char *name;
+/*	unsigned type;
+/*	unsigned rflags;
+/*	unsigned lflags;
+/*	void	(*callback)(int status, DNS_RR *list, int rcode,
+/*				const char *why, void *context);
+/*	void	*context;
+/*
+/*	void	dns_async_cancel(query)
+/*	DNS_ASYNC *query;
+/*
+/*	int	dns_async_pending()
+/*
+/*	int	dns_async_wait(timeout)
+/*	int	timeout;
+/*
+/*	void	dns_async_cache_flush()
+/* DESCRIPTION
+/*	This module sends DNS queries without waiting for the reply,
+/*	so that a process can have multiple lookups in flight at
+/*	the same time. Replies are decoded with the same validation
+/*	and reply filtering as dns_lookup(3).
+/*
+/*	dns_async_lookup() starts a lookup of the specified name
+/*	and resource record type. The name, type, rflags and lflags
+/*	arguments are as with dns_lookup_x(). The result is a handle
+/*	that remains valid until the callback function is invoked,
+/*	or until the request is cancelled. The callback is never
+/*	invoked from within dns_async_lookup(), even when the result
+/*	is already known.
+/*
+/*	The callback function receives the dns_lookup() status,
+/*	a list of resource records that the callback must pass to
+/*	dns_rr_free(), the reply RCODE, a reason for failure, and
+/*	the application context. The reason text is valid only
+/*	during the callback.
+/*
+/*	dns_async_cancel() cancels the specified lookup. The callback
+/*	will not be invoked.
+/*
+/*	dns_async_pending() returns the number of lookups whose
+/*	callback has not yet been invoked.
+/*
+/*	Lookups make progress in two ways. An event-driven program
+/*	needs to do nothing special: the resolver socket and
+/*	retransmission timer are registered with the events(3)
+/*	manager, and event_loop() invokes callbacks as replies
+/*	arrive. Other programs call dns_async_wait(), which waits
+/*	until all pending lookups have completed, or until the
+/*	timeout (in seconds) expires. A negative timeout means wait
+/*	indefinitely. dns_async_wait() does not call event_loop(),
+/*	so that a server does not accept new connections while it
+/*	waits. The result is the number of lookups that are still
+/*	pending.
+/*
+/*	Each process keeps a small LRU cache of recent lookup
+/*	results. A positive result is cached for the smallest TTL
+/*	of its resource records; a "not found" result is cached
+/*	for the negative TTL from the SOA record in the authority
+/*	section (RFC 2308). Other results are not cached. The TTL
+/*	of cached records is reduced by the time spent in the cache.
+/*	dns_async_cache_flush() empties the cache.
+/*
+/*	Queries are sent over UDP to the IPv4 name servers in the
+/*	resolver configuration, rotating to the next server after
+/*	each timeout. The timeout and number of attempts are taken
+/*	from the resolver configuration (see resolv.conf(5)).  The
+/*	search list and default domain are applied as with
+/*	res_search(3). A truncated reply is retried over TCP, also
+/*	without blocking.
+/*
+/*	Each query is sent from its own socket, so that it has its
+/*	own source port, and with a query ID from the kernel random
+/*	number generator. A reply is accepted only when it comes
+/*	from a configured name server, and when its ID and question
+/*	section match the query.
+/* BUGS
+/*	When no IPv4 name server is configured, all lookups are
+/*	done with the blocking dns_lookup(3) resolver.
+/* SEE ALSO
+/*	dns_lookup(3), blocking DNS lookup
+/*	events(3), event manager
+/* LICENSE
+/* .ad
+/* .fi
+/*	The Secure Mailer license must be distributed with this software.
+/* AUTHOR(S)
+/*	Wietse Venema
+/*	IBM T.J. Watson Research
+/*	P.O. Box 704
+/*	Yorktown Heights, NY 10598, USA
+/*
+/*	Wietse Venema
+/*	Google, Inc.
+/*	111 8th Avenue
+/*	New York, NY 10011, USA
+/*--*/
+
+/* System library. */
+
+#include <sys_defs.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <errno.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+
+#ifdef HAS_GETRANDOM
+#include <sys/random.h>
+#endif
+
+#if defined(USE_SYSV_POLL) || defined(USE_SYSV_POLL_THEN_SELECT)
+#include <poll.h>
+#define DNS_ASYNC_POLL
+#endif
+
+#ifdef USE_SYS_SELECT_H
+#include <sys/select.h>
+#endif
+
+/* Utility library. */
+
+#include <mymalloc.h>
+#include <msg.h>
+#include <vstring.h>
+#include <argv.h>
+#include <ring.h>
+#include <htable.h>
+#include <events.h>
+#include <iostuff.h>
+#include <myrand.h>
+#include <valid_hostname.h>
+#include <stringops.h>
+
+/* DNS library. */
+
+#define LIBDNS_INTERNAL
+#include "dns.h"
+
+/* Local stuff. */
+
+#define DNS_ASYNC_QUERY_SIZE	2048	/* XXX */
+#define DNS_ASYNC_REPLY_SIZE	4096	/* as advertised with EDNS0 */
+#define DNS_ASYNC_CNAME_MAX	10	/* as with dns_lookup() */
+#define DNS_ASYNC_CACHE_SIZE	100	/* cache entries */
+#define DNS_ASYNC_CACHE_TTL	3600	/* upper bound */
+
+#ifndef T_OPT
+#define T_OPT		41		/* [RFC6891] */
+#endif
+
+#ifdef MSG_NOSIGNAL
+#define DNS_ASYNC_SEND_FLAGS	MSG_NOSIGNAL
+#else
+#define DNS_ASYNC_SEND_FLAGS	0
+#endif
+
+ /*
+  * Transport state of a lookup in flight.
+  */
+#define DNS_ASYNC_UDP		0	/* waiting for UDP reply */
+#define DNS_ASYNC_TCP_SEND	1	/* connecting or sending over TCP */
+#define DNS_ASYNC_TCP_RECV	2	/* receiving over TCP */
+
+ /*
+  * One lookup in progress, or one completed lookup whose callback has not
+  * yet been invoked.
+  */
+struct DNS_ASYNC {
+    RING    ring;			/* in-flight or completed list */
+    char   *orig_name;			/* name as requested */
+    char   *name;			/* name being queried */
+    ARGV   *search;			/* search list candidates */
+    int     search_pos;			/* next search list candidate */
+    unsigned type;			/* T_A, T_MX, etc. */
+    unsigned rflags;			/* resolver flags */
+    unsigned lflags;			/* dns_lookup() flags */
+    int     maybe_secure;		/* CNAME chain still secure */
+    int     cname_count;		/* CNAME indirections */
+    unsigned short id;			/* query ID */
+    int     server;			/* current name server */
+    int     tries;			/* transmissions so far */
+    time_t  deadline;			/* retransmission time */
+    int     sock;			/* per-query socket */
+    int     state;			/* DNS_ASYNC_UDP etc. */
+    VSTRING *tcp_buf;			/* TCP query or reply */
+    size_t  tcp_pos;			/* TCP bytes sent or received */
+    unsigned char *query;		/* query packet */
+    int     query_len;			/* query packet length */
+    char   *cache_key;			/* cache lookup key */
+    int     status;			/* dns_lookup() status */
+    DNS_RR *rr;				/* lookup result */
+    int     rcode;			/* reply RCODE */
+    VSTRING *why;			/* reason for failure */
+    DNS_ASYNC_FN callback;		/* completion routine */
+    void   *context;			/* application context */
+};
+
+ /*
+  * One cached lookup result.
+  */
+typedef struct {
+    RING    ring;			/* LRU linkage */
+    char   *key;			/* cache lookup key */
+    time_t  stored;			/* time of reply */
+    time_t  expire;			/* end of lifetime */
+    int     status;			/* DNS_OK or DNS_NOTFOUND */
+    int     rcode;			/* reply RCODE */
+    char   *why;			/* reason for failure */
+    DNS_RR *rr;				/* records or SOA */
+} DNS_ASYNC_CACHE;
+
+static int dns_async_init_done;		/* resolver configuration read */
+static struct sockaddr_in *dns_async_servers;	/* IPv4 name servers */
+static int dns_async_server_count;	/* number of name servers */
+static int dns_async_timeout;		/* per-try timeout */
+static int dns_async_max_tries;		/* total transmissions */
+static int dns_async_rand_fd = -1;	/* random source */
+static RING dns_async_queries;		/* lookups in flight */
+static RING dns_async_done;		/* completed lookups */
+static HTABLE *dns_async_cache;		/* recent results */
+static RING dns_async_cache_lru;	/* most recently used first */
+
+#define USER_FLAGS (RES_DEBUG | RES_DNSRCH | RES_DEFNAMES | RES_USE_DNSSEC)
+#define CACHE_FLAGS (RES_DNSRCH | RES_DEFNAMES | RES_USE_DNSSEC)
+
+#define STR(x)		vstring_str(x)
+#define RING_TO_QUERY(r) RING_TO_APPL((r), DNS_ASYNC, ring)
+#define RING_TO_CACHE(r) RING_TO_APPL((r), DNS_ASYNC_CACHE, ring)
+#define RING_EMPTY(r)	(ring_succ(r) == (r))
+
+static void dns_async_event(int, void *);
+static void dns_async_timer(int, void *);
+
+/* dns_async_init - one-time initialization */
+
+static void dns_async_init(void)
+{
+    int     n;
+
+    dns_async_init_done = 1;
+    ring_init(&dns_async_queries);
+    ring_init(&dns_async_done);
+    ring_init(&dns_async_cache_lru);
+    dns_async_cache = htable_create(DNS_ASYNC_CACHE_SIZE);
+
+    /*
+     * Query IDs must not be predictable. Open the random device now, in
+     * case getrandom() is not available.
+     */
+#ifdef HAS_GETRANDOM
+    if (getrandom((void *) &n, sizeof(n), GRND_NONBLOCK) != sizeof(n))
+#endif
+	if ((dns_async_rand_fd = open("/dev/urandom", O_RDONLY, 0)) < 0)
+	    msg_warn("dns_async: open /dev/urandom: %m"
+		     " -- using pseudo-random query IDs");
+	else
+	    close_on_exec(dns_async_rand_fd, CLOSE_ON_EXEC);
+
+    /*
+     * Use the name servers that res_send() would use. Without a usable
+     * server, all lookups are done with the blocking resolver.
+     */
+    if ((_res.options & RES_INIT) == 0 && res_init() < 0) {
+	msg_warn("dns_async: name service initialization failure");
+	return;
+    }
+    dns_async_servers = (struct sockaddr_in *)
+	mymalloc(sizeof(*dns_async_servers) * (_res.nscount + 1));
+    for (n = 0; n < _res.nscount; n++)
+	if (_res.nsaddr_list[n].sin_family == AF_INET)
+	    dns_async_servers[dns_async_server_count++] = _res.nsaddr_list[n];
+    dns_async_timeout = _res.retrans > 0 ? _res.retrans : 1;
+    dns_async_max_tries = (_res.retry > 0 ? _res.retry : 1)
+	* (dns_async_server_count > 0 ? dns_async_server_count : 1);
+    if (msg_verbose)
+	msg_info("dns_async: %d IPv4 name server(s), timeout %ds, %d tries",
+		 dns_async_server_count, dns_async_timeout,
+		 dns_async_max_tries);
+}
+
+/* dns_async_rand16 - generate query ID */
+
+static unsigned dns_async_rand16(void)
+{
+    unsigned short id;
+
+#ifdef HAS_GETRANDOM
+    if (getrandom((void *) &id, sizeof(id), GRND_NONBLOCK) == sizeof(id))
+	return (id);
+#endif
+    if (dns_async_rand_fd >= 0
+	&& read(dns_async_rand_fd, (void *) &id, sizeof(id)) == sizeof(id))
+	return (id);
+    return (myrand() & 0xffff);
+}
+
+/* dns_async_sock_close - close per-query socket */
+
+static void dns_async_sock_close(DNS_ASYNC *q)
+{
+    if (q->sock >= 0) {
+	event_disable_readwrite(q->sock);
+	(void) close(q->sock);
+	q->sock = -1;
+    }
+}
+
+/* dns_async_sock_open - create per-query socket */
+
+static int dns_async_sock_open(DNS_ASYNC *q, int type)
+{
+    dns_async_sock_close(q);
+    if ((q->sock = socket(AF_INET, type, 0)) < 0) {
+	msg_warn("dns_async: socket: %m");
+	return (-1);
+    }
+    non_blocking(q->sock, NON_BLOCKING);
+    close_on_exec(q->sock, CLOSE_ON_EXEC);
+    return (0);
+}
+
+/* dns_async_update - update timer request */
+
+static void dns_async_update(void)
+{
+    RING   *entry;
+    time_t  earliest = 0;
+    time_t  now;
+    DNS_ASYNC *q;
+
+    /*
+     * Wake up for completed lookups, or for the earliest retransmission.
+     * Per-query sockets are registered when they are opened.
+     */
+    if (!RING_EMPTY(&dns_async_done)) {
+	event_request_timer(dns_async_timer, (void *) 0, 0);
+    } else if (!RING_EMPTY(&dns_async_queries)) {
+	RING_FOREACH(entry, &dns_async_queries) {
+	    q = RING_TO_QUERY(entry);
+	    if (earliest == 0 || q->deadline < earliest)
+		earliest = q->deadline;
+	}
+	now = time((time_t *) 0);
+	event_request_timer(dns_async_timer, (void *) 0,
+			    earliest > now ? (int) (earliest - now) : 0);
+    } else {
+	event_cancel_timer(dns_async_timer, (void *) 0);
+    }
+}
+
+/* dns_async_cache_free - destroy cache entry */
+
+static void dns_async_cache_free(void *ptr)
+{
+    DNS_ASYNC_CACHE *cp = (DNS_ASYNC_CACHE *) ptr;
+
+    ring_detach(&cp->ring);
+    if (cp->rr)
+	dns_rr_free(cp->rr);
+    if (cp->why)
+	myfree(cp->why);
+    myfree((void *) cp);
+}
+
+/* dns_async_cache_flush - empty the cache */
+
+void    dns_async_cache_flush(void)
+{
+    if (dns_async_cache) {
+	htable_free(dns_async_cache, dns_async_cache_free);
+	dns_async_cache = htable_create(DNS_ASYNC_CACHE_SIZE);
+    }
+}
+
+/* dns_async_cache_ttl - determine how long a result may be cached */
+
+static unsigned dns_async_cache_ttl(int status, DNS_RR *rr)
+{
+    unsigned ttl = DNS_ASYNC_CACHE_TTL;
+    UINT32_TYPE soa_buf[5];
+
+    /*
+     * Cache a positive result for the smallest record TTL. Cache a negative
+     * result for the smaller of the SOA record TTL and the SOA minimum
+     * field. Don't cache a negative result without SOA record.
+     */
+    if (rr == 0)
+	return (0);
+    for ( /* void */ ; rr; rr = rr->next) {
+	if (rr->ttl < ttl)
+	    ttl = rr->ttl;
+	if (status == DNS_NOTFOUND) {
+	    if (rr->type != T_SOA || rr->data_len != sizeof(soa_buf))
+		return (0);
+	    memcpy((void *) soa_buf, rr->data, sizeof(soa_buf));
+	    if (soa_buf[4] < ttl)
+		ttl = soa_buf[4];
+	}
+    }
+    return (ttl);
+}
+
+/* dns_async_cache_store - remember lookup result */
+
+static void dns_async_cache_store(DNS_ASYNC *q)
+{
+    DNS_ASYNC_CACHE *cp;
+    HTABLE_INFO *ht;
+    unsigned ttl;
+    DNS_RR *rr;
+
+    if (q->status != DNS_OK && q->status != DNS_NOTFOUND)
+	return;
+    if ((ttl = dns_async_cache_ttl(q->status, q->rr)) == 0)
+	return;
+    if ((ht = htable_locate(dns_async_cache, q->cache_key)) != 0)
+	htable_delete(dns_async_cache, q->cache_key, dns_async_cache_free);
+    else if (dns_async_cache->used >= DNS_ASYNC_CACHE_SIZE) {
+	cp = RING_TO_CACHE(ring_pred(&dns_async_cache_lru));
+	htable_delete(dns_async_cache, cp->key, dns_async_cache_free);
+    }
+    cp = (DNS_ASYNC_CACHE *) mymalloc(sizeof(*cp));
+    cp->stored = time((time_t *) 0);
+    cp->expire = cp->stored + ttl;
+    cp->status = q->status;
+    cp->rcode = q->rcode;
+    cp->why = VSTRING_LEN(q->why) ? mystrdup(STR(q->why)) : 0;
+    cp->rr = 0;
+    for (rr = q->rr; rr; rr = rr->next)
+	cp->rr = dns_rr_append(cp->rr, dns_rr_copy(rr));
+    cp->key = htable_enter(dns_async_cache, q->cache_key, (void *) cp)->key;
+    ring_append(&dns_async_cache_lru, &cp->ring);
+}
+
+/* dns_async_cache_find - look up cached result */
+
+static int dns_async_cache_find(DNS_ASYNC *q)
+{
+    DNS_ASYNC_CACHE *cp;
+    time_t  now;
+    DNS_RR *rr;
+    DNS_RR *copy;
+
+    if ((cp = (DNS_ASYNC_CACHE *) htable_find(dns_async_cache,
+					      q->cache_key)) == 0)
+	return (0);
+    now = time((time_t *) 0);
+    if (cp->expire <= now) {
+	htable_delete(dns_async_cache, q->cache_key, dns_async_cache_free);
+	return (0);
+    }
+    ring_detach(&cp->ring);
+    ring_append(&dns_async_cache_lru, &cp->ring);
+    q->status = cp->status;
+    q->rcode = cp->rcode;
+    vstring_strcpy(q->why, cp->why ? cp->why : "");
+    if (msg_verbose)
+	msg_info("dns_async: %s (%s): cached %s",
+		 q->orig_name, dns_strtype(q->type),
+		 q->status == DNS_OK ? "OK" : "NOTFOUND");
+
+    /*
+     * Return the SOA record of a negative result only if it was requested.
+     */
+    if (cp->status == DNS_OK || (q->lflags & DNS_REQ_FLAG_NCACHE_TTL)) {
+	for (rr = cp->rr; rr; rr = rr->next) {
+	    copy = dns_rr_copy(rr);
+	    copy->ttl -= (now - cp->stored);
+	    q->rr = dns_rr_append(q->rr, copy);
+	}
+    }
+    return (1);
+}
+
+/* dns_async_finish - move lookup to the completed list */
+
+static void dns_async_finish(DNS_ASYNC *q, int status, DNS_RR *rr, int rcode)
+{
+    q->status = status;
+    q->rr = rr;
+    q->rcode = rcode;
+    dns_async_sock_close(q);
+    dns_async_cache_store(q);
+
+    /*
+     * The negative TTL was requested for caching purposes. Don't return it
+     * to a caller who did not ask for it.
+     */
+    if (status != DNS_OK && (q->lflags & DNS_REQ_FLAG_NCACHE_TTL) == 0
+	&& q->rr != 0) {
+	dns_rr_free(q->rr);
+	q->rr = 0;
+    }
+    ring_detach(&q->ring);
+    ring_prepend(&dns_async_done, &q->ring);
+}
+
+/* dns_async_blocking - do the lookup with the blocking resolver */
+
+static void dns_async_blocking(DNS_ASYNC *q, unsigned rflags)
+{
+    DNS_RR *rr;
+    int     rcode = 0;
+    int     status;
+
+    status = dns_lookup_x(q->name, q->type, rflags, &rr, (VSTRING *) 0,
+			  q->why, &rcode,
+			  q->lflags | DNS_REQ_FLAG_NCACHE_TTL);
+    dns_async_finish(q, status, rr, rcode);
+}
+
+/* dns_async_send - (re)transmit query */
+
+static void dns_async_send(DNS_ASYNC *q)
+{
+    struct sockaddr_in *sin = dns_async_servers + q->server;
+
+    if (msg_verbose)
+	msg_info("dns_async: send %s (%s) id %u to %s over %s try %d",
+		 q->name, dns_strtype(q->type), q->id,
+		 inet_ntoa(sin->sin_addr),
+		 q->state == DNS_ASYNC_UDP ? "UDP" : "TCP", q->tries + 1);
+    q->deadline = time((time_t *) 0) + dns_async_timeout;
+
+    /*
+     * A UDP retransmission reuses the query socket, so that a late reply
+     * to an earlier transmission is still accepted.
+     */
+    if (q->state == DNS_ASYNC_UDP) {
+	if (sendto(q->sock, (void *) q->query, q->query_len, 0,
+		   (struct sockaddr *) sin, sizeof(*sin)) < 0 && msg_verbose)
+	    msg_info("dns_async: sendto %s: %m", inet_ntoa(sin->sin_addr));
+	return;
+    }
+
+    /*
+     * Each TCP try uses a new connection. The query is sent when the
+     * connection completes. Errors are handled as a timeout.
+     */
+    q->state = DNS_ASYNC_TCP_SEND;
+    if (dns_async_sock_open(q, SOCK_STREAM) < 0) {
+	q->deadline = time((time_t *) 0);
+	return;
+    }
+    if (connect(q->sock, (struct sockaddr *) sin, sizeof(*sin)) < 0
+	&& errno != EINPROGRESS) {
+	if (msg_verbose)
+	    msg_info("dns_async: connect %s: %m", inet_ntoa(sin->sin_addr));
+	dns_async_sock_close(q);
+	q->deadline = time((time_t *) 0);
+	return;
+    }
+    if (q->tcp_buf == 0)
+	q->tcp_buf = vstring_alloc(DNS_ASYNC_REPLY_SIZE);
+    VSTRING_RESET(q->tcp_buf);
+    VSTRING_ADDCH(q->tcp_buf, q->query_len >> 8);
+    VSTRING_ADDCH(q->tcp_buf, q->query_len & 0xff);
+    vstring_memcat(q->tcp_buf, (char *) q->query, q->query_len);
+    q->tcp_pos = 0;
+    event_enable_write(q->sock, dns_async_event, (void *) q);
+}
+
+/* dns_async_tcp_fail - give up on this TCP try */
+
+static void dns_async_tcp_fail(DNS_ASYNC *q, const char *what)
+{
+    if (msg_verbose)
+	msg_info("dns_async: %s (%s): TCP %s error: %m",
+		 q->name, dns_strtype(q->type), what);
+    dns_async_sock_close(q);
+    q->state = DNS_ASYNC_TCP_SEND;
+    q->deadline = time((time_t *) 0);
+}
+
+/* dns_async_query - build and send query for the current name */
+
+static void dns_async_query(DNS_ASYNC *q)
+{
+    HEADER *header;
+    unsigned id;
+
+#define NO_MKQUERY_DATA_BUF     ((unsigned char *) 0)
+#define NO_MKQUERY_DATA_LEN     ((int) 0)
+#define NO_MKQUERY_NEWRR        ((unsigned char *) 0)
+
+    if (q->query == 0)
+	q->query = (unsigned char *) mymalloc(DNS_ASYNC_QUERY_SIZE);
+    if ((q->query_len = res_mkquery(QUERY, q->name, C_IN, q->type,
+				    NO_MKQUERY_DATA_BUF, NO_MKQUERY_DATA_LEN,
+				    NO_MKQUERY_NEWRR, q->query,
+				    DNS_ASYNC_QUERY_SIZE - RRFIXEDSZ - 1)) < 0) {
+	SET_H_ERRNO(NO_RECOVERY);
+	vstring_sprintf(q->why, "Host or domain name not found. "
+			"Name service error for name=%s type=%s: %s",
+			q->name, dns_strtype(q->type),
+			dns_strerror(NO_RECOVERY));
+	dns_async_finish(q, DNS_FAIL, (DNS_RR *) 0, 0);
+	return;
+    }
+    header = (HEADER *) q->query;
+
+    /*
+     * Request DNSSEC validation with an EDNS0 OPT record that has the DO
+     * bit set, as res_query() does with RES_USE_DNSSEC.
+     */
+#if RES_USE_DNSSEC != 0
+    if (q->rflags & RES_USE_DNSSEC) {
+	unsigned char *cp = q->query + q->query_len;
+
+	*cp++ = 0;				/* root domain */
+	*cp++ = T_OPT >> 8;
+	*cp++ = T_OPT & 0xff;
+	*cp++ = DNS_ASYNC_REPLY_SIZE >> 8;	/* UDP payload size */
+	*cp++ = DNS_ASYNC_REPLY_SIZE & 0xff;
+	*cp++ = 0;				/* extended RCODE */
+	*cp++ = 0;				/* version */
+	*cp++ = 0x80;				/* DO bit */
+	*cp++ = 0;
+	*cp++ = 0;				/* RDLEN */
+	*cp++ = 0;
+	q->query_len = cp - q->query;
+	header->arcount = htons(ntohs(header->arcount) + 1);
+    }
+#endif
+
+    /*
+     * Each query gets a new socket, and therefore a new source port, and an
+     * unpredictable ID.
+     */
+    if (dns_async_sock_open(q, SOCK_DGRAM) < 0) {
+	SET_H_ERRNO(TRY_AGAIN);
+	vstring_sprintf(q->why, "Host or domain name not found. "
+			"Name service error for name=%s type=%s: %s",
+			q->name, dns_strtype(q->type),
+			dns_strerror(TRY_AGAIN));
+	dns_async_finish(q, DNS_RETRY, (DNS_RR *) 0, SERVFAIL);
+	return;
+    }
+    event_enable_read(q->sock, dns_async_event, (void *) q);
+    id = dns_async_rand16();
+    header->id = htons(id);
+    q->id = id;
+    q->state = DNS_ASYNC_UDP;
+    q->tries = 0;
+    dns_async_send(q);
+}
+
+/* dns_async_search - generate the res_search() name candidates */
+
+static ARGV *dns_async_search(const char *name, unsigned rflags)
+{
+    ARGV   *argv = argv_alloc(2);
+    VSTRING *buf;
+    const char *cp;
+    char  **dp;
+    int     dots = 0;
+    int     tried_as_is = 0;
+
+    for (cp = name; *cp; cp++)
+	if (*cp == '.')
+	    dots++;
+    if (cp > name && cp[-1] == '.') {
+	argv_add(argv, name, (char *) 0);
+	argv_terminate(argv);
+	return (argv);
+    }
+    if (dots >= _res.ndots) {
+	argv_add(argv, name, (char *) 0);
+	tried_as_is = 1;
+    }
+    if ((dots == 0 && (rflags & RES_DEFNAMES))
+	|| (dots != 0 && (rflags & RES_DNSRCH))) {
+	buf = vstring_alloc(100);
+	for (dp = _res.dnsrch; *dp; dp++) {
+	    vstring_sprintf(buf, "%s.%s", name, *dp);
+	    argv_add(argv, STR(buf), (char *) 0);
+	}
+	vstring_free(buf);
+    }
+    if (tried_as_is == 0)
+	argv_add(argv, name, (char *) 0);
+    argv_terminate(argv);
+    return (argv);
+}
+
+/* dns_async_set_name - start querying the specified name */
+
+static void dns_async_set_name(DNS_ASYNC *q, const char *name)
+{
+    if (q->name)
+	myfree(q->name);
+    q->name = mystrdup(name);
+    dns_async_query(q);
+}
+
+/* dns_async_reply - process reply for lookup */
+
+static void dns_async_reply(DNS_ASYNC *q, unsigned char *buf, size_t len)
+{
+    char    cname[DNS_NAME_LEN];
+    DNS_RR *rr;
+    int     rcode;
+    int     status;
+
+    /*
+     * Retry a truncated UDP reply over TCP, starting with the same server.
+     */
+    if (((HEADER *) buf)->tc && q->state == DNS_ASYNC_UDP) {
+	if (msg_verbose)
+	    msg_info("dns_async: %s (%s): truncated reply",
+		     q->name, dns_strtype(q->type));
+	q->state = DNS_ASYNC_TCP_SEND;
+	q->tries = 0;
+	dns_async_send(q);
+	return;
+    }
+    dns_async_sock_close(q);
+    status = dns_lookup_reply(q->orig_name, q->name, q->type, q->rflags,
+			      buf, len, &rr, (VSTRING *) 0, q->why, &rcode,
+			      q->lflags | DNS_REQ_FLAG_NCACHE_TTL,
+			      cname, sizeof(cname), &q->maybe_secure);
+    switch (status) {
+    case DNS_RECURSE:
+	if (msg_verbose)
+	    msg_info("dns_async: %s aliased to %s", q->name, cname);
+	if (++q->cname_count >= DNS_ASYNC_CNAME_MAX) {
+	    vstring_sprintf(q->why, "Name server loop for %s", q->name);
+	    msg_warn("dns_async: Name server loop for %s", q->name);
+	    dns_async_finish(q, DNS_NOTFOUND, (DNS_RR *) 0, rcode);
+	    return;
+	}
+#if RES_USE_DNSSEC
+
+	/*
+	 * Once an intermediate CNAME reply is not validated, all consequent
+	 * RRs are deemed not validated, so we don't ask for further DNSSEC
+	 * replies.
+	 */
+	if (q->maybe_secure == 0)
+	    q->rflags &= ~RES_USE_DNSSEC;
+#endif
+	q->search_pos = q->search->argc;
+	dns_async_set_name(q, cname);
+	return;
+    case DNS_NOTFOUND:
+	if (q->search_pos < q->search->argc) {
+	    if (rr)
+		dns_rr_free(rr);
+	    dns_async_set_name(q, q->search->argv[q->search_pos++]);
+	    return;
+	}
+	/* FALLTHROUGH */
+    default:
+	dns_async_finish(q, status, rr, rcode);
+	return;
+    }
+}
+
+/* dns_async_same_name - compare reply question with query name */
+
+static int dns_async_same_name(const char *reply_name, const char *name)
+{
+    size_t  len = strlen(name);
+
+    if (len > 1 && name[len - 1] == '.')
+	len -= 1;
+    return (strncasecmp(reply_name, name, len) == 0 && reply_name[len] == 0);
+}
+
+/* dns_async_match - match reply with query */
+
+static int dns_async_match(DNS_ASYNC *q, unsigned char *buf, size_t len)
+{
+    char    qname[DNS_NAME_LEN];
+    unsigned char *pos;
+    unsigned qtype;
+    unsigned qclass;
+    int     n;
+
+    if (len < HFIXEDSZ || ((HEADER *) buf)->qr == 0
+	|| ntohs(((HEADER *) buf)->qdcount) != 1
+	|| ntohs(((HEADER *) buf)->id) != q->id)
+	return (0);
+    pos = buf + HFIXEDSZ;
+    if ((n = dn_expand(buf, buf + len, pos, qname, sizeof(qname))) < 0
+	|| pos + n + QFIXEDSZ > buf + len)
+	return (0);
+    pos += n;
+    GETSHORT(qtype, pos);
+    GETSHORT(qclass, pos);
+    if (qtype != q->type || qclass != C_IN
+	|| !dns_async_same_name(qname, q->name)) {
+	if (msg_verbose)
+	    msg_info("dns_async: reply for %s (%s) does not match query"
+		     " for %s (%s)", qname, dns_strtype(qtype),
+		     q->name, dns_strtype(q->type));
+	return (0);
+    }
+    return (1);
+}
+
+/* dns_async_udp_receive - read UDP reply */
+
+static void dns_async_udp_receive(DNS_ASYNC *q)
+{
+    static unsigned char *buf;
+    struct sockaddr_in sin;
+    SOCKADDR_SIZE sin_len;
+    ssize_t len;
+    int     n;
+
+    if (buf == 0)
+	buf = (unsigned char *) mymalloc(DNS_ASYNC_REPLY_SIZE);
+
+    for (;;) {
+	sin_len = sizeof(sin);
+	if ((len = recvfrom(q->sock, (void *) buf, DNS_ASYNC_REPLY_SIZE,
+			    0, (struct sockaddr *) &sin, &sin_len)) < 0) {
+	    if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR
+		&& msg_verbose)
+		msg_info("dns_async: recvfrom: %m");
+	    return;
+	}
+
+	/*
+	 * Ignore replies that don't match this query: the source must be a
+	 * configured name server, and the ID and question must match.
+	 */
+	if (sin_len < sizeof(sin) || sin.sin_family != AF_INET)
+	    continue;
+	for (n = 0; n < dns_async_server_count; n++)
+	    if (dns_async_servers[n].sin_addr.s_addr == sin.sin_addr.s_addr
+		&& dns_async_servers[n].sin_port == sin.sin_port)
+		break;
+	if (n >= dns_async_server_count || !dns_async_match(q, buf, len))
+	    continue;
+	dns_async_reply(q, buf, len);
+	return;
+    }
+}
+
+/* dns_async_tcp_send - send query over TCP */
+
+static void dns_async_tcp_send(DNS_ASYNC *q)
+{
+    ssize_t len;
+
+    if ((len = send(q->sock, STR(q->tcp_buf) + q->tcp_pos,
+		    VSTRING_LEN(q->tcp_buf) - q->tcp_pos,
+		    DNS_ASYNC_SEND_FLAGS)) < 0) {
+	if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+	    dns_async_tcp_fail(q, "write");
+	return;
+    }
+    q->deadline = time((time_t *) 0) + dns_async_timeout;
+    if ((q->tcp_pos += len) < VSTRING_LEN(q->tcp_buf))
+	return;
+    event_disable_readwrite(q->sock);
+    event_enable_read(q->sock, dns_async_event, (void *) q);
+    q->state = DNS_ASYNC_TCP_RECV;
+    q->tcp_pos = 0;
+    VSTRING_RESET(q->tcp_buf);
+    VSTRING_SPACE(q->tcp_buf, 2);
+}
+
+/* dns_async_tcp_receive - read reply over TCP */
+
+static void dns_async_tcp_receive(DNS_ASYNC *q)
+{
+    unsigned char *buf = (unsigned char *) STR(q->tcp_buf);
+    size_t  want;
+    ssize_t len;
+
+    /*
+     * The reply is preceded by a two-byte length.
+     */
+    want = (q->tcp_pos < 2 ? 2 : 2 + (buf[0] << 8 | buf[1]));
+    if ((len = read(q->sock, buf + q->tcp_pos, want - q->tcp_pos)) <= 0) {
+	if (len == 0 || (errno != EAGAIN && errno != EWOULDBLOCK
+			 && errno != EINTR))
+	    dns_async_tcp_fail(q, "read");
+	return;
+    }
+    q->deadline = time((time_t *) 0) + dns_async_timeout;
+    if ((q->tcp_pos += len) < want)
+	return;
+    if (want == 2) {
+	if ((want = buf[0] << 8 | buf[1]) < HFIXEDSZ) {
+	    errno = EMSGSIZE;
+	    dns_async_tcp_fail(q, "read");
+	} else
+	    VSTRING_SPACE(q->tcp_buf, 2 + want);
+	return;
+    }
+    if (!dns_async_match(q, buf + 2, want - 2)) {
+	errno = EBADMSG;
+	dns_async_tcp_fail(q, "read");
+	return;
+    }
+    dns_async_reply(q, buf + 2, want - 2);
+}
+
+/* dns_async_io - handle I/O for lookup */
+
+static void dns_async_io(DNS_ASYNC *q)
+{
+    switch (q->state) {
+    case DNS_ASYNC_UDP:
+	dns_async_udp_receive(q);
+	break;
+    case DNS_ASYNC_TCP_SEND:
+	dns_async_tcp_send(q);
+	break;
+    case DNS_ASYNC_TCP_RECV:
+	dns_async_tcp_receive(q);
+	break;
+    default:
+	msg_panic("dns_async_io: bad state: %d", q->state);
+    }
+}
+
+/* dns_async_expire - retransmit or give up */
+
+static void dns_async_expire(void)
+{
+    RING   *entry;
+    RING   *next;
+    DNS_ASYNC *q;
+    time_t  now = time((time_t *) 0);
+
+    for (entry = ring_succ(&dns_async_queries);
+	 entry != &dns_async_queries; entry = next) {
+	next = ring_succ(entry);
+	q = RING_TO_QUERY(entry);
+	if (q->deadline > now)
+	    continue;
+	if (++q->tries >= dns_async_max_tries) {
+	    SET_H_ERRNO(TRY_AGAIN);
+	    vstring_sprintf(q->why, "Host or domain name not found. "
+			    "Name service error for name=%s type=%s: %s",
+			    q->name, dns_strtype(q->type),
+			    dns_strerror(TRY_AGAIN));
+	    if (msg_verbose)
+		msg_info("dns_async: %s (%s): timeout",
+			 q->name, dns_strtype(q->type));
+	    dns_async_finish(q, DNS_RETRY, (DNS_RR *) 0, SERVFAIL);
+	} else {
+	    q->server = (q->server + 1) % dns_async_server_count;
+	    dns_async_send(q);
+	}
+    }
+}
+
+/* dns_async_free - destroy lookup */
+
+static void dns_async_free(DNS_ASYNC *q)
+{
+    myfree(q->orig_name);
+    if (q->name)
+	myfree(q->name);
+    argv_free(q->search);
+    if (q->query)
+	myfree((void *) q->query);
+    myfree(q->cache_key);
+    dns_async_sock_close(q);
+    if (q->tcp_buf)
+	vstring_free(q->tcp_buf);
+    if (q->rr)
+	dns_rr_free(q->rr);
+    vstring_free(q->why);
+    myfree((void *) q);
+}
+
+/* dns_async_deliver - invoke callbacks for completed lookups */
+
+static void dns_async_deliver(void)
+{
+    DNS_ASYNC *q;
+    DNS_RR *rr;
+
+    while (!RING_EMPTY(&dns_async_done)) {
+	q = RING_TO_QUERY(ring_succ(&dns_async_done));
+	ring_detach(&q->ring);
+	rr = q->rr;
+	q->rr = 0;
+	q->callback(q->status, rr, q->rcode, STR(q->why), q->context);
+	dns_async_free(q);
+    }
+}
+
+/* dns_async_event - I/O on per-query socket */
+
+static void dns_async_event(int unused_event, void *context)
+{
+    dns_async_io((DNS_ASYNC *) context);
+    dns_async_deliver();
+    dns_async_update();
+}
+
+/* dns_async_timer - retransmission timer or deferred completion */
+
+static void dns_async_timer(int unused_event, void *unused_context)
+{
+    dns_async_expire();
+    dns_async_deliver();
+    dns_async_update();
+}
+
+/* dns_async_lookup - start non-blocking lookup */
+
+DNS_ASYNC *dns_async_lookup(const char *name, unsigned type, unsigned rflags,
+			            unsigned lflags, DNS_ASYNC_FN callback,
+			            void *context)
+{
+    DNS_ASYNC *q;
+    char   *lc_name;
+
+    if ((rflags & USER_FLAGS) != rflags)
+	msg_panic("dns_async_lookup: bad flags: %d", rflags);
+    if (dns_async_init_done == 0)
+	dns_async_init();
+
+    q = (DNS_ASYNC *) mymalloc(sizeof(*q));
+    q->orig_name = mystrdup(name);
+    q->name = 0;
+    q->search = 0;
+    q->search_pos = 0;
+    q->type = type;
+    q->rflags = rflags;
+    q->lflags = lflags;
+    q->maybe_secure = 1;
+    q->cname_count = 0;
+    q->id = 0;
+    q->server = 0;
+    q->tries = 0;
+    q->deadline = 0;
+    q->sock = -1;
+    q->state = DNS_ASYNC_UDP;
+    q->tcp_buf = 0;
+    q->tcp_pos = 0;
+    q->query = 0;
+    q->query_len = 0;
+    lc_name = lowercase(mystrdup(name));
+    q->cache_key = concatenate(dns_strtype(type), ":",
+			       dns_str_resflags(rflags & CACHE_FLAGS), ":",
+			       lc_name, (char *) 0);
+    myfree(lc_name);
+    q->status = DNS_NOTFOUND;
+    q->rr = 0;
+    q->rcode = NOERROR;
+    q->why = vstring_alloc(10);
+    q->callback = callback;
+    q->context = context;
+    ring_init(&q->ring);
+    ring_prepend(&dns_async_queries, &q->ring);
+
+    /*
+     * Reject names that dns_lookup() would reject.
+     */
+    if (valid_hostaddr(name, DONT_GRIPE) || !valid_hostname(name, DONT_GRIPE)) {
+	vstring_sprintf(q->why,
+			"Name service error for %s: invalid host or domain name",
+			name);
+	q->search = argv_alloc(1);
+	dns_async_finish(q, DNS_NOTFOUND, (DNS_RR *) 0, NXDOMAIN);
+    }
+
+    /*
+     * Reuse a recent result.
+     */
+    else if (dns_async_cache_find(q)) {
+	q->search = argv_alloc(1);
+	ring_detach(&q->ring);
+	ring_prepend(&dns_async_done, &q->ring);
+    }
+
+    /*
+     * Without a usable name server, use the blocking resolver.
+     */
+    else if (dns_async_server_count == 0) {
+	q->search = argv_alloc(1);
+	q->name = mystrdup(name);
+	dns_async_blocking(q, rflags);
+    }
+
+    /*
+     * Send the first query.
+     */
+    else {
+	q->search = dns_async_search(name, rflags);
+	q->search_pos = 1;
+	dns_async_set_name(q, q->search->argv[0]);
+    }
+    dns_async_update();
+    return (q);
+}
+
+/* dns_async_cancel - cancel lookup */
+
+void    dns_async_cancel(DNS_ASYNC *q)
+{
+    ring_detach(&q->ring);
+    dns_async_free(q);
+    dns_async_update();
+}
+
+/* dns_async_pending - count lookups that have not completed */
+
+int     dns_async_pending(void)
+{
+    RING   *entry;
+    int     count = 0;
+
+    if (dns_async_init_done == 0)
+	return (0);
+    RING_FOREACH(entry, &dns_async_queries)
+	count++;
+    RING_FOREACH(entry, &dns_async_done)
+	count++;
+    return (count);
+}
+
+/* dns_async_poll - wait for I/O on per-query sockets */
+
+static void dns_async_poll(int delay)
+{
+    RING   *entry;
+    DNS_ASYNC *q;
+    DNS_ASYNC **qv;
+    int     count = 0;
+    int     n = 0;
+    int     i;
+
+#ifdef DNS_ASYNC_POLL
+    struct pollfd *pfd;
+
+#else
+    fd_set  rmask;
+    fd_set  wmask;
+    struct timeval tv;
+    int     maxfd = -1;
+
+#endif
+
+    RING_FOREACH(entry, &dns_async_queries)
+	count++;
+    qv = (DNS_ASYNC **) mymalloc(sizeof(*qv) * (count + 1));
+
+    /*
+     * A lookup without socket is waiting for its TCP retry time.
+     */
+#ifdef DNS_ASYNC_POLL
+    pfd = (struct pollfd *) mymalloc(sizeof(*pfd) * (count + 1));
+    RING_FOREACH(entry, &dns_async_queries) {
+	q = RING_TO_QUERY(entry);
+	if (q->sock < 0)
+	    continue;
+	qv[n] = q;
+	pfd[n].fd = q->sock;
+	pfd[n].events = (q->state == DNS_ASYNC_TCP_SEND ? POLLOUT : POLLIN);
+	pfd[n].revents = 0;
+	n++;
+    }
+    if (poll(pfd, n, delay * 1000) > 0)
+	for (i = 0; i < n; i++)
+	    if (pfd[i].revents != 0 && qv[i]->sock == pfd[i].fd)
+		dns_async_io(qv[i]);
+    myfree((void *) pfd);
+#else
+    FD_ZERO(&rmask);
+    FD_ZERO(&wmask);
+    RING_FOREACH(entry, &dns_async_queries) {
+	q = RING_TO_QUERY(entry);
+	if (q->sock < 0)
+	    continue;
+	if (q->sock >= FD_SETSIZE)
+	    msg_panic("dns_async_poll: descriptor %d does not fit "
+		      "FD_SETSIZE %d", q->sock, FD_SETSIZE);
+	qv[n++] = q;
+	FD_SET(q->sock, q->state == DNS_ASYNC_TCP_SEND ? &wmask : &rmask);
+	if (q->sock > maxfd)
+	    maxfd = q->sock;
+    }
+    tv.tv_sec = delay;
+    tv.tv_usec = 0;
+    if (select(maxfd + 1, &rmask, &wmask, (fd_set *) 0, &tv) > 0)
+	for (i = 0; i < n; i++)
+	    if (qv[i]->sock >= 0
+		&& (FD_ISSET(qv[i]->sock, &rmask)
+		    || FD_ISSET(qv[i]->sock, &wmask)))
+		dns_async_io(qv[i]);
+#endif
+    myfree((void *) qv);
+}
+
+/* dns_async_wait - wait for lookups without running the event loop */
+
+int     dns_async_wait(int timeout)
+{
+    time_t  limit = (timeout >= 0 ? time((time_t *) 0) + timeout : 0);
+    time_t  earliest;
+    time_t  now;
+    RING   *entry;
+    DNS_ASYNC *q;
+    int     delay;
+
+    if (dns_async_init_done == 0)
+	return (0);
+    for (;;) {
+	dns_async_deliver();
+	if (RING_EMPTY(&dns_async_queries))
+	    break;
+	now = time((time_t *) 0);
+	if (timeout >= 0 && now >= limit)
+	    break;
+	earliest = 0;
+	RING_FOREACH(entry, &dns_async_queries) {
+	    q = RING_TO_QUERY(entry);
+	    if (earliest == 0 || q->deadline < earliest)
+		earliest = q->deadline;
+	}
+	if (timeout >= 0 && limit < earliest)
+	    earliest = limit;
+	delay = (earliest > now ? earliest - now : 0);
+	dns_async_poll(delay);
+	dns_async_expire();
+    }
+    dns_async_update();
+    return (dns_async_pending());
+}
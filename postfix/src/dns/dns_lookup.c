@@ -74,6 +74,27 @@
 /*	VSTRING *why;
 /*	int	*rcode;
 /*	unsigned lflags;
+/* LIBRARY-INTERNAL FUNCTIONS
+/*	#define LIBDNS_INTERNAL
+/*	#include <dns.h>
+/*
+/*	int	dns_lookup_reply(orig_name, name, type, rflags, buf, len,
+/*				list, fqdn, why, rcode, lflags, cname,
+/*				c_len, maybe_secure)
+/*	const char *orig_name;
+/*	const char *name;
+/*	unsigned type;
+/*	unsigned rflags;
+/*	unsigned char *buf;
+/*	size_t	len;
+/*	DNS_RR	**list;
+/*	VSTRING *fqdn;
+/*	VSTRING *why;
+/*	int	*rcode;
+/*	unsigned lflags;
+/*	char	*cname;
+/*	int	c_len;
+/*	int	*maybe_secure;
 /* DESCRIPTION
 /*	dns_lookup() looks up DNS resource records. When requested to
 /*	look up data other than type CNAME, it will follow a limited
@@ -94,6 +115,15 @@
 /*	DNS_REQ_FLAG_NCACHE_TTL feature. The workaround does not
 /*	support EDNS0 or DNSSEC, but it should be sufficient for
 /*	DNSBL/DNSWL lookups.
+/*
+/*	dns_lookup_reply() decodes a name server reply for \fIname\fR
+/*	that was obtained by other means, such as the dns_async(3)
+/*	resolver, with the same validation and reply filtering as
+/*	dns_lookup(). The result is DNS_RECURSE when the reply
+/*	contains only a CNAME for the requested type; the alias is
+/*	then stored in \fIcname\fR. The \fImaybe_secure\fR argument
+/*	must be initialized to 1 before the first query in a CNAME
+/*	chain.
 /* INPUTS
 /* .ad
 /* .fi
@@ -203,6 +233,7 @@
 /*	their own DNS client software.
 /* SEE ALSO
 /*	dns_rr(3) resource record memory and list management
+/*	dns_async(3) non-blocking DNS lookup
 /* LICENSE
 /* .ad
 /* .fi
@@ -414,6 +445,32 @@ static int dns_res_search(const char *name, int class, int type,
     return (len);
 }
 
+/* dns_reply_init - pre-parse name server reply header */
+
+static void dns_reply_init(DNS_REPLY *reply, unsigned flags, int len)
+{
+    HEADER *reply_header = (HEADER *) reply->buf;
+
+    /*
+     * Initialize the reply structure. Some structure members are filled on
+     * the fly while the reply is being parsed.  Coerce AD bit to boolean.
+     */
+#if RES_USE_DNSSEC != 0
+    reply->dnssec_ad = (flags & RES_USE_DNSSEC) ? !!reply_header->ad : 0;
+#else
+    reply->dnssec_ad = 0;
+#endif
+    SET_HAVE_DNS_REPLY_PACKET(reply, len);
+    reply->query_start = reply->buf + sizeof(HEADER);
+    reply->answer_start = 0;
+    reply->query_count = ntohs(reply_header->qdcount);
+    reply->answer_count = ntohs(reply_header->ancount);
+    reply->auth_count = ntohs(reply_header->nscount);
+    if (msg_verbose > 1)
+	msg_info("dns_query: reply len=%d ancount=%d nscount=%d",
+		 len, reply->answer_count, reply->auth_count);
+}
+
 /* dns_query - query name server and pre-parse the reply */
 
 static int dns_query(const char *name, int type, unsigned flags,
@@ -534,23 +591,9 @@ static int dns_query(const char *name, int type, unsigned flags,
     }
 
     /*
-     * Initialize the reply structure. Some structure members are filled on
-     * the fly while the reply is being parsed.  Coerce AD bit to boolean.
+     * Initialize the reply structure.
      */
-#if RES_USE_DNSSEC != 0
-    reply->dnssec_ad = (flags & RES_USE_DNSSEC) ? !!reply_header->ad : 0;
-#else
-    reply->dnssec_ad = 0;
-#endif
-    SET_HAVE_DNS_REPLY_PACKET(reply, len);
-    reply->query_start = reply->buf + sizeof(HEADER);
-    reply->answer_start = 0;
-    reply->query_count = ntohs(reply_header->qdcount);
-    reply->answer_count = ntohs(reply_header->ancount);
-    reply->auth_count = ntohs(reply_header->nscount);
-    if (msg_verbose > 1)
-	msg_info("dns_query: reply len=%d ancount=%d nscount=%d",
-		 len, reply->answer_count, reply->auth_count);
+    dns_reply_init(reply, flags, len);
 
     /*
      * Future proofing. If this reaches the panic call, then some code change
@@ -909,6 +952,75 @@ static int dns_get_answer(const char *orig_name, DNS_REPLY *reply, int type,
     return (not_found_status);
 }
 
+/* dns_get_reply - extract the answer from a pre-parsed reply */
+
+static int dns_get_reply(const char *orig_name, const char *name,
+			         unsigned type, int status, DNS_REPLY *reply,
+			         DNS_RR **rrlist, VSTRING *fqdn, VSTRING *why,
+			         char *cname, int c_len, int *maybe_secure)
+{
+    if (status != DNS_OK) {
+
+	/*
+	 * If the record does not exist, and we have a copy of the server
+	 * response, try to extract the negative caching TTL for the SOA
+	 * record in the authority section. DO NOT return an error if an SOA
+	 * record is malformed.
+	 */
+	if (status == DNS_NOTFOUND && TEST_HAVE_DNS_REPLY_PACKET(reply)
+	    && reply->auth_count > 0) {
+	    reply->answer_count = reply->auth_count;	/* XXX TODO: Fix API */
+	    (void) dns_get_answer(orig_name, reply, T_SOA, rrlist, fqdn,
+				  cname, c_len, maybe_secure);
+	}
+	return (status);
+    }
+
+    /*
+     * Extract resource records of the requested type. Pick up CNAME
+     * information just in case the requested data is not found.
+     */
+    status = dns_get_answer(orig_name, reply, type, rrlist, fqdn,
+			    cname, c_len, maybe_secure);
+    switch (status) {
+    default:
+	if (why)
+	    vstring_sprintf(why, "Name service error for name=%s type=%s: "
+			    "Malformed or unexpected name server reply",
+			    name, dns_strtype(type));
+	return (status);
+    case DNS_NULLMX:
+	if (why)
+	    vstring_sprintf(why, "Domain %s does not accept mail (nullMX)",
+			    name);
+	SET_H_ERRNO(NO_DATA);
+	return (status);
+    case DNS_OK:
+	if (rrlist && dns_rr_filter_maps) {
+	    if (dns_rr_filter_execute(rrlist) < 0) {
+		if (why)
+		    vstring_sprintf(why,
+				    "Error looking up name=%s type=%s: "
+				    "Invalid DNS reply filter syntax",
+				    name, dns_strtype(type));
+		dns_rr_free(*rrlist);
+		*rrlist = 0;
+		status = DNS_RETRY;
+	    } else if (*rrlist == 0) {
+		if (why)
+		    vstring_sprintf(why,
+				    "Error looking up name=%s type=%s: "
+				    "DNS reply filter drops all results",
+				    name, dns_strtype(type));
+		status = DNS_POLICY;
+	    }
+	}
+	return (status);
+    case DNS_RECURSE:
+	return (status);
+    }
+}
+
 /* dns_lookup_x - DNS lookup user interface */
 
 int     dns_lookup_x(const char *name, unsigned type, unsigned flags,
@@ -970,62 +1082,15 @@ int     dns_lookup_x(const char *name, unsigned type, unsigned flags,
 	status = dns_query(name, type, flags, &reply, why, lflags);
 	if (rcode)
 	    *rcode = reply.rcode;
-	if (status != DNS_OK) {
-
-	    /*
-	     * If the record does not exist, and we have a copy of the server
-	     * response, try to extract the negative caching TTL for the SOA
-	     * record in the authority section. DO NOT return an error if an
-	     * SOA record is malformed.
-	     */
-	    if (status == DNS_NOTFOUND && TEST_HAVE_DNS_REPLY_PACKET(&reply)
-		&& reply.auth_count > 0) {
-		reply.answer_count = reply.auth_count;	/* XXX TODO: Fix API */
-		(void) dns_get_answer(orig_name, &reply, T_SOA, rrlist, fqdn,
-				      cname, c_len, &maybe_secure);
-	    }
-	    return (status);
-	}
 
 	/*
 	 * Extract resource records of the requested type. Pick up CNAME
 	 * information just in case the requested data is not found.
 	 */
-	status = dns_get_answer(orig_name, &reply, type, rrlist, fqdn,
-				cname, c_len, &maybe_secure);
+	status = dns_get_reply(orig_name, name, type, status, &reply, rrlist,
+			       fqdn, why, cname, c_len, &maybe_secure);
 	switch (status) {
 	default:
-	    if (why)
-		vstring_sprintf(why, "Name service error for name=%s type=%s: "
-				"Malformed or unexpected name server reply",
-				name, dns_strtype(type));
-	    return (status);
-	case DNS_NULLMX:
-	    if (why)
-		vstring_sprintf(why, "Domain %s does not accept mail (nullMX)",
-				name);
-	    SET_H_ERRNO(NO_DATA);
-	    return (status);
-	case DNS_OK:
-	    if (rrlist && dns_rr_filter_maps) {
-		if (dns_rr_filter_execute(rrlist) < 0) {
-		    if (why)
-			vstring_sprintf(why,
-					"Error looking up name=%s type=%s: "
-					"Invalid DNS reply filter syntax",
-					name, dns_strtype(type));
-		    dns_rr_free(*rrlist);
-		    *rrlist = 0;
-		    status = DNS_RETRY;
-		} else if (*rrlist == 0) {
-		    if (why)
-			vstring_sprintf(why,
-					"Error looking up name=%s type=%s: "
-					"DNS reply filter drops all results",
-					name, dns_strtype(type));
-		    status = DNS_POLICY;
-		}
-	    }
 	    return (status);
 	case DNS_RECURSE:
 	    if (msg_verbose)
@@ -1049,6 +1114,79 @@ int     dns_lookup_x(const char *name, unsigned type, unsigned flags,
     return (DNS_NOTFOUND);
 }
 
+/* dns_lookup_reply - decode name server reply that was received elsewhere */
+
+int     dns_lookup_reply(const char *orig_name, const char *name,
+			         unsigned type, unsigned flags,
+			         unsigned char *buf, size_t len,
+			         DNS_RR **rrlist, VSTRING *fqdn, VSTRING *why,
+			         int *rcode, unsigned lflags, char *cname,
+			         int c_len, int *maybe_secure)
+{
+    DNS_REPLY reply;
+    HEADER *reply_header = (HEADER *) buf;
+    int     keep_notfound = (lflags & DNS_REQ_FLAG_NCACHE_TTL);
+    int     status;
+
+    if (rrlist)
+	*rrlist = 0;
+    if (len < sizeof(HEADER))
+	msg_panic("dns_lookup_reply: short reply: %ld", (long) len);
+    reply.buf = buf;
+    reply.buf_len = len;
+    reply.rcode = reply_header->rcode;
+    if (rcode)
+	*rcode = reply.rcode;
+
+    /*
+     * Map the reply code as dns_res_query() does, then pre-parse the reply
+     * as dns_query() does.
+     */
+    switch (reply_header->rcode) {
+    case NXDOMAIN:
+	SET_H_ERRNO(HOST_NOT_FOUND);
+	break;
+    case NOERROR:
+	SET_H_ERRNO(reply_header->ancount != 0 ? 0 : NO_DATA);
+	break;
+    case SERVFAIL:
+	SET_H_ERRNO(TRY_AGAIN);
+	break;
+    default:
+	SET_H_ERRNO(NO_RECOVERY);
+	break;
+    }
+    if (h_errno != 0) {
+	if (why)
+	    vstring_sprintf(why, "Host or domain name not found. "
+			    "Name service error for name=%s type=%s: %s",
+			    name, dns_strtype(type), dns_strerror(h_errno));
+	if (msg_verbose)
+	    msg_info("dns_query: %s (%s): %s",
+		     name, dns_strtype(type), dns_strerror(h_errno));
+	switch (h_errno) {
+	case NO_RECOVERY:
+	    return (DNS_FAIL);
+	case HOST_NOT_FOUND:
+	case NO_DATA:
+	    status = DNS_NOTFOUND;
+	    break;
+	default:
+	    return (DNS_RETRY);
+	}
+    } else {
+	if (msg_verbose)
+	    msg_info("dns_query: %s (%s): OK", name, dns_strtype(type));
+	status = DNS_OK;
+    }
+    if (status == DNS_NOTFOUND && !keep_notfound)
+	SET_NO_DNS_REPLY_PACKET(&reply);
+    else
+	dns_reply_init(&reply, flags, len);
+    return (dns_get_reply(orig_name, name, type, status, &reply, rrlist,
+			  fqdn, why, cname, c_len, maybe_secure));
+}
+
 /* dns_lookup_rl - DNS lookup interface with types list */
 
 int     dns_lookup_rl(const char *name, unsigned flags, DNS_RR **rrlist,
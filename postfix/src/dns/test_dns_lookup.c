@@ -4,10 +4,20 @@
 /* SUMMARY
 /*	DNS lookup test program
 /* SYNOPSIS
-/*	test_dns_lookup query-type domain-name
+/*	test_dns_lookup [-npv] [-f filter] query-type domain-name
+/*
+/*	test_dns_lookup -a [-nv] [-f filter] [-s server[:port]]
+/*		query-type domain-name...
 /* DESCRIPTION
 /*	test_dns_lookup performs a DNS query of the specified resource
 /*	type for the specified resource name.
+/*
+/*	With -a, test_dns_lookup uses dns_async(3) to start the
+/*	queries for all types and names at the same time, and
+/*	reports each result as it arrives. The -s option sends the
+/*	queries to the specified IPv4 name server instead of the
+/*	configured ones, for example, a test server on a non-standard
+/*	port.
 /* DIAGNOSTICS
 /*	Problems are reported to the standard error stream.
 /* LICENSE
@@ -40,6 +50,8 @@
 #include <msg_vstream.h>
 #include <mymalloc.h>
 #include <argv.h>
+#include <split_at.h>
+#include <stringops.h>
 
 /* Global library. */
 
@@ -60,13 +72,55 @@ static void print_rr(VSTRING *buf, DNS_RR *rr)
 
 static NORETURN usage(char **argv)
 {
-    msg_fatal("usage: %s [-npv] [-f filter] types name", argv[0]);
+    msg_fatal("usage: %s [-npv] [-f filter] types name\n"
+	      "       %s -a [-nv] [-f filter] [-s server[:port]] types name...",
+	      argv[0], argv[0]);
+}
+
+/* print_async - print dns_async_lookup() result */
+
+static void print_async(int status, DNS_RR *rr, int rcode, const char *why,
+			        void *context)
+{
+    char   *query = (char *) context;
+    VSTRING *buf;
+
+    if (status != DNS_OK)
+	msg_warn("%s: %s (rcode=%d)", query, why, rcode);
+    if (rr) {
+	vstream_printf("%s: %s\n", query, status == DNS_OK ? "OK" : "reply");
+	buf = vstring_alloc(100);
+	print_rr(buf, rr);
+	dns_rr_free(rr);
+	vstring_free(buf);
+	vstream_fflush(VSTREAM_OUT);
+    }
+    myfree(query);
+}
+
+/* set_server - override the name server list */
+
+static void set_server(char *server)
+{
+    char   *port;
+
+    if ((_res.options & RES_INIT) == 0 && res_init() < 0)
+	msg_fatal("res_init failed");
+    if ((port = split_at_right(server, ':')) != 0)
+	_res.nsaddr_list[0].sin_port = htons(atoi(port));
+    else
+	_res.nsaddr_list[0].sin_port = htons(NAMESERVER_PORT);
+    if (inet_pton(AF_INET, server, &_res.nsaddr_list[0].sin_addr) != 1)
+	msg_fatal("bad IPv4 server address: %s", server);
+    _res.nsaddr_list[0].sin_family = AF_INET;
+    _res.nscount = 1;
 }
 
 int     main(int argc, char **argv)
 {
     ARGV   *types_argv;
     unsigned *types;
+    unsigned *ltype;
     char   *name;
     VSTRING *fqdn = vstring_alloc(100);
     VSTRING *why = vstring_alloc(100);
@@ -76,10 +130,17 @@ int     main(int argc, char **argv)
     int     i;
     int     ch;
     int     lflags = DNS_REQ_FLAG_NONE;
+    int     async = 0;
 
     msg_vstream_init(argv[0], VSTREAM_ERR);
-    while ((ch = GETOPT(argc, argv, "f:npv")) > 0) {
+    while ((ch = GETOPT(argc, argv, "af:nps:v")) > 0) {
 	switch (ch) {
+	case 'a':
+	    async = 1;
+	    break;
+	case 's':
+	    set_server(optarg);
+	    break;
 	case 'v':
 	    msg_verbose++;
 	    break;
@@ -96,7 +157,7 @@ int     main(int argc, char **argv)
 	    usage(argv);
 	}
     }
-    if (argc != optind + 2)
+    if (async ? argc < optind + 2 : argc != optind + 2)
 	usage(argv);
     types_argv = argv_split(argv[optind], CHARS_COMMA_SP);
     types = (unsigned *) mymalloc(sizeof(*types) * (types_argv->argc + 1));
@@ -105,6 +166,17 @@ int     main(int argc, char **argv)
 	    msg_fatal("invalid query type: %s", types_argv->argv[i]);
     types[i] = 0;
     argv_free(types_argv);
+    if (async) {
+	for (i = optind + 1; i < argc; i++)
+	    for (ltype = types; *ltype; ltype++)
+		dns_async_lookup(argv[i], *ltype, RES_USE_DNSSEC, lflags,
+				 print_async,
+				 concatenate(argv[i], "/",
+					     dns_strtype(*ltype), (char *) 0));
+	dns_async_wait(-1);
+	myfree((void *) types);
+	exit(0);
+    }
     name = argv[optind + 1];
     msg_verbose = 1;
     switch (dns_lookup_rv(name, RES_USE_DNSSEC, &rr, fqdn, why,
@@ -0,0 +1,290 @@
+/*++
+/* NAME
+/*	mail_group_sync 3
+/* SUMMARY
+/*	group commit for queue files
+/* SYNOPSIS
+/*	#include <mail_group_sync.h>
+/*
+/*	void	mail_group_sync_init(path, delay)
+/*	const char *path;
+/*	int	delay;
+/*
+/*	int	mail_group_sync(fd)
+/*	int	fd;
+/* DESCRIPTION
+/*	This module allows a number of processes to share one file
+/*	system synchronization operation, instead of running one
+/*	fsync() operation per queue file. This reduces the number of
+/*	disk cache flushes when many processes write queue files at
+/*	the same time.
+/*
+/*	mail_group_sync_init() opens or creates the specified lock
+/*	file, which must be shared by all processes that participate.
+/*	The delay argument specifies the time in milliseconds that
+/*	a process waits before it synchronizes the file system on
+/*	behalf of other processes. This function must be called
+/*	before the process enters a chroot jail.
+/*
+/*	mail_group_sync() has the same result as fsync(): it returns
+/*	when all data and meta data of the specified file are on
+/*	stable storage. Each caller waits for a file system
+/*	synchronization that starts after the call. The first caller
+/*	that finds no synchronization in progress waits for the
+/*	specified delay, so that other callers can join, and then
+/*	runs syncfs() for all of them. The other callers wait until
+/*	it completes. When mail_group_sync_init() was not called,
+/*	when group commit is not available, or when a group
+/*	synchronization fails, the caller runs its own fsync()
+/*	operation.
+/*
+/*	Group commit is not available on systems without syncfs(),
+/*	and on Linux kernels before 5.8, whose syncfs() does not
+/*	report data write-back errors.
+/*
+/*	The lock file contains the number of file system synchronizations
+/*	that have started, the number of the last completed
+/*	synchronization, and its error status. Access is serialized
+/*	with a lock on byte 0; the process that runs syncfs() holds
+/*	a lock on byte 1.
+/* DIAGNOSTICS
+/*	mail_group_sync() returns 0 in case of success, -1 in case
+/*	of error. Fatal errors: cannot lock, read or update the lock
+/*	file.
+/*
+/*	Warning: group commit is not available on this system.
+/* SEE ALSO
+/*	fsync(2), syncfs(2)
+/* LICENSE
+/* .ad
+/* .fi
+/*	The Secure Mailer license must be distributed with this software.
+/* AUTHOR(S)
+/*	Wietse Venema
+/*	IBM T.J. Watson Research
+/*	P.O. Box 704
+/*	Yorktown Heights, NY 10598, USA
+/*--*/
+
+/* System library. */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE			/* syncfs() */
+#endif
+#include <sys_defs.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <stdio.h>			/* sscanf() */
+
+#ifdef SYNCFS_MIN_KERNEL
+#include <sys/utsname.h>
+#endif
+
+/* Utility library. */
+
+#include <msg.h>
+#include <iostuff.h>
+
+/* Global library. */
+
+#include <mail_group_sync.h>
+
+ /*
+  * Shared state, stored in the lock file.
+  */
+typedef struct {
+    long    started;			/* syncs that were started */
+    long    done;			/* last sync that completed */
+    int     error;			/* errno of last completed sync */
+} MAIL_GROUP_SYNC_STATE;
+
+#define MAIL_GROUP_SYNC_STATE_LOCK	0	/* protects shared state */
+#define MAIL_GROUP_SYNC_LEADER_LOCK	1	/* held while syncing */
+#define MAIL_GROUP_SYNC_STATE_OFFSET	16
+
+#ifdef HAS_SYNCFS
+
+static int mail_group_sync_fd = -1;
+static int mail_group_sync_delay;
+
+/* mail_group_sync_lock - lock or unlock one byte of the lock file */
+
+static int mail_group_sync_lock(int which, int type, int cmd)
+{
+    const char *myname = "mail_group_sync_lock";
+    struct flock lock;
+    int     status;
+
+    memset((void *) &lock, 0, sizeof(lock));
+    lock.l_type = type;
+    lock.l_whence = SEEK_SET;
+    lock.l_start = which;
+    lock.l_len = 1;
+    while ((status = fcntl(mail_group_sync_fd, cmd, &lock)) < 0
+	   && errno == EINTR)
+	 /* void */ ;
+    if (status < 0 && (cmd == F_SETLKW
+		       || (errno != EAGAIN && errno != EACCES)))
+	msg_fatal("%s: lock byte %d: %m", myname, which);
+    return (status);
+}
+
+#define LOCK_STATE() \
+    mail_group_sync_lock(MAIL_GROUP_SYNC_STATE_LOCK, F_WRLCK, F_SETLKW)
+#define UNLOCK_STATE() \
+    mail_group_sync_lock(MAIL_GROUP_SYNC_STATE_LOCK, F_UNLCK, F_SETLK)
+#define TRY_LOCK_LEADER() \
+    mail_group_sync_lock(MAIL_GROUP_SYNC_LEADER_LOCK, F_WRLCK, F_SETLK)
+#define WAIT_LEADER() \
+    mail_group_sync_lock(MAIL_GROUP_SYNC_LEADER_LOCK, F_RDLCK, F_SETLKW)
+#define UNLOCK_LEADER() \
+    mail_group_sync_lock(MAIL_GROUP_SYNC_LEADER_LOCK, F_UNLCK, F_SETLK)
+
+/* mail_group_sync_usable - syncfs() reports write-back errors */
+
+static int mail_group_sync_usable(void)
+{
+#ifdef SYNCFS_MIN_KERNEL
+    struct utsname uts;
+    int     have_major, have_minor;
+    int     need_major, need_minor;
+
+    if (sscanf(SYNCFS_MIN_KERNEL, "%d.%d", &need_major, &need_minor) != 2)
+	msg_panic("bad SYNCFS_MIN_KERNEL value: %s", SYNCFS_MIN_KERNEL);
+    if (uname(&uts) < 0
+	|| sscanf(uts.release, "%d.%d", &have_major, &have_minor) != 2)
+	return (0);
+    return (have_major > need_major
+	    || (have_major == need_major && have_minor >= need_minor));
+#else
+    return (1);
+#endif
+}
+
+/* mail_group_sync_get - read shared state */
+
+static void mail_group_sync_get(MAIL_GROUP_SYNC_STATE *state)
+{
+    ssize_t count;
+
+    if ((count = pread(mail_group_sync_fd, (void *) state, sizeof(*state),
+		       MAIL_GROUP_SYNC_STATE_OFFSET)) < 0)
+	msg_fatal("read group sync state: %m");
+    if (count != sizeof(*state))
+	memset((void *) state, 0, sizeof(*state));
+}
+
+/* mail_group_sync_put - update shared state */
+
+static void mail_group_sync_put(MAIL_GROUP_SYNC_STATE *state)
+{
+    if (pwrite(mail_group_sync_fd, (void *) state, sizeof(*state),
+	       MAIL_GROUP_SYNC_STATE_OFFSET) != sizeof(*state))
+	msg_fatal("update group sync state: %m");
+}
+
+#endif
+
+/* mail_group_sync_init - open the lock file */
+
+void    mail_group_sync_init(const char *path, int delay)
+{
+#ifdef HAS_SYNCFS
+    if (mail_group_sync_fd >= 0) {
+	(void) close(mail_group_sync_fd);
+	mail_group_sync_fd = -1;
+    }
+    if (!mail_group_sync_usable()) {
+	msg_warn("syncfs() on this kernel does not report write errors "
+		 "-- using fsync()");
+	return;
+    }
+    if ((mail_group_sync_fd = open(path, O_RDWR | O_CREAT, 0600)) < 0)
+	msg_fatal("open %s: %m", path);
+    close_on_exec(mail_group_sync_fd, CLOSE_ON_EXEC);
+    mail_group_sync_delay = delay;
+#else
+    msg_warn("group commit is not available on this system -- using fsync()");
+#endif
+}
+
+/* mail_group_sync - wait until file is on stable storage */
+
+int     mail_group_sync(int fd)
+{
+#ifdef HAS_SYNCFS
+    const char *myname = "mail_group_sync";
+    MAIL_GROUP_SYNC_STATE state;
+    long    need;
+    long    gen;
+    int     err;
+
+    if (mail_group_sync_fd < 0)
+	return (fsync(fd));
+
+    /*
+     * Any file system synchronization that starts after this point covers
+     * all data that was written to our file.
+     */
+    LOCK_STATE();
+    mail_group_sync_get(&state);
+    need = state.started + 1;
+    UNLOCK_STATE();
+
+    for (;;) {
+	LOCK_STATE();
+	mail_group_sync_get(&state);
+
+	/*
+	 * Done. If the last synchronization failed, don't try to figure out
+	 * if our file was affected.
+	 */
+	if (state.done >= need) {
+	    UNLOCK_STATE();
+	    return (state.error ? fsync(fd) : 0);
+	}
+
+	/*
+	 * No synchronization in progress. Give other processes a chance to
+	 * join, then synchronize the file system on behalf of everyone who
+	 * started waiting before the syncfs() call. We never wait for the
+	 * state lock while other processes wait for us.
+	 */
+	if (TRY_LOCK_LEADER() == 0) {
+	    UNLOCK_STATE();
+	    if (mail_group_sync_delay > 0)
+		doze(mail_group_sync_delay * 1000);
+	    LOCK_STATE();
+	    mail_group_sync_get(&state);
+	    gen = ++state.started;
+	    mail_group_sync_put(&state);
+	    UNLOCK_STATE();
+	    if (msg_verbose)
+		msg_info("%s: syncfs generation %ld", myname, gen);
+	    err = (syncfs(fd) < 0 ? errno : 0);
+	    LOCK_STATE();
+	    mail_group_sync_get(&state);
+	    if (gen > state.done) {
+		state.done = gen;
+		state.error = err;
+		mail_group_sync_put(&state);
+	    }
+	    UNLOCK_STATE();
+	    UNLOCK_LEADER();
+	    return (err ? fsync(fd) : 0);
+	}
+
+	/*
+	 * Wait until the current synchronization completes. If it started
+	 * too early for us, one of the waiting processes will start another.
+	 */
+	UNLOCK_STATE();
+	WAIT_LEADER();
+	UNLOCK_LEADER();
+    }
+#else
+    return (fsync(fd));
+#endif
+}
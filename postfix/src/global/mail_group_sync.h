@@ -0,0 +1,30 @@
+#ifndef _MAIL_GROUP_SYNC_H_INCLUDED_
+#define _MAIL_GROUP_SYNC_H_INCLUDED_
+
+/*++
+/* NAME
+/*	mail_group_sync 3h
+/* SUMMARY
+/*	group commit for queue files
+/* SYNOPSIS
+/*	#include <mail_group_sync.h>
+/* DESCRIPTION
+/* .nf
+
+ /* External interface. */
+
+extern void mail_group_sync_init(const char *, int);
+extern int mail_group_sync(int);
+
+/* LICENSE
+/* .ad
+/* .fi
+/*	The Secure Mailer license must be distributed with this software.
+/* AUTHOR(S)
+/*	Wietse Venema
+/*	IBM T.J. Watson Research
+/*	P.O. Box 704
+/*	Yorktown Heights, NY 10598, USA
+/*--*/
+
+#endif
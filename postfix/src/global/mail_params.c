@@ -56,6 +56,8 @@
 /*	char	*var_db_type;
 /*	char	*var_hash_queue_names;
 /*	int	var_hash_queue_depth;
+/*	int	var_hash_queue_prev_depth;
+/*	int	var_queue_file_bufsize;
 /*	int	var_trigger_timeout;
 /*	char	*var_rcpt_delim;
 /*	int	var_fork_tries;
@@ -100,6 +102,11 @@
 /*	int	var_db_create_buf;
 /*	int	var_db_read_buf;
 /*	long	var_lmdb_map_size;
+/*	int	var_pcre_jit_stack;
+/*	int	var_lookup_cache_size;
+/*	int	var_lookup_cache_ttl;
+/*	int	var_lookup_cache_neg_ttl;
+/*	char	*var_lookup_cache_types;
 /*	int	var_proc_limit;
 /*	int	var_mime_maxdepth;
 /*	int	var_mime_bound_len;
@@ -132,6 +139,9 @@
 /*	int     var_compat_level;
 /*	char	*var_drop_hdrs;
 /*	bool	var_enable_orcpt;
+/*	bool	var_event_lazy_unreg;
+/*	int	var_resolve_cache_size;
+/*	int	var_resolve_cache_ttl;
 /*
 /*	void	mail_params_init()
 /*
@@ -202,6 +212,7 @@
 #include <dict.h>
 #include <dict_db.h>
 #include <dict_lmdb.h>
+#include <dict_pcre.h>
 #include <inet_proto.h>
 #include <vstring_vstream.h>
 #include <iostuff.h>
@@ -270,6 +281,8 @@ int     var_ipc_ttl_limit;
 char   *var_db_type;
 char   *var_hash_queue_names;
 int     var_hash_queue_depth;
+int     var_hash_queue_prev_depth;
+int     var_queue_file_bufsize;
 int     var_trigger_timeout;
 char   *var_rcpt_delim;
 int     var_fork_tries;
@@ -314,6 +327,11 @@ char   *var_proxywrite_service;
 int     var_db_create_buf;
 int     var_db_read_buf;
 long    var_lmdb_map_size;
+int     var_pcre_jit_stack;
+int     var_lookup_cache_size;
+int     var_lookup_cache_ttl;
+int     var_lookup_cache_neg_ttl;
+char   *var_lookup_cache_types;
 int     var_proc_limit;
 int     var_mime_maxdepth;
 int     var_mime_bound_len;
@@ -339,6 +357,9 @@ bool    var_multi_enable;
 bool    var_long_queue_ids;
 bool    var_daemon_open_fatal;
 bool    var_dns_ncache_ttl_fix;
+bool    var_event_lazy_unreg;
+int     var_resolve_cache_size;
+int     var_resolve_cache_ttl;
 char   *var_dsn_filter;
 int     var_smtputf8_enable;
 int     var_strict_smtputf8;
@@ -742,6 +763,7 @@ void    mail_params_init()
 	VAR_DSN_FILTER, DEF_DSN_FILTER, &var_dsn_filter, 0, 0,
 	VAR_SMTPUTF8_AUTOCLASS, DEF_SMTPUTF8_AUTOCLASS, &var_smtputf8_autoclass, 1, 0,
 	VAR_DROP_HDRS, DEF_DROP_HDRS, &var_drop_hdrs, 0, 0,
+	VAR_LOOKUP_CACHE_TYPES, DEF_LOOKUP_CACHE_TYPES, &var_lookup_cache_types, 0, 0,
 	0,
     };
     static const CONFIG_STR_FN_TABLE function_str_defaults_2[] = {
@@ -754,6 +776,8 @@ void    mail_params_init()
 	VAR_DONT_REMOVE, DEF_DONT_REMOVE, &var_dont_remove, 0, 0,
 	VAR_LINE_LIMIT, DEF_LINE_LIMIT, &var_line_limit, 512, 0,
 	VAR_HASH_QUEUE_DEPTH, DEF_HASH_QUEUE_DEPTH, &var_hash_queue_depth, 1, 0,
+	VAR_HASH_QUEUE_PREV_DEPTH, DEF_HASH_QUEUE_PREV_DEPTH, &var_hash_queue_prev_depth, 0, 0,
+	VAR_QUEUE_FILE_BUFSIZE, DEF_QUEUE_FILE_BUFSIZE, &var_queue_file_bufsize, 0, 0,
 	VAR_FORK_TRIES, DEF_FORK_TRIES, &var_fork_tries, 1, 0,
 	VAR_FLOCK_TRIES, DEF_FLOCK_TRIES, &var_flock_tries, 1, 0,
 	VAR_DEBUG_PEER_LEVEL, DEF_DEBUG_PEER_LEVEL, &var_debug_peer_level, 1, 0,
@@ -766,6 +790,9 @@ void    mail_params_init()
 	VAR_MIME_BOUND_LEN, DEF_MIME_BOUND_LEN, &var_mime_bound_len, 1, 0,
 	VAR_DELAY_MAX_RES, DEF_DELAY_MAX_RES, &var_delay_max_res, MIN_DELAY_MAX_RES, MAX_DELAY_MAX_RES,
 	VAR_INET_WINDOW, DEF_INET_WINDOW, &var_inet_windowsize, 0, 0,
+	VAR_RESOLVE_CACHE_SIZE, DEF_RESOLVE_CACHE_SIZE, &var_resolve_cache_size, 0, 0,
+	VAR_PCRE_JIT_STACK, DEF_PCRE_JIT_STACK, &var_pcre_jit_stack, 0, 0,
+	VAR_LOOKUP_CACHE_SIZE, DEF_LOOKUP_CACHE_SIZE, &var_lookup_cache_size, 0, 0,
 	0,
     };
     static const CONFIG_LONG_TABLE long_defaults[] = {
@@ -785,6 +812,9 @@ void    mail_params_init()
 	VAR_FLOCK_STALE, DEF_FLOCK_STALE, &var_flock_stale, 1, 0,
 	VAR_DAEMON_TIMEOUT, DEF_DAEMON_TIMEOUT, &var_daemon_timeout, 1, 0,
 	VAR_IN_FLOW_DELAY, DEF_IN_FLOW_DELAY, &var_in_flow_delay, 0, 10,
+	VAR_RESOLVE_CACHE_TTL, DEF_RESOLVE_CACHE_TTL, &var_resolve_cache_ttl, 0, 0,
+	VAR_LOOKUP_CACHE_TTL, DEF_LOOKUP_CACHE_TTL, &var_lookup_cache_ttl, 0, 0,
+	VAR_LOOKUP_CACHE_NEG_TTL, DEF_LOOKUP_CACHE_NEG_TTL, &var_lookup_cache_neg_ttl, 0, 0,
 	0,
     };
     static const CONFIG_BOOL_TABLE bool_defaults[] = {
@@ -805,6 +835,7 @@ void    mail_params_init()
 	VAR_LONG_QUEUE_IDS, DEF_LONG_QUEUE_IDS, &var_long_queue_ids,
 	VAR_STRICT_SMTPUTF8, DEF_STRICT_SMTPUTF8, &var_strict_smtputf8,
 	VAR_ENABLE_ORCPT, DEF_ENABLE_ORCPT, &var_enable_orcpt,
+	VAR_EVENT_LAZY_UNREG, DEF_EVENT_LAZY_UNREG, &var_event_lazy_unreg,
 	0,
     };
     const char *cp;
@@ -904,6 +935,7 @@ void    mail_params_init()
     check_overlap();
     dict_db_cache_size = var_db_read_buf;
     dict_lmdb_map_size = var_lmdb_map_size;
+    dict_pcre_jit_stack_size = var_pcre_jit_stack;
     inet_windowsize = var_inet_windowsize;
 
     /*
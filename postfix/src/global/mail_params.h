@@ -741,6 +741,7 @@ extern char *var_relocated_maps;
   */
 #define VAR_QUEUE_RUN_DELAY	"queue_run_delay"
 #define DEF_QUEUE_RUN_DELAY     "300s"
+extern int var_queue_run_delay;
 
 #define VAR_MIN_BACKOFF_TIME	"minimal_backoff_time"
 #define DEF_MIN_BACKOFF_TIME    DEF_QUEUE_RUN_DELAY
@@ -883,6 +884,29 @@ extern char *var_defer_xports;
 #define DEF_QMGR_CLOG_WARN_TIME	"300s"
 extern int var_qmgr_clog_warn_time;
 
+ /*
+  * Queue manager: optional deferred queue index, and how often to rebuild
+  * it from the deferred queue directory.
+  */
+#define VAR_QMGR_INDEX_MAP	"qmgr_index_database"
+#define DEF_QMGR_INDEX_MAP	""
+extern char *var_qmgr_index_map;
+
+#define VAR_QMGR_INDEX_REBUILD	"qmgr_index_rebuild_time"
+#define DEF_QMGR_INDEX_REBUILD	"1h"
+extern int var_qmgr_index_rebuild;
+
+#define VAR_QMGR_DEFERRED_HEAP	"qmgr_deferred_heap"
+#define DEF_QMGR_DEFERRED_HEAP	0
+extern bool var_qmgr_deferred_heap;
+
+ /*
+  * Queue manager: learn about new incoming queue files from the kernel.
+  */
+#define VAR_QMGR_IN_NOTIFY	"qmgr_incoming_notify"
+#define DEF_QMGR_IN_NOTIFY	0
+extern bool var_qmgr_in_notify;
+
  /*
   * Master: default process count limit per mail subsystem.
   */
@@ -976,6 +1000,14 @@ extern char *var_hash_queue_names;
 #define DEF_HASH_QUEUE_DEPTH	1
 extern int var_hash_queue_depth;
 
+#define VAR_HASH_QUEUE_PREV_DEPTH	"hash_queue_previous_depth"
+#define DEF_HASH_QUEUE_PREV_DEPTH	0
+extern int var_hash_queue_prev_depth;
+
+#define VAR_HASH_QUEUE_MIGR_LIMIT	"hash_queue_migration_limit"
+#define DEF_HASH_QUEUE_MIGR_LIMIT	1000
+extern int var_hash_queue_migr_limit;
+
  /*
   * Short queue IDs contain the time in microseconds and file inode number.
   * Long queue IDs also contain the time in seconds.
@@ -1045,6 +1077,18 @@ extern bool var_smtp_cache_demand;
 #define DEF_SMTP_CONN_TMOUT	"30s"
 extern int var_smtp_conn_tmout;
 
+#define VAR_SMTP_PCONN_LIMIT	"smtp_parallel_connect_limit"
+#define DEF_SMTP_PCONN_LIMIT	1
+#define VAR_LMTP_PCONN_LIMIT	"lmtp_parallel_connect_limit"
+#define DEF_LMTP_PCONN_LIMIT	1
+extern int var_smtp_pconn_limit;
+
+#define VAR_SMTP_PCONN_DELAY	"smtp_parallel_connect_delay"
+#define DEF_SMTP_PCONN_DELAY	250
+#define VAR_LMTP_PCONN_DELAY	"lmtp_parallel_connect_delay"
+#define DEF_LMTP_PCONN_DELAY	250
+extern int var_smtp_pconn_delay;
+
 #define VAR_SMTP_HELO_TMOUT	"smtp_helo_timeout"
 #define DEF_SMTP_HELO_TMOUT	"300s"
 #define VAR_LMTP_HELO_TMOUT	"lmtp_lhlo_timeout"
@@ -1964,6 +2008,18 @@ extern char *var_body_checks;
 #define DEF_BODY_CHECK_LEN	(50*1024)
 extern int var_body_check_len;
 
+ /*
+  * Cleanup server: share one file system sync between concurrent cleanup
+  * processes.
+  */
+#define VAR_CLEANUP_GROUP_SYNC	"cleanup_group_sync"
+#define DEF_CLEANUP_GROUP_SYNC	0
+extern bool var_cleanup_group_sync;
+
+#define VAR_CLEANUP_SYNC_DELAY	"cleanup_group_sync_delay"
+#define DEF_CLEANUP_SYNC_DELAY	2
+extern int var_cleanup_sync_delay;
+
  /*
   * Bounce service: truncate bounce message that exceed $bounce_size_limit.
   */
@@ -2710,6 +2766,14 @@ extern int var_fault_inj_code;
 #define DEF_HTML_DIR			"no"
 #endif
 
+ /*
+  * How many recipient domains trivial-rewrite remembers the transport_maps
+  * domain search result for.
+  */
+#define VAR_TRANSPORT_CACHE_SIZE	"transport_domain_cache_size"
+#define DEF_TRANSPORT_CACHE_SIZE	10000
+extern int var_transport_cache_size;
+
  /*
   * Safety: resolve the address with unquoted localpart (default, but
   * technically incorrect), instead of resolving the address with quoted
@@ -2942,6 +3006,24 @@ extern long var_lmdb_map_size;
 #define DEF_QATTR_COUNT_LIMIT		100
 extern int var_qattr_count_limit;
 
+ /*
+  * Adaptive stream buffer sizes. Streams start with VSTREAM_BUFSIZE bytes
+  * and grow up to these limits while they carry large amounts of data.
+  */
+#define VAR_QUEUE_FILE_BUFSIZE		"queue_file_buffer_limit"
+#define DEF_QUEUE_FILE_BUFSIZE		65536
+extern int var_queue_file_bufsize;
+
+#define VAR_SMTP_DATA_BUFSIZE		"smtp_data_buffer_limit"
+#define DEF_SMTP_DATA_BUFSIZE		65536
+#define VAR_LMTP_DATA_BUFSIZE		"lmtp_data_buffer_limit"
+#define DEF_LMTP_DATA_BUFSIZE		65536
+extern int var_smtp_data_bufsize;
+
+#define VAR_SMTPD_DATA_BUFSIZE		"smtpd_data_buffer_limit"
+#define DEF_SMTPD_DATA_BUFSIZE		65536
+extern int var_smtpd_data_bufsize;
+
  /*
   * MIME support.
   */
@@ -4166,6 +4248,53 @@ extern int var_idna2003_compat;
 #define DEF_DNS_NCACHE_TTL_FIX		0
 extern bool var_dns_ncache_ttl_fix;
 
+ /*
+  * Event manager tuning. With kernel-based event filters that support
+  * in-place updates, defer unregister requests in multi-client servers.
+  */
+#define VAR_EVENT_LAZY_UNREG		"event_lazy_unregister"
+#define DEF_EVENT_LAZY_UNREG		0
+extern bool var_event_lazy_unreg;
+
+ /*
+  * Address resolver client cache. This caches (class, sender, address)
+  * lookups in each client process, so that a message with many recipients
+  * in the same domain does not need a trivial-rewrite round trip for each.
+  */
+#define VAR_RESOLVE_CACHE_SIZE		"resolve_client_cache_size"
+#define DEF_RESOLVE_CACHE_SIZE		1000
+extern int var_resolve_cache_size;
+
+#define VAR_RESOLVE_CACHE_TTL		"resolve_client_cache_ttl"
+#define DEF_RESOLVE_CACHE_TTL		"30s"
+extern int var_resolve_cache_ttl;
+
+ /*
+  * PCRE2 just-in-time matcher stack limit.
+  */
+#define VAR_PCRE_JIT_STACK		"pcre_jit_stack_size"
+#define DEF_PCRE_JIT_STACK		(1024 * 1024)
+extern int var_pcre_jit_stack;
+
+ /*
+  * Per-process lookup result cache for network-based tables.
+  */
+#define VAR_LOOKUP_CACHE_SIZE		"lookup_result_cache_size"
+#define DEF_LOOKUP_CACHE_SIZE		1000
+extern int var_lookup_cache_size;
+
+#define VAR_LOOKUP_CACHE_TTL		"lookup_result_cache_ttl"
+#define DEF_LOOKUP_CACHE_TTL		"60s"
+extern int var_lookup_cache_ttl;
+
+#define VAR_LOOKUP_CACHE_NEG_TTL	"lookup_result_cache_negative_ttl"
+#define DEF_LOOKUP_CACHE_NEG_TTL	"0s"
+extern int var_lookup_cache_neg_ttl;
+
+#define VAR_LOOKUP_CACHE_TYPES		"lookup_result_cache_types"
+#define DEF_LOOKUP_CACHE_TYPES		""
+extern char *var_lookup_cache_types;
+
 /* LICENSE
 /* .ad
 /* .fi
@@ -60,7 +60,13 @@
 /*
 /*	mail_queue_open() opens the named queue file. The \fIflags\fR
 /*	and \fImode\fR arguments are as with open(2). The result is a
-/*	null pointer in case of problems.
+/*	null pointer in case of problems. With O_CREAT, the file is
+/*	always opened in the layout for the current queue hashing
+/*	depth; a file that still exists in the previous layout is
+/*	moved into place first. Streams opened with
+/*	mail_queue_open() or mail_queue_enter() grow their buffer up
+/*	to $queue_file_buffer_limit bytes while a large file is read
+/*	or written.
 /*
 /*	mail_queue_dir() returns the directory name of the specified queue
 /*	file. When a null result buffer pointer is provided, the result is
@@ -70,14 +76,21 @@
 /*	mail_queue_path() returns the pathname of the specified queue
 /*	file. When a null result buffer pointer is provided, the result
 /*	is written to a private buffer that may be overwritten upon the
-/*	next call.
+/*	next call. When \fBhash_queue_previous_depth\fR is non-zero,
+/*	and the file does not exist under the current queue hashing
+/*	depth but does exist under the previous depth, the result is
+/*	the pathname in the previous layout. This allows queue files
+/*	to be migrated to a different hashing depth while mail is
+/*	being delivered. Do not use this result to create a file;
+/*	use mail_queue_open() with O_CREAT instead.
 /*
 /*	mail_queue_mkdirs() creates missing parent directories
 /*	for the file named in \fBpath\fR. A non-zero result means
 /*	that the operation failed.
 /*
-/*	mail_queue_rename() renames a queue file. A non-zero result
-/*	means the operation failed.
+/*	mail_queue_rename() renames a queue file. The destination is
+/*	always in the layout for the current queue hashing depth.
+/*	A non-zero result means the operation failed.
 /*
 /*	mail_queue_remove() removes the named queue file. A non-zero result
 /*	means the operation failed.
@@ -111,6 +124,7 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/time.h>			/* gettimeofday, not in POSIX */
+#include <sys/stat.h>
 #include <string.h>
 #include <errno.h>
 
@@ -140,18 +154,30 @@
 
 #define STR	vstring_str
 
-/* mail_queue_dir - construct mail queue directory name */
+/* mail_queue_hashed - is this queue hashed */
 
-const char *mail_queue_dir(VSTRING *buf, const char *queue_name,
-			           const char *queue_id)
+static int mail_queue_hashed(const char *queue_name)
+{
+    static ARGV *hash_queue_names = 0;
+    char  **cpp;
+
+    if (hash_queue_names == 0)
+	hash_queue_names = argv_split(var_hash_queue_names, CHARS_COMMA_SP);
+    for (cpp = hash_queue_names->argv; *cpp; cpp++)
+	if (strcasecmp(*cpp, queue_name) == 0)
+	    return (1);
+    return (0);
+}
+
+/* mail_queue_hash_dir - construct directory name for given hash depth */
+
+static const char *mail_queue_hash_dir(VSTRING *buf, const char *queue_name,
+				               const char *queue_id, int depth)
 {
     const char *myname = "mail_queue_dir";
-    static VSTRING *private_buf = 0;
     static VSTRING *hash_buf = 0;
-    static ARGV *hash_queue_names = 0;
     static VSTRING *usec_buf = 0;
     const char *delim;
-    char  **cpp;
 
     /*
      * Sanity checks.
@@ -164,15 +190,8 @@ const char *mail_queue_dir(VSTRING *buf, const char *queue_name,
     /*
      * Initialize.
      */
-    if (buf == 0) {
-	if (private_buf == 0)
-	    private_buf = vstring_alloc(100);
-	buf = private_buf;
-    }
-    if (hash_buf == 0) {
+    if (hash_buf == 0)
 	hash_buf = vstring_alloc(100);
-	hash_queue_names = argv_split(var_hash_queue_names, CHARS_COMMA_SP);
-    }
 
     /*
      * First, put the basic queue directory name into place.
@@ -183,19 +202,62 @@ const char *mail_queue_dir(VSTRING *buf, const char *queue_name,
     /*
      * Then, see if we need to append a little directory forest.
      */
-    for (cpp = hash_queue_names->argv; *cpp; cpp++) {
-	if (strcasecmp(*cpp, queue_name) == 0) {
-	    if (MQID_FIND_LG_INUM_SEPARATOR(delim, queue_id)) {
-		if (usec_buf == 0)
-		    usec_buf = vstring_alloc(20);
-		MQID_LG_GET_HEX_USEC(usec_buf, delim);
-		queue_id = STR(usec_buf);
-	    }
-	    vstring_strcat(buf,
-		      dir_forest(hash_buf, queue_id, var_hash_queue_depth));
-	    break;
+    if (mail_queue_hashed(queue_name)) {
+	if (MQID_FIND_LG_INUM_SEPARATOR(delim, queue_id)) {
+	    if (usec_buf == 0)
+		usec_buf = vstring_alloc(20);
+	    MQID_LG_GET_HEX_USEC(usec_buf, delim);
+	    queue_id = STR(usec_buf);
 	}
+	vstring_strcat(buf, dir_forest(hash_buf, queue_id, depth));
+    }
+    return (STR(buf));
+}
+
+/* MAIL_QUEUE_MIGRATING - files may exist in the previous layout */
+
+#define MAIL_QUEUE_MIGRATING(queue_name) \
+	(var_hash_queue_prev_depth > 0 \
+	 && var_hash_queue_prev_depth != var_hash_queue_depth \
+	 && mail_queue_hashed(queue_name))
+
+/* mail_queue_dir - construct mail queue directory name */
+
+const char *mail_queue_dir(VSTRING *buf, const char *queue_name,
+			           const char *queue_id)
+{
+    static VSTRING *private_buf = 0;
+
+    /*
+     * Initialize.
+     */
+    if (buf == 0) {
+	if (private_buf == 0)
+	    private_buf = vstring_alloc(100);
+	buf = private_buf;
     }
+    return (mail_queue_hash_dir(buf, queue_name, queue_id,
+				var_hash_queue_depth));
+}
+
+/* mail_queue_new_path - path name in the current layout */
+
+static const char *mail_queue_new_path(VSTRING *buf, const char *queue_name,
+				               const char *queue_id)
+{
+    (void) mail_queue_dir(buf, queue_name, queue_id);
+    vstring_strcat(buf, queue_id);
+    return (STR(buf));
+}
+
+/* mail_queue_prev_path - path name in the previous layout */
+
+static const char *mail_queue_prev_path(VSTRING *buf, const char *queue_name,
+				                const char *queue_id)
+{
+    (void) mail_queue_hash_dir(buf, queue_name, queue_id,
+			       var_hash_queue_prev_depth);
+    vstring_strcat(buf, queue_id);
     return (STR(buf));
 }
 
@@ -205,6 +267,9 @@ const char *mail_queue_path(VSTRING *buf, const char *queue_name,
 			            const char *queue_id)
 {
     static VSTRING *private_buf = 0;
+    static VSTRING *prev_buf = 0;
+    struct stat st;
+    int     saved_errno;
 
     /*
      * Initialize.
@@ -218,8 +283,24 @@ const char *mail_queue_path(VSTRING *buf, const char *queue_name,
     /*
      * Append the queue id to the possibly hashed queue directory.
      */
-    (void) mail_queue_dir(buf, queue_name, queue_id);
-    vstring_strcat(buf, queue_id);
+    (void) mail_queue_new_path(buf, queue_name, queue_id);
+
+    /*
+     * While queue files are migrated to a different hashing depth, a file
+     * that does not exist in the current layout may still exist in the
+     * previous one. Don't clobber the caller's errno.
+     */
+    if (MAIL_QUEUE_MIGRATING(queue_name)) {
+	saved_errno = errno;
+	if (lstat(STR(buf), &st) < 0 && errno == ENOENT) {
+	    if (prev_buf == 0)
+		prev_buf = vstring_alloc(100);
+	    if (lstat(mail_queue_prev_path(prev_buf, queue_name,
+					   queue_id), &st) == 0)
+		vstring_strcpy(buf, STR(prev_buf));
+	}
+	errno = saved_errno;
+    }
     return (STR(buf));
 }
 
@@ -256,7 +337,15 @@ int     mail_queue_rename(const char *queue_id, const char *old_queue,
      * intermediate directories.
      */
     error = sane_rename(mail_queue_path(old_buf, old_queue, queue_id),
-			mail_queue_path(new_buf, new_queue, queue_id));
+		       mail_queue_new_path(new_buf, new_queue, queue_id));
+
+    /*
+     * The queue manager may have moved the file to the current layout after
+     * we found it in the previous one.
+     */
+    if (error != 0 && errno == ENOENT && MAIL_QUEUE_MIGRATING(old_queue))
+	error = sane_rename(mail_queue_path(old_buf, old_queue, queue_id),
+			    STR(new_buf));
     if (error != 0 && mail_queue_mkdirs(STR(new_buf)) == 0)
 	error = sane_rename(STR(old_buf), STR(new_buf));
 
@@ -273,7 +362,16 @@ int     mail_queue_rename(const char *queue_id, const char *old_queue,
 
 int     mail_queue_remove(const char *queue_name, const char *queue_id)
 {
-    return (REMOVE(mail_queue_path((VSTRING *) 0, queue_name, queue_id)));
+    int     error;
+
+    /*
+     * The queue manager may have moved the file to the current layout after
+     * we found it in the previous one.
+     */
+    error = REMOVE(mail_queue_path((VSTRING *) 0, queue_name, queue_id));
+    if (error != 0 && errno == ENOENT && MAIL_QUEUE_MIGRATING(queue_name))
+	error = REMOVE(mail_queue_path((VSTRING *) 0, queue_name, queue_id));
+    return (error);
 }
 
 /* mail_queue_name_ok - validate mail queue name */
@@ -400,7 +498,7 @@ VSTREAM *mail_queue_enter(const char *queue_name, mode_t mode,
 			    MQID_SH_ENCODE_USEC(usec_buf, tp->tv_usec),
 			    file_id);
 	}
-	mail_queue_path(path_buf, queue_name, STR(id_buf));
+	mail_queue_new_path(path_buf, queue_name, STR(id_buf));
 	if (sane_rename(STR(temp_path), STR(path_buf)) == 0)	/* success */
 	    break;
 	if (errno == EPERM || errno == EISDIR)	/* collision. weird. */
@@ -415,7 +513,9 @@ VSTREAM *mail_queue_enter(const char *queue_name, mode_t mode,
     }
 
     stream = vstream_fdopen(fd, O_RDWR);
-    vstream_control(stream, CA_VSTREAM_CTL_PATH(STR(path_buf)), CA_VSTREAM_CTL_END);
+    vstream_control(stream, CA_VSTREAM_CTL_PATH(STR(path_buf)),
+		    CA_VSTREAM_CTL_BUFSIZE_LIMIT(var_queue_file_bufsize),
+		    CA_VSTREAM_CTL_END);
     return (stream);
 }
 
@@ -424,16 +524,59 @@ VSTREAM *mail_queue_enter(const char *queue_name, mode_t mode,
 VSTREAM *mail_queue_open(const char *queue_name, const char *queue_id,
 			         int flags, mode_t mode)
 {
-    const char *path = mail_queue_path((VSTRING *) 0, queue_name, queue_id);
+    static VSTRING *path_buf;
+    static VSTRING *prev_buf;
+    const char *path;
+    struct stat st;
     VSTREAM *fp;
 
+    if (path_buf == 0) {
+	path_buf = vstring_alloc(100);
+	prev_buf = vstring_alloc(100);
+    }
+
     /*
-     * Try the operation. If file creation fails, see if it is because of a
-     * missing subdirectory.
+     * A file that may be created is always opened in the current layout,
+     * otherwise a logfile writer could re-create a file in the previous
+     * layout after the queue manager moved it. If the file still exists in
+     * the previous layout, move it into place first, so that we append to
+     * the existing file instead of starting a new one.
      */
-    if ((fp = vstream_fopen(path, flags, mode)) == 0)
-	if (errno == ENOENT)
-	    if ((flags & O_CREAT) == O_CREAT && mail_queue_mkdirs(path) == 0)
-		fp = vstream_fopen(path, flags, mode);
+    if ((flags & O_CREAT) == O_CREAT) {
+	path = mail_queue_new_path(path_buf, queue_name, queue_id);
+	if (MAIL_QUEUE_MIGRATING(queue_name)
+	    && lstat(path, &st) < 0 && errno == ENOENT
+	    && lstat(mail_queue_prev_path(prev_buf, queue_name,
+					  queue_id), &st) == 0
+	    && sane_rename(STR(prev_buf), path) < 0
+	    && (errno != ENOENT || mail_queue_mkdirs(path) < 0
+		|| sane_rename(STR(prev_buf), path) < 0)
+	    && errno != ENOENT)
+	    msg_warn("move %s to %s: %m", STR(prev_buf), path);
+
+	/*
+	 * Try the operation. If file creation fails, see if it is because of
+	 * a missing subdirectory.
+	 */
+	if ((fp = vstream_fopen(path, flags, mode)) == 0
+	    && errno == ENOENT && mail_queue_mkdirs(path) == 0)
+	    fp = vstream_fopen(path, flags, mode);
+    }
+
+    /*
+     * Otherwise, the queue manager may move the file to the current layout
+     * after we found it in the previous one. If so, look again.
+     */
+    else {
+	path = mail_queue_path(path_buf, queue_name, queue_id);
+	if ((fp = vstream_fopen(path, flags, mode)) == 0
+	    && errno == ENOENT && MAIL_QUEUE_MIGRATING(queue_name))
+	    fp = vstream_fopen(mail_queue_path(path_buf, queue_name,
+					       queue_id), flags, mode);
+    }
+    if (fp != 0)
+	vstream_control(fp,
+			CA_VSTREAM_CTL_BUFSIZE_LIMIT(var_queue_file_bufsize),
+			CA_VSTREAM_CTL_END);
     return (fp);
 }
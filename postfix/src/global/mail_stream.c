@@ -51,6 +51,8 @@
 /*	But it may take forever. The mode argument specifies additional
 /*	file permissions that will be OR-ed in when the file is finished.
 /*	While embryonic files have mode 0600, finished files have mode 0700.
+/*	At finish time, the file is written to stable storage with
+/*	mail_group_sync(3).
 /*
 /*	mail_stream_command() opens a mail stream to external command,
 /*	and receives queue ID information from the command. The result
@@ -96,6 +98,8 @@
 /*	file modification time stamp by this amount.  This has
 /*	effect only within the deferred mail queue.
 /*	This feature may have no effect with remote file systems.
+/* SEE ALSO
+/*	mail_group_sync(3), group commit for queue files
 /* LICENSE
 /* .ad
 /* .fi
@@ -137,6 +141,7 @@
 #include <mail_params.h>
 #include <mail_stream.h>
 #include <mail_parm_split.h>
+#include <mail_group_sync.h>
 
 /* Application-specific. */
 
@@ -237,6 +242,10 @@ static int mail_stream_finish_file(MAIL_STREAM *info, VSTRING *unused_why)
      * must end with an explicit END record. Postfix queue files without END
      * record are discarded.
      * 
+     * With group commit, the file is on stable storage when a syncfs() call
+     * that started after the fchmod() has completed. That call may be made
+     * by another process; see mail_group_sync(3).
+     * 
      * Attempt to detect file system clocks that are ahead of local time, but
      * don't check the file system clock all the time. The effect of file
      * system clock drift can be difficult to understand (Postfix ignores new
@@ -295,7 +304,7 @@ static int mail_stream_finish_file(MAIL_STREAM *info, VSTRING *unused_why)
 #endif
 	|| fchmod(vstream_fileno(info->stream), 0700 | info->mode)
 #ifdef HAS_FSYNC
-	|| fsync(vstream_fileno(info->stream))
+	|| mail_group_sync(vstream_fileno(info->stream))
 #endif
 	|| (check_incoming_fs_clock
 	    && fstat(vstream_fileno(info->stream), &st) < 0)
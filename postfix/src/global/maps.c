@@ -36,6 +36,9 @@
 /*	See dict_open(3) for a description of flags.
 /*	This includes the flags that specify preferences for search
 /*	string case folding.
+/*	Tables whose type is listed with the lookup_result_cache_types
+/*	configuration parameter are encapsulated with dict_memo(3),
+/*	unless the flags include DICT_FLAG_NO_CACHE.
 /*
 /*	maps_find() searches the specified list of dictionaries
 /*	in the specified order for the named key. The result is in
@@ -114,8 +117,28 @@
 /* Global library. */
 
 #include "mail_conf.h"
+#include "mail_params.h"
 #include "maps.h"
 
+/* maps_memo - add lookup result cache, if configured */
+
+static DICT *maps_memo(DICT *dict, int dict_flags)
+{
+    static ARGV *cache_types;
+    char  **cpp;
+
+    if (var_lookup_cache_size <= 0 || (dict_flags & DICT_FLAG_NO_CACHE))
+	return (dict);
+    if (cache_types == 0)
+	cache_types = argv_split(var_lookup_cache_types, CHARS_COMMA_SP);
+    for (cpp = cache_types->argv; *cpp; cpp++)
+	if (strcmp(*cpp, dict->type) == 0)
+	    return (dict_memo(dict, var_lookup_cache_size,
+			      var_lookup_cache_ttl,
+			      var_lookup_cache_neg_ttl));
+    return (dict);
+}
+
 /* maps_create - initialize */
 
 MAPS   *maps_create(const char *title, const char *map_names, int dict_flags)
@@ -153,7 +176,8 @@ MAPS   *maps_create(const char *title, const char *map_names, int dict_flags)
 			    map_type_name, OPEN_FLAGS,
 			    dict_flags_str(dict_flags));
 	    if ((dict = dict_handle(vstring_str(map_type_name_flags))) == 0)
-		dict = dict_open(map_type_name, OPEN_FLAGS, dict_flags);
+		dict = maps_memo(dict_open(map_type_name, OPEN_FLAGS,
+					   dict_flags), dict_flags);
 	    if ((dict->flags & dict_flags) != dict_flags)
 		msg_panic("%s: map %s has flags 0%o, want flags 0%o",
 			  myname, map_type_name, dict->flags, dict_flags);
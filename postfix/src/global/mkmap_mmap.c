@@ -0,0 +1,56 @@
+/*++
+/* NAME
+/*	mkmap_mmap 3
+/* SUMMARY
+/*	create or open database, mmap: style
+/* SYNOPSIS
+/*	#include <mkmap.h>
+/*
+/*	MKMAP	*mkmap_mmap_open(path)
+/*	const char *path;
+/* DESCRIPTION
+/*	This module implements support for creating memory-mapped
+/*	tables. The table is written as \fIpath\fR.mmap.tmp, and is
+/*	renamed to \fIpath\fR.mmap when it is closed.
+/*
+/*	All errors are fatal.
+/* SEE ALSO
+/*	dict_mmap(3), memory-mapped dictionary interface.
+/* LICENSE
+/* .ad
+/* .fi
+/*	The Secure Mailer license must be distributed with this software.
+/* AUTHOR(S)
+/*	Wietse Venema
+/*	Google, Inc.
+/*	111 8th Avenue
+/*	New York, NY 10011, USA
+/*--*/
+
+/* System library. */
+
+#include <sys_defs.h>
+
+/* Utility library. */
+
+#include <mymalloc.h>
+#include <dict.h>
+#include <dict_mmap.h>
+
+/* Application-specific. */
+
+#include <mkmap.h>
+
+ /*
+  * Dummy module: the dict_mmap module has all the functionality built-in,
+  * as the whole table is written when it is closed.
+  */
+MKMAP  *mkmap_mmap_open(const char *unused_path)
+{
+    MKMAP  *mkmap = (MKMAP *) mymalloc(sizeof(*mkmap));
+
+    mkmap->open = dict_mmap_open;
+    mkmap->after_open = 0;
+    mkmap->after_close = 0;
+    return (mkmap);
+}
@@ -97,6 +97,7 @@
 #include <dict_sdbm.h>
 #include <dict_proxy.h>
 #include <dict_fail.h>
+#include <dict_mmap.h>
 #include <sigdelay.h>
 #include <mymalloc.h>
 #include <stringops.h>
@@ -137,6 +138,7 @@ static const MKMAP_OPEN_INFO mkmap_open_info[] = {
     DICT_TYPE_BTREE, mkmap_btree_open,
 #endif
     DICT_TYPE_FAIL, mkmap_fail_open,
+    DICT_TYPE_MMAP, mkmap_mmap_open,
     0,
 };
 
@@ -17,6 +17,12 @@
 /*	ssize_t	maxsize;
 /*	int	flags;
 /*
+/*	int	rec_get_text(stream, buf, len, maxsize)
+/*	VSTREAM	*stream;
+/*	VSTRING	*buf;
+/*	ssize_t	*len;
+/*	ssize_t	maxsize;
+/*
 /*	int	rec_put(stream, type, data, len)
 /*	VSTREAM	*stream;
 /*	int	type;
@@ -92,6 +98,13 @@
 /*	enables the REC_FLAG_FOLLOW_PTR, REC_FLAG_SKIP_DTXT
 /*	and REC_FLAG_SEEK_END features.
 /*
+/*	rec_get_text() is like rec_get(), except that it does not
+/*	read the content of REC_TYPE_NORM and REC_TYPE_CONT records.
+/*	Instead, it stores the content length via the \fIlen\fR
+/*	argument, and the caller must consume exactly that many bytes
+/*	from the stream, for example with vstream_fcopy(), before
+/*	reading the next record.
+/*
 /*	REC_GET_HIDDEN_TYPE() is an unsafe macro that returns
 /*	non-zero when the specified record type is "not exposed"
 /*	by rec_get().
@@ -231,6 +244,74 @@ int     rec_put(VSTREAM *stream, int type, const char *data, ssize_t len)
     return (type);
 }
 
+/* rec_get_hdr - read record type and length */
+
+static int rec_get_hdr(VSTREAM *stream, ssize_t *lenp, ssize_t maxsize)
+{
+    int     type;
+    ssize_t len;
+    int     len_byte;
+    unsigned shift;
+
+    /*
+     * Extract the record type.
+     */
+    if ((type = VSTREAM_GETC(stream)) == VSTREAM_EOF)
+	return (REC_TYPE_EOF);
+
+    /*
+     * Find out the record data length. Return an error result when the
+     * record data length is malformed or when it exceeds the acceptable
+     * limit.
+     */
+    for (len = 0, shift = 0; /* void */ ; shift += 7) {
+	if (shift >= (int) (NBBY * sizeof(int))) {
+	    msg_warn("%s: too many length bits, record type %d",
+		     VSTREAM_PATH(stream), type);
+	    return (REC_TYPE_ERROR);
+	}
+	if ((len_byte = VSTREAM_GETC(stream)) == VSTREAM_EOF) {
+	    msg_warn("%s: unexpected EOF reading length, record type %d",
+		     VSTREAM_PATH(stream), type);
+	    return (REC_TYPE_ERROR);
+	}
+	len |= (len_byte & 0177) << shift;
+	if ((len_byte & 0200) == 0)
+	    break;
+    }
+    if (len < 0 || (maxsize > 0 && len > maxsize)) {
+	msg_warn("%s: illegal length %ld, record type %d",
+		 VSTREAM_PATH(stream), (long) len, type);
+	while (len-- > 0 && VSTREAM_GETC(stream) != VSTREAM_EOF)
+	     /* void */ ;
+	return (REC_TYPE_ERROR);
+    }
+    *lenp = len;
+    return (type);
+}
+
+/* rec_get_data - read record data */
+
+static int rec_get_data(VSTREAM *stream, int type, VSTRING *buf, ssize_t len)
+{
+    const char *myname = "rec_get";
+
+    /*
+     * Reserve buffer space for the result, and read the record data into
+     * the buffer.
+     */
+    if (vstream_fread_buf(stream, buf, len) != len) {
+	msg_warn("%s: unexpected EOF in data, record type %d length %ld",
+		 VSTREAM_PATH(stream), type, (long) len);
+	return (REC_TYPE_ERROR);
+    }
+    VSTRING_TERMINATE(buf);
+    if (msg_verbose > 2)
+	msg_info("%s: type %c len %ld data %.10s", myname,
+		 type, (long) len, vstring_str(buf));
+    return (type);
+}
+
 /* rec_get_raw - retrieve typed record */
 
 int     rec_get_raw(VSTREAM *stream, VSTRING *buf, ssize_t maxsize, int flags)
@@ -238,8 +319,6 @@ int     rec_get_raw(VSTREAM *stream, VSTRING *buf, ssize_t maxsize, int flags)
     const char *myname = "rec_get";
     int     type;
     ssize_t len;
-    int     len_byte;
-    unsigned shift;
 
     /*
      * Sanity check.
@@ -248,54 +327,9 @@ int     rec_get_raw(VSTREAM *stream, VSTRING *buf, ssize_t maxsize, int flags)
 	msg_panic("%s: bad record size limit: %ld", myname, (long) maxsize);
 
     for (;;) {
-
-	/*
-	 * Extract the record type.
-	 */
-	if ((type = VSTREAM_GETC(stream)) == VSTREAM_EOF)
-	    return (REC_TYPE_EOF);
-
-	/*
-	 * Find out the record data length. Return an error result when the
-	 * record data length is malformed or when it exceeds the acceptable
-	 * limit.
-	 */
-	for (len = 0, shift = 0; /* void */ ; shift += 7) {
-	    if (shift >= (int) (NBBY * sizeof(int))) {
-		msg_warn("%s: too many length bits, record type %d",
-			 VSTREAM_PATH(stream), type);
-		return (REC_TYPE_ERROR);
-	    }
-	    if ((len_byte = VSTREAM_GETC(stream)) == VSTREAM_EOF) {
-		msg_warn("%s: unexpected EOF reading length, record type %d",
-			 VSTREAM_PATH(stream), type);
-		return (REC_TYPE_ERROR);
-	    }
-	    len |= (len_byte & 0177) << shift;
-	    if ((len_byte & 0200) == 0)
-		break;
-	}
-	if (len < 0 || (maxsize > 0 && len > maxsize)) {
-	    msg_warn("%s: illegal length %ld, record type %d",
-		     VSTREAM_PATH(stream), (long) len, type);
-	    while (len-- > 0 && VSTREAM_GETC(stream) != VSTREAM_EOF)
-		 /* void */ ;
-	    return (REC_TYPE_ERROR);
-	}
-
-	/*
-	 * Reserve buffer space for the result, and read the record data into
-	 * the buffer.
-	 */
-	if (vstream_fread_buf(stream, buf, len) != len) {
-	    msg_warn("%s: unexpected EOF in data, record type %d length %ld",
-		     VSTREAM_PATH(stream), type, (long) len);
-	    return (REC_TYPE_ERROR);
-	}
-	VSTRING_TERMINATE(buf);
-	if (msg_verbose > 2)
-	    msg_info("%s: type %c len %ld data %.10s", myname,
-		     type, (long) len, vstring_str(buf));
+	if ((type = rec_get_hdr(stream, &len, maxsize)) < 0
+	    || (type = rec_get_data(stream, type, buf, len)) < 0)
+	    return (type);
 
 	/*
 	 * Transparency options.
@@ -318,6 +352,42 @@ int     rec_get_raw(VSTREAM *stream, VSTRING *buf, ssize_t maxsize, int flags)
     return (type);
 }
 
+/* rec_get_text - retrieve typed record, leave message text unread */
+
+int     rec_get_text(VSTREAM *stream, VSTRING *buf, ssize_t *lenp,
+		             ssize_t maxsize)
+{
+    const char *myname = "rec_get_text";
+    int     type;
+
+    /*
+     * Sanity check.
+     */
+    if (maxsize < 0)
+	msg_panic("%s: bad record size limit: %ld", myname, (long) maxsize);
+
+    for (;;) {
+	if ((type = rec_get_hdr(stream, lenp, maxsize)) < 0)
+	    return (type);
+	if (type == REC_TYPE_NORM || type == REC_TYPE_CONT)
+	    return (type);
+	if ((type = rec_get_data(stream, type, buf, *lenp)) < 0)
+	    return (type);
+	if (type == REC_TYPE_PTR
+	    && (type = rec_goto(stream, vstring_str(buf))) != REC_TYPE_ERROR)
+	    continue;
+	if (type == REC_TYPE_DTXT)
+	    continue;
+	if (type == REC_TYPE_END
+	    && vstream_fseek(stream, (off_t) 0, SEEK_END) < 0) {
+	    msg_warn("%s: seek error after reading END record: %m",
+		     VSTREAM_PATH(stream));
+	    return (REC_TYPE_ERROR);
+	}
+	return (type);
+    }
+}
+
 /* rec_goto - follow PTR record */
 
 int     rec_goto(VSTREAM *stream, const char *buf)
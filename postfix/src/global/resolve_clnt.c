@@ -28,8 +28,22 @@
 /*	const char *address;
 /*	RESOLVE_REPLY *reply;
 /*
+/*	void	resolve_clnt_query_batch(sender, count, addresses, replies)
+/*	const char *sender;
+/*	int	count;
+/*	const char **addresses;
+/*	RESOLVE_REPLY *replies;
+/*
+/*	void	resolve_clnt_verify_batch(sender, count, addresses, replies)
+/*	const char *sender;
+/*	int	count;
+/*	const char **addresses;
+/*	RESOLVE_REPLY *replies;
+/*
 /*	void	resolve_clnt_free(reply)
 /*	RESOLVE_REPLY *reply;
+/*
+/*	void	resolve_clnt_stat_log()
 /* DESCRIPTION
 /*	This module implements a mail address resolver client.
 /*
@@ -48,6 +62,24 @@
 /*	resolve_clnt_verify_from() implements an alternative version that can
 /*	be used for address verification.
 /*
+/*	resolve_clnt_query_batch() and resolve_clnt_verify_batch()
+/*	resolve an array of addresses with the same sender. The
+/*	replies argument is an array of initialized reply structures,
+/*	one per address. Addresses that are not cached are sent to
+/*	the resolver daemon in pipelined batches of up to
+/*	RESOLVE_BATCH_LIMIT requests, so that the cost of an IPC round
+/*	trip is shared by all addresses in a batch.
+/*
+/*	Results are kept in a per-process LRU cache that is keyed on
+/*	the request class, sender and address. The cache holds at
+/*	most $resolve_client_cache_size entries, and entries expire
+/*	after $resolve_client_cache_ttl. A zero cache size disables
+/*	the cache.
+/*
+/*	resolve_clnt_stat_log() logs the number of cache hits and
+/*	misses since the previous call, if any, and resets the
+/*	counters. This is typically called when a process terminates.
+/*
 /*	In the resolver reply, the flags member is the bit-wise OR of
 /*	zero or more of the following:
 /* .IP RESOLVE_FLAG_FINAL
@@ -88,8 +120,16 @@
 /*	cases where the local machine is the final destination.
 /* DIAGNOSTICS
 /*	Warnings: communication failure. Fatal error: mail system is down.
+/* CONFIGURATION PARAMETERS
+/* .ad
+/* .fi
+/* .IP "resolve_client_cache_size (1000)"
+/*	The maximal number of cached resolver results.
+/* .IP "resolve_client_cache_ttl (30s)"
+/*	The time after which a cached resolver result expires.
 /* SEE ALSO
 /*	mail_proto(3h) low-level mail component glue.
+/*	ctable(3) LRU cache manager
 /* LICENSE
 /* .ad
 /* .fi
@@ -121,6 +161,8 @@
 #include <vstring_vstream.h>
 #include <events.h>
 #include <iostuff.h>
+#include <mymalloc.h>
+#include <ctable.h>
 
 /* Global library. */
 
@@ -136,11 +178,36 @@
   */
 extern CLNT_STREAM *rewrite_clnt_stream;
 
-static time_t last_expire;
-static VSTRING *last_class;
-static VSTRING *last_sender;
-static VSTRING *last_addr;
-static RESOLVE_REPLY last_reply;
+ /*
+  * The resolver cache. Cache keys are the request class, sender and address,
+  * separated by newline characters. Lookups and updates pass the caller's
+  * result buffer to the ctable(3) call-backs through the cache context.
+  */
+typedef struct {
+    int     mode;			/* see below */
+    const RESOLVE_REPLY *reply;		/* caller result */
+} RESOLVE_CLNT_CTX;
+
+#define RESOLVE_CLNT_CACHE_PEEK	0	/* miss: add expired placeholder */
+#define RESOLVE_CLNT_CACHE_SAVE	1	/* save caller result */
+
+typedef struct {
+    time_t  expire;			/* entry expiration time */
+    RESOLVE_REPLY reply;		/* cached result */
+} RESOLVE_CLNT_ENTRY;
+
+static CTABLE *resolve_clnt_cache;
+static VSTRING *resolve_clnt_key;
+static int resolve_clnt_hits;
+static int resolve_clnt_miss;
+
+#define RESOLVE_CLNT_KEY_SEP	'\n'
+
+#define RESOLVE_CLNT_CACHEABLE(sender, addr) \
+	(var_resolve_cache_size > 0 && *(addr) != 0 \
+	 && strchr((sender), RESOLVE_CLNT_KEY_SEP) == 0)
+
+#define STR vstring_str
 
 /* resolve_clnt_init - initialize reply */
 
@@ -152,63 +219,130 @@ void    resolve_clnt_init(RESOLVE_REPLY *reply)
     reply->flags = 0;
 }
 
-/* resolve_clnt - resolve address to (transport, next hop, recipient) */
+/* resolve_clnt_copy - copy resolver result */
 
-void    resolve_clnt(const char *class, const char *sender,
-		             const char *addr, RESOLVE_REPLY *reply)
+static void resolve_clnt_copy(RESOLVE_REPLY *dst, const RESOLVE_REPLY *src)
 {
-    const char *myname = "resolve_clnt";
-    VSTREAM *stream;
-    int     server_flags;
-    int     count = 0;
+    vstring_strcpy(dst->transport, STR(src->transport));
+    vstring_strcpy(dst->nexthop, STR(src->nexthop));
+    vstring_strcpy(dst->recipient, STR(src->recipient));
+    dst->flags = src->flags;
+}
 
-    /*
-     * One-entry cache.
-     */
-    if (last_addr == 0) {
-	last_class = vstring_alloc(10);
-	last_sender = vstring_alloc(10);
-	last_addr = vstring_alloc(100);
-	resolve_clnt_init(&last_reply);
+/* resolve_clnt_trace - log resolver result */
+
+static void resolve_clnt_trace(const char *myname, const char *how,
+			               const char *sender, const char *addr,
+			               const RESOLVE_REPLY *reply)
+{
+#define IFSET(flag, text) ((reply->flags & (flag)) ? (text) : "")
+
+    msg_info("%s: %s`%s' -> `%s' -> transp=`%s' host=`%s' rcpt=`%s' flags=%s%s%s%s class=%s%s%s%s%s",
+	     myname, how, sender, addr, STR(reply->transport),
+	     STR(reply->nexthop), STR(reply->recipient),
+	     IFSET(RESOLVE_FLAG_FINAL, "final"),
+	     IFSET(RESOLVE_FLAG_ROUTED, "routed"),
+	     IFSET(RESOLVE_FLAG_ERROR, "error"),
+	     IFSET(RESOLVE_FLAG_FAIL, "fail"),
+	     IFSET(RESOLVE_CLASS_LOCAL, "local"),
+	     IFSET(RESOLVE_CLASS_ALIAS, "alias"),
+	     IFSET(RESOLVE_CLASS_VIRTUAL, "virtual"),
+	     IFSET(RESOLVE_CLASS_RELAY, "relay"),
+	     IFSET(RESOLVE_CLASS_DEFAULT, "default"));
+}
+
+/* resolve_clnt_pagein - create cache entry */
+
+static void *resolve_clnt_pagein(const char *unused_key, void *context)
+{
+    RESOLVE_CLNT_CTX *ctx = (RESOLVE_CLNT_CTX *) context;
+    RESOLVE_CLNT_ENTRY *entry;
+
+    entry = (RESOLVE_CLNT_ENTRY *) mymalloc(sizeof(*entry));
+    resolve_clnt_init(&entry->reply);
+    if (ctx->mode == RESOLVE_CLNT_CACHE_SAVE) {
+	resolve_clnt_copy(&entry->reply, ctx->reply);
+	entry->expire = time((time_t *) 0) + var_resolve_cache_ttl;
+    } else {
+	entry->expire = 0;
     }
+    return ((void *) entry);
+}
 
-    /*
-     * Sanity check. The result must not clobber the input because we may
-     * have to retransmit the request.
-     */
-#define STR vstring_str
+/* resolve_clnt_pageout - destroy cache entry */
 
-    if (addr == STR(reply->recipient))
-	msg_panic("%s: result clobbers input", myname);
+static void resolve_clnt_pageout(void *data, void *unused_context)
+{
+    RESOLVE_CLNT_ENTRY *entry = (RESOLVE_CLNT_ENTRY *) data;
 
-    /*
-     * Peek at the cache.
-     */
-#define IFSET(flag, text) ((reply->flags & (flag)) ? (text) : "")
+    resolve_clnt_free(&entry->reply);
+    myfree((void *) entry);
+}
 
-    if (time((time_t *) 0) < last_expire
-	&& *addr && strcmp(addr, STR(last_addr)) == 0
-	&& strcmp(class, STR(last_class)) == 0
-	&& strcmp(sender, STR(last_sender)) == 0) {
-	vstring_strcpy(reply->transport, STR(last_reply.transport));
-	vstring_strcpy(reply->nexthop, STR(last_reply.nexthop));
-	vstring_strcpy(reply->recipient, STR(last_reply.recipient));
-	reply->flags = last_reply.flags;
-	if (msg_verbose)
-	    msg_info("%s: cached: `%s' -> `%s' -> transp=`%s' host=`%s' rcpt=`%s' flags=%s%s%s%s class=%s%s%s%s%s",
-		     myname, sender, addr, STR(reply->transport),
-		     STR(reply->nexthop), STR(reply->recipient),
-		     IFSET(RESOLVE_FLAG_FINAL, "final"),
-		     IFSET(RESOLVE_FLAG_ROUTED, "routed"),
-		     IFSET(RESOLVE_FLAG_ERROR, "error"),
-		     IFSET(RESOLVE_FLAG_FAIL, "fail"),
-		     IFSET(RESOLVE_CLASS_LOCAL, "local"),
-		     IFSET(RESOLVE_CLASS_ALIAS, "alias"),
-		     IFSET(RESOLVE_CLASS_VIRTUAL, "virtual"),
-		     IFSET(RESOLVE_CLASS_RELAY, "relay"),
-		     IFSET(RESOLVE_CLASS_DEFAULT, "default"));
-	return;
+/* resolve_clnt_cache_key - format cache key */
+
+static const char *resolve_clnt_cache_key(const char *class,
+					          const char *sender,
+					          const char *addr)
+{
+    if (resolve_clnt_cache == 0) {
+	resolve_clnt_cache = ctable_create(var_resolve_cache_size,
+					   resolve_clnt_pagein,
+					   resolve_clnt_pageout, (void *) 0);
+	resolve_clnt_key = vstring_alloc(100);
     }
+    vstring_sprintf(resolve_clnt_key, "%s%c%s%c%s",
+		    class, RESOLVE_CLNT_KEY_SEP, sender,
+		    RESOLVE_CLNT_KEY_SEP, addr);
+    return (STR(resolve_clnt_key));
+}
+
+/* resolve_clnt_cache_find - look up unexpired result */
+
+static int resolve_clnt_cache_find(const char *class, const char *sender,
+				           const char *addr, RESOLVE_REPLY *reply)
+{
+    const char *key = resolve_clnt_cache_key(class, sender, addr);
+    const RESOLVE_CLNT_ENTRY *entry;
+    RESOLVE_CLNT_CTX ctx;
+
+    ctx.mode = RESOLVE_CLNT_CACHE_PEEK;
+    ctx.reply = reply;
+    ctable_newcontext(resolve_clnt_cache, (void *) &ctx);
+    entry = (const RESOLVE_CLNT_ENTRY *) ctable_locate(resolve_clnt_cache, key);
+    if (entry->expire <= time((time_t *) 0)) {
+	resolve_clnt_miss += 1;
+	return (0);
+    }
+    resolve_clnt_hits += 1;
+    resolve_clnt_copy(reply, &entry->reply);
+    return (1);
+}
+
+/* resolve_clnt_cache_save - save result */
+
+static void resolve_clnt_cache_save(const char *class, const char *sender,
+				            const char *addr,
+				            const RESOLVE_REPLY *reply)
+{
+    const char *key = resolve_clnt_cache_key(class, sender, addr);
+    RESOLVE_CLNT_CTX ctx;
+
+    ctx.mode = RESOLVE_CLNT_CACHE_SAVE;
+    ctx.reply = reply;
+    ctable_newcontext(resolve_clnt_cache, (void *) &ctx);
+    (void) ctable_refresh(resolve_clnt_cache, key);
+}
+
+/* resolve_clnt_query - one resolver round trip */
+
+static void resolve_clnt_query(const char *class, const char *sender,
+			               const char *addr, RESOLVE_REPLY *reply)
+{
+    const char *myname = "resolve_clnt";
+    VSTREAM *stream;
+    int     server_flags;
+    int     count = 0;
 
     /*
      * Keep trying until we get a complete response. The resolve service is
@@ -243,18 +377,7 @@ void    resolve_clnt(const char *class, const char *sender,
 			 var_rewrite_service);
 	} else {
 	    if (msg_verbose)
-		msg_info("%s: `%s' -> `%s' -> transp=`%s' host=`%s' rcpt=`%s' flags=%s%s%s%s class=%s%s%s%s%s",
-			 myname, sender, addr, STR(reply->transport),
-			 STR(reply->nexthop), STR(reply->recipient),
-			 IFSET(RESOLVE_FLAG_FINAL, "final"),
-			 IFSET(RESOLVE_FLAG_ROUTED, "routed"),
-			 IFSET(RESOLVE_FLAG_ERROR, "error"),
-			 IFSET(RESOLVE_FLAG_FAIL, "fail"),
-			 IFSET(RESOLVE_CLASS_LOCAL, "local"),
-			 IFSET(RESOLVE_CLASS_ALIAS, "alias"),
-			 IFSET(RESOLVE_CLASS_VIRTUAL, "virtual"),
-			 IFSET(RESOLVE_CLASS_RELAY, "relay"),
-			 IFSET(RESOLVE_CLASS_DEFAULT, "default"));
+		resolve_clnt_trace(myname, "", sender, addr, reply);
 	    /* Server-requested disconnect. */
 	    if (server_flags != 0)
 		clnt_stream_recover(rewrite_clnt_stream);
@@ -268,18 +391,187 @@ void    resolve_clnt(const char *class, const char *sender,
 	sleep(1);				/* XXX make configurable */
 	clnt_stream_recover(rewrite_clnt_stream);
     }
+}
+
+/* resolve_clnt_batch_query - one pipelined resolver round trip */
+
+static void resolve_clnt_batch_query(const char *class, const char *sender,
+				             int count, const char **addr,
+				             RESOLVE_REPLY **reply)
+{
+    const char *myname = "resolve_clnt_batch";
+    const char *request;
+    VSTREAM *stream;
+    int     server_flags;
+    int     disconnect;
+    int     status;
+    int     tries = 0;
+    int     n;
+
+    request = (strcmp(class, RESOLVE_VERIFY) == 0 ?
+	       RESOLVE_VERIFY_BATCH : RESOLVE_REGULAR_BATCH);
 
     /*
-     * Update the cache.
+     * Send all requests, then receive all replies. The server reads the
+     * entire batch before it replies, so this cannot deadlock. Keep trying
+     * until we get a complete response for every address.
      */
-    vstring_strcpy(last_class, class);
-    vstring_strcpy(last_sender, sender);
-    vstring_strcpy(last_addr, addr);
-    vstring_strcpy(last_reply.transport, STR(reply->transport));
-    vstring_strcpy(last_reply.nexthop, STR(reply->nexthop));
-    vstring_strcpy(last_reply.recipient, STR(reply->recipient));
-    last_reply.flags = reply->flags;
-    last_expire = time((time_t *) 0) + 30;	/* XXX make configurable */
+    if (rewrite_clnt_stream == 0)
+	rewrite_clnt_stream = clnt_stream_create(MAIL_CLASS_PRIVATE,
+						 var_rewrite_service,
+						 var_ipc_idle_limit,
+						 var_ipc_ttl_limit);
+
+    for (;;) {
+	stream = clnt_stream_access(rewrite_clnt_stream);
+	errno = 0;
+	tries += 1;
+	disconnect = 0;
+	status = attr_print(stream, ATTR_FLAG_NONE,
+			    SEND_ATTR_STR(MAIL_ATTR_REQ, request),
+			    SEND_ATTR_STR(MAIL_ATTR_SENDER, sender),
+			    SEND_ATTR_INT(MAIL_ATTR_NREQ, count),
+			    ATTR_TYPE_END);
+	for (n = 0; status == 0 && n < count; n++)
+	    status = attr_print(stream, ATTR_FLAG_NONE,
+				SEND_ATTR_STR(MAIL_ATTR_ADDR, addr[n]),
+				ATTR_TYPE_END);
+	if (status == 0)
+	    status = vstream_fflush(stream);
+	for (n = 0; status == 0 && n < count; n++) {
+	    if (attr_scan(stream, ATTR_FLAG_STRICT,
+			  RECV_ATTR_INT(MAIL_ATTR_FLAGS, &server_flags),
+		    RECV_ATTR_STR(MAIL_ATTR_TRANSPORT, reply[n]->transport),
+		      RECV_ATTR_STR(MAIL_ATTR_NEXTHOP, reply[n]->nexthop),
+		       RECV_ATTR_STR(MAIL_ATTR_RECIP, reply[n]->recipient),
+			  RECV_ATTR_INT(MAIL_ATTR_FLAGS, &reply[n]->flags),
+			  ATTR_TYPE_END) != 5)
+		status = -1;
+	    else if (server_flags != 0)
+		disconnect = 1;
+	}
+	if (status != 0) {
+	    if (msg_verbose || tries > 1 || (errno && errno != EPIPE && errno != ENOENT))
+		msg_warn("problem talking to service %s: %m",
+			 var_rewrite_service);
+	} else {
+	    /* Server-requested disconnect. */
+	    if (disconnect)
+		clnt_stream_recover(rewrite_clnt_stream);
+	    for (n = 0; n < count; n++) {
+		if (msg_verbose)
+		    resolve_clnt_trace(myname, "", sender, addr[n], reply[n]);
+		if (STR(reply[n]->transport)[0] == 0) {
+		    msg_warn("%s: null transport result for: <%s>",
+			     myname, addr[n]);
+		    break;
+		} else if (STR(reply[n]->recipient)[0] == 0 && *addr[n] != 0) {
+		    msg_warn("%s: null recipient result for: <%s>",
+			     myname, addr[n]);
+		    break;
+		}
+	    }
+	    if (n == count)
+		break;
+	}
+	sleep(1);				/* XXX make configurable */
+	clnt_stream_recover(rewrite_clnt_stream);
+    }
+}
+
+/* resolve_clnt - resolve address to (transport, next hop, recipient) */
+
+void    resolve_clnt(const char *class, const char *sender,
+		             const char *addr, RESOLVE_REPLY *reply)
+{
+    const char *myname = "resolve_clnt";
+
+    /*
+     * Sanity check. The result must not clobber the input because we may
+     * have to retransmit the request.
+     */
+    if (addr == STR(reply->recipient))
+	msg_panic("%s: result clobbers input", myname);
+
+    /*
+     * Peek at the cache. Empty addresses, and senders that would make the
+     * cache key ambiguous, bypass the cache.
+     */
+    if (!RESOLVE_CLNT_CACHEABLE(sender, addr)) {
+	resolve_clnt_query(class, sender, addr, reply);
+    } else if (resolve_clnt_cache_find(class, sender, addr, reply)) {
+	if (msg_verbose)
+	    resolve_clnt_trace(myname, "cached: ", sender, addr, reply);
+    } else {
+	resolve_clnt_query(class, sender, addr, reply);
+	resolve_clnt_cache_save(class, sender, addr, reply);
+    }
+}
+
+/* resolve_clnt_batch - resolve multiple addresses */
+
+void    resolve_clnt_batch(const char *class, const char *sender, int count,
+			           const char **addr, RESOLVE_REPLY *reply)
+{
+    const char *myname = "resolve_clnt_batch";
+    const char **miss_addr;
+    RESOLVE_REPLY **miss_reply;
+    int     miss_count = 0;
+    int     chunk;
+    int     n;
+
+    if (count <= 0)
+	return;
+
+    /*
+     * Answer what we can from the cache, and collect the misses.
+     */
+    miss_addr = (const char **) mymalloc(sizeof(*miss_addr) * count);
+    miss_reply = (RESOLVE_REPLY **) mymalloc(sizeof(*miss_reply) * count);
+    for (n = 0; n < count; n++) {
+	if (addr[n] == STR(reply[n].recipient))
+	    msg_panic("%s: result clobbers input", myname);
+	if (RESOLVE_CLNT_CACHEABLE(sender, addr[n])
+	    && resolve_clnt_cache_find(class, sender, addr[n], reply + n)) {
+	    if (msg_verbose)
+		resolve_clnt_trace(myname, "cached: ", sender, addr[n],
+				   reply + n);
+	    continue;
+	}
+	miss_addr[miss_count] = addr[n];
+	miss_reply[miss_count] = reply + n;
+	miss_count += 1;
+    }
+
+    /*
+     * Resolve the misses in batches of bounded size.
+     */
+    for (n = 0; n < miss_count; n += chunk) {
+	chunk = miss_count - n;
+	if (chunk > RESOLVE_BATCH_LIMIT)
+	    chunk = RESOLVE_BATCH_LIMIT;
+	resolve_clnt_batch_query(class, sender, chunk, miss_addr + n,
+				 miss_reply + n);
+    }
+    for (n = 0; n < miss_count; n++)
+	if (RESOLVE_CLNT_CACHEABLE(sender, miss_addr[n]))
+	    resolve_clnt_cache_save(class, sender, miss_addr[n],
+				    miss_reply[n]);
+    myfree((void *) miss_addr);
+    myfree((void *) miss_reply);
+}
+
+/* resolve_clnt_stat_log - log and reset cache statistics */
+
+void    resolve_clnt_stat_log(void)
+{
+    if (resolve_clnt_hits || resolve_clnt_miss) {
+	msg_info("statistics: address resolver cache hits=%d miss=%d success=%d%%",
+		 resolve_clnt_hits, resolve_clnt_miss,
+		 (int) (resolve_clnt_hits * 100.0
+			/ ((double) resolve_clnt_hits + resolve_clnt_miss)));
+	resolve_clnt_hits = resolve_clnt_miss = 0;
+    }
 }
 
 /* resolve_clnt_free - destroy reply */
@@ -391,6 +683,7 @@ int     main(int argc, char **argv)
 	vstring_free(buffer);
     }
     resolve_clnt_free(&reply);
+    resolve_clnt_stat_log();
     exit(0);
 }
 
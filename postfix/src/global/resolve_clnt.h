@@ -21,6 +21,10 @@
   */
 #define RESOLVE_REGULAR	"resolve"
 #define RESOLVE_VERIFY	"verify"
+#define RESOLVE_REGULAR_BATCH	"resolve_batch"
+#define RESOLVE_VERIFY_BATCH	"verify_batch"
+
+#define RESOLVE_BATCH_LIMIT	100	/* max requests per batch */
 
 #define RESOLVE_FLAG_FINAL	(1<<0)	/* final delivery */
 #define RESOLVE_FLAG_ROUTED	(1<<1)	/* routed destination */
@@ -49,7 +53,10 @@ typedef struct RESOLVE_REPLY {
 
 extern void resolve_clnt_init(RESOLVE_REPLY *);
 extern void resolve_clnt(const char *, const char *, const char *, RESOLVE_REPLY *);
+extern void resolve_clnt_batch(const char *, const char *, int,
+			               const char **, RESOLVE_REPLY *);
 extern void resolve_clnt_free(RESOLVE_REPLY *);
+extern void resolve_clnt_stat_log(void);
 
 #define RESOLVE_NULL_FROM	""
 
@@ -57,6 +64,10 @@ extern void resolve_clnt_free(RESOLVE_REPLY *);
 	resolve_clnt(RESOLVE_REGULAR, (f), (a), (r))
 #define resolve_clnt_verify_from(f, a, r) \
 	resolve_clnt(RESOLVE_VERIFY, (f), (a), (r))
+#define resolve_clnt_query_batch(f, n, a, r) \
+	resolve_clnt_batch(RESOLVE_REGULAR, (f), (n), (a), (r))
+#define resolve_clnt_verify_batch(f, n, a, r) \
+	resolve_clnt_batch(RESOLVE_VERIFY, (f), (n), (a), (r))
 
 #define RESOLVE_CLNT_ASSIGN(reply, transport, nexthop, recipient) { \
 	(reply).transport = (transport); \
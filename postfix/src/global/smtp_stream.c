@@ -37,6 +37,11 @@
 /*	ssize_t	len;
 /*	VSTREAM *stream;
 /*
+/*	ssize_t	smtp_fcopy(src, len, stream)
+/*	VSTREAM	*src;
+/*	ssize_t	len;
+/*	VSTREAM *stream;
+/*
 /*	void	smtp_fread_buf(vp, len, stream)
 /*	VSTRING	*vp;
 /*	ssize_t	len;
@@ -111,6 +116,12 @@
 /*	Long strings are not broken. No CR LF is appended. The stream
 /*	is not flushed.
 /*
+/*	smtp_fcopy() is like smtp_fwrite(), but copies up to \fIlen\fR
+/*	bytes from the \fIsrc\fR stream buffer directly into the
+/*	named stream buffer. The result is the number of bytes copied;
+/*	a short count means that \fIsrc\fR had a read error or
+/*	end-of-file condition.
+/*
 /*	smtp_fread_buf() invokes vstream_fread_buf() to read the
 /*	specified number of unformatted bytes from the stream. The
 /*	result is not null-terminated. NOTE: do not skip calling
@@ -507,6 +518,32 @@ void    smtp_fread_buf(VSTRING *vp, ssize_t todo, VSTREAM *stream)
 	smtp_longjmp(stream, SMTP_ERR_EOF, "smtp_fread");
 }
 
+/* smtp_fcopy - copy unformatted bytes from stream to SMTP peer */
+
+ssize_t smtp_fcopy(VSTREAM *src, ssize_t todo, VSTREAM *stream)
+{
+    ssize_t done;
+
+    if (todo < 0)
+	msg_panic("smtp_fcopy: negative todo %ld", (long) todo);
+
+    /*
+     * Do the I/O, protected against timeout.
+     */
+    smtp_timeout_reset(stream);
+    done = vstream_fcopy(src, stream, todo);
+
+    /*
+     * See if there was a problem. A short count without a write error means
+     * that the source stream ran out of data.
+     */
+    if (vstream_ftimeout(stream))
+	smtp_longjmp(stream, SMTP_ERR_TIME, "smtp_fcopy");
+    if (vstream_ferror(stream))
+	smtp_longjmp(stream, SMTP_ERR_EOF, "smtp_fcopy");
+    return (done);
+}
+
 /* smtp_fputc - write to SMTP peer */
 
 void    smtp_fputc(int ch, VSTREAM *stream)
@@ -214,6 +214,7 @@
 #include <listen.h>
 #include <watchdog.h>
 #include <split_at.h>
+#include <dict.h>
 
 /* Global library. */
 
@@ -261,6 +262,7 @@ static NORETURN multi_server_exit(void)
 {
     if (multi_server_onexit)
 	multi_server_onexit(multi_server_name, multi_server_argv);
+    dict_memo_stat_log();
     exit(0);
 }
 
@@ -689,6 +691,12 @@ NORETURN multi_server_main(int argc, char **argv, MULTI_SERVER_FN service,...)
     if (redo_syslog_init)
 	msg_syslog_init(mail_task(var_procname), LOG_PID, LOG_FACILITY);
 
+    /*
+     * Optionally, save system calls when client connections are enabled
+     * and disabled for events; see events(3).
+     */
+    event_lazy_unregister = var_event_lazy_unreg;
+
     /*
      * Register higher-level dictionaries and initialize the support for
      * dynamically-loaded dictionarles.
@@ -897,8 +905,13 @@ NORETURN multi_server_main(int argc, char **argv, MULTI_SERVER_FN service,...)
      */
     if (var_idle_limit > 0)
 	event_request_timer(multi_server_timeout, (void *) 0, var_idle_limit);
+
+    /*
+     * Ask for exclusive wake-up, so that a connection request on a shared
+     * listen socket does not wake up every idle server process.
+     */
     for (fd = MASTER_LISTEN_FD; fd < MASTER_LISTEN_FD + socket_count; fd++) {
-	event_enable_read(fd, multi_server_accept, CAST_INT_TO_VOID_PTR(fd));
+	event_enable_read_excl(fd, multi_server_accept, CAST_INT_TO_VOID_PTR(fd));
 	close_on_exec(fd, CLOSE_ON_EXEC);
     }
     event_enable_read(MASTER_STATUS_FD, multi_server_abort, (void *) 0);
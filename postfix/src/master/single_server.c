@@ -196,6 +196,7 @@
 #include <listen.h>
 #include <watchdog.h>
 #include <split_at.h>
+#include <dict.h>
 
 /* Global library. */
 
@@ -239,6 +240,7 @@ static NORETURN single_server_exit(void)
 {
     if (single_server_onexit)
 	single_server_onexit(single_server_name, single_server_argv);
+    dict_memo_stat_log();
     exit(0);
 }
 
@@ -797,8 +799,13 @@ NORETURN single_server_main(int argc, char **argv, SINGLE_SERVER_FN service,...)
 	event_request_timer(single_server_timeout, (void *) 0, var_idle_limit);
     if (retire_me)
 	event_request_timer(single_server_retire, (void *) 0, retire_me);
+
+    /*
+     * Ask for exclusive wake-up, so that a connection request on a shared
+     * listen socket does not wake up every idle server process.
+     */
     for (fd = MASTER_LISTEN_FD; fd < MASTER_LISTEN_FD + socket_count; fd++) {
-	event_enable_read(fd, single_server_accept, CAST_INT_TO_VOID_PTR(fd));
+	event_enable_read_excl(fd, single_server_accept, CAST_INT_TO_VOID_PTR(fd));
 	close_on_exec(fd, CLOSE_ON_EXEC);
     }
     event_enable_read(MASTER_STATUS_FD, single_server_abort, (void *) 0);
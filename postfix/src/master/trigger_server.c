@@ -199,6 +199,7 @@
 #include <listen.h>
 #include <watchdog.h>
 #include <split_at.h>
+#include <dict.h>
 
 /* Global library. */
 
@@ -242,6 +243,7 @@ static NORETURN trigger_server_exit(void)
 {
     if (trigger_server_onexit)
 	trigger_server_onexit(trigger_server_name, trigger_server_argv);
+    dict_memo_stat_log();
     exit(0);
 }
 
@@ -133,6 +133,9 @@
 /*	A table that reliably fails all requests. The lookup table
 /*	name is used for logging only. This table exists to simplify
 /*	Postfix error tests.
+/* .IP \fBmmap\fR
+/*	The output is one file named \fIfile_name\fB.mmap\fR.
+/*	Postfix processes share this file through \fBmmap\fR(2).
 /* .IP \fBsdbm\fR
 /*	The output consists of two files, named \fIfile_name\fB.pag\fR and
 /*	\fIfile_name\fB.dir\fR.
@@ -173,7 +173,10 @@
 /*	hierarchy and remove subdirectories that are no longer needed.
 /*	File position rearrangements are necessary after a change in the
 /*	\fBhash_queue_names\fR and/or \fBhash_queue_depth\fR
-/*	configuration parameters.
+/*	configuration parameters. After a change in \fBhash_queue_depth\fR
+/*	only, set \fBhash_queue_previous_depth\fR to the old value
+/*	instead, and the queue manager(8) will move files while mail
+/*	is being delivered (Postfix 3.5 and later).
 /* .IP \(bu
 /*	Rename queue files created with "enable_long_queue_ids =
 /*	yes" to short names, for migration to Postfix <= 2.8.  The
@@ -1018,7 +1021,8 @@ static void super(const char **queues, int action)
 	     * bounce/defer logfiles.
 	     */
 	    if (action & ACTION_STRUCT) {
-		(void) mail_queue_path(wanted_path, queue_name, path);
+		(void) mail_queue_dir(wanted_path, queue_name, path);
+		vstring_strcat(wanted_path, path);
 		if (strcmp(STR(actual_path), STR(wanted_path)) != 0) {
 		    position_mismatch++;	/* before we fix */
 		    (void) postrename(STR(actual_path), STR(wanted_path));
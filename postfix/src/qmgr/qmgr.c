@@ -345,6 +345,31 @@
 /*	A transport-specific override for the default_transport_rate_delay
 /*	parameter value, where the initial \fItransport\fR in the parameter
 /*	name is the master.cf name of the message delivery transport.
+/* .PP
+/*	Available in Postfix version 3.5 and later:
+/* .IP "\fBqmgr_index_database (empty)\fR"
+/*	Optional index of the deferred queue with the next delivery
+/*	attempt time of each message, so that a deferred queue run
+/*	opens only messages that are due.
+/* .IP "\fBqmgr_index_rebuild_time (1h)\fR"
+/*	The time between rebuilds of the deferred queue index from
+/*	the deferred queue directory.
+/* .IP "\fBqmgr_deferred_heap (no)\fR"
+/*	Keep the deferred queue index in memory, ordered by next
+/*	delivery attempt time, and run the deferred queue when the
+/*	next message is due.
+/* .IP "\fBqmgr_incoming_notify (no)\fR"
+/*	On Linux systems, use inotify(7) to learn about new incoming
+/*	queue files, instead of scanning the incoming queue after
+/*	each wakeup request.
+/* .IP "\fBhash_queue_previous_depth (0)\fR"
+/*	The hash_queue_depth value before it was last changed; while
+/*	this is non-zero, queue files are looked up under both depths,
+/*	and the queue manager moves them to the current depth.
+/* .IP "\fBhash_queue_migration_limit (1000)\fR"
+/*	The maximal number of queue files that the queue manager
+/*	examines per second while it moves queue files to the current
+/*	hash_queue_depth.
 /* SAFETY CONTROLS
 /* .ad
 /* .fi
@@ -462,6 +487,7 @@
 #include <mail_proto.h>			/* QMGR_SCAN constants */
 #include <mail_flow.h>
 #include <flush_clnt.h>
+#include <resolve_clnt.h>
 
 /* Master process interface */
 
@@ -511,6 +537,11 @@ int     var_qmgr_daemon_timeout;
 int     var_qmgr_ipc_timeout;
 int     var_dsn_delay_cleared;
 int     var_vrfy_pend_limit;
+char   *var_qmgr_index_map;
+int     var_qmgr_index_rebuild;
+bool    var_qmgr_deferred_heap;
+bool    var_qmgr_in_notify;
+int     var_hash_queue_migr_limit;
 
 static QMGR_SCAN *qmgr_scans[2];
 
@@ -522,13 +553,21 @@ static QMGR_SCAN *qmgr_scans[2];
 
 static void qmgr_deferred_run_event(int unused_event, void *dummy)
 {
+    time_t  next;
+    int     delay = var_queue_run_delay;
 
     /*
      * This routine runs when it is time for another deferred queue scan.
-     * Make sure this routine gets called again in the future.
+     * Make sure this routine gets called again in the future. With an
+     * in-memory deferred queue index, wake up as soon as the next deferred
+     * message is due. Messages that are deferred later are due no sooner
+     * than $minimal_backoff_time, so they are no worse off than with
+     * periodic queue scans.
      */
     qmgr_scan_request(qmgr_scans[QMGR_SCAN_IDX_DEFERRED], QMGR_SCAN_START);
-    event_request_timer(qmgr_deferred_run_event, dummy, var_queue_run_delay);
+    if ((next = qmgr_index_next()) != 0 && next - event_time() < delay)
+	delay = (next > event_time() ? next - event_time() : 1);
+    event_request_timer(qmgr_deferred_run_event, dummy, delay);
 }
 
 /* qmgr_trigger_event - respond to external trigger(s) */
@@ -585,7 +624,13 @@ static void qmgr_trigger_event(char *buf, ssize_t len,
      * Process each request type at most once. Modifiers take effect upon the
      * next queue run. If no queue run is in progress, and a queue scan is
      * requested, the request takes effect immediately.
+     * 
+     * With incoming queue notification, new queue files are reported by the
+     * kernel, and a plain wakeup request does not need a queue scan.
      */
+    if (incoming_flag == QMGR_SCAN_START
+	&& qmgr_scans[QMGR_SCAN_IDX_INCOMING]->notify != 0)
+	incoming_flag = 0;
     if (incoming_flag != 0)
 	qmgr_scan_request(qmgr_scans[QMGR_SCAN_IDX_INCOMING], incoming_flag);
     if (deferred_flag != 0)
@@ -659,7 +704,8 @@ static int qmgr_loop(char *unused_name, char **unused_argv)
 	if (token_count < var_proc_limit) {
 	    if (feed != 0 && last_scan_idx == QMGR_SCAN_IDX_INCOMING)
 		mail_flow_put(1);
-	    else if (qmgr_scans[QMGR_SCAN_IDX_INCOMING]->handle == 0)
+	    else if (qmgr_scans[QMGR_SCAN_IDX_INCOMING]->handle == 0
+		     && !QMGR_SCAN_NOTIFIED(qmgr_scans[QMGR_SCAN_IDX_INCOMING]))
 		mail_flow_put(var_proc_limit - token_count);
 	} else if (token_count > var_proc_limit) {
 	    mail_flow_get(token_count - var_proc_limit);
@@ -680,11 +726,19 @@ static void pre_accept(char *unused_name, char **unused_argv)
     }
 }
 
+/* qmgr_exit - log statistics before terminating */
+
+static void qmgr_exit(char *unused_name, char **unused_argv)
+{
+    resolve_clnt_stat_log();
+}
+
 /* qmgr_pre_init - pre-jail initialization */
 
 static void qmgr_pre_init(char *unused_name, char **unused_argv)
 {
     flush_init();
+    qmgr_index_init();
 }
 
 /* qmgr_post_init - post-jail initialization */
@@ -736,6 +790,9 @@ static void qmgr_post_init(char *name, char **unused_argv)
     qmgr_move(MAIL_QUEUE_ACTIVE, MAIL_QUEUE_INCOMING, event_time());
     qmgr_scans[QMGR_SCAN_IDX_INCOMING] = qmgr_scan_create(MAIL_QUEUE_INCOMING);
     qmgr_scans[QMGR_SCAN_IDX_DEFERRED] = qmgr_scan_create(MAIL_QUEUE_DEFERRED);
+    if (var_qmgr_in_notify)
+	qmgr_notify_init(qmgr_scans[QMGR_SCAN_IDX_INCOMING]);
+    qmgr_rehash_init();
     qmgr_scan_request(qmgr_scans[QMGR_SCAN_IDX_INCOMING], QMGR_SCAN_START);
     qmgr_deferred_run_event(0, (void *) 0);
 }
@@ -751,6 +808,7 @@ int     main(int argc, char **argv)
 	VAR_CONC_POS_FDBACK, DEF_CONC_POS_FDBACK, &var_conc_pos_feedback, 1, 0,
 	VAR_CONC_NEG_FDBACK, DEF_CONC_NEG_FDBACK, &var_conc_neg_feedback, 1, 0,
 	VAR_DEF_FILTER_NEXTHOP, DEF_DEF_FILTER_NEXTHOP, &var_def_filter_nexthop, 0, 0,
+	VAR_QMGR_INDEX_MAP, DEF_QMGR_INDEX_MAP, &var_qmgr_index_map, 0, 0,
 	0,
     };
     static const CONFIG_TIME_TABLE time_table[] = {
@@ -761,6 +819,7 @@ int     main(int argc, char **argv)
 	VAR_DSN_QUEUE_TIME, DEF_DSN_QUEUE_TIME, &var_dsn_queue_time, 0, 8640000,
 	VAR_XPORT_RETRY_TIME, DEF_XPORT_RETRY_TIME, &var_transport_retry_time, 1, 0,
 	VAR_QMGR_CLOG_WARN_TIME, DEF_QMGR_CLOG_WARN_TIME, &var_qmgr_clog_warn_time, 0, 0,
+	VAR_QMGR_INDEX_REBUILD, DEF_QMGR_INDEX_REBUILD, &var_qmgr_index_rebuild, 1, 0,
 	VAR_XPORT_REFILL_DELAY, DEF_XPORT_REFILL_DELAY, &var_xport_refill_delay, 1, 0,
 	VAR_XPORT_RATE_DELAY, DEF_XPORT_RATE_DELAY, &var_xport_rate_delay, 0, 0,
 	VAR_DEST_RATE_DELAY, DEF_DEST_RATE_DELAY, &var_dest_rate_delay, 0, 0,
@@ -786,12 +845,15 @@ int     main(int argc, char **argv)
 	VAR_LOCAL_CON_LIMIT, DEF_LOCAL_CON_LIMIT, &var_local_con_lim, 0, 0,
 	VAR_CONC_COHORT_LIM, DEF_CONC_COHORT_LIM, &var_conc_cohort_limit, 0, 0,
 	VAR_VRFY_PEND_LIMIT, DEF_VRFY_PEND_LIMIT, &var_vrfy_pend_limit, 1, 0,
+	VAR_HASH_QUEUE_MIGR_LIMIT, DEF_HASH_QUEUE_MIGR_LIMIT, &var_hash_queue_migr_limit, 1, 0,
 	0,
     };
     static const CONFIG_BOOL_TABLE bool_table[] = {
 	VAR_VERP_BOUNCE_OFF, DEF_VERP_BOUNCE_OFF, &var_verp_bounce_off,
 	VAR_CONC_FDBACK_DEBUG, DEF_CONC_FDBACK_DEBUG, &var_conc_feedback_debug,
 	VAR_DSN_DELAY_CLEARED, DEF_DSN_DELAY_CLEARED, &var_dsn_delay_cleared,
+	VAR_QMGR_DEFERRED_HEAP, DEF_QMGR_DEFERRED_HEAP, &var_qmgr_deferred_heap,
+	VAR_QMGR_IN_NOTIFY, DEF_QMGR_IN_NOTIFY, &var_qmgr_in_notify,
 	0,
     };
 
@@ -814,6 +876,7 @@ int     main(int argc, char **argv)
 			CA_MAIL_SERVER_POST_INIT(qmgr_post_init),
 			CA_MAIL_SERVER_LOOP(qmgr_loop),
 			CA_MAIL_SERVER_PRE_ACCEPT(pre_accept),
+			CA_MAIL_SERVER_EXIT(qmgr_exit),
 			CA_MAIL_SERVER_SOLITARY,
 			CA_MAIL_SERVER_WATCHDOG(&var_qmgr_daemon_timeout),
 			0);
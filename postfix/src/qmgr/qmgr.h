@@ -19,6 +19,8 @@
   */
 #include <vstream.h>
 #include <scan_dir.h>
+#include <argv.h>
+#include <arena.h>
 
  /*
   * Global library.
@@ -339,6 +341,7 @@ struct QMGR_MESSAGE {
     long    warn_offset;		/* warning bounce flag offset */
     time_t  warn_time;			/* time next warning to be sent */
     long    data_offset;		/* data seek offset */
+    ARENA  *arena;			/* storage for strings below */
     char   *queue_name;			/* queue name */
     char   *queue_id;			/* queue file */
     char   *encoding;			/* content encoding */
@@ -497,8 +500,17 @@ struct QMGR_SCAN {
     int     flags;			/* private, this run */
     int     nflags;			/* private, next run */
     struct SCAN_DIR *handle;		/* scan */
+    int     indexed;			/* use deferred queue index */
+    ARGV   *due;			/* index scan */
+    ssize_t due_pos;			/* index scan position */
+    ARGV   *notify;			/* new queue files, see qmgr_notify */
+    ssize_t notify_pos;			/* next new queue file */
 };
 
+#define QMGR_SCAN_BUSY(s) ((s)->handle != 0 || (s)->due != 0)
+#define QMGR_SCAN_NOTIFIED(s) \
+	((s)->notify != 0 && (s)->notify_pos < (s)->notify->argc)
+
  /*
   * Flags that control queue scans or destination selection. These are
   * similar to the QMGR_REQ_XXX request codes.
@@ -515,6 +527,27 @@ struct QMGR_SCAN {
 extern QMGR_SCAN *qmgr_scan_create(const char *);
 extern void qmgr_scan_request(QMGR_SCAN *, int);
 extern char *qmgr_scan_next(QMGR_SCAN *);
+extern void qmgr_scan_notify(QMGR_SCAN *, const char *);
+
+ /*
+  * qmgr_notify.c
+  */
+extern void qmgr_notify_init(QMGR_SCAN *);
+
+ /*
+  * qmgr_index.c
+  */
+extern int qmgr_index_enabled;
+extern void qmgr_index_init(void);
+extern void qmgr_index_enter(const char *, time_t);
+extern void qmgr_index_delete(const char *);
+extern ARGV *qmgr_index_scan(void);
+extern time_t qmgr_index_next(void);
+
+ /*
+  * qmgr_rehash.c
+  */
+extern void qmgr_rehash_init(void);
 
  /*
   * qmgr_error.c
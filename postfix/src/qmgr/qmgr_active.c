@@ -31,7 +31,9 @@
 /* .IP QMGR_SCAN_ALL
 /*	Examine all queue files. Normally, deferred queue files with
 /*	future time stamps are ignored, and incoming queue files with
-/*	future time stamps are frowned upon.
+/*	future time stamps are frowned upon. Deferred queue files
+/*	that are ignored are recorded in the deferred queue index,
+/*	if one is used.
 /* .PP
 /*	qmgr_active_drain() allocates one delivery process.
 /*	Process allocation is asynchronous. Once the delivery
@@ -161,8 +163,11 @@ static void qmgr_active_defer(const char *queue_name, const char *queue_id,
 		      queue_id, queue_name, dest_queue);
 	msg_warn("%s: rename %s from %s to %s: %m", myname,
 		 queue_id, queue_name, dest_queue);
-    } else if (msg_verbose) {
-	msg_info("%s: defer %s", myname, queue_id);
+    } else {
+	if (strcmp(dest_queue, MAIL_QUEUE_DEFERRED) == 0)
+	    qmgr_index_enter(queue_id, tbuf.modtime);
+	if (msg_verbose)
+	    msg_info("%s: defer %s", myname, queue_id);
     }
 }
 
@@ -183,8 +188,11 @@ int     qmgr_active_feed(QMGR_SCAN *scan_info, const char *queue_id)
     /*
      * Make sure this is something we are willing to open.
      */
-    if (mail_open_ok(scan_info->queue, queue_id, &st, &path) == MAIL_OPEN_NO)
+    if (mail_open_ok(scan_info->queue, queue_id, &st, &path) == MAIL_OPEN_NO) {
+	if (scan_info->indexed)
+	    qmgr_index_delete(queue_id);
 	return (0);
+    }
 
     if (msg_verbose)
 	msg_info("%s: %s", myname, path);
@@ -198,12 +206,18 @@ int     qmgr_active_feed(QMGR_SCAN *scan_info, const char *queue_id)
 	if (msg_verbose)
 	    msg_info("%s: skip %s (%ld seconds)", myname, queue_id,
 		     (long) (st.st_mtime - event_time()));
+	if (scan_info->indexed)
+	    qmgr_index_enter(queue_id, st.st_mtime);
 	return (0);
     }
 
     /*
      * Move the message to the active queue. File access errors are fatal.
+     * The message leaves the deferred queue index, if any; it is entered
+     * again when delivery is deferred.
      */
+    if (scan_info->indexed)
+	qmgr_index_delete(queue_id);
     if (mail_queue_rename(queue_id, scan_info->queue, MAIL_QUEUE_ACTIVE)) {
 	if (errno != ENOENT)
 	    msg_fatal("%s: %s: rename from %s to %s: %m", myname,
@@ -0,0 +1,403 @@
+/*++
+/* NAME
+/*	qmgr_bench 1t
+/* SUMMARY
+/*	queue manager recipient assignment benchmark
+/* SYNOPSIS
+/*	qmgr_bench [-v] [-d domains] [-m messages] [-r recipients]
+/*		[-t transports] [directory]
+/* DESCRIPTION
+/*	qmgr_bench creates synthetic queue files in the \fBactive\fR
+/*	subdirectory of the specified directory (default: a new
+/*	directory under /tmp), and reads each file with
+/*	qmgr_message_alloc() as the queue manager would, including
+/*	recipient address resolution, assignment to destination
+/*	queues, and creation of delivery requests. The elapsed time
+/*	and the number of recipients per second are written to the
+/*	standard output.
+/*
+/*	Address resolution is simulated inside the benchmark process:
+/*	each recipient domain resolves to itself as next-hop
+/*	destination, so that the measurement is not dominated by
+/*	trivial-rewrite(8) round trips. Queue files are removed
+/*	afterwards.
+/*
+/*	Options:
+/* .IP "\fB-d \fIdomains\fR (default: 100)"
+/*	The number of different recipient domains per message.
+/* .IP "\fB-m \fImessages\fR (default: 10)"
+/*	The number of queue files.
+/* .IP "\fB-r \fIrecipients\fR (default: 50000)"
+/*	The number of recipients per queue file.
+/* .IP "\fB-t \fItransports\fR (default: 1)"
+/*	The number of different message delivery transports.
+/* .IP \fB-v\fR
+/*	Enable verbose logging.
+/* SEE ALSO
+/*	qmgr(8), queue manager
+/* LICENSE
+/* .ad
+/* .fi
+/*	The Secure Mailer license must be distributed with this software.
+/* AUTHOR(S)
+/*	Wietse Venema
+/*	IBM T.J. Watson Research
+/*	P.O. Box 704
+/*	Yorktown Heights, NY 10598, USA
+/*--*/
+
+/* System library. */
+
+#include <sys_defs.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+
+/* Utility library. */
+
+#include <msg.h>
+#include <msg_vstream.h>
+#include <mymalloc.h>
+#include <vstring.h>
+#include <vstream.h>
+#include <stringops.h>
+
+/* Global library. */
+
+#include <mail_params.h>
+#include <mail_version.h>
+#include <mail_conf.h>
+#include <mail_queue.h>
+#include <record.h>
+#include <rec_type.h>
+#include <resolve_clnt.h>
+
+/* Application-specific. */
+
+#include "qmgr.h"
+
+ /*
+  * Queue manager parameters, normally defined in qmgr.c.
+  */
+int     var_queue_run_delay;
+int     var_min_backoff_time;
+int     var_max_backoff_time;
+int     var_max_queue_time;
+int     var_dsn_queue_time;
+int     var_qmgr_active_limit;
+int     var_qmgr_rcpt_limit;
+int     var_qmgr_msg_rcpt_limit;
+int     var_xport_rcpt_limit;
+int     var_stack_rcpt_limit;
+int     var_xport_refill_limit;
+int     var_xport_refill_delay;
+int     var_delivery_slot_cost;
+int     var_delivery_slot_loan;
+int     var_delivery_slot_discount;
+int     var_min_delivery_slots;
+int     var_init_dest_concurrency;
+int     var_transport_retry_time;
+int     var_dest_con_limit;
+int     var_dest_rcpt_limit;
+char   *var_defer_xports;
+int     var_local_con_lim;
+int     var_local_rcpt_lim;
+bool    var_verp_bounce_off;
+int     var_qmgr_clog_warn_time;
+char   *var_conc_pos_feedback;
+char   *var_conc_neg_feedback;
+int     var_conc_cohort_limit;
+int     var_conc_feedback_debug;
+int     var_xport_rate_delay;
+int     var_dest_rate_delay;
+char   *var_def_filter_nexthop;
+int     var_vrfy_pend_limit;
+int     var_dsn_delay_cleared;
+char   *var_qmgr_index_map;
+int     var_qmgr_index_rebuild;
+bool    var_qmgr_deferred_heap;
+int     var_hash_queue_migr_limit;
+
+static int bench_transports = 1;
+
+#define STR	vstring_str
+
+/* resolve_clnt_init - initialize simulated reply */
+
+void    resolve_clnt_init(RESOLVE_REPLY *reply)
+{
+    reply->transport = vstring_alloc(100);
+    reply->nexthop = vstring_alloc(100);
+    reply->recipient = vstring_alloc(100);
+    reply->flags = 0;
+}
+
+/* resolve_clnt_free - destroy simulated reply */
+
+void    resolve_clnt_free(RESOLVE_REPLY *reply)
+{
+    reply->transport = vstring_free(reply->transport);
+    reply->nexthop = vstring_free(reply->nexthop);
+    reply->recipient = vstring_free(reply->recipient);
+}
+
+/* resolve_clnt - simulated address resolution */
+
+void    resolve_clnt(const char *unused_class, const char *unused_sender,
+		             const char *addr, RESOLVE_REPLY *reply)
+{
+    const char *domain;
+    int     n;
+
+    if ((domain = strrchr(addr, '@')) == 0)
+	msg_panic("resolve_clnt: no domain in %s", addr);
+    domain += 1;
+    n = (bench_transports > 1) ? atoi(domain + 1) % bench_transports : 0;
+    if (n == 0)
+	vstring_strcpy(reply->transport, "smtp");
+    else
+	vstring_sprintf(reply->transport, "smtp%d", n);
+    vstring_strcpy(reply->nexthop, domain);
+    vstring_strcpy(reply->recipient, addr);
+    reply->flags = RESOLVE_CLASS_DEFAULT;
+}
+
+/* resolve_clnt_batch - simulated batch address resolution */
+
+void    resolve_clnt_batch(const char *class, const char *sender, int count,
+		              const char **addr, RESOLVE_REPLY *reply)
+{
+    int     n;
+
+    for (n = 0; n < count; n++)
+	resolve_clnt(class, sender, addr[n], reply + n);
+}
+
+/* make_queue_file - create synthetic queue file */
+
+static void make_queue_file(const char *queue_id, int rcpt_count,
+			            int domain_count)
+{
+    VSTRING *path = vstring_alloc(100);
+    VSTREAM *fp;
+    long    data_offset;
+    long    xtra_offset;
+    int     n;
+
+#define BENCH_CONTENT	"Subject: benchmark"
+
+    mail_queue_path(path, MAIL_QUEUE_ACTIVE, queue_id);
+    if ((fp = vstream_fopen(STR(path), O_CREAT | O_TRUNC | O_RDWR, 0600)) == 0)
+	msg_fatal("open %s: %m", STR(path));
+    rec_fprintf(fp, REC_TYPE_SIZE, REC_TYPE_SIZE_FORMAT,
+		0L, 0L, (long) rcpt_count, 0L, 0L, 0L);
+    rec_fprintf(fp, REC_TYPE_TIME, REC_TYPE_TIME_FORMAT,
+		(long) time((time_t *) 0), 0L);
+    rec_fputs(fp, REC_TYPE_FROM, "sender@example.com");
+    for (n = 0; n < rcpt_count; n++)
+	rec_fprintf(fp, REC_TYPE_RCPT, "user%d@d%d.example",
+		    n, (n * 7919) % domain_count);
+    rec_fputs(fp, REC_TYPE_MESG, "");
+    data_offset = vstream_ftell(fp);
+    rec_fputs(fp, REC_TYPE_NORM, BENCH_CONTENT);
+    xtra_offset = vstream_ftell(fp);
+    rec_fputs(fp, REC_TYPE_XTRA, "");
+    rec_fputs(fp, REC_TYPE_END, "");
+
+    /*
+     * Update the fixed-width size and content pointer records.
+     */
+    if (vstream_fseek(fp, 0L, SEEK_SET) < 0)
+	msg_fatal("seek %s: %m", STR(path));
+    rec_fprintf(fp, REC_TYPE_SIZE, REC_TYPE_SIZE_FORMAT,
+		xtra_offset - data_offset, data_offset, (long) rcpt_count,
+		0L, (long) strlen(BENCH_CONTENT), 0L);
+    if (vstream_fseek(fp, data_offset, SEEK_SET) < 0)
+	msg_fatal("seek %s: %m", STR(path));
+    if (vstream_fclose(fp))
+	msg_fatal("write %s: %m", STR(path));
+    vstring_free(path);
+}
+
+/* usage - explain */
+
+static NORETURN usage(const char *myname)
+{
+    msg_fatal("usage: %s [-v] [-d domains] [-m messages] [-r recipients] "
+	      "[-t transports] [directory]", myname);
+}
+
+MAIL_VERSION_STAMP_DECLARE;
+
+/* main - benchmark driver */
+
+int     main(int argc, char **argv)
+{
+    static const CONFIG_STR_TABLE str_table[] = {
+	{VAR_DEFER_XPORTS, DEF_DEFER_XPORTS, &var_defer_xports, 0, 0},
+	{VAR_CONC_POS_FDBACK, DEF_CONC_POS_FDBACK, &var_conc_pos_feedback, 1, 0},
+	{VAR_CONC_NEG_FDBACK, DEF_CONC_NEG_FDBACK, &var_conc_neg_feedback, 1, 0},
+	{VAR_DEF_FILTER_NEXTHOP, DEF_DEF_FILTER_NEXTHOP, &var_def_filter_nexthop, 0, 0},
+	{VAR_QMGR_INDEX_MAP, DEF_QMGR_INDEX_MAP, &var_qmgr_index_map, 0, 0},
+	{0},
+    };
+    static const CONFIG_TIME_TABLE time_table[] = {
+	{VAR_QUEUE_RUN_DELAY, DEF_QUEUE_RUN_DELAY, &var_queue_run_delay, 1, 0},
+	{VAR_MIN_BACKOFF_TIME, DEF_MIN_BACKOFF_TIME, &var_min_backoff_time, 1, 0},
+	{VAR_MAX_BACKOFF_TIME, DEF_MAX_BACKOFF_TIME, &var_max_backoff_time, 1, 0},
+	{VAR_MAX_QUEUE_TIME, DEF_MAX_QUEUE_TIME, &var_max_queue_time, 0, 8640000},
+	{VAR_DSN_QUEUE_TIME, DEF_DSN_QUEUE_TIME, &var_dsn_queue_time, 0, 8640000},
+	{VAR_XPORT_RETRY_TIME, DEF_XPORT_RETRY_TIME, &var_transport_retry_time, 1, 0},
+	{VAR_QMGR_CLOG_WARN_TIME, DEF_QMGR_CLOG_WARN_TIME, &var_qmgr_clog_warn_time, 0, 0},
+	{VAR_XPORT_REFILL_DELAY, DEF_XPORT_REFILL_DELAY, &var_xport_refill_delay, 1, 0},
+	{VAR_XPORT_RATE_DELAY, DEF_XPORT_RATE_DELAY, &var_xport_rate_delay, 0, 0},
+	{VAR_DEST_RATE_DELAY, DEF_DEST_RATE_DELAY, &var_dest_rate_delay, 0, 0},
+	{VAR_QMGR_INDEX_REBUILD, DEF_QMGR_INDEX_REBUILD, &var_qmgr_index_rebuild, 1, 0},
+	{0},
+    };
+    static const CONFIG_INT_TABLE int_table[] = {
+	{VAR_QMGR_ACT_LIMIT, DEF_QMGR_ACT_LIMIT, &var_qmgr_active_limit, 1, 0},
+	{VAR_XPORT_RCPT_LIMIT, DEF_XPORT_RCPT_LIMIT, &var_xport_rcpt_limit, 0, 0},
+	{VAR_STACK_RCPT_LIMIT, DEF_STACK_RCPT_LIMIT, &var_stack_rcpt_limit, 0, 0},
+	{VAR_XPORT_REFILL_LIMIT, DEF_XPORT_REFILL_LIMIT, &var_xport_refill_limit, 1, 0},
+	{VAR_DELIVERY_SLOT_COST, DEF_DELIVERY_SLOT_COST, &var_delivery_slot_cost, 0, 0},
+	{VAR_DELIVERY_SLOT_LOAN, DEF_DELIVERY_SLOT_LOAN, &var_delivery_slot_loan, 0, 0},
+	{VAR_DELIVERY_SLOT_DISCOUNT, DEF_DELIVERY_SLOT_DISCOUNT, &var_delivery_slot_discount, 0, 100},
+	{VAR_MIN_DELIVERY_SLOTS, DEF_MIN_DELIVERY_SLOTS, &var_min_delivery_slots, 0, 0},
+	{VAR_INIT_DEST_CON, DEF_INIT_DEST_CON, &var_init_dest_concurrency, 1, 0},
+	{VAR_DEST_CON_LIMIT, DEF_DEST_CON_LIMIT, &var_dest_con_limit, 0, 0},
+	{VAR_DEST_RCPT_LIMIT, DEF_DEST_RCPT_LIMIT, &var_dest_rcpt_limit, 0, 0},
+	{VAR_LOCAL_RCPT_LIMIT, DEF_LOCAL_RCPT_LIMIT, &var_local_rcpt_lim, 0, 0},
+	{VAR_LOCAL_CON_LIMIT, DEF_LOCAL_CON_LIMIT, &var_local_con_lim, 0, 0},
+	{VAR_CONC_COHORT_LIM, DEF_CONC_COHORT_LIM, &var_conc_cohort_limit, 0, 0},
+	{VAR_VRFY_PEND_LIMIT, DEF_VRFY_PEND_LIMIT, &var_vrfy_pend_limit, 1, 0},
+	{0},
+    };
+    static const CONFIG_BOOL_TABLE bool_table[] = {
+	{VAR_VERP_BOUNCE_OFF, DEF_VERP_BOUNCE_OFF, &var_verp_bounce_off},
+	{VAR_CONC_FDBACK_DEBUG, DEF_CONC_FDBACK_DEBUG, &var_conc_feedback_debug},
+	{VAR_DSN_DELAY_CLEARED, DEF_DSN_DELAY_CLEARED, &var_dsn_delay_cleared},
+	{VAR_QMGR_DEFERRED_HEAP, DEF_QMGR_DEFERRED_HEAP, &var_qmgr_deferred_heap},
+	{0},
+    };
+    int     domain_count = 100;
+    int     msg_count = 10;
+    int     rcpt_count = 50000;
+    char   *dir;
+    char    template[] = "/tmp/qmgr_bench.XXXXXX";
+    VSTRING *queue_id = vstring_alloc(20);
+    VSTRING *path = vstring_alloc(100);
+    QMGR_MESSAGE *message;
+    struct timeval start;
+    struct timeval done;
+    double  elapsed;
+    long    total = 0;
+    int     ch;
+    int     n;
+
+    MAIL_VERSION_STAMP_ALLOCATE;
+
+    msg_vstream_init(argv[0], VSTREAM_ERR);
+    while ((ch = GETOPT(argc, argv, "d:m:r:t:v")) > 0) {
+	switch (ch) {
+	case 'd':
+	    if ((domain_count = atoi(optarg)) <= 0)
+		usage(argv[0]);
+	    break;
+	case 'm':
+	    if ((msg_count = atoi(optarg)) <= 0)
+		usage(argv[0]);
+	    break;
+	case 'r':
+	    if ((rcpt_count = atoi(optarg)) <= 0)
+		usage(argv[0]);
+	    break;
+	case 't':
+	    if ((bench_transports = atoi(optarg)) <= 0)
+		usage(argv[0]);
+	    break;
+	case 'v':
+	    msg_verbose++;
+	    break;
+	default:
+	    usage(argv[0]);
+	}
+    }
+    if (argc - optind > 1)
+	usage(argv[0]);
+
+    /*
+     * Use the built-in parameter defaults, and keep all recipients of a
+     * message in core.
+     */
+    mail_conf_suck();
+    mail_params_init();
+    get_mail_conf_str_table(str_table);
+    get_mail_conf_time_table(time_table);
+    get_mail_conf_int_table(int_table);
+    get_mail_conf_bool_table(bool_table);
+    var_qmgr_rcpt_limit = var_qmgr_msg_rcpt_limit = INT_MAX / 2;
+
+    if (optind < argc) {
+	dir = argv[optind];
+    } else if ((dir = mkdtemp(template)) == 0) {
+	msg_fatal("mkdtemp %s: %m", template);
+    }
+    if (chdir(dir) < 0)
+	msg_fatal("chdir %s: %m", dir);
+    if (mkdir(MAIL_QUEUE_ACTIVE, 0700) < 0 && errno != EEXIST)
+	msg_fatal("mkdir %s/%s: %m", dir, MAIL_QUEUE_ACTIVE);
+
+    for (n = 0; n < msg_count; n++) {
+	vstring_sprintf(queue_id, "B%07X", n);
+	make_queue_file(STR(queue_id), rcpt_count, domain_count);
+    }
+
+    /*
+     * Read each queue file, with as many refills as needed to bring all
+     * recipients in core.
+     */
+    GETTIMEOFDAY(&start);
+    for (n = 0; n < msg_count; n++) {
+	vstring_sprintf(queue_id, "B%07X", n);
+	message = qmgr_message_alloc(MAIL_QUEUE_ACTIVE, STR(queue_id), 0, 0);
+	if (message == 0 || message == QMGR_MESSAGE_LOCKED)
+	    msg_fatal("%s: cannot read queue file", STR(queue_id));
+	while (message->rcpt_offset > 0)
+	    if (qmgr_message_realloc(message) == 0)
+		msg_fatal("%s: cannot re-read queue file", STR(queue_id));
+	total += message->rcpt_count;
+    }
+    GETTIMEOFDAY(&done);
+    elapsed = (done.tv_sec - start.tv_sec)
+	+ (done.tv_usec - start.tv_usec) / 1000000.0;
+    vstream_printf("%d messages, %ld recipients, %d domains, "
+		   "%d transports: %.3f s, %.0f recipients/s\n",
+		   msg_count, total, domain_count, bench_transports,
+		   elapsed, elapsed > 0 ? total / elapsed : 0.0);
+    vstream_fflush(VSTREAM_OUT);
+
+    /*
+     * Clean up the queue files.
+     */
+    for (n = 0; n < msg_count; n++) {
+	vstring_sprintf(queue_id, "B%07X", n);
+	mail_queue_path(path, MAIL_QUEUE_ACTIVE, STR(queue_id));
+	if (unlink(STR(path)) < 0)
+	    msg_warn("remove %s: %m", STR(path));
+    }
+    if (optind >= argc) {
+	(void) rmdir(MAIL_QUEUE_ACTIVE);
+	(void) chdir("/");
+	(void) rmdir(dir);
+    }
+    vstring_free(queue_id);
+    vstring_free(path);
+    return (0);
+}
@@ -0,0 +1,426 @@
+/*++
+/* NAME
+/*	qmgr_index 3
+/* SUMMARY
+/*	deferred queue index
+/* SYNOPSIS
+/*	#include "qmgr.h"
+/*
+/*	int	qmgr_index_enabled;
+/*
+/*	void	qmgr_index_init()
+/*
+/*	void	qmgr_index_enter(queue_id, when)
+/*	const char *queue_id;
+/*	time_t	when;
+/*
+/*	void	qmgr_index_delete(queue_id)
+/*	const char *queue_id;
+/*
+/*	ARGV	*qmgr_index_scan()
+/*
+/*	time_t	qmgr_index_next()
+/* DESCRIPTION
+/*	This module maintains an optional index of the deferred
+/*	queue, with the next delivery attempt time of each queue
+/*	file. The index is kept in an on-disk table, or in an
+/*	in-memory min-heap. With the index, a deferred queue run opens only
+/*	queue files that are due, instead of examining every file
+/*	in the deferred queue directory. The queue manager is the
+/*	only program that moves mail into the deferred queue, so
+/*	the index can be maintained here. Changes made by other
+/*	programs (for example, postsuper) are picked up when the
+/*	index is rebuilt with a directory scan.
+/*
+/*	qmgr_index_init() creates an in-memory index when the
+/*	qmgr_deferred_heap parameter is enabled, otherwise it opens
+/*	the table specified with the qmgr_index_database parameter.
+/*	The index is emptied, so that the first deferred queue run
+/*	rebuilds it. This function must be called before the process
+/*	drops privileges. The qmgr_index_enabled variable is non-zero
+/*	when an index is used.
+/*
+/*	qmgr_index_enter() records the next delivery attempt time
+/*	for the named deferred queue file.
+/*
+/*	qmgr_index_delete() removes the named queue file from the
+/*	index.
+/*
+/*	qmgr_index_scan() returns a list of deferred queue IDs that
+/*	are due for delivery, in order of increasing delivery attempt
+/*	time. The result should be destroyed with argv_free(). The
+/*	result is a null pointer when the index needs to be rebuilt
+/*	with a directory scan; in that case, the caller must call
+/*	qmgr_index_enter() for each deferred queue file that is not
+/*	yet due. A rebuild is requested once every
+/*	$qmgr_index_rebuild_time seconds.
+/*
+/*	qmgr_index_next() returns the earliest delivery attempt
+/*	time in an in-memory index, or zero when that time is not
+/*	known.
+/*
+/*	The functions in this module do nothing when no index is
+/*	used.
+/* DIAGNOSTICS
+/*	Fatal: cannot open or update the index.
+/* SEE ALSO
+/*	dict(3) generic dictionary manager
+/* LICENSE
+/* .ad
+/* .fi
+/*	The Secure Mailer license must be distributed with this software.
+/* AUTHOR(S)
+/*	Wietse Venema
+/*	IBM T.J. Watson Research
+/*	P.O. Box 704
+/*	Yorktown Heights, NY 10598, USA
+/*--*/
+
+/* System library. */
+
+#include <sys_defs.h>
+#include <sys/stat.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+
+/* Utility library. */
+
+#include <msg.h>
+#include <mymalloc.h>
+#include <vstring.h>
+#include <argv.h>
+#include <dict.h>
+#include <htable.h>
+#include <set_eugid.h>
+#include <events.h>
+
+/* Global library. */
+
+#include <mail_params.h>
+#include <data_redirect.h>
+
+/* Application-specific. */
+
+#include "qmgr.h"
+
+int     qmgr_index_enabled;
+
+static DICT *qmgr_index_dict;		/* on-disk index */
+static time_t qmgr_index_rebuild;	/* next rebuild time */
+
+ /*
+  * Index entry, sorted by delivery attempt time.
+  */
+typedef struct {
+    time_t  when;			/* next delivery attempt */
+    char   *queue_id;			/* queue file name */
+    ssize_t pos;			/* in-memory heap position */
+} QMGR_INDEX_ENTRY;
+
+ /*
+  * In-memory index: a binary min-heap ordered by delivery attempt time, and
+  * a hash table to find a queue file's heap entry.
+  */
+static QMGR_INDEX_ENTRY **qmgr_index_heap;
+static ssize_t qmgr_index_heap_len;
+static ssize_t qmgr_index_heap_size;
+static HTABLE *qmgr_index_table;
+
+#define QMGR_INDEX_PARENT(i)	(((i) - 1) / 2)
+#define QMGR_INDEX_CHILD(i)	(2 * (i) + 1)
+
+/* qmgr_index_heap_set - place entry at heap position */
+
+static void qmgr_index_heap_set(ssize_t pos, QMGR_INDEX_ENTRY *entry)
+{
+    qmgr_index_heap[pos] = entry;
+    entry->pos = pos;
+}
+
+/* qmgr_index_heap_up - restore heap order towards the root */
+
+static void qmgr_index_heap_up(ssize_t pos)
+{
+    QMGR_INDEX_ENTRY *entry = qmgr_index_heap[pos];
+    ssize_t parent;
+
+    while (pos > 0) {
+	parent = QMGR_INDEX_PARENT(pos);
+	if (qmgr_index_heap[parent]->when <= entry->when)
+	    break;
+	qmgr_index_heap_set(pos, qmgr_index_heap[parent]);
+	pos = parent;
+    }
+    qmgr_index_heap_set(pos, entry);
+}
+
+/* qmgr_index_heap_down - restore heap order towards the leaves */
+
+static void qmgr_index_heap_down(ssize_t pos)
+{
+    QMGR_INDEX_ENTRY *entry = qmgr_index_heap[pos];
+    ssize_t child;
+
+    while ((child = QMGR_INDEX_CHILD(pos)) < qmgr_index_heap_len) {
+	if (child + 1 < qmgr_index_heap_len
+	    && qmgr_index_heap[child + 1]->when < qmgr_index_heap[child]->when)
+	    child += 1;
+	if (entry->when <= qmgr_index_heap[child]->when)
+	    break;
+	qmgr_index_heap_set(pos, qmgr_index_heap[child]);
+	pos = child;
+    }
+    qmgr_index_heap_set(pos, entry);
+}
+
+/* qmgr_index_heap_remove - remove entry from heap and hash table */
+
+static void qmgr_index_heap_remove(QMGR_INDEX_ENTRY *entry)
+{
+    QMGR_INDEX_ENTRY *last;
+    ssize_t pos = entry->pos;
+
+    last = qmgr_index_heap[--qmgr_index_heap_len];
+    if (last != entry) {
+	qmgr_index_heap_set(pos, last);
+	if (pos > 0 && qmgr_index_heap[QMGR_INDEX_PARENT(pos)]->when > last->when)
+	    qmgr_index_heap_up(pos);
+	else
+	    qmgr_index_heap_down(pos);
+    }
+    htable_delete(qmgr_index_table, entry->queue_id, (void (*) (void *)) 0);
+    myfree(entry->queue_id);
+    myfree((void *) entry);
+}
+
+/* qmgr_index_init - open deferred queue index */
+
+void    qmgr_index_init(void)
+{
+    VSTRING *redirect;
+    mode_t  saved_mask;
+
+    qmgr_index_rebuild = 0;
+
+    /*
+     * The in-memory index trades memory for speed: it needs no table
+     * lookups, and it knows when the next message is due.
+     */
+    if (var_qmgr_deferred_heap) {
+	if (*var_qmgr_index_map)
+	    msg_warn("%s is enabled -- ignoring %s",
+		     VAR_QMGR_DEFERRED_HEAP, VAR_QMGR_INDEX_MAP);
+	qmgr_index_heap_size = 1000;
+	qmgr_index_heap = (QMGR_INDEX_ENTRY **)
+	    mymalloc(sizeof(*qmgr_index_heap) * qmgr_index_heap_size);
+	qmgr_index_heap_len = 0;
+	qmgr_index_table = htable_create(qmgr_index_heap_size);
+	qmgr_index_enabled = 1;
+	return;
+    }
+    if (*var_qmgr_index_map == 0)
+	return;
+
+    /*
+     * Start with an empty index. The first deferred queue run rebuilds it
+     * from the queue directory, which may have changed while the queue
+     * manager was not running. The queue manager is the only writer, so an
+     * exclusive lock is sufficient, and there is no need to sync each
+     * update: after a crash, the index is rebuilt anyway.
+     */
+#define QMGR_INDEX_OPEN_FLAGS (DICT_FLAG_DUP_REPLACE | DICT_FLAG_OPEN_LOCK)
+
+    SAVE_AND_SET_EUGID(var_owner_uid, var_owner_gid);
+    redirect = vstring_alloc(100);
+    saved_mask = umask(022);
+    qmgr_index_dict =
+	dict_open(data_redirect_map(redirect, var_qmgr_index_map),
+		  O_CREAT | O_RDWR | O_TRUNC, QMGR_INDEX_OPEN_FLAGS);
+    (void) umask(saved_mask);
+    if (qmgr_index_dict->update == 0 || qmgr_index_dict->sequence == 0
+	|| qmgr_index_dict->delete == 0)
+	msg_fatal("%s=%s: table does not support update, delete and sequence",
+		  VAR_QMGR_INDEX_MAP, var_qmgr_index_map);
+    vstring_free(redirect);
+    RESTORE_SAVED_EUGID();
+    qmgr_index_enabled = 1;
+}
+
+/* qmgr_index_enter - record next delivery attempt time */
+
+void    qmgr_index_enter(const char *queue_id, time_t when)
+{
+    char    buf[sizeof(long) * 3 + 1];
+    QMGR_INDEX_ENTRY *entry;
+
+    if (qmgr_index_enabled == 0)
+	return;
+    if (msg_verbose)
+	msg_info("qmgr_index_enter: %s %ld", queue_id, (long) when);
+
+    /*
+     * In-memory index: update the existing entry, or add a new one.
+     */
+    if (qmgr_index_heap) {
+	if ((entry = (QMGR_INDEX_ENTRY *)
+	     htable_find(qmgr_index_table, queue_id)) != 0) {
+	    entry->when = when;
+	    if (entry->pos > 0
+		&& qmgr_index_heap[QMGR_INDEX_PARENT(entry->pos)]->when > when)
+		qmgr_index_heap_up(entry->pos);
+	    else
+		qmgr_index_heap_down(entry->pos);
+	    return;
+	}
+	if (qmgr_index_heap_len >= qmgr_index_heap_size) {
+	    qmgr_index_heap_size *= 2;
+	    qmgr_index_heap = (QMGR_INDEX_ENTRY **)
+		myrealloc((void *) qmgr_index_heap,
+			  sizeof(*qmgr_index_heap) * qmgr_index_heap_size);
+	}
+	entry = (QMGR_INDEX_ENTRY *) mymalloc(sizeof(*entry));
+	entry->when = when;
+	entry->queue_id = mystrdup(queue_id);
+	htable_enter(qmgr_index_table, entry->queue_id, (void *) entry);
+	qmgr_index_heap_set(qmgr_index_heap_len++, entry);
+	qmgr_index_heap_up(entry->pos);
+	return;
+    }
+
+    /*
+     * On-disk index.
+     */
+    sprintf(buf, "%ld", (long) when);
+    if (dict_put(qmgr_index_dict, queue_id, buf) != DICT_STAT_SUCCESS)
+	msg_fatal("%s: update %s: %m", qmgr_index_dict->name, queue_id);
+}
+
+/* qmgr_index_delete - forget queue file */
+
+void    qmgr_index_delete(const char *queue_id)
+{
+    QMGR_INDEX_ENTRY *entry;
+
+    if (qmgr_index_enabled == 0)
+	return;
+    if (msg_verbose)
+	msg_info("qmgr_index_delete: %s", queue_id);
+    if (qmgr_index_heap) {
+	if ((entry = (QMGR_INDEX_ENTRY *)
+	     htable_find(qmgr_index_table, queue_id)) != 0)
+	    qmgr_index_heap_remove(entry);
+    } else if (dict_del(qmgr_index_dict, queue_id) == DICT_STAT_ERROR) {
+	msg_fatal("%s: delete %s: %m", qmgr_index_dict->name, queue_id);
+    }
+}
+
+/* qmgr_index_compare - order entries by delivery attempt time */
+
+static int qmgr_index_compare(const void *p1, const void *p2)
+{
+    const QMGR_INDEX_ENTRY *e1 = (const QMGR_INDEX_ENTRY *) p1;
+    const QMGR_INDEX_ENTRY *e2 = (const QMGR_INDEX_ENTRY *) p2;
+
+    return (e1->when < e2->when ? -1 : e1->when > e2->when ? 1 : 0);
+}
+
+/* qmgr_index_scan - list deferred queue files that are due */
+
+ARGV   *qmgr_index_scan(void)
+{
+    const char *myname = "qmgr_index_scan";
+    QMGR_INDEX_ENTRY *due;
+    ssize_t due_len = 0;
+    ssize_t due_size = 100;
+    const char *queue_id;
+    const char *value;
+    time_t  now = event_time();
+    long    when;
+    ARGV   *argv;
+    int     func;
+    int     n;
+
+    if (qmgr_index_enabled == 0)
+	return (0);
+
+    /*
+     * Rebuild the index periodically, to pick up queue files that were
+     * added or changed by other programs.
+     */
+    if (now >= qmgr_index_rebuild) {
+	if (msg_verbose)
+	    msg_info("%s: rebuild deferred queue index", myname);
+	qmgr_index_rebuild = now + var_qmgr_index_rebuild;
+	return (0);
+    }
+
+    /*
+     * In-memory index: take the entries that are due off the heap, oldest
+     * first. A queue file that is not really due is entered again by
+     * qmgr_active_feed().
+     */
+    if (qmgr_index_heap) {
+	argv = argv_alloc(10);
+	while (qmgr_index_heap_len > 0 && qmgr_index_heap[0]->when <= now + 1) {
+	    argv_add(argv, qmgr_index_heap[0]->queue_id, ARGV_END);
+	    qmgr_index_heap_remove(qmgr_index_heap[0]);
+	}
+	argv_terminate(argv);
+	if (msg_verbose)
+	    msg_info("%s: %ld deferred queue files are due, %ld are not",
+		     myname, (long) argv->argc, (long) qmgr_index_heap_len);
+	return (argv);
+    }
+
+    /*
+     * Collect the queue IDs that are due before making changes, so that we
+     * don't update the table while a sequence operation is in progress.
+     */
+    due = (QMGR_INDEX_ENTRY *) mymalloc(sizeof(*due) * due_size);
+    for (func = DICT_SEQ_FUN_FIRST; /* see below */ ; func = DICT_SEQ_FUN_NEXT) {
+	if (dict_seq(qmgr_index_dict, func, &queue_id, &value) != 0)
+	    break;
+	if (sscanf(value, "%ld", &when) != 1) {
+	    msg_warn("%s: bad entry for %s: \"%s\"",
+		     qmgr_index_dict->name, queue_id, value);
+	    when = 0;
+	}
+	if (when > now + 1)
+	    continue;
+	if (due_len >= due_size) {
+	    due_size *= 2;
+	    due = (QMGR_INDEX_ENTRY *)
+		myrealloc((void *) due, sizeof(*due) * due_size);
+	}
+	due[due_len].when = when;
+	due[due_len].queue_id = mystrdup(queue_id);
+	due_len += 1;
+    }
+    if (qmgr_index_dict->error)
+	msg_fatal("%s: sequence error", qmgr_index_dict->name);
+
+    /*
+     * Oldest first.
+     */
+    qsort((void *) due, due_len, sizeof(*due), qmgr_index_compare);
+    argv = argv_alloc(due_len + 1);
+    for (n = 0; n < due_len; n++) {
+	argv_add(argv, due[n].queue_id, ARGV_END);
+	myfree(due[n].queue_id);
+    }
+    argv_terminate(argv);
+    myfree((void *) due);
+    if (msg_verbose)
+	msg_info("%s: %ld deferred queue files are due", myname, (long) due_len);
+    return (argv);
+}
+
+/* qmgr_index_next - earliest delivery attempt time */
+
+time_t  qmgr_index_next(void)
+{
+    if (qmgr_index_heap && qmgr_index_heap_len > 0)
+	return (qmgr_index_heap[0]->when);
+    return (0);
+}
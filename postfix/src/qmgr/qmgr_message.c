@@ -128,6 +128,7 @@
 #include <stringops.h>
 #include <myflock.h>
 #include <sane_time.h>
+#include <binhash.h>
 
 /* Global library. */
 
@@ -160,6 +161,17 @@ int     qmgr_message_count;
 int     qmgr_recipient_count;
 int     qmgr_vrfy_pend_count;
 
+ /*
+  * Recipients that share a destination queue, see qmgr_message_group().
+  */
+typedef struct QMGR_RCPT_GROUP {
+    QMGR_QUEUE *queue;			/* destination queue */
+    int     head;			/* first recipient index */
+    int     tail;			/* last recipient index */
+    struct QMGR_RCPT_GROUP *next;	/* next group, same transport */
+    struct QMGR_RCPT_GROUP *last;	/* last group, same transport */
+} QMGR_RCPT_GROUP;
+
 /* qmgr_message_create - create in-core message structure */
 
 static QMGR_MESSAGE *qmgr_message_create(const char *queue_name,
@@ -183,8 +195,9 @@ static QMGR_MESSAGE *qmgr_message_create(const char *queue_name,
     message->queued_time = sane_time();
     message->refill_time = 0;
     message->data_offset = 0;
-    message->queue_id = mystrdup(queue_id);
-    message->queue_name = mystrdup(queue_name);
+    message->arena = arena_create(ARENA_CHUNK_SIZE);
+    message->queue_id = arena_strdup(message->arena, queue_id);
+    message->queue_name = arena_strdup(message->arena, queue_name);
     message->encoding = 0;
     message->sender = 0;
     message->dsn_envid = 0;
@@ -619,26 +632,20 @@ static int qmgr_message_read(QMGR_MESSAGE *message)
 	    continue;
 	}
 	if (rec_type == REC_TYPE_FILT) {
-	    if (message->filter_xport != 0)
-		myfree(message->filter_xport);
-	    message->filter_xport = mystrdup(start);
+	    message->filter_xport = arena_strdup(message->arena, start);
 	    continue;
 	}
 	if (rec_type == REC_TYPE_INSP) {
-	    if (message->inspect_xport != 0)
-		myfree(message->inspect_xport);
-	    message->inspect_xport = mystrdup(start);
+	    message->inspect_xport = arena_strdup(message->arena, start);
 	    continue;
 	}
 	if (rec_type == REC_TYPE_RDR) {
-	    if (message->redirect_addr != 0)
-		myfree(message->redirect_addr);
-	    message->redirect_addr = mystrdup(start);
+	    message->redirect_addr = arena_strdup(message->arena, start);
 	    continue;
 	}
 	if (rec_type == REC_TYPE_FROM) {
 	    if (message->sender == 0) {
-		message->sender = mystrdup(start);
+		message->sender = arena_strdup(message->arena, start);
 		opened(message->queue_id, message->sender,
 		       message->cont_length, message->rcpt_unread,
 		       "queue %s", message->queue_name);
@@ -647,9 +654,7 @@ static int qmgr_message_read(QMGR_MESSAGE *message)
 	}
 	if (rec_type == REC_TYPE_DSN_ENVID) {
 	    /* Allow Milter override. */
-	    if (message->dsn_envid != 0)
-		myfree(message->dsn_envid);
-	    message->dsn_envid = mystrdup(start);
+	    message->dsn_envid = arena_strdup(message->arena, start);
 	}
 	if (rec_type == REC_TYPE_DSN_RET) {
 	    /* Allow Milter override. */
@@ -662,9 +667,7 @@ static int qmgr_message_read(QMGR_MESSAGE *message)
 	if (rec_type == REC_TYPE_ATTR) {
 	    /* Allow extra segment to override envelope segment info. */
 	    if (strcmp(name, MAIL_ATTR_ENCODING) == 0) {
-		if (message->encoding != 0)
-		    myfree(message->encoding);
-		message->encoding = mystrdup(value);
+		message->encoding = arena_strdup(message->arena, value);
 	    }
 
 	    /*
@@ -683,73 +686,66 @@ static int qmgr_message_read(QMGR_MESSAGE *message)
 	     */
 	    else if (strcmp(name, MAIL_ATTR_ACT_CLIENT_NAME) == 0) {
 		if (have_log_client_attr == 0 && message->client_name == 0)
-		    message->client_name = mystrdup(value);
+		    message->client_name = arena_strdup(message->arena, value);
 	    } else if (strcmp(name, MAIL_ATTR_ACT_CLIENT_ADDR) == 0) {
 		if (have_log_client_attr == 0 && message->client_addr == 0)
-		    message->client_addr = mystrdup(value);
+		    message->client_addr = arena_strdup(message->arena, value);
 	    } else if (strcmp(name, MAIL_ATTR_ACT_CLIENT_PORT) == 0) {
 		if (have_log_client_attr == 0 && message->client_port == 0)
-		    message->client_port = mystrdup(value);
+		    message->client_port = arena_strdup(message->arena, value);
 	    } else if (strcmp(name, MAIL_ATTR_ACT_PROTO_NAME) == 0) {
 		if (have_log_client_attr == 0 && message->client_proto == 0)
-		    message->client_proto = mystrdup(value);
+		    message->client_proto =
+			arena_strdup(message->arena, value);
 	    } else if (strcmp(name, MAIL_ATTR_ACT_HELO_NAME) == 0) {
 		if (have_log_client_attr == 0 && message->client_helo == 0)
-		    message->client_helo = mystrdup(value);
+		    message->client_helo = arena_strdup(message->arena, value);
 	    }
 	    /* Original client attributes. */
 	    else if (strcmp(name, MAIL_ATTR_LOG_CLIENT_NAME) == 0) {
-		if (message->client_name != 0)
-		    myfree(message->client_name);
-		message->client_name = mystrdup(value);
+		message->client_name = arena_strdup(message->arena, value);
 		have_log_client_attr = 1;
 	    } else if (strcmp(name, MAIL_ATTR_LOG_CLIENT_ADDR) == 0) {
-		if (message->client_addr != 0)
-		    myfree(message->client_addr);
-		message->client_addr = mystrdup(value);
+		message->client_addr = arena_strdup(message->arena, value);
 		have_log_client_attr = 1;
 	    } else if (strcmp(name, MAIL_ATTR_LOG_CLIENT_PORT) == 0) {
-		if (message->client_port != 0)
-		    myfree(message->client_port);
-		message->client_port = mystrdup(value);
+		message->client_port = arena_strdup(message->arena, value);
 		have_log_client_attr = 1;
 	    } else if (strcmp(name, MAIL_ATTR_LOG_PROTO_NAME) == 0) {
-		if (message->client_proto != 0)
-		    myfree(message->client_proto);
-		message->client_proto = mystrdup(value);
+		message->client_proto = arena_strdup(message->arena, value);
 		have_log_client_attr = 1;
 	    } else if (strcmp(name, MAIL_ATTR_LOG_HELO_NAME) == 0) {
-		if (message->client_helo != 0)
-		    myfree(message->client_helo);
-		message->client_helo = mystrdup(value);
+		message->client_helo = arena_strdup(message->arena, value);
 		have_log_client_attr = 1;
 	    } else if (strcmp(name, MAIL_ATTR_SASL_METHOD) == 0) {
 		if (message->sasl_method == 0)
-		    message->sasl_method = mystrdup(value);
+		    message->sasl_method = arena_strdup(message->arena, value);
 		else
 		    msg_warn("%s: ignoring multiple %s attribute: %s",
 			   message->queue_id, MAIL_ATTR_SASL_METHOD, value);
 	    } else if (strcmp(name, MAIL_ATTR_SASL_USERNAME) == 0) {
 		if (message->sasl_username == 0)
-		    message->sasl_username = mystrdup(value);
+		    message->sasl_username =
+			arena_strdup(message->arena, value);
 		else
 		    msg_warn("%s: ignoring multiple %s attribute: %s",
 			 message->queue_id, MAIL_ATTR_SASL_USERNAME, value);
 	    } else if (strcmp(name, MAIL_ATTR_SASL_SENDER) == 0) {
 		if (message->sasl_sender == 0)
-		    message->sasl_sender = mystrdup(value);
+		    message->sasl_sender = arena_strdup(message->arena, value);
 		else
 		    msg_warn("%s: ignoring multiple %s attribute: %s",
 			   message->queue_id, MAIL_ATTR_SASL_SENDER, value);
 	    } else if (strcmp(name, MAIL_ATTR_LOG_IDENT) == 0) {
 		if (message->log_ident == 0)
-		    message->log_ident = mystrdup(value);
+		    message->log_ident = arena_strdup(message->arena, value);
 		else
 		    msg_warn("%s: ignoring multiple %s attribute: %s",
 			     message->queue_id, MAIL_ATTR_LOG_IDENT, value);
 	    } else if (strcmp(name, MAIL_ATTR_RWR_CONTEXT) == 0) {
 		if (message->rewrite_context == 0)
-		    message->rewrite_context = mystrdup(value);
+		    message->rewrite_context =
+			arena_strdup(message->arena, value);
 		else
 		    msg_warn("%s: ignoring multiple %s attribute: %s",
 			   message->queue_id, MAIL_ATTR_RWR_CONTEXT, value);
@@ -793,7 +789,7 @@ static int qmgr_message_read(QMGR_MESSAGE *message)
 			msg_info("%s: enabling VERP for sender \"%.100s\"",
 				 message->queue_id, message->sender);
 		    message->single_rcpt = 1;
-		    message->verp_delims = mystrdup(start);
+		    message->verp_delims = arena_strdup(message->arena, start);
 		}
 	    }
 	    continue;
@@ -839,29 +835,30 @@ static int qmgr_message_read(QMGR_MESSAGE *message)
      * null pointer.
      */
     if (message->dsn_envid == 0)
-	message->dsn_envid = mystrdup("");
+	message->dsn_envid = arena_strdup(message->arena, "");
     if (message->encoding == 0)
-	message->encoding = mystrdup(MAIL_ATTR_ENC_NONE);
+	message->encoding = arena_strdup(message->arena, MAIL_ATTR_ENC_NONE);
     if (message->client_name == 0)
-	message->client_name = mystrdup("");
+	message->client_name = arena_strdup(message->arena, "");
     if (message->client_addr == 0)
-	message->client_addr = mystrdup("");
+	message->client_addr = arena_strdup(message->arena, "");
     if (message->client_port == 0)
-	message->client_port = mystrdup("");
+	message->client_port = arena_strdup(message->arena, "");
     if (message->client_proto == 0)
-	message->client_proto = mystrdup("");
+	message->client_proto = arena_strdup(message->arena, "");
     if (message->client_helo == 0)
-	message->client_helo = mystrdup("");
+	message->client_helo = arena_strdup(message->arena, "");
     if (message->sasl_method == 0)
-	message->sasl_method = mystrdup("");
+	message->sasl_method = arena_strdup(message->arena, "");
     if (message->sasl_username == 0)
-	message->sasl_username = mystrdup("");
+	message->sasl_username = arena_strdup(message->arena, "");
     if (message->sasl_sender == 0)
-	message->sasl_sender = mystrdup("");
+	message->sasl_sender = arena_strdup(message->arena, "");
     if (message->log_ident == 0)
-	message->log_ident = mystrdup("");
+	message->log_ident = arena_strdup(message->arena, "");
     if (message->rewrite_context == 0)
-	message->rewrite_context = mystrdup(MAIL_ATTR_RWR_LOCAL);
+	message->rewrite_context =
+	    arena_strdup(message->arena, MAIL_ATTR_RWR_LOCAL);
     /* Postfix < 2.3 compatibility. */
     if (message->create_time == 0)
 	message->create_time = message->arrival_time.tv_sec;
@@ -933,86 +930,111 @@ void    qmgr_message_kill_record(QMGR_MESSAGE *message, long offset)
     qmgr_message_close(message);
 }
 
-/* qmgr_message_sort_compare - compare recipient information */
+/* qmgr_message_group - group message recipients by destination queue */
 
-static int qmgr_message_sort_compare(const void *p1, const void *p2)
+static void qmgr_message_group(QMGR_MESSAGE *message)
 {
-    RECIPIENT *rcpt1 = (RECIPIENT *) p1;
-    RECIPIENT *rcpt2 = (RECIPIENT *) p2;
-    QMGR_QUEUE *queue1;
-    QMGR_QUEUE *queue2;
-    char   *at1;
-    char   *at2;
-    int     result;
-
-    /*
-     * Compare most significant to least significant recipient attributes.
-     * The comparison function must be transitive, so NULL values need to be
-     * assigned an ordinal (we set NULL last).
-     */
-
-    queue1 = rcpt1->u.queue;
-    queue2 = rcpt2->u.queue;
-    if (queue1 != 0 && queue2 == 0)
-	return (-1);
-    if (queue1 == 0 && queue2 != 0)
-	return (1);
-    if (queue1 != 0 && queue2 != 0) {
-
-	/*
-	 * Compare message transport.
-	 */
-	if ((result = strcmp(queue1->transport->name,
-			     queue2->transport->name)) != 0)
-	    return (result);
+    RECIPIENT_LIST *list = &message->rcpt_list;
+    QMGR_RCPT_GROUP *groups;
+    QMGR_RCPT_GROUP *gp;
+    QMGR_RCPT_GROUP *first;
+    QMGR_RCPT_GROUP *null_group;
+    BINHASH *queue_groups;
+    BINHASH *xport_groups;
+    RECIPIENT *grouped;
+    RECIPIENT *rcpt;
+    QMGR_QUEUE *queue;
+    int    *next_rcpt;
+    int     ngroups;
+    int     n;
+    int     i;
 
-	/*
-	 * Compare queue name (nexthop or recipient@nexthop).
-	 */
-	if ((result = strcmp(queue1->name, queue2->name)) != 0)
-	    return (result);
-    }
+    if (list->len < 2)
+	return;
 
     /*
-     * Compare recipient domain.
+     * Place each recipient in the group for its queue, in one hash table
+     * pass instead of a comparison sort. Groups of the same transport are
+     * chained together, so that qmgr_message_assign() visits each transport
+     * and each queue once. Recipients without queue go last. Within a
+     * group, recipients stay in queue file order.
      */
-    at1 = strrchr(rcpt1->address, '@');
-    at2 = strrchr(rcpt2->address, '@');
-    if (at1 == 0 && at2 != 0)
-	return (1);
-    if (at1 != 0 && at2 == 0)
-	return (-1);
-    if (at1 != 0 && at2 != 0
-	&& (result = strcasecmp_utf8(at1, at2)) != 0)
-	return (result);
+    groups = (QMGR_RCPT_GROUP *) mymalloc(sizeof(*groups) * (list->len + 1));
+    next_rcpt = (int *) mymalloc(sizeof(*next_rcpt) * list->len);
+    queue_groups = binhash_create(13);
+    xport_groups = binhash_create(13);
+    null_group = groups;
+    null_group->head = null_group->tail = -1;
+    ngroups = 1;
+    for (i = 0; i < list->len; i++) {
+	if ((queue = list->info[i].u.queue) == 0) {
+	    gp = null_group;
+	} else if ((gp = (QMGR_RCPT_GROUP *)
+		    binhash_find(queue_groups, (void *) &queue,
+				 sizeof(queue))) == 0) {
+	    gp = groups + ngroups++;
+	    gp->queue = queue;
+	    gp->head = gp->tail = -1;
+	    gp->next = 0;
+	    gp->last = gp;
+	    binhash_enter(queue_groups, (void *) &queue, sizeof(queue),
+			  (void *) gp);
+	    if ((first = (QMGR_RCPT_GROUP *)
+		 binhash_find(xport_groups, (void *) &queue->transport,
+			      sizeof(queue->transport))) == 0) {
+		binhash_enter(xport_groups, (void *) &queue->transport,
+			      sizeof(queue->transport), (void *) gp);
+	    } else {
+		first->last->next = gp;
+		first->last = gp;
+		gp->last = 0;
+	    }
+	}
+	next_rcpt[i] = -1;
+	if (gp->tail < 0)
+	    gp->head = i;
+	else
+	    next_rcpt[gp->tail] = i;
+	gp->tail = i;
+    }
 
     /*
-     * Compare recipient address.
+     * Copy the recipients out group by group. The first group of each
+     * transport carries the chain for that transport.
      */
-    return (strcmp(rcpt1->address, rcpt2->address));
-}
-
-/* qmgr_message_sort - sort message recipient addresses by domain */
+    grouped = (RECIPIENT *) mymalloc(sizeof(*grouped) * list->len);
+    rcpt = grouped;
+    for (n = 1; n < ngroups; n++) {
+	if (groups[n].last == 0)
+	    continue;
+	for (gp = groups + n; gp != 0; gp = gp->next)
+	    for (i = gp->head; i >= 0; i = next_rcpt[i])
+		*rcpt++ = list->info[i];
+    }
+    for (i = null_group->head; i >= 0; i = next_rcpt[i])
+	*rcpt++ = list->info[i];
+    if (rcpt != grouped + list->len)
+	msg_panic("qmgr_message_group: recipient count mismatch");
+    memcpy((void *) list->info, (void *) grouped,
+	   sizeof(*grouped) * list->len);
+
+    myfree((void *) grouped);
+    myfree((void *) next_rcpt);
+    myfree((void *) groups);
+    binhash_free(queue_groups, (void (*) (void *)) 0);
+    binhash_free(xport_groups, (void (*) (void *)) 0);
 
-static void qmgr_message_sort(QMGR_MESSAGE *message)
-{
-    qsort((void *) message->rcpt_list.info, message->rcpt_list.len,
-	  sizeof(message->rcpt_list.info[0]), qmgr_message_sort_compare);
     if (msg_verbose) {
-	RECIPIENT_LIST list = message->rcpt_list;
-	RECIPIENT *rcpt;
-
-	msg_info("start sorted recipient list");
-	for (rcpt = list.info; rcpt < list.info + list.len; rcpt++)
-	    msg_info("qmgr_message_sort: %s", rcpt->address);
-	msg_info("end sorted recipient list");
+	msg_info("start grouped recipient list");
+	for (rcpt = list->info; rcpt < list->info + list->len; rcpt++)
+	    msg_info("qmgr_message_group: %s", rcpt->address);
+	msg_info("end grouped recipient list");
     }
 }
 
-/* qmgr_resolve_one - resolve or skip one recipient */
+/* qmgr_resolve_check - redirect failed or malformed resolver results */
 
-static int qmgr_resolve_one(QMGR_MESSAGE *message, RECIPIENT *recipient,
-			            const char *addr, RESOLVE_REPLY *reply)
+static int qmgr_resolve_check(RESOLVE_REPLY *reply)
 {
 #define QMGR_REDIRECT(rp, tp, np) do { \
 	(rp)->flags = 0; \
@@ -1020,10 +1042,6 @@ static int qmgr_resolve_one(QMGR_MESSAGE *message, RECIPIENT *recipient,
 	vstring_strcpy((rp)->nexthop, (np)); \
     } while (0)
 
-    if ((message->tflags & DEL_REQ_FLAG_MTA_VRFY) == 0)
-	resolve_clnt_query_from(message->sender, addr, reply);
-    else
-	resolve_clnt_verify_from(message->sender, addr, reply);
     if (reply->flags & RESOLVE_FLAG_FAIL) {
 	QMGR_REDIRECT(reply, MAIL_SERVICE_RETRY,
 		      "4.3.0 address resolver failure");
@@ -1037,11 +1055,43 @@ static int qmgr_resolve_one(QMGR_MESSAGE *message, RECIPIENT *recipient,
     }
 }
 
+/* qmgr_resolve_one - resolve or skip one recipient */
+
+static int qmgr_resolve_one(QMGR_MESSAGE *message, RECIPIENT *recipient,
+			            const char *addr, RESOLVE_REPLY *reply)
+{
+    if ((message->tflags & DEL_REQ_FLAG_MTA_VRFY) == 0)
+	resolve_clnt_query_from(message->sender, addr, reply);
+    else
+	resolve_clnt_verify_from(message->sender, addr, reply);
+    return (qmgr_resolve_check(reply));
+}
+
+/* qmgr_resolve_batch - resolve consecutive recipients in one exchange */
+
+static void qmgr_resolve_batch(QMGR_MESSAGE *message, RECIPIENT *first,
+			               int count, RESOLVE_REPLY *reply)
+{
+    const char *addr[RESOLVE_BATCH_LIMIT];
+    int     n;
+
+    for (n = 0; n < count; n++)
+	addr[n] = first[n].address;
+    if ((message->tflags & DEL_REQ_FLAG_MTA_VRFY) == 0)
+	resolve_clnt_query_batch(message->sender, count, addr, reply);
+    else
+	resolve_clnt_verify_batch(message->sender, count, addr, reply);
+}
+
 /* qmgr_message_resolve - resolve recipients */
 
 static void qmgr_message_resolve(QMGR_MESSAGE *message)
 {
     static ARGV *defer_xport_argv;
+    static RESOLVE_REPLY *batch_reply;
+    RECIPIENT *batch_start = 0;
+    RECIPIENT *batch_end = 0;
+    RESOLVE_REPLY *batched;
     RECIPIENT_LIST list = message->rcpt_list;
     RECIPIENT *recipient;
     QMGR_TRANSPORT *transport = 0;
@@ -1061,6 +1111,13 @@ static void qmgr_message_resolve(QMGR_MESSAGE *message)
 #define STR		vstring_str
 #define LEN		VSTRING_LEN
 
+    if (batch_reply == 0) {
+	batch_reply = (RESOLVE_REPLY *)
+	    mymalloc(sizeof(*batch_reply) * RESOLVE_BATCH_LIMIT);
+	for (batched = batch_reply; batched < batch_reply + RESOLVE_BATCH_LIMIT;
+	     batched++)
+	    resolve_clnt_init(batched);
+    }
     resolve_clnt_init(&reply);
     queue_name = vstring_alloc(1);
     for (recipient = list.info; recipient < list.info + list.len; recipient++) {
@@ -1117,10 +1174,25 @@ static void qmgr_message_resolve(QMGR_MESSAGE *message)
 	/*
 	 * Resolve the destination to (transport, nexthop, address). The
 	 * result address may differ from the one specified by the sender.
+	 * Recipients are resolved in pipelined batches, so that a message
+	 * with many recipients does not wait for one resolver round trip
+	 * per recipient.
 	 */
 	else {
-	    if (qmgr_resolve_one(message, recipient,
-				 recipient->address, &reply) < 0)
+	    if (recipient >= batch_end) {
+		batch_start = recipient;
+		batch_end = recipient + RESOLVE_BATCH_LIMIT;
+		if (batch_end > list.info + list.len)
+		    batch_end = list.info + list.len;
+		qmgr_resolve_batch(message, batch_start,
+				   batch_end - batch_start, batch_reply);
+	    }
+	    batched = batch_reply + (recipient - batch_start);
+	    vstring_strcpy(reply.transport, STR(batched->transport));
+	    vstring_strcpy(reply.nexthop, STR(batched->nexthop));
+	    vstring_strcpy(reply.recipient, STR(batched->recipient));
+	    reply.flags = batched->flags;
+	    if (qmgr_resolve_check(&reply) < 0)
 		continue;
 	    if (!STREQ(recipient->address, STR(reply.recipient)))
 		RECIPIENT_UPDATE(recipient->address, STR(reply.recipient));
@@ -1420,42 +1492,7 @@ void    qmgr_message_free(QMGR_MESSAGE *message)
 	msg_panic("qmgr_message_free: queue file is open");
     while ((job = message->job_list.next) != 0)
 	qmgr_job_free(job);
-    myfree(message->queue_id);
-    myfree(message->queue_name);
-    if (message->dsn_envid)
-	myfree(message->dsn_envid);
-    if (message->encoding)
-	myfree(message->encoding);
-    if (message->sender)
-	myfree(message->sender);
-    if (message->verp_delims)
-	myfree(message->verp_delims);
-    if (message->filter_xport)
-	myfree(message->filter_xport);
-    if (message->inspect_xport)
-	myfree(message->inspect_xport);
-    if (message->redirect_addr)
-	myfree(message->redirect_addr);
-    if (message->client_name)
-	myfree(message->client_name);
-    if (message->client_addr)
-	myfree(message->client_addr);
-    if (message->client_port)
-	myfree(message->client_port);
-    if (message->client_proto)
-	myfree(message->client_proto);
-    if (message->client_helo)
-	myfree(message->client_helo);
-    if (message->sasl_method)
-	myfree(message->sasl_method);
-    if (message->sasl_username)
-	myfree(message->sasl_username);
-    if (message->sasl_sender)
-	myfree(message->sasl_sender);
-    if (message->log_ident)
-	myfree(message->log_ident);
-    if (message->rewrite_context)
-	myfree(message->rewrite_context);
+    arena_free(message->arena);
     recipient_list_free(&message->rcpt_list);
     qmgr_message_count--;
     if ((message->tflags & DEL_REQ_FLAG_MTA_VRFY) != 0)
@@ -1522,9 +1559,8 @@ QMGR_MESSAGE *qmgr_message_alloc(const char *queue_name, const char *queue_id,
 	if (mail_queue_remove(MAIL_QUEUE_DEFER, queue_id) && errno != ENOENT)
 	    msg_fatal("%s: %s: remove %s %s: %m", myname,
 		      queue_id, MAIL_QUEUE_DEFER, queue_id);
-	qmgr_message_sort(message);
 	qmgr_message_resolve(message);
-	qmgr_message_sort(message);
+	qmgr_message_group(message);
 	qmgr_message_assign(message);
 	qmgr_message_close(message);
 	if (message->rcpt_offset == 0)
@@ -1558,9 +1594,8 @@ QMGR_MESSAGE *qmgr_message_realloc(QMGR_MESSAGE *message)
 	qmgr_message_close(message);
 	return (0);
     } else {
-	qmgr_message_sort(message);
 	qmgr_message_resolve(message);
-	qmgr_message_sort(message);
+	qmgr_message_group(message);
 	qmgr_message_assign(message);
 	qmgr_message_close(message);
 	if (message->rcpt_offset == 0)
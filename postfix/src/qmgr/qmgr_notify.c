@@ -0,0 +1,249 @@
+/*++
+/* NAME
+/*	qmgr_notify 3
+/* SUMMARY
+/*	incoming queue change notification
+/* SYNOPSIS
+/*	#include "qmgr.h"
+/*
+/*	void	qmgr_notify_init(scan_info)
+/*	QMGR_SCAN *scan_info;
+/* DESCRIPTION
+/*	This module uses the Linux inotify(7) interface to learn
+/*	about new incoming queue files as soon as they become
+/*	available, instead of scanning the incoming queue directory
+/*	after each wakeup request.
+/*
+/*	qmgr_notify_init() sets up watches on the incoming queue
+/*	directory and its hashed subdirectories, if any, and requests
+/*	that the names of new queue files be passed to
+/*	qmgr_scan_notify() with the specified incoming queue scan
+/*	context. A queue file is reported when it is closed after
+/*	writing (i.e. after the cleanup server has finished it),
+/*	or when it is renamed into the incoming queue from another
+/*	queue.
+/*
+/*	The incoming queue is still scanned when the queue manager
+/*	starts, when a new hashed subdirectory appears, when the
+/*	kernel event queue overflows, upon explicit flush requests,
+/*	and once every $queue_run_delay seconds to pick up queue
+/*	files with future time stamps.
+/*
+/*	qmgr_notify_init() must be called after the process has
+/*	changed to the queue directory.
+/* DIAGNOSTICS
+/*	Fatal: out of memory. Warnings: inotify(7) is not available
+/*	or cannot be initialized; the queue manager then relies on
+/*	incoming queue scans as usual.
+/* SEE ALSO
+/*	inotify(7), Linux file system event monitoring
+/*	qmgr_scan(3), queue scanning
+/* LICENSE
+/* .ad
+/* .fi
+/*	The Secure Mailer license must be distributed with this software.
+/* AUTHOR(S)
+/*	Wietse Venema
+/*	IBM T.J. Watson Research
+/*	P.O. Box 704
+/*	Yorktown Heights, NY 10598, USA
+/*--*/
+
+/* System library. */
+
+#include <sys_defs.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+
+#ifdef HAS_INOTIFY
+#include <sys/inotify.h>
+#endif
+
+/* Utility library. */
+
+#include <msg.h>
+#include <mymalloc.h>
+#include <vstring.h>
+#include <binhash.h>
+#include <argv.h>
+#include <events.h>
+#include <iostuff.h>
+
+/* Global library. */
+
+#include <mail_params.h>
+#include <mail_queue.h>
+
+/* Application-specific. */
+
+#include "qmgr.h"
+
+#ifdef HAS_INOTIFY
+
+static int qmgr_notify_fd = -1;		/* inotify instance */
+static BINHASH *qmgr_notify_dirs;	/* watch descriptor -> pathname */
+
+#define QMGR_NOTIFY_DIR_MASK	(IN_CLOSE_WRITE | IN_MOVED_FROM | IN_MOVED_TO \
+				| IN_CREATE | IN_ONLYDIR)
+
+/* qmgr_notify_watch - watch one directory and its subdirectories */
+
+static void qmgr_notify_watch(const char *path)
+{
+    const char *myname = "qmgr_notify_watch";
+    DIR    *dir;
+    struct dirent *dp;
+    struct stat st;
+    VSTRING *subdir;
+    const char *cp;
+    int     depth;
+    int     wd;
+
+    if ((wd = inotify_add_watch(qmgr_notify_fd, path,
+				QMGR_NOTIFY_DIR_MASK)) < 0) {
+	msg_warn("%s: inotify_add_watch %s: %m", myname, path);
+	return;
+    }
+    if (msg_verbose)
+	msg_info("%s: watch %s", myname, path);
+    if (binhash_find(qmgr_notify_dirs, (void *) &wd, sizeof(wd)) == 0)
+	binhash_enter(qmgr_notify_dirs, (void *) &wd, sizeof(wd),
+		      (void *) mystrdup(path));
+
+    /*
+     * Hashed queue subdirectories have single-character names.
+     */
+    for (depth = 0, cp = path; (cp = strchr(cp, '/')) != 0; cp++)
+	depth++;
+    if (depth >= var_hash_queue_depth || (dir = opendir(path)) == 0)
+	return;
+    subdir = vstring_alloc(100);
+    while ((dp = readdir(dir)) != 0) {
+	if (dp->d_name[0] == '.' || dp->d_name[1] != 0)
+	    continue;
+	vstring_sprintf(subdir, "%s/%s", path, dp->d_name);
+	if (lstat(vstring_str(subdir), &st) == 0 && S_ISDIR(st.st_mode))
+	    qmgr_notify_watch(vstring_str(subdir));
+    }
+    closedir(dir);
+    vstring_free(subdir);
+}
+
+/* qmgr_notify_event - process inotify events */
+
+static void qmgr_notify_event(int unused_event, void *context)
+{
+    const char *myname = "qmgr_notify_event";
+    QMGR_SCAN *scan_info = (QMGR_SCAN *) context;
+    union {
+	struct inotify_event align;
+	char    data[4096];
+    }       buf;
+    struct inotify_event *ev;
+    const char *parent;
+    VSTRING *subdir;
+    ssize_t len;
+    ssize_t off;
+    static uint32_t temp_cookie;
+
+    /*
+     * Drain the event queue. When events were lost, fall back to a full
+     * incoming queue scan.
+     */
+    while ((len = read(qmgr_notify_fd, buf.data, sizeof(buf.data))) > 0) {
+	for (off = 0; off < len; off += sizeof(*ev) + ev->len) {
+	    ev = (struct inotify_event *) (buf.data + off);
+	    if (ev->mask & IN_Q_OVERFLOW) {
+		msg_warn("%s: inotify event queue overflow -- scanning %s",
+			 myname, scan_info->queue);
+		qmgr_scan_request(scan_info, QMGR_SCAN_START);
+		continue;
+	    }
+	    if (ev->len == 0)
+		continue;
+	    if (ev->mask & IN_ISDIR) {
+		if ((ev->mask & (IN_CREATE | IN_MOVED_TO)) == 0
+		    || (parent = (const char *) binhash_find(qmgr_notify_dirs,
+							 (void *) &ev->wd,
+						     sizeof(ev->wd))) == 0)
+		    continue;
+
+		/*
+		 * A new hashed subdirectory. Files may have been created
+		 * before the watch was in place.
+		 */
+		subdir = vstring_alloc(100);
+		vstring_sprintf(subdir, "%s/%s", parent, ev->name);
+		qmgr_notify_watch(vstring_str(subdir));
+		vstring_free(subdir);
+		qmgr_scan_request(scan_info, QMGR_SCAN_START);
+		continue;
+	    }
+
+	    /*
+	     * The cleanup server renames a new queue file from a temporary
+	     * name to its queue ID before the file is complete; it is reported
+	     * when the cleanup server closes it.
+	     */
+	    if (ev->mask & IN_MOVED_FROM) {
+		if (!mail_queue_id_ok(ev->name))
+		    temp_cookie = ev->cookie;
+		continue;
+	    }
+	    if ((ev->mask & IN_MOVED_TO) && ev->cookie == temp_cookie)
+		continue;
+	    if ((ev->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) != 0
+		&& mail_queue_id_ok(ev->name))
+		qmgr_scan_notify(scan_info, ev->name);
+	}
+    }
+    if (len < 0 && errno != EAGAIN && errno != EINTR)
+	msg_fatal("%s: read inotify events: %m", myname);
+}
+
+/* qmgr_notify_scan_event - periodic incoming queue scan */
+
+static void qmgr_notify_scan_event(int unused_event, void *context)
+{
+    QMGR_SCAN *scan_info = (QMGR_SCAN *) context;
+
+    qmgr_scan_request(scan_info, QMGR_SCAN_START);
+    event_request_timer(qmgr_notify_scan_event, context, var_queue_run_delay);
+}
+
+#endif
+
+/* qmgr_notify_init - watch incoming queue */
+
+void    qmgr_notify_init(QMGR_SCAN *scan_info)
+{
+#ifdef HAS_INOTIFY
+    const char *myname = "qmgr_notify_init";
+
+    if ((qmgr_notify_fd = inotify_init()) < 0) {
+	msg_warn("%s: inotify_init: %m -- using queue scans", myname);
+	return;
+    }
+    close_on_exec(qmgr_notify_fd, CLOSE_ON_EXEC);
+    non_blocking(qmgr_notify_fd, NON_BLOCKING);
+    qmgr_notify_dirs = binhash_create(17);
+    qmgr_notify_watch(scan_info->queue);
+    if (qmgr_notify_dirs->used == 0) {
+	msg_warn("%s: cannot watch %s -- using queue scans",
+		 myname, scan_info->queue);
+	(void) close(qmgr_notify_fd);
+	qmgr_notify_fd = -1;
+	return;
+    }
+    scan_info->notify = argv_alloc(10);
+    event_enable_read(qmgr_notify_fd, qmgr_notify_event, (void *) scan_info);
+    event_request_timer(qmgr_notify_scan_event, (void *) scan_info,
+			var_queue_run_delay);
+#else
+    msg_warn("%s: inotify is not available on this system -- using queue scans",
+	     VAR_QMGR_IN_NOTIFY);
+#endif
+}
@@ -0,0 +1,228 @@
+/*++
+/* NAME
+/*	qmgr_rehash 3
+/* SUMMARY
+/*	migrate queue files to a new hashing depth
+/* SYNOPSIS
+/*	#include "qmgr.h"
+/*
+/*	void	qmgr_rehash_init()
+/* DESCRIPTION
+/*	This module moves queue files from the directory layout for
+/*	the previous queue hashing depth (hash_queue_previous_depth)
+/*	to the layout for the current depth (hash_queue_depth), while
+/*	mail is being delivered. Meanwhile, mail_queue_path(3) looks
+/*	for queue files in both layouts.
+/*
+/*	qmgr_rehash_init() starts the migration when the hashing
+/*	depth is being changed. Once per second, the queue manager
+/*	examines up to $hash_queue_migration_limit queue files, one
+/*	queue at a time, and moves those that are not in the right
+/*	place. The incoming and active queues are skipped;
+/*	files there are created in the new layout, and leave those
+/*	queues soon enough. When a scan of all queues had to skip
+/*	files, the queues are scanned again. After a scan that skipped
+/*	no files, the queue manager logs that the migration is
+/*	complete, and that hash_queue_previous_depth can be reset
+/*	to zero.
+/*
+/*	A file is moved while the queue manager holds the same
+/*	exclusive lock that bounce(8), defer(8) and trace(8) logfile
+/*	writers take before they append to a file. Files that are
+/*	locked by another process, or that cannot be opened or moved,
+/*	are skipped, and are tried again in the next scan.
+/*
+/*	qmgr_rehash_init() must be called after the process has
+/*	changed to the queue directory.
+/* DIAGNOSTICS
+/*	Warnings: cannot move a queue file.
+/* SEE ALSO
+/*	mail_queue(3), mail queue file access
+/*	postsuper(1), queue maintenance
+/* LICENSE
+/* .ad
+/* .fi
+/*	The Secure Mailer license must be distributed with this software.
+/* AUTHOR(S)
+/*	Wietse Venema
+/*	IBM T.J. Watson Research
+/*	P.O. Box 704
+/*	Yorktown Heights, NY 10598, USA
+/*--*/
+
+/* System library. */
+
+#include <sys_defs.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+/* Utility library. */
+
+#include <msg.h>
+#include <vstring.h>
+#include <argv.h>
+#include <scan_dir.h>
+#include <events.h>
+#include <sane_fsops.h>
+#include <myflock.h>
+
+#ifdef STRCASECMP_IN_STRINGS_H
+#include <strings.h>
+#endif
+
+/* Global library. */
+
+#include <mail_params.h>
+#include <mail_queue.h>
+#include <mail_scan_dir.h>
+
+/* Application-specific. */
+
+#include "qmgr.h"
+
+static ARGV *qmgr_rehash_queues;	/* queues to migrate */
+static int qmgr_rehash_index;		/* current queue */
+static SCAN_DIR *qmgr_rehash_scan;	/* current queue scan */
+static int qmgr_rehash_count;		/* files moved */
+static int qmgr_rehash_skipped;		/* files skipped in this scan */
+
+#define STR	vstring_str
+
+#define QMGR_REHASH_DELAY	1
+
+/* qmgr_rehash_move - move one queue file into place */
+
+#define QMGR_REHASH_SKIPPED	(-1)	/* try again in the next scan */
+#define QMGR_REHASH_DONE	0	/* in place, or gone */
+#define QMGR_REHASH_MOVED	1	/* moved into place */
+
+static int qmgr_rehash_move(const char *queue_name, const char *queue_id)
+{
+    static VSTRING *old_path;
+    static VSTRING *new_path;
+    int     fd;
+    int     status = QMGR_REHASH_SKIPPED;
+
+    if (old_path == 0) {
+	old_path = vstring_alloc(100);
+	new_path = vstring_alloc(100);
+    }
+
+    /*
+     * Leave the file alone if it is already in the right place.
+     */
+    vstring_sprintf(old_path, "%s/%s", scan_dir_path(qmgr_rehash_scan),
+		    queue_id);
+    (void) mail_queue_dir(new_path, queue_name, queue_id);
+    vstring_strcat(new_path, queue_id);
+    if (strcmp(STR(old_path), STR(new_path)) == 0)
+	return (QMGR_REHASH_DONE);
+
+    /*
+     * Other processes may move or remove the file at any time. Don't move a
+     * logfile while someone appends to it, and don't wait for the lock.
+     */
+    if ((fd = open(STR(old_path), O_RDWR, 0)) < 0) {
+	if (errno == ENOENT)
+	    return (QMGR_REHASH_DONE);
+	msg_warn("open %s: %m", STR(old_path));
+	return (QMGR_REHASH_SKIPPED);
+    }
+    if (myflock(fd, INTERNAL_LOCK, MYFLOCK_OP_EXCLUSIVE | MYFLOCK_OP_NOWAIT) < 0) {
+	if (errno != EAGAIN)
+	    msg_warn("lock %s: %m", STR(old_path));
+    } else if (sane_rename(STR(old_path), STR(new_path)) == 0
+	       || (errno == ENOENT
+		   && mail_queue_mkdirs(STR(new_path)) == 0
+		   && sane_rename(STR(old_path), STR(new_path)) == 0)) {
+	if (msg_verbose)
+	    msg_info("move %s to %s", STR(old_path), STR(new_path));
+	status = QMGR_REHASH_MOVED;
+    } else if (errno == ENOENT) {
+	status = QMGR_REHASH_DONE;
+    } else {
+	msg_warn("move %s to %s: %m", STR(old_path), STR(new_path));
+    }
+    (void) close(fd);
+    return (status);
+}
+
+/* qmgr_rehash_event - move a limited number of queue files */
+
+static void qmgr_rehash_event(int unused_event, void *unused_context)
+{
+    const char *queue_name;
+    char   *queue_id;
+    int     count;
+    int     status;
+
+    for (count = 0; count < var_hash_queue_migr_limit; count++) {
+	queue_name = qmgr_rehash_queues->argv[qmgr_rehash_index];
+	if (qmgr_rehash_scan == 0)
+	    qmgr_rehash_scan = scan_dir_open(queue_name);
+	if ((queue_id = mail_scan_dir_next(qmgr_rehash_scan)) == 0) {
+	    qmgr_rehash_scan = scan_dir_close(qmgr_rehash_scan);
+	    if (qmgr_rehash_queues->argv[++qmgr_rehash_index] != 0)
+		continue;
+
+	    /*
+	     * Files in the previous layout become unreachable once
+	     * hash_queue_previous_depth is reset. Scan again until no file
+	     * is skipped.
+	     */
+	    if (qmgr_rehash_skipped > 0) {
+		msg_info("moved %d queue files to %s %d; skipped %d, "
+			 "scanning again", qmgr_rehash_count,
+			 VAR_HASH_QUEUE_DEPTH, var_hash_queue_depth,
+			 qmgr_rehash_skipped);
+		qmgr_rehash_skipped = 0;
+		qmgr_rehash_index = 0;
+		break;
+	    }
+	    msg_info("moved %d queue files to %s %d; %s can be set to 0",
+		     qmgr_rehash_count, VAR_HASH_QUEUE_DEPTH,
+		     var_hash_queue_depth, VAR_HASH_QUEUE_PREV_DEPTH);
+	    qmgr_rehash_queues = argv_free(qmgr_rehash_queues);
+	    return;
+	}
+	if (!mail_queue_id_ok(queue_id))
+	    continue;
+	if ((status = qmgr_rehash_move(queue_name, queue_id))
+	    == QMGR_REHASH_MOVED)
+	    qmgr_rehash_count += 1;
+	else if (status == QMGR_REHASH_SKIPPED)
+	    qmgr_rehash_skipped += 1;
+    }
+    event_request_timer(qmgr_rehash_event, (void *) 0, QMGR_REHASH_DELAY);
+}
+
+/* qmgr_rehash_init - start queue file migration */
+
+void    qmgr_rehash_init(void)
+{
+    ARGV   *hash_queue_names;
+    char  **cpp;
+
+    if (var_hash_queue_prev_depth == 0
+	|| var_hash_queue_prev_depth == var_hash_queue_depth)
+	return;
+
+    hash_queue_names = argv_split(var_hash_queue_names, CHARS_COMMA_SP);
+    qmgr_rehash_queues = argv_alloc(hash_queue_names->argc);
+    for (cpp = hash_queue_names->argv; *cpp; cpp++)
+	if (strcasecmp(*cpp, MAIL_QUEUE_INCOMING) != 0
+	    && strcasecmp(*cpp, MAIL_QUEUE_ACTIVE) != 0)
+	    argv_add(qmgr_rehash_queues, *cpp, (char *) 0);
+    argv_terminate(qmgr_rehash_queues);
+    argv_free(hash_queue_names);
+    if (qmgr_rehash_queues->argc == 0) {
+	qmgr_rehash_queues = argv_free(qmgr_rehash_queues);
+	return;
+    }
+    msg_info("moving queue files from %s %d to %s %d",
+	     VAR_HASH_QUEUE_PREV_DEPTH, var_hash_queue_prev_depth,
+	     VAR_HASH_QUEUE_DEPTH, var_hash_queue_depth);
+    event_request_timer(qmgr_rehash_event, (void *) 0, QMGR_REHASH_DELAY);
+}
@@ -15,6 +15,10 @@
 /*	void	qmgr_scan_request(scan_info, flags)
 /*	QMGR_SCAN *scan_info;
 /*	int	flags;
+/*
+/*	void	qmgr_scan_notify(scan_info, queue_id)
+/*	QMGR_SCAN *scan_info;
+/*	const char *queue_id;
 /* DESCRIPTION
 /*	This module implements queue scans. A queue scan always runs
 /*	to completion, so that all files get a fair chance. The caller
@@ -26,7 +30,11 @@
 /*	qmgr_scan_next() returns the base name of the next queue file.
 /*	A null pointer means that no file was found. qmgr_scan_next()
 /*	automagically restarts a queue scan when a scan request had
-/*	arrived while the scan was in progress.
+/*	arrived while the scan was in progress. When a deferred
+/*	queue index is used (see qmgr_index(3)), a deferred queue
+/*	scan returns only the queue files that are due, oldest
+/*	first, except when the index is rebuilt or when all queue
+/*	files must be examined.
 /*
 /*	qmgr_scan_request() records a request for the next queue scan. The
 /*	flags argument is the bit-wise OR of zero or more of the following,
@@ -45,6 +53,11 @@
 /* .IP QMGR_SCAN_START
 /*	Start a queue scan when none is in progress, or restart the
 /*	current scan upon completion.
+/* .PP
+/*	qmgr_scan_notify() reports that the named queue file has
+/*	become available (see qmgr_notify(3)). qmgr_scan_next()
+/*	returns such queue files before it continues a queue scan,
+/*	so that they are picked up without scanning the queue.
 /* DIAGNOSTICS
 /*	Fatal: out of memory.
 /*	Panic: interface violations, internal consistency errors.
@@ -62,16 +75,19 @@
 /* System library. */
 
 #include <sys_defs.h>
+#include <string.h>
 
 /* Utility library. */
 
 #include <msg.h>
 #include <mymalloc.h>
 #include <scan_dir.h>
+#include <argv.h>
 
 /* Global library. */
 
 #include <mail_scan_dir.h>
+#include <mail_queue.h>
 
 /* Application-specific. */
 
@@ -86,7 +102,7 @@ static void qmgr_scan_start(QMGR_SCAN *scan_info)
     /*
      * Sanity check.
      */
-    if (scan_info->handle)
+    if (QMGR_SCAN_BUSY(scan_info))
 	msg_panic("%s: %s queue scan in progress",
 		  myname, scan_info->queue);
 
@@ -104,7 +120,38 @@ static void qmgr_scan_start(QMGR_SCAN *scan_info)
      */
     scan_info->flags = scan_info->nflags;
     scan_info->nflags = 0;
-    scan_info->handle = scan_dir_open(scan_info->queue);
+
+    /*
+     * With a deferred queue index, open only the queue files that are due,
+     * unless all queue files must be examined, or unless the index needs to
+     * be rebuilt with a directory scan.
+     */
+    if (scan_info->indexed && (scan_info->flags & QMGR_SCAN_ALL) == 0
+	&& (scan_info->due = qmgr_index_scan()) != 0) {
+	scan_info->due_pos = 0;
+    } else {
+	scan_info->handle = scan_dir_open(scan_info->queue);
+    }
+}
+
+/* qmgr_scan_get - next queue file from the scan in progress */
+
+static char *qmgr_scan_get(QMGR_SCAN *scan_info)
+{
+    if (scan_info->due)
+	return (scan_info->due_pos < scan_info->due->argc ?
+		scan_info->due->argv[scan_info->due_pos++] : 0);
+    return (mail_scan_dir_next(scan_info->handle));
+}
+
+/* qmgr_scan_stop - terminate the scan in progress */
+
+static void qmgr_scan_stop(QMGR_SCAN *scan_info)
+{
+    if (scan_info->due)
+	scan_info->due = argv_free(scan_info->due);
+    else
+	scan_info->handle = scan_dir_close(scan_info->handle);
 }
 
 /* qmgr_scan_request - request for future scan */
@@ -129,21 +176,21 @@ void    qmgr_scan_request(QMGR_SCAN *scan_info, int flags)
      * Apply "ignore time stamp" requests also towards the scan that is
      * already in progress.
      */
-    if (scan_info->handle != 0 && (flags & QMGR_SCAN_ALL))
+    if (QMGR_SCAN_BUSY(scan_info) && (flags & QMGR_SCAN_ALL))
 	scan_info->flags |= QMGR_SCAN_ALL;
 
     /*
      * Apply "override defer_transports" requests also towards the scan that
      * is already in progress.
      */
-    if (scan_info->handle != 0 && (flags & QMGR_FLUSH_DFXP))
+    if (QMGR_SCAN_BUSY(scan_info) && (flags & QMGR_FLUSH_DFXP))
 	scan_info->flags |= QMGR_FLUSH_DFXP;
 
     /*
      * If a scan is in progress, just record the request.
      */
     scan_info->nflags |= flags;
-    if (scan_info->handle == 0 && (flags & QMGR_SCAN_START) != 0) {
+    if (!QMGR_SCAN_BUSY(scan_info) && (flags & QMGR_SCAN_START) != 0) {
 	scan_info->nflags &= ~QMGR_SCAN_START;
 	qmgr_scan_start(scan_info);
     }
@@ -155,22 +202,46 @@ char   *qmgr_scan_next(QMGR_SCAN *scan_info)
 {
     char   *path = 0;
 
+    /*
+     * Queue files that were reported as new take precedence.
+     */
+    if (scan_info->notify != 0) {
+	if (QMGR_SCAN_NOTIFIED(scan_info))
+	    return (scan_info->notify->argv[scan_info->notify_pos++]);
+	if (scan_info->notify->argc > 0) {
+	    argv_truncate(scan_info->notify, 0);
+	    scan_info->notify_pos = 0;
+	}
+    }
+
     /*
      * Restart the scan if we reach the end and a queue scan request has
      * arrived in the mean time.
      */
-    if (scan_info->handle && (path = mail_scan_dir_next(scan_info->handle)) == 0) {
-	scan_info->handle = scan_dir_close(scan_info->handle);
+    if (QMGR_SCAN_BUSY(scan_info) && (path = qmgr_scan_get(scan_info)) == 0) {
+	qmgr_scan_stop(scan_info);
 	if (msg_verbose && (scan_info->nflags & QMGR_SCAN_START) == 0)
 	    msg_info("done %s queue scan", scan_info->queue);
     }
-    if (!scan_info->handle && (scan_info->nflags & QMGR_SCAN_START)) {
+    if (!QMGR_SCAN_BUSY(scan_info) && (scan_info->nflags & QMGR_SCAN_START)) {
 	qmgr_scan_start(scan_info);
-	path = mail_scan_dir_next(scan_info->handle);
+	path = qmgr_scan_get(scan_info);
     }
     return (path);
 }
 
+/* qmgr_scan_notify - report new queue file */
+
+void    qmgr_scan_notify(QMGR_SCAN *scan_info, const char *queue_id)
+{
+    if (scan_info->notify == 0)
+	msg_panic("qmgr_scan_notify: %s queue notification is not enabled",
+		  scan_info->queue);
+    if (msg_verbose)
+	msg_info("qmgr_scan_notify: %s %s", scan_info->queue, queue_id);
+    argv_add(scan_info->notify, queue_id, ARGV_END);
+}
+
 /* qmgr_scan_create - create queue scan context */
 
 QMGR_SCAN *qmgr_scan_create(const char *queue)
@@ -181,5 +252,11 @@ QMGR_SCAN *qmgr_scan_create(const char *queue)
     scan_info->queue = mystrdup(queue);
     scan_info->flags = scan_info->nflags = 0;
     scan_info->handle = 0;
+    scan_info->indexed = (qmgr_index_enabled
+			  && strcmp(queue, MAIL_QUEUE_DEFERRED) == 0);
+    scan_info->due = 0;
+    scan_info->due_pos = 0;
+    scan_info->notify = 0;
+    scan_info->notify_pos = 0;
     return (scan_info);
 }
@@ -482,6 +482,14 @@
 /*	Available in Postfix version 3.4 and later:
 /* .IP "\fBsmtp_tls_connection_reuse (no)\fR"
 /*	Try to make multiple deliveries per TLS-encrypted connection.
+/* .PP
+/*	Available in Postfix version 3.5 and later:
+/* .IP "\fBsmtp_parallel_connect_limit (1)\fR"
+/*	The maximal number of concurrent TCP connection attempts to the
+/*	IP addresses of one server host.
+/* .IP "\fBsmtp_parallel_connect_delay (250)\fR"
+/*	The time in milliseconds between the start of concurrent TCP
+/*	connection attempts.
 /* OBSOLETE STARTTLS CONTROLS
 /* .ad
 /* .fi
@@ -592,6 +600,11 @@
 /* .IP "\fBsmtp_tls_connection_reuse (no)\fR"
 /*	Try to make multiple deliveries per TLS-encrypted connection.
 /* .PP
+/*	Available in Postfix version 3.5 and later:
+/* .IP "\fBsmtp_data_buffer_limit (65536)\fR"
+/*	The maximal size in bytes to which the Postfix SMTP client
+/*	grows its connection buffer while it sends message content.
+/* .PP
 /*	Implemented in the qmgr(8) daemon:
 /* .IP "\fBtransport_destination_concurrency_limit ($default_destination_concurrency_limit)\fR"
 /*	A transport-specific override for the
@@ -888,9 +901,12 @@ bool    var_smtp_defer_mxaddr;
 bool    var_smtp_send_xforward;
 int     var_smtp_mxaddr_limit;
 int     var_smtp_mxsess_limit;
+int     var_smtp_pconn_limit;
+int     var_smtp_pconn_delay;
 int     var_smtp_cache_conn;
 int     var_smtp_reuse_time;
 int     var_smtp_reuse_count;
+int     var_smtp_data_bufsize;
 char   *var_smtp_cache_dest;
 char   *var_scache_service;		/* You can now leave this here. */
 bool    var_smtp_cache_demand;
@@ -52,6 +52,13 @@
 /*
 /*	All routines either return a DNS_RR pointer, or return a null
 /*	pointer and update the \fIwhy\fR argument accordingly.
+/*
+/*	With DNS lookups enabled, the address lookups for all mail
+/*	exchanger hosts, and for all address types, are started at
+/*	the same time. The results are processed in the order of
+/*	the mail exchanger list and of the inet_protocols setting,
+/*	so that the result is the same as with one lookup at a time.
+/*	The time taken by each lookup is logged with verbose logging.
 /* LICENSE
 /* .ad
 /* .fi
@@ -80,6 +87,7 @@
 #include <string.h>
 #include <unistd.h>
 #include <errno.h>
+#include <sys/time.h>
 
 /* Utility library. */
 
@@ -91,6 +99,7 @@
 #include <myaddrinfo.h>
 #include <inet_proto.h>
 #include <midna_domain.h>
+#include <htable.h>
 
 /* Global library. */
 
@@ -107,6 +116,144 @@
 #include "smtp.h"
 #include "smtp_addr.h"
 
+ /*
+  * Address lookups in progress, indexed by host name. Each host has one
+  * query per address type, in the order of the inet_protocols setting.
+  */
+typedef struct {
+    DNS_ASYNC *handle;			/* pending lookup or null */
+    unsigned type;			/* T_A or T_AAAA */
+    int     status;			/* dns_lookup() status */
+    DNS_RR *rr;				/* lookup result */
+    VSTRING *why;			/* reason for failure */
+    struct timeval start;		/* lookup start time */
+    struct timeval done;		/* lookup completion time */
+} SMTP_ADDR_QUERY;
+
+typedef struct {
+    int     count;			/* number of address types */
+    SMTP_ADDR_QUERY *query;		/* one lookup per address type */
+} SMTP_ADDR_LOOKUP;
+
+static HTABLE *smtp_addr_lookups;
+
+/* smtp_addr_lookup_done - save address lookup result */
+
+static void smtp_addr_lookup_done(int status, DNS_RR *rr, int unused_rcode,
+				          const char *why, void *context)
+{
+    SMTP_ADDR_QUERY *qp = (SMTP_ADDR_QUERY *) context;
+
+    qp->handle = 0;
+    qp->status = status;
+    qp->rr = rr;
+    vstring_strcpy(qp->why, why);
+    GETTIMEOFDAY(&qp->done);
+}
+
+/* smtp_addr_lookup_free - destroy address lookup */
+
+static void smtp_addr_lookup_free(void *ptr)
+{
+    SMTP_ADDR_LOOKUP *lp = (SMTP_ADDR_LOOKUP *) ptr;
+    SMTP_ADDR_QUERY *qp;
+
+    for (qp = lp->query; qp < lp->query + lp->count; qp++) {
+	if (qp->handle)
+	    dns_async_cancel(qp->handle);
+	if (qp->rr)
+	    dns_rr_free(qp->rr);
+	vstring_free(qp->why);
+    }
+    myfree((void *) lp->query);
+    myfree((void *) lp);
+}
+
+/* smtp_addr_lookup_start - start address lookups for one host name */
+
+static void smtp_addr_lookup_start(const char *host, int res_opt)
+{
+    INET_PROTO_INFO *proto_info = inet_proto_info();
+    SMTP_ADDR_LOOKUP *lp;
+    SMTP_ADDR_QUERY *qp;
+    unsigned *tp;
+
+    if (smtp_addr_lookups == 0)
+	smtp_addr_lookups = htable_create(13);
+    if (htable_find(smtp_addr_lookups, host) != 0)
+	return;
+    lp = (SMTP_ADDR_LOOKUP *) mymalloc(sizeof(*lp));
+    for (lp->count = 0, tp = proto_info->dns_atype_list; *tp; tp++)
+	lp->count++;
+    lp->query = (SMTP_ADDR_QUERY *) mymalloc(sizeof(*lp->query) * lp->count);
+    htable_enter(smtp_addr_lookups, host, (void *) lp);
+    for (qp = lp->query, tp = proto_info->dns_atype_list; *tp; qp++, tp++) {
+	if (msg_verbose)
+	    msg_info("lookup %s type %s flags %s",
+		     host, dns_strtype(*tp), dns_str_resflags(res_opt));
+	qp->type = *tp;
+	qp->status = DNS_NOTFOUND;
+	qp->rr = 0;
+	qp->why = vstring_alloc(100);
+	GETTIMEOFDAY(&qp->start);
+	qp->done = qp->start;
+	qp->handle = dns_async_lookup(host, *tp, res_opt, DNS_REQ_FLAG_NONE,
+				      smtp_addr_lookup_done, (void *) qp);
+    }
+}
+
+/* smtp_addr_lookup_result - wait for and merge address lookup results */
+
+static int smtp_addr_lookup_result(const char *host, DNS_RR **addr,
+				           VSTRING *why)
+{
+    const char *myname = "smtp_addr_lookup_result";
+    SMTP_ADDR_LOOKUP *lp;
+    SMTP_ADDR_QUERY *qp;
+    SMTP_ADDR_QUERY *hpref = 0;
+    int     status = DNS_NOTFOUND;
+    long    msec;
+
+    if ((lp = (SMTP_ADDR_LOOKUP *) htable_find(smtp_addr_lookups, host)) == 0)
+	msg_panic("%s: no lookup for host %s", myname, host);
+    (void) dns_async_wait(-1);
+
+    /*
+     * Merge the per-type results as dns_lookup_v() would: records are
+     * appended in address type order, and the last result with the highest
+     * status determines the status and reason. As with dns_lookup_v(), a
+     * successful lookup does not update the reason.
+     */
+    *addr = 0;
+    for (qp = lp->query; qp < lp->query + lp->count; qp++) {
+	if (qp->handle != 0)
+	    msg_panic("%s: lookup for host %s type %s did not complete",
+		      myname, host, dns_strtype(qp->type));
+	if (msg_verbose) {
+	    msec = (qp->done.tv_sec - qp->start.tv_sec) * 1000
+		+ (qp->done.tv_usec - qp->start.tv_usec) / 1000;
+	    msg_info("%s: host %s type %s status %d time %ld ms",
+		     myname, host, dns_strtype(qp->type), qp->status, msec);
+	}
+	if (qp->rr) {
+	    *addr = dns_rr_append(*addr, qp->rr);
+	    qp->rr = 0;
+	}
+	if (qp->status != DNS_OK)
+	    vstring_strcpy(why, STR(qp->why));
+	if (qp + 1 < lp->query + lp->count
+	    && (hpref == 0 || qp->status >= hpref->status))
+	    hpref = qp;
+	status = qp->status;
+    }
+    if (hpref != 0 && status < hpref->status) {
+	status = hpref->status;
+	vstring_strcpy(why, STR(hpref->why));
+    }
+    htable_delete(smtp_addr_lookups, host, smtp_addr_lookup_free);
+    return (status);
+}
+
 /* smtp_print_addr - print address list */
 
 static void smtp_print_addr(const char *what, DNS_RR *addr_list)
@@ -127,6 +274,22 @@ static void smtp_print_addr(const char *what, DNS_RR *addr_list)
     msg_info("end %s address list", what);
 }
 
+/* smtp_addr_literal - convert numerical host name */
+
+static struct addrinfo *smtp_addr_literal(const char *host)
+{
+    INET_PROTO_INFO *proto_info = inet_proto_info();
+    struct addrinfo *res0;
+
+    if (hostaddr_to_sockaddr(host, (char *) 0, 0, &res0) != 0)
+	return (0);
+    if (strchr((char *) proto_info->sa_family_list, res0->ai_family) == 0) {
+	freeaddrinfo(res0);
+	return (0);
+    }
+    return (res0);
+}
+
 /* smtp_addr_one - address lookup for one host name */
 
 static DNS_RR *smtp_addr_one(DNS_RR *addr_list, const char *host, int res_opt,
@@ -148,16 +311,13 @@ static DNS_RR *smtp_addr_one(DNS_RR *addr_list, const char *host, int res_opt,
     /*
      * Interpret a numerical name as an address.
      */
-    if (hostaddr_to_sockaddr(host, (char *) 0, 0, &res0) == 0) {
-	if (strchr((char *) proto_family_list, res0->ai_family) != 0) {
-	    if ((addr = dns_sa_to_rr(host, pref, res0->ai_addr)) == 0)
-		msg_fatal("host %s: conversion error for address family "
-			  "%d: %m", host, res0->ai_addr->sa_family);
-	    addr_list = dns_rr_append(addr_list, addr);
-	    freeaddrinfo(res0);
-	    return (addr_list);
-	}
+    if ((res0 = smtp_addr_literal(host)) != 0) {
+	if ((addr = dns_sa_to_rr(host, pref, res0->ai_addr)) == 0)
+	    msg_fatal("host %s: conversion error for address family "
+		      "%d: %m", host, res0->ai_addr->sa_family);
+	addr_list = dns_rr_append(addr_list, addr);
 	freeaddrinfo(res0);
+	return (addr_list);
     }
 
     /*
@@ -168,9 +328,8 @@ static DNS_RR *smtp_addr_one(DNS_RR *addr_list, const char *host, int res_opt,
      */
     if (smtp_host_lookup_mask & SMTP_HOST_FLAG_DNS) {
 	res_opt |= smtp_dns_res_opt;
-	switch (dns_lookup_v(host, res_opt, &addr, (VSTRING *) 0,
-			     why->reason, DNS_REQ_FLAG_NONE,
-			     proto_info->dns_atype_list)) {
+	smtp_addr_lookup_start(host, res_opt);
+	switch (smtp_addr_lookup_result(host, &addr, why->reason)) {
 	case DNS_OK:
 	    for (rr = addr; rr; rr = rr->next)
 		rr->pref = pref;
@@ -252,6 +411,7 @@ static DNS_RR *smtp_addr_list(DNS_RR *mx_names, DSN_BUF *why)
 {
     DNS_RR *addr_list = 0;
     DNS_RR *rr;
+    struct addrinfo *res0;
     int     res_opt = 0;
 
     if (mx_names->dnssec_valid)
@@ -281,7 +441,23 @@ static DNS_RR *smtp_addr_list(DNS_RR *mx_names, DSN_BUF *why)
      * getaddrinfo() may invoke a resolver that runs in a different process
      * (NIS server, nscd), so we can't even reliably turn this off by
      * tweaking the in-process resolver flags.
+     * 
+     * Start the DNS address lookups for all mail exchangers before waiting
+     * for any of them. smtp_addr_one() processes the results in MX order.
+     * Skip the names that smtp_addr_one() converts without DNS lookup,
+     * otherwise their lookup results would never be collected.
      */
+    if (smtp_host_lookup_mask & SMTP_HOST_FLAG_DNS) {
+	for (rr = mx_names; rr; rr = rr->next) {
+	    if (rr->type != T_MX)
+		continue;
+	    if ((res0 = smtp_addr_literal((char *) rr->data)) != 0)
+		freeaddrinfo(res0);
+	    else
+		smtp_addr_lookup_start((char *) rr->data,
+				       res_opt | smtp_dns_res_opt);
+	}
+    }
     for (rr = mx_names; rr; rr = rr->next) {
 	if (rr->type != T_MX)
 	    msg_panic("smtp_addr_list: bad resource type: %d", rr->type);
@@ -72,6 +72,12 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <ctype.h>
+#include <sys/time.h>
+
+#if defined(USE_SYSV_POLL) || defined(USE_SYSV_POLL_THEN_SELECT)
+#include <poll.h>
+#define SMTP_CONNECT_RACE		/* parallel connect is supported */
+#endif
 
 #ifndef IPPORT_SMTP
 #define IPPORT_SMTP 25
@@ -119,6 +125,8 @@
 static SMTP_SESSION *smtp_connect_sock(int, struct sockaddr *, int,
 				               SMTP_ITERATOR *, DSN_BUF *,
 				               int);
+static SMTP_SESSION *smtp_connect_stream(int, struct sockaddr *,
+				               SMTP_ITERATOR *, time_t, int);
 
 /* smtp_connect_unix - connect to UNIX-domain address */
 
@@ -168,32 +176,25 @@ static SMTP_SESSION *smtp_connect_unix(SMTP_ITERATOR *iter, DSN_BUF *why,
 			      sizeof(sock_un), iter, why, sess_flags));
 }
 
-/* smtp_connect_addr - connect to explicit address */
+/* smtp_connect_bind - create and bind socket for explicit address */
 
-static SMTP_SESSION *smtp_connect_addr(SMTP_ITERATOR *iter, DSN_BUF *why,
-				               int sess_flags)
+static int smtp_connect_bind(DNS_RR *addr, unsigned port, struct sockaddr *sa,
+			             SOCKADDR_SIZE *salen, DSN_BUF *why)
 {
-    const char *myname = "smtp_connect_addr";
-    struct sockaddr_storage ss;		/* remote */
-    struct sockaddr *sa = (struct sockaddr *) &ss;
-    SOCKADDR_SIZE salen = sizeof(ss);
+    const char *myname = "smtp_connect_bind";
     MAI_HOSTADDR_STR hostaddr;
-    DNS_RR *addr = iter->rr;
-    unsigned port = iter->port;
     int     sock;
     char   *bind_addr;
     char   *bind_var;
 
-    dsb_reset(why);				/* Paranoia */
-
     /*
      * Sanity checks.
      */
-    if (dns_rr_to_sa(addr, port, sa, &salen) != 0) {
+    if (dns_rr_to_sa(addr, port, sa, salen) != 0) {
 	msg_warn("%s: skip address type %s: %m",
 		 myname, dns_strtype(addr->type));
 	dsb_simple(why, "4.4.0", "network address conversion failed: %m");
-	return (0);
+	return (-1);
     }
 
     /*
@@ -266,6 +267,25 @@ static SMTP_SESSION *smtp_connect_addr(SMTP_ITERATOR *iter, DSN_BUF *why,
 	    }
 	}
     }
+    return (sock);
+}
+
+/* smtp_connect_addr - connect to explicit address */
+
+static SMTP_SESSION *smtp_connect_addr(SMTP_ITERATOR *iter, DSN_BUF *why,
+				               int sess_flags)
+{
+    const char *myname = "smtp_connect_addr";
+    struct sockaddr_storage ss;		/* remote */
+    struct sockaddr *sa = (struct sockaddr *) &ss;
+    SOCKADDR_SIZE salen = sizeof(ss);
+    unsigned port = iter->port;
+    int     sock;
+
+    dsb_reset(why);				/* Paranoia */
+
+    if ((sock = smtp_connect_bind(iter->rr, port, sa, &salen, why)) < 0)
+	return (0);
 
     /*
      * Connect to the server.
@@ -277,6 +297,278 @@ static SMTP_SESSION *smtp_connect_addr(SMTP_ITERATOR *iter, DSN_BUF *why,
     return (smtp_connect_sock(sock, sa, salen, iter, why, sess_flags));
 }
 
+ /*
+  * Parallel connection attempts to the addresses of one server host, in the
+  * spirit of RFC 8305. The attempts alternate between IPv6 and IPv4
+  * addresses, and are started with a fixed delay between them; the first
+  * attempt that completes wins, and the others are closed. We use poll(),
+  * so that this works with any file descriptor number. On historical
+  * systems without poll(), addresses are tried one at a time.
+  */
+#ifdef SMTP_CONNECT_RACE
+
+typedef struct {
+    DNS_RR *rr;				/* server address */
+    struct sockaddr_storage ss;		/* server socket address */
+    SOCKADDR_SIZE salen;		/* server socket address length */
+    int     sock;			/* connection in progress, or -1 */
+    struct timeval deadline;		/* connect timeout */
+    int     revents;			/* poll() result */
+} SMTP_CONNECT_TRY;
+
+#define SMTP_CONNECT_TRY_MAX	10	/* Sanity limit */
+
+#define SMTP_TV_MSEC(t1, t2) \
+	(((t1).tv_sec - (t2).tv_sec) * 1000 \
+	    + ((t1).tv_usec - (t2).tv_usec) / 1000)
+
+#define SMTP_TV_ADD_MSEC(t, ms) do { \
+	(t).tv_sec += (ms) / 1000; \
+	(t).tv_usec += ((ms) % 1000) * 1000; \
+	if ((t).tv_usec >= 1000000) { \
+	    (t).tv_sec += 1; \
+	    (t).tv_usec -= 1000000; \
+	} \
+    } while (0)
+
+/* smtp_connect_fail - report connection failure */
+
+static void smtp_connect_fail(SMTP_ITERATOR *iter, DNS_RR *rr, int err,
+			              DSN_BUF *why)
+{
+    MAI_HOSTADDR_STR hostaddr;
+
+    /*
+     * The caller logs the last failure, as with sequential connections.
+     */
+    if (SMTP_HAS_DSN(why))
+	msg_info("%s", STR(why->reason));
+    if (dns_rr_to_pa(rr, &hostaddr) == 0)
+	strcpy(hostaddr.buf, "unknown");
+    errno = err;
+    if (iter->port)
+	dsb_simple(why, "4.4.1", "connect to %s[%s]:%d: %m",
+		   SMTP_HNAME(rr), hostaddr.buf, ntohs(iter->port));
+    else
+	dsb_simple(why, "4.4.1", "connect to %s[%s]: %m",
+		   SMTP_HNAME(rr), hostaddr.buf);
+}
+
+/* smtp_connect_interleave - alternate address families */
+
+static void smtp_connect_interleave(SMTP_CONNECT_TRY *try, int count)
+{
+    DNS_RR *same[SMTP_CONNECT_TRY_MAX];
+    DNS_RR *other[SMTP_CONNECT_TRY_MAX];
+    int     same_count = 0;
+    int     other_count = 0;
+    int     n;
+    int     i;
+    int     j;
+
+    /*
+     * Preserve the relative order within each address family, and start
+     * with the family of the first address (the smtp_address_preference
+     * winner).
+     */
+    for (n = 0; n < count; n++) {
+	if (try[n].rr->type == try[0].rr->type)
+	    same[same_count++] = try[n].rr;
+	else
+	    other[other_count++] = try[n].rr;
+    }
+    for (n = i = j = 0; n < count; n++) {
+	if (j >= other_count || (i < same_count && (n & 1) == 0))
+	    try[n].rr = same[i++];
+	else
+	    try[n].rr = other[j++];
+    }
+}
+
+/* smtp_connect_race - parallel connect to the addresses of one host */
+
+static SMTP_SESSION *smtp_connect_race(SMTP_ITERATOR *iter, DSN_BUF *why,
+				               int sess_flags, int addr_left)
+{
+    const char *myname = "smtp_connect_race";
+    SMTP_CONNECT_TRY try[SMTP_CONNECT_TRY_MAX];
+    SMTP_CONNECT_TRY *tp;
+    SMTP_CONNECT_TRY *winner = 0;
+    DNS_RR *rr;
+    int     limit;
+    int     count;
+    int     started;
+    int     pending;
+    int     err;
+    SOCKOPT_SIZE err_len;
+    struct timeval now;
+    struct timeval next_start;
+    struct pollfd pfd[SMTP_CONNECT_TRY_MAX];
+    int     nfds;
+    int     wait_ms;
+    time_t  start_time;
+    DNS_RR *last_rr;
+    MAI_HOSTADDR_STR hostaddr;
+
+    /*
+     * Collect the addresses that immediately follow the current one, and
+     * that belong to the same host. Those share the TLS policy and the
+     * DNSSEC status of the current address.
+     */
+    limit = var_smtp_pconn_limit;
+    if (addr_left > 0 && limit > addr_left)
+	limit = addr_left;
+    if (limit > SMTP_CONNECT_TRY_MAX)
+	limit = SMTP_CONNECT_TRY_MAX;
+    for (count = 0, rr = iter->rr; rr != 0 && count < limit;
+	 count++, rr = rr->next) {
+	if (rr != iter->rr
+	    && (rr->dnssec_valid != iter->rr->dnssec_valid
+		|| strcasecmp(SMTP_HNAME(rr), STR(iter->host)) != 0))
+	    break;
+	try[count].rr = rr;
+	try[count].sock = -1;
+    }
+    if (count < 2)
+	return (smtp_connect_addr(iter, why, sess_flags));
+    last_rr = try[count - 1].rr;
+    smtp_connect_interleave(try, count);
+
+    dsb_reset(why);				/* Paranoia */
+    start_time = time((time_t *) 0);
+    GETTIMEOFDAY(&now);
+    next_start = now;
+    started = pending = 0;
+
+    while (winner == 0 && (started < count || pending > 0)) {
+
+	/*
+	 * Start the next connection attempt when the attempt delay has
+	 * passed, or when no attempt is in progress.
+	 */
+	if (started < count
+	    && (pending == 0 || SMTP_TV_MSEC(now, next_start) >= 0)) {
+	    tp = try + started++;
+	    tp->salen = sizeof(tp->ss);
+	    if ((tp->sock = smtp_connect_bind(tp->rr, iter->port,
+					      SOCK_ADDR_PTR(&tp->ss),
+					      &tp->salen, why)) < 0)
+		continue;
+	    if (msg_verbose && dns_rr_to_pa(tp->rr, &hostaddr) != 0)
+		msg_info("%s: trying: %s[%s] port %d...", myname,
+			 SMTP_HNAME(tp->rr), hostaddr.buf, ntohs(iter->port));
+	    non_blocking(tp->sock, NON_BLOCKING);
+	    if (sane_connect(tp->sock, SOCK_ADDR_PTR(&tp->ss),
+			     tp->salen) == 0) {
+		winner = tp;
+		break;
+	    }
+	    if (errno != EINPROGRESS) {
+		smtp_connect_fail(iter, tp->rr, errno, why);
+		close(tp->sock);
+		tp->sock = -1;
+		continue;
+	    }
+	    pending++;
+	    tp->deadline = now;
+	    SMTP_TV_ADD_MSEC(tp->deadline, var_smtp_conn_tmout * 1000);
+	    next_start = now;
+	    SMTP_TV_ADD_MSEC(next_start, var_smtp_pconn_delay);
+	}
+
+	/*
+	 * Wait until a connection completes, until a connection times out,
+	 * or until it is time to start the next connection.
+	 */
+#define SMTP_WAIT_UNTIL(wait_ms, when, now) do { \
+	long _ms = SMTP_TV_MSEC((when), (now)); \
+	if (_ms < 0) \
+	    _ms = 0; \
+	if ((wait_ms) < 0 || _ms < (wait_ms)) \
+	    (wait_ms) = _ms; \
+    } while (0)
+
+	nfds = 0;
+	wait_ms = -1;				/* no time limit */
+	if (started < count)
+	    SMTP_WAIT_UNTIL(wait_ms, next_start, now);
+	for (tp = try; tp < try + started; tp++) {
+	    tp->revents = 0;
+	    if (tp->sock < 0)
+		continue;
+	    pfd[nfds].fd = tp->sock;
+	    pfd[nfds].events = POLLOUT;
+	    pfd[nfds].revents = 0;
+	    nfds++;
+	    if (var_smtp_conn_tmout > 0)
+		SMTP_WAIT_UNTIL(wait_ms, tp->deadline, now);
+	}
+	if (poll(pfd, nfds, wait_ms) < 0) {
+	    if (errno != EINTR)
+		msg_fatal("%s: poll: %m", myname);
+	} else {
+	    for (nfds = 0, tp = try; tp < try + started; tp++)
+		if (tp->sock >= 0)
+		    tp->revents = pfd[nfds++].revents;
+	}
+	GETTIMEOFDAY(&now);
+
+	/*
+	 * Harvest completed and timed out connection attempts.
+	 */
+	for (tp = try; tp < try + started; tp++) {
+	    if (tp->sock < 0)
+		continue;
+	    if (tp->revents != 0) {
+		err_len = sizeof(err);
+		if (getsockopt(tp->sock, SOL_SOCKET, SO_ERROR,
+			       (void *) &err, &err_len) < 0)
+		    err = errno;
+		if (err == 0) {
+		    winner = tp;
+		    break;
+		}
+	    } else if (var_smtp_conn_tmout > 0
+		       && SMTP_TV_MSEC(tp->deadline, now) <= 0) {
+		err = ETIMEDOUT;
+	    } else {
+		continue;
+	    }
+	    smtp_connect_fail(iter, tp->rr, err, why);
+	    close(tp->sock);
+	    tp->sock = -1;
+	    pending--;
+	}
+    }
+
+    /*
+     * Close the connection attempts that lost the race, and report the
+     * winner (or the last address tried) to the caller.
+     */
+    for (tp = try; tp < try + started; tp++) {
+	if (tp != winner && tp->sock >= 0) {
+	    if (msg_verbose && dns_rr_to_pa(tp->rr, &hostaddr) != 0)
+		msg_info("%s: abandon %s[%s]", myname,
+			 SMTP_HNAME(tp->rr), hostaddr.buf);
+	    close(tp->sock);
+	}
+    }
+    iter->rr = (winner ? winner->rr : last_rr);
+    if (dns_rr_to_pa(iter->rr, &hostaddr) != 0)
+	vstring_strcpy(iter->addr, hostaddr.buf);
+    if (winner == 0)
+	return (0);
+    if (SMTP_HAS_DSN(why)) {
+	msg_info("%s", STR(why->reason));
+	dsb_reset(why);
+    }
+    non_blocking(winner->sock, BLOCKING);
+    return (smtp_connect_stream(winner->sock, SOCK_ADDR_PTR(&winner->ss),
+				iter, start_time, sess_flags));
+}
+
+#endif
+
 /* smtp_connect_sock - connect a socket over some transport */
 
 static SMTP_SESSION *smtp_connect_sock(int sock, struct sockaddr *sa,
@@ -287,7 +579,6 @@ static SMTP_SESSION *smtp_connect_sock(int sock, struct sockaddr *sa,
 {
     int     conn_stat;
     int     saved_errno;
-    VSTREAM *stream;
     time_t  start_time;
     const char *name = STR(iter->host);
     const char *addr = STR(iter->addr);
@@ -312,6 +603,18 @@ static SMTP_SESSION *smtp_connect_sock(int sock, struct sockaddr *sa,
 	close(sock);
 	return (0);
     }
+    return (smtp_connect_stream(sock, sa, iter, start_time, sess_flags));
+}
+
+/* smtp_connect_stream - bundle up connected socket */
+
+static SMTP_SESSION *smtp_connect_stream(int sock, struct sockaddr *sa,
+					         SMTP_ITERATOR *iter,
+					         time_t start_time,
+					         int sess_flags)
+{
+    VSTREAM *stream;
+
     stream = vstream_fdopen(sock, O_RDWR);
 
     /*
@@ -985,8 +1288,23 @@ static void smtp_connect_inet(SMTP_STATE *state, const char *nexthop,
 	    if ((state->misc_flags & SMTP_MISC_FLAG_CONN_LOAD) == 0
 		|| addr->pref == domain_best_pref
 		|| !(session = smtp_reuse_addr(state,
-					  SMTP_KEY_MASK_SCACHE_ENDP_LABEL)))
-		session = smtp_connect_addr(iter, why, state->misc_flags);
+					  SMTP_KEY_MASK_SCACHE_ENDP_LABEL))) {
+#ifdef SMTP_CONNECT_RACE
+		if (var_smtp_pconn_limit > 1) {
+		    session = smtp_connect_race(iter, why, state->misc_flags,
+						var_smtp_mxaddr_limit > 0 ?
+					 var_smtp_mxaddr_limit - addr_count + 1 :
+						0);
+		    /* Skip the addresses that were tried in parallel. */
+		    while (addr != iter->rr) {
+			addr = addr->next;
+			next = (++addr_count == var_smtp_mxaddr_limit) ?
+			    0 : addr->next;
+		    }
+		} else
+#endif
+		    session = smtp_connect_addr(iter, why, state->misc_flags);
+	    }
 	    if ((state->session = session) != 0) {
 		session->state = state;
 #ifdef USE_TLS
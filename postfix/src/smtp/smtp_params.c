@@ -93,7 +93,10 @@
 	VAR_SMTP_LINE_LIMIT, DEF_SMTP_LINE_LIMIT, &var_smtp_line_limit, 0, 0,
 	VAR_SMTP_MXADDR_LIMIT, DEF_SMTP_MXADDR_LIMIT, &var_smtp_mxaddr_limit, 0, 0,
 	VAR_SMTP_MXSESS_LIMIT, DEF_SMTP_MXSESS_LIMIT, &var_smtp_mxsess_limit, 0, 0,
+	VAR_SMTP_PCONN_LIMIT, DEF_SMTP_PCONN_LIMIT, &var_smtp_pconn_limit, 1, 0,
+	VAR_SMTP_PCONN_DELAY, DEF_SMTP_PCONN_DELAY, &var_smtp_pconn_delay, 0, 0,
 	VAR_SMTP_REUSE_COUNT, DEF_SMTP_REUSE_COUNT, &var_smtp_reuse_count, 0, 0,
+	VAR_SMTP_DATA_BUFSIZE, DEF_SMTP_DATA_BUFSIZE, &var_smtp_data_bufsize, 0, 0,
 #ifdef USE_TLS
 	VAR_SMTP_TLS_SCERT_VD, DEF_SMTP_TLS_SCERT_VD, &var_smtp_tls_scert_vd, 0, 0,
 #endif
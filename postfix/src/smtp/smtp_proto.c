@@ -1195,6 +1195,54 @@ static void smtp_text_out(void *context, int rec_type,
     } while (data_left > 0);
 }
 
+/* smtp_text_copy - copy one body record from queue file */
+
+static int smtp_text_copy(SMTP_STATE *state, int rec_type, ssize_t len)
+{
+    SMTP_SESSION *session = state->session;
+    ssize_t data_left;
+    ssize_t count;
+    int     ch;
+
+    /*
+     * Same as smtp_text_out(), but the record content is still in the queue
+     * file stream. A short copy means that the queue file is truncated.
+     */
+    data_left = len;
+    do {
+	if (state->space_left == var_smtp_line_limit && data_left > 0) {
+	    if ((ch = VSTREAM_GETC(state->src)) == VSTREAM_EOF)
+		return (-1);
+	    if (ch == '.')
+		smtp_fputc('.', session->stream);
+	    vstream_ungetc(state->src, ch);
+	}
+	if (var_smtp_line_limit > 0 && data_left >= state->space_left) {
+	    count = state->space_left;
+	    if (smtp_fcopy(state->src, count, session->stream) != count)
+		return (-1);
+	    smtp_fputs("", 0, session->stream);
+	    data_left -= count;
+	    state->space_left = var_smtp_line_limit;
+	    if (data_left > 0 || rec_type == REC_TYPE_CONT) {
+		smtp_fputc(' ', session->stream);
+		state->space_left -= 1;
+	    }
+	} else {
+	    if (smtp_fcopy(state->src, data_left, session->stream) != data_left)
+		return (-1);
+	    if (rec_type == REC_TYPE_CONT) {
+		state->space_left -= data_left;
+	    } else {
+		smtp_fputs("", 0, session->stream);
+		state->space_left = var_smtp_line_limit;
+	    }
+	    break;
+	}
+    } while (data_left > 0);
+    return (0);
+}
+
 /* smtp_format_out - output one header/body record */
 
 static void PRINTFLIKE(3, 4) smtp_format_out(void *, int, const char *,...);
@@ -1406,6 +1454,7 @@ static int smtp_loop(SMTP_STATE *state, NOCLOBBER int send_state,
     NOCLOBBER int mail_from_rejected;
     NOCLOBBER int downgrading;
     int     mime_errs;
+    ssize_t text_len;
     SMTP_RESP fake;
     int     fail_status;
 
@@ -2218,6 +2267,9 @@ static int smtp_loop(SMTP_STATE *state, NOCLOBBER int send_state,
 
 	    smtp_stream_setup(session->stream, var_smtp_data1_tmout,
 			      var_smtp_rec_deadline);
+	    vstream_control(session->stream,
+			    CA_VSTREAM_CTL_BUFSIZE_LIMIT(var_smtp_data_bufsize),
+			    CA_VSTREAM_CTL_END);
 
 	    if ((except = vstream_setjmp(session->stream)) == 0) {
 
@@ -2252,15 +2304,25 @@ static int smtp_loop(SMTP_STATE *state, NOCLOBBER int send_state,
 							   (void *) state);
 		state->space_left = var_smtp_line_limit;
 
-		while ((rec_type = rec_get(state->src, session->scratch, 0)) > 0) {
-		    if (rec_type != REC_TYPE_NORM && rec_type != REC_TYPE_CONT)
-			break;
-		    if (session->mime_state == 0) {
-			smtp_text_out((void *) state, rec_type,
-				      vstring_str(session->scratch),
-				      VSTRING_LEN(session->scratch),
-				      (off_t) 0);
-		    } else {
+		/*
+		 * Without MIME processing, copy message text from the queue
+		 * file buffer straight into the SMTP stream buffer.
+		 */
+		if (session->mime_state == 0) {
+		    while ((rec_type = rec_get_text(state->src, session->scratch,
+						    &text_len, 0)) > 0) {
+			if (rec_type != REC_TYPE_NORM && rec_type != REC_TYPE_CONT)
+			    break;
+			if (smtp_text_copy(state, rec_type, text_len) < 0) {
+			    rec_type = REC_TYPE_ERROR;
+			    break;
+			}
+			prev_type = rec_type;
+		    }
+		} else {
+		    while ((rec_type = rec_get(state->src, session->scratch, 0)) > 0) {
+			if (rec_type != REC_TYPE_NORM && rec_type != REC_TYPE_CONT)
+			    break;
 			mime_errs =
 			    mime_state_update(session->mime_state, rec_type,
 					      vstring_str(session->scratch),
@@ -2269,8 +2331,8 @@ static int smtp_loop(SMTP_STATE *state, NOCLOBBER int send_state,
 			    smtp_mime_fail(state, mime_errs);
 			    RETURN(0);
 			}
+			prev_type = rec_type;
 		    }
-		    prev_type = rec_type;
 		}
 
 		if (session->mime_state) {
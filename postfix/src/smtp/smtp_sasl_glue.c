@@ -242,7 +242,8 @@ void    smtp_sasl_initialize(void)
     smtp_sasl_passwd_map = maps_create(VAR_LMTP_SMTP(SASL_PASSWD),
 				       var_smtp_sasl_passwd,
 				       DICT_FLAG_LOCK | DICT_FLAG_FOLD_FIX
-				       | DICT_FLAG_UTF8_REQUEST);
+				       | DICT_FLAG_UTF8_REQUEST
+				       | DICT_FLAG_NO_CACHE);
     if ((smtp_sasl_impl = xsasl_client_init(var_smtp_sasl_type,
 					    var_smtp_sasl_path)) == 0)
 	msg_fatal("SASL library initialization");
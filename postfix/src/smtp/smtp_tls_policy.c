@@ -138,7 +138,8 @@ void    smtp_tls_list_init(void)
 	tls_policy = maps_create(VAR_LMTP_SMTP(TLS_POLICY),
 				 var_smtp_tls_policy,
 				 DICT_FLAG_LOCK | DICT_FLAG_FOLD_FIX
-				 | DICT_FLAG_UTF8_REQUEST);
+				 | DICT_FLAG_UTF8_REQUEST
+				 | DICT_FLAG_NO_CACHE);
 	if (*var_smtp_tls_per_site)
 	    msg_warn("%s ignored when %s is not empty.",
 		     VAR_LMTP_SMTP(TLS_PER_SITE), VAR_LMTP_SMTP(TLS_POLICY));
@@ -148,7 +149,8 @@ void    smtp_tls_list_init(void)
 	tls_per_site = maps_create(VAR_LMTP_SMTP(TLS_PER_SITE),
 				   var_smtp_tls_per_site,
 				   DICT_FLAG_LOCK | DICT_FLAG_FOLD_FIX
-				   | DICT_FLAG_UTF8_REQUEST);
+				   | DICT_FLAG_UTF8_REQUEST
+				   | DICT_FLAG_NO_CACHE);
     }
 }
 
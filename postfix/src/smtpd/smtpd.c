@@ -730,6 +730,12 @@
 /*	The maximal number of AUTH commands that any client is allowed to
 /*	send to this service per time unit, regardless of whether or not
 /*	Postfix actually accepts those commands.
+/* .PP
+/*	Available in Postfix version 3.5 and later:
+/* .IP "\fBsmtpd_data_buffer_limit (65536)\fR"
+/*	The maximal size in bytes to which the Postfix SMTP server
+/*	grows its connection buffer while it receives large amounts
+/*	of data, such as message content.
 /* TARPIT CONTROLS
 /* .ad
 /* .fi
@@ -1193,6 +1199,7 @@
 #include <is_header.h>
 #include <anvil_clnt.h>
 #include <flush_clnt.h>
+#include <resolve_clnt.h>
 #include <ehlo_mask.h>			/* ehlo filter */
 #include <maps.h>			/* ehlo filter */
 #include <valid_mailhost_addr.h>
@@ -1417,6 +1424,7 @@ char   *var_unk_addr_tf_act;
 char   *var_unv_rcpt_tf_act;
 char   *var_unv_from_tf_act;
 bool    var_smtpd_rec_deadline;
+int     var_smtpd_data_bufsize;
 
 int     smtpd_proxy_opts;
 
@@ -2075,7 +2083,7 @@ static int mail_open_stream(SMTPD_STATE *state)
      */
     if (state->dest) {
 	state->cleanup = state->dest->stream;
-	state->queue_id = mystrdup(state->dest->id);
+	state->queue_id = arena_strdup(state->mail_arena, state->dest->id);
 	if (SMTPD_STAND_ALONE(state) == 0) {
 	    if (state->milters != 0
 		&& (state->saved_flags & MILTER_SKIP_FLAGS) == 0)
@@ -2659,16 +2667,18 @@ static int mail_cmd(SMTPD_STATE *state, int argc, SMTPD_TOKEN *argv)
      * No more early returns. The mail transaction is in progress.
      */
     GETTIMEOFDAY(&state->arrival_time);
-    state->sender = mystrdup(STR(state->addr_buf));
+    state->sender = arena_strdup(state->mail_arena, STR(state->addr_buf));
     vstring_sprintf(state->instance, "%x.%lx.%lx.%x",
 		    var_pid, (unsigned long) state->arrival_time.tv_sec,
 	       (unsigned long) state->arrival_time.tv_usec, state->seqno++);
     if (verp_delims)
-	state->verp_delims = mystrdup(verp_delims);
+	state->verp_delims = arena_strdup(state->mail_arena, verp_delims);
     if (dsn_envid)
-	state->dsn_envid = mystrdup(STR(state->dsn_buf));
+	state->dsn_envid =
+	    arena_strdup(state->mail_arena, STR(state->dsn_buf));
     if (USE_SMTPD_PROXY(state))
-	state->proxy_mail = mystrdup(STR(state->buffer));
+	state->proxy_mail =
+	    arena_strdup(state->mail_arena, STR(state->buffer));
     if (var_smtpd_delay_open == 0 && mail_open_stream(state) < 0) {
 	/* XXX Reset access map side effects. */
 	mail_reset(state);
@@ -2697,24 +2707,14 @@ static void mail_reset(SMTPD_STATE *state)
 	state->cleanup = 0;
     }
     state->err = 0;
-    if (state->queue_id != 0) {
-	myfree(state->queue_id);
-	state->queue_id = 0;
-    }
+    state->queue_id = 0;
     if (state->sender) {
 	if (state->milters != 0)
 	    milter_abort(state->milters);
-	myfree(state->sender);
 	state->sender = 0;
     }
-    if (state->verp_delims) {
-	myfree(state->verp_delims);
-	state->verp_delims = 0;
-    }
-    if (state->proxy_mail) {
-	myfree(state->proxy_mail);
-	state->proxy_mail = 0;
-    }
+    state->verp_delims = 0;
+    state->proxy_mail = 0;
     if (state->saved_filter) {
 	myfree(state->saved_filter);
 	state->saved_filter = 0;
@@ -2745,10 +2745,7 @@ static void mail_reset(SMTPD_STATE *state)
 	smtpd_xforward_reset(state);
     if (state->prepend)
 	state->prepend = argv_free(state->prepend);
-    if (state->dsn_envid) {
-	myfree(state->dsn_envid);
-	state->dsn_envid = 0;
-    }
+    state->dsn_envid = 0;
     if (state->milter_argv) {
 	myfree((void *) state->milter_argv);
 	state->milter_argv = 0;
@@ -2765,6 +2762,11 @@ static void mail_reset(SMTPD_STATE *state)
     }
     if (state->bdat_get_buffer)
 	VSTRING_RESET(state->bdat_get_buffer);
+
+    /*
+     * Release the strings for this mail transaction all at once.
+     */
+    arena_reset(state->mail_arena);
 }
 
 /* rcpt_cmd - process RCPT TO command */
@@ -5361,6 +5363,9 @@ static void smtpd_proto(SMTPD_STATE *state)
      * of the problem.
      */
     smtp_stream_setup(state->client, var_smtpd_tmout, var_smtpd_rec_deadline);
+    vstream_control(state->client,
+		    CA_VSTREAM_CTL_BUFSIZE_LIMIT(var_smtpd_data_bufsize),
+		    CA_VSTREAM_CTL_END);
 
     while ((status = vstream_setjmp(state->client)) == SMTP_ERR_NONE)
 	 /* void */ ;
@@ -5967,6 +5972,13 @@ static void pre_accept(char *unused_name, char **unused_argv)
     }
 }
 
+/* smtpd_exit - log statistics before terminating */
+
+static void smtpd_exit(char *unused_name, char **unused_argv)
+{
+    resolve_clnt_stat_log();
+}
+
 /* pre_jail_init - pre-jail initialization */
 
 static void pre_jail_init(char *unused_name, char **unused_argv)
@@ -6269,6 +6281,7 @@ int     main(int argc, char **argv)
 	VAR_PLAINTEXT_CODE, DEF_PLAINTEXT_CODE, &var_plaintext_code, 0, 0,
 	VAR_SMTPD_CRATE_LIMIT, DEF_SMTPD_CRATE_LIMIT, &var_smtpd_crate_limit, 0, 0,
 	VAR_SMTPD_CCONN_LIMIT, DEF_SMTPD_CCONN_LIMIT, &var_smtpd_cconn_limit, 0, 0,
+	VAR_SMTPD_DATA_BUFSIZE, DEF_SMTPD_DATA_BUFSIZE, &var_smtpd_data_bufsize, 0, 0,
 	VAR_SMTPD_CMAIL_LIMIT, DEF_SMTPD_CMAIL_LIMIT, &var_smtpd_cmail_limit, 0, 0,
 	VAR_SMTPD_CRCPT_LIMIT, DEF_SMTPD_CRCPT_LIMIT, &var_smtpd_crcpt_limit, 0, 0,
 	VAR_SMTPD_CNTLS_LIMIT, DEF_SMTPD_CNTLS_LIMIT, &var_smtpd_cntls_limit, 0, 0,
@@ -6464,5 +6477,6 @@ int     main(int argc, char **argv)
 		       CA_MAIL_SERVER_PRE_INIT(pre_jail_init),
 		       CA_MAIL_SERVER_PRE_ACCEPT(pre_accept),
 		       CA_MAIL_SERVER_POST_INIT(post_jail_init),
+		       CA_MAIL_SERVER_EXIT(smtpd_exit),
 		       0);
 }
@@ -21,6 +21,7 @@
 #include <vstring.h>
 #include <argv.h>
 #include <myaddrinfo.h>
+#include <arena.h>
 
  /*
   * Global library.
@@ -93,6 +94,7 @@ typedef struct {
     int     error_mask;			/* client errors */
     int     notify_mask;		/* what to report to postmaster */
     char   *helo_name;			/* client HELO/EHLO argument */
+    ARENA  *mail_arena;			/* per-transaction strings */
     char   *queue_id;			/* from cleanup server/queue file */
     VSTREAM *cleanup;			/* cleanup server/queue file handle */
     MAIL_STREAM *dest;			/* another server/file handle */
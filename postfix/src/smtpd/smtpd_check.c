@@ -813,7 +813,8 @@ void    smtpd_check_init(void)
     smtpd_sender_login_maps = maps_create(VAR_SMTPD_SND_AUTH_MAPS,
 					  var_smtpd_snd_auth_maps,
 					  DICT_FLAG_LOCK | DICT_FLAG_FOLD_FIX
-					  | DICT_FLAG_UTF8_REQUEST);
+					  | DICT_FLAG_UTF8_REQUEST
+					  | DICT_FLAG_NO_CACHE);
 
     /*
      * error_text is used for returning error responses.
@@ -95,6 +95,7 @@ void    smtpd_state_init(SMTPD_STATE *state, VSTREAM *stream,
     state->notify_mask = name_mask(VAR_NOTIFY_CLASSES, mail_error_masks,
 				   var_notify_classes);
     state->helo_name = 0;
+    state->mail_arena = arena_create(ARENA_CHUNK_SIZE);
     state->queue_id = 0;
     state->cleanup = 0;
     state->dest = 0;
@@ -211,6 +212,8 @@ void    smtpd_state_reset(SMTPD_STATE *state)
 	myfree(state->access_denied);
     if (state->protocol)
 	myfree(state->protocol);
+    if (state->mail_arena)
+	arena_free(state->mail_arena);
     smtpd_peer_reset(state);
 
     /*
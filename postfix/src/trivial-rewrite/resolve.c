@@ -14,6 +14,10 @@
 /*	void	resolve_proto(context, stream)
 /*	RES_CONTEXT *context;
 /*	VSTREAM	*stream;
+/*
+/*	void	resolve_batch_proto(context, stream)
+/*	RES_CONTEXT *context;
+/*	VSTREAM	*stream;
 /* DESCRIPTION
 /*	This module implements the trivial address resolving engine.
 /*	It distinguishes between local and remote mail, and optionally
@@ -30,6 +34,13 @@
 /*	resolve_proto() implements the client-server protocol:
 /*	read one address in FQDN form, reply with a (transport,
 /*	nexthop, internalized recipient) triple.
+/*
+/*	resolve_batch_proto() implements the batch version of the
+/*	client-server protocol: read one sender and a count of up
+/*	to RESOLVE_BATCH_LIMIT addresses, then the addresses, and
+/*	reply with one triple per address, in request order. All
+/*	addresses are read before the first reply is sent, so that
+/*	a client may write the entire batch before it reads.
 /* STANDARDS
 /* DIAGNOSTICS
 /*	Problems and transactions are logged to the syslog daemon.
@@ -71,6 +82,7 @@
 #include <valid_utf8_hostname.h>
 #include <stringops.h>
 #include <mymalloc.h>
+#include <argv.h>
 
 /* Global library. */
 
@@ -793,6 +805,67 @@ int     resolve_proto(RES_CONTEXT *context, VSTREAM *stream)
     return (0);
 }
 
+/* resolve_batch_proto - read batch request and send replies */
+
+int     resolve_batch_proto(RES_CONTEXT *context, VSTREAM *stream)
+{
+    static ARGV *batch;
+    int     count;
+    int     flags;
+    int     n;
+
+    if (attr_scan(stream, ATTR_FLAG_STRICT,
+		  RECV_ATTR_STR(MAIL_ATTR_SENDER, sender),
+		  RECV_ATTR_INT(MAIL_ATTR_NREQ, &count),
+		  ATTR_TYPE_END) != 2)
+	return (-1);
+    if (count < 1 || count > RESOLVE_BATCH_LIMIT) {
+	msg_warn("bad resolver batch size: %d", count);
+	return (-1);
+    }
+
+    /*
+     * Read the entire batch before replying. The client writes all requests
+     * before it reads any reply, so replying early could deadlock when both
+     * sides fill their socket buffers.
+     */
+    if (batch == 0)
+	batch = argv_alloc(count);
+    else
+	argv_truncate(batch, 0);
+    for (n = 0; n < count; n++) {
+	if (attr_scan(stream, ATTR_FLAG_STRICT,
+		      RECV_ATTR_STR(MAIL_ATTR_ADDR, query),
+		      ATTR_TYPE_END) != 1)
+	    return (-1);
+	argv_add(batch, STR(query), (char *) 0);
+    }
+
+    for (n = 0; n < count; n++) {
+	resolve_addr(context, STR(sender), batch->argv[n],
+		     channel, nexthop, nextrcpt, &flags);
+
+	if (msg_verbose)
+	    msg_info("`%s' -> `%s' -> (`%s' `%s' `%s' `%d')",
+		     STR(sender), batch->argv[n], STR(channel),
+		     STR(nexthop), STR(nextrcpt), flags);
+
+	attr_print(stream, ATTR_FLAG_NONE,
+		   SEND_ATTR_INT(MAIL_ATTR_FLAGS, server_flags),
+		   SEND_ATTR_STR(MAIL_ATTR_TRANSPORT, STR(channel)),
+		   SEND_ATTR_STR(MAIL_ATTR_NEXTHOP, STR(nexthop)),
+		   SEND_ATTR_STR(MAIL_ATTR_RECIP, STR(nextrcpt)),
+		   SEND_ATTR_INT(MAIL_ATTR_FLAGS, flags),
+		   ATTR_TYPE_END);
+    }
+
+    if (vstream_fflush(stream) != 0) {
+	msg_warn("write resolver reply: %m");
+	return (-1);
+    }
+    return (0);
+}
+
 /* resolve_init - module initializations */
 
 void    resolve_init(void)
@@ -22,6 +22,9 @@
 /*
 /*	void	transport_free(info);
 /*	TRANSPORT_INFO * info;
+/*
+/*	void	transport_stat_log(info)
+/*	TRANSPORT_INFO *info;
 /* DESCRIPTION
 /*	This module implements access to the table that maps transport
 /*	user@domain addresses to (channel, nexthop) tuples.
@@ -35,7 +38,16 @@
 /*
 /*	transport_lookup() finds the channel and nexthop for the given
 /*	domain, and returns 1 if something was found.	Otherwise, 0
-/*	is returned.
+/*	is returned. The result of the domain and parent domain
+/*	search is remembered per recipient domain in a bounded LRU
+/*	cache, so that a flood of recipients in the same domain
+/*	needs only one walk over the transport maps. Lookups of the
+/*	full and extension-stripped address are never cached. The
+/*	cache is invalidated whenever the wild-card entry is
+/*	refreshed.
+/*
+/*	transport_stat_log() logs and resets the domain cache
+/*	statistics, if there was any activity.
 /* DIAGNOSTICS
 /*	info->transport_path->error is non-zero when the lookup
 /*	should be tried again.
@@ -45,6 +57,7 @@
 /*	transport(5), format of transport map
 /* CONFIGURATION PARAMETERS
 /*	transport_maps, names of maps to be searched.
+/*	transport_domain_cache_size, size of the per-domain lookup cache.
 /* LICENSE
 /* .ad
 /* .fi
@@ -94,6 +107,16 @@ static int transport_match_parent_style;
 
 static void transport_wildcard_init(TRANSPORT_INFO *);
 
+ /*
+  * Per-domain memo of the domain and parent domain lookup result. A null
+  * value means that the domain walk found nothing. An entry is valid only
+  * while its generation matches the cache generation.
+  */
+typedef struct {
+    unsigned gen;			/* cache generation */
+    char   *value;			/* table entry or null */
+} TRANSPORT_DOMAIN;
+
 /* transport_pre_init - pre-jail initialization */
 
 TRANSPORT_INFO *transport_pre_init(const char *transport_maps_name,
@@ -109,14 +132,64 @@ TRANSPORT_INFO *transport_pre_init(const char *transport_maps_name,
     tp->wildcard_channel = tp->wildcard_nexthop = 0;
     tp->wildcard_errno = 0;
     tp->expire = 0;
+    tp->domain_cache = 0;
+    tp->domain_gen = 0;
+    tp->domain_query = 0;
+    tp->domain_hits = tp->domain_miss = tp->domain_evict = 0;
+    tp->domain_refresh = 0;
     return (tp);
 }
 
+/* transport_domain_pagein - look up domain and parent domains */
+
+static void *transport_domain_pagein(const char *unused_key, void *context)
+{
+    TRANSPORT_INFO *tp = (TRANSPORT_INFO *) context;
+    TRANSPORT_DOMAIN *dp;
+    const char *value;
+
+#define DOMAIN_STRATEGY \
+	(MA_FIND_DOMAIN | (transport_match_parent_style == MATCH_FLAG_PARENT ? \
+			   MA_FIND_PDMS : MA_FIND_PDDMDS))
+
+    tp->domain_miss += 1;
+    value = mail_addr_find_strategy(tp->transport_path, tp->domain_query,
+				    (char **) 0, DOMAIN_STRATEGY);
+    dp = (TRANSPORT_DOMAIN *) mymalloc(sizeof(*dp));
+    dp->value = value ? mystrdup(value) : 0;
+
+    /*
+     * Don't remember a lookup error. A stale generation forces a refresh
+     * the next time that this domain is looked up.
+     */
+    dp->gen = tp->transport_path->error ? tp->domain_gen - 1 : tp->domain_gen;
+    return ((void *) dp);
+}
+
+/* transport_domain_pageout - destroy domain cache entry */
+
+static void transport_domain_pageout(void *data, void *context)
+{
+    TRANSPORT_INFO *tp = (TRANSPORT_INFO *) context;
+    TRANSPORT_DOMAIN *dp = (TRANSPORT_DOMAIN *) data;
+
+    if (tp->domain_refresh == 0)
+	tp->domain_evict += 1;
+    if (dp->value)
+	myfree(dp->value);
+    myfree((void *) dp);
+}
+
 /* transport_post_init - post-jail initialization */
 
 void    transport_post_init(TRANSPORT_INFO *tp)
 {
     transport_match_parent_style = match_parent_style(VAR_TRANSPORT_MAPS);
+    if (var_transport_cache_size > 0)
+	tp->domain_cache = ctable_create(var_transport_cache_size,
+					 transport_domain_pagein,
+					 transport_domain_pageout,
+					 (void *) tp);
     transport_wildcard_init(tp);
 }
 
@@ -130,9 +203,25 @@ void    transport_free(TRANSPORT_INFO *tp)
 	vstring_free(tp->wildcard_channel);
     if (tp->wildcard_nexthop)
 	vstring_free(tp->wildcard_nexthop);
+    if (tp->domain_cache) {
+	tp->domain_refresh = 1;
+	ctable_free(tp->domain_cache);
+    }
     myfree((void *) tp);
 }
 
+/* transport_stat_log - log and reset domain cache statistics */
+
+void    transport_stat_log(TRANSPORT_INFO *tp)
+{
+    if (tp->domain_hits || tp->domain_miss || tp->domain_evict) {
+	msg_info("statistics: %s domain cache hits=%d miss=%d evict=%d",
+		 tp->transport_path->title, tp->domain_hits,
+		 tp->domain_miss, tp->domain_evict);
+	tp->domain_hits = tp->domain_miss = tp->domain_evict = 0;
+    }
+}
+
 /* update_entry - update from transport table entry */
 
 static void update_entry(const char *new_channel, const char *new_nexthop,
@@ -238,6 +327,7 @@ static void transport_wildcard_init(TRANSPORT_INFO *tp)
 	tp->wildcard_nexthop = 0;
     }
     tp->expire = event_time() + 30;		/* XXX make configurable */
+    tp->domain_gen += 1;			/* flush domain cache */
 }
 
 /* transport_lookup - map a transport domain */
@@ -273,13 +363,59 @@ int     transport_lookup(TRANSPORT_INFO *tp, const char *addr,
     if ((ratsign = strrchr(addr, '@')) == 0 || ratsign[1] == 0)
 	msg_panic("transport_lookup: bad address: \"%s\"", addr);
 
-    if ((value = mail_addr_find_strategy(tp->transport_path, addr, (char **) 0,
-					 LOOKUP_STRATEGY)) != 0) {
-	parse_transport_entry(value, rcpt_domain, channel, nexthop);
-	return (FOUND);
+    if (tp->domain_cache == 0) {
+	if ((value = mail_addr_find_strategy(tp->transport_path, addr,
+					     (char **) 0,
+					     LOOKUP_STRATEGY)) != 0) {
+	    parse_transport_entry(value, rcpt_domain, channel, nexthop);
+	    return (FOUND);
+	}
+	if (tp->transport_path->error != 0)
+	    return (NOTFOUND);
+    } else {
+	const TRANSPORT_DOMAIN *dp;
+	int     miss = tp->domain_miss;
+
+	/*
+	 * The full and extension-stripped address lookups depend on the
+	 * localpart, and cannot be shared between recipients.
+	 */
+	if ((value = mail_addr_find_strategy(tp->transport_path, addr,
+					     (char **) 0,
+					     MA_FIND_FULL | MA_FIND_NOEXT)) != 0) {
+	    parse_transport_entry(value, rcpt_domain, channel, nexthop);
+	    return (FOUND);
+	}
+	if (tp->transport_path->error != 0)
+	    return (NOTFOUND);
+
+	/*
+	 * The domain and parent domain lookups depend on the domain only.
+	 * Refresh the wild-card first, so that a table change that is
+	 * noticed there also invalidates the domain cache.
+	 */
+	if (event_time() > tp->expire)
+	    transport_wildcard_init(tp);
+	tp->transport_path->error = 0;
+	tp->domain_query = addr;
+	ctable_newcontext(tp->domain_cache, (void *) tp);
+	dp = (const TRANSPORT_DOMAIN *)
+	    ctable_locate(tp->domain_cache, ratsign + 1);
+	if (tp->domain_miss == miss && dp->gen != tp->domain_gen) {
+	    tp->domain_refresh = 1;
+	    dp = (const TRANSPORT_DOMAIN *)
+		ctable_refresh(tp->domain_cache, ratsign + 1);
+	    tp->domain_refresh = 0;
+	}
+	if (tp->domain_miss == miss)
+	    tp->domain_hits += 1;
+	else if (tp->transport_path->error != 0)
+	    return (NOTFOUND);
+	if (dp->value) {
+	    parse_transport_entry(dp->value, rcpt_domain, channel, nexthop);
+	    return (FOUND);
+	}
     }
-    if (tp->transport_path->error != 0)
-	return (NOTFOUND);
 
     /*
      * Fall back to the wild-card entry.
@@ -314,6 +450,8 @@ int     transport_lookup(TRANSPORT_INFO *tp, const char *addr,
 #include <vstream.h>
 #include <vstring_vstream.h>
 
+int     var_transport_cache_size = DEF_TRANSPORT_CACHE_SIZE;
+
 static NORETURN usage(const char *progname)
 {
     msg_fatal("usage: %s [-v] database", progname);
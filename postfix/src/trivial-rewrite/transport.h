@@ -17,6 +17,7 @@
   * Utility library.
   */
 #include <vstring.h>
+#include <ctable.h>
 
  /*
   * Global library.
@@ -32,12 +33,20 @@ typedef struct TRANSPORT_INFO {
     VSTRING *wildcard_nexthop;
     int     wildcard_errno;
     time_t  expire;
+    CTABLE *domain_cache;		/* domain -> table entry */
+    unsigned domain_gen;		/* domain cache generation */
+    const char *domain_query;		/* address being looked up */
+    int     domain_hits;		/* domain cache hits */
+    int     domain_miss;		/* domain cache misses */
+    int     domain_evict;		/* domain cache evictions */
+    int     domain_refresh;		/* refresh in progress */
 } TRANSPORT_INFO;
 
 extern TRANSPORT_INFO *transport_pre_init(const char *, const char *);
 extern void transport_post_init(TRANSPORT_INFO *);
 extern int transport_lookup(TRANSPORT_INFO *, const char *, const char *, VSTRING *, VSTRING *);
 extern void transport_free(TRANSPORT_INFO *);
+extern void transport_stat_log(TRANSPORT_INFO *);
 
 /* LICENSE
 /* .ad
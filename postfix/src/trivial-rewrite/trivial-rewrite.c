@@ -44,6 +44,12 @@
 /* .RE
 /* .IP "\fBverify \fIsender\fR \fIaddress\fR"
 /*	Resolve the address for address verification purposes.
+/* .IP "\fBresolve_batch \fIsender\fR \fIcount\fR \fIaddress ...\fR"
+/* .IP "\fBverify_batch \fIsender\fR \fIcount\fR \fIaddress ...\fR"
+/*	Resolve up to 100 addresses with the same sender in one
+/*	exchange. The server reads all addresses before it sends
+/*	one \fBresolve\fR or \fBverify\fR reply per address, in
+/*	request order.
 /* SERVER PROCESS MANAGEMENT
 /* .ad
 /* .fi
@@ -175,6 +181,12 @@
 /* .IP "\fBsender_dependent_default_transport_maps (empty)\fR"
 /*	A sender-dependent override for the global default_transport
 /*	parameter setting.
+/* .PP
+/*	Available in Postfix version 3.5 and later:
+/* .IP "\fBtransport_domain_cache_size (10000)\fR"
+/*	The number of recipient domains for which trivial-rewrite(8)
+/*	remembers the result of the transport_maps domain and parent
+/*	domain search.
 /* ADDRESS VERIFICATION CONTROLS
 /* .ad
 /* .fi
@@ -359,6 +371,7 @@ char   *var_null_relay_maps_key;
 char   *var_null_def_xport_maps_key;
 int     var_resolve_num_dom;
 bool    var_allow_min_user;
+int     var_transport_cache_size;
 
  /*
   * Shadow personality for address verification.
@@ -496,6 +509,10 @@ static void rewrite_service(VSTREAM *stream, char *unused_service, char **argv)
 	    status = resolve_proto(&resolve_regular, stream);
 	} else if (strcmp(vstring_str(command), RESOLVE_VERIFY) == 0) {
 	    status = resolve_proto(&resolve_verify, stream);
+	} else if (strcmp(vstring_str(command), RESOLVE_REGULAR_BATCH) == 0) {
+	    status = resolve_batch_proto(&resolve_regular, stream);
+	} else if (strcmp(vstring_str(command), RESOLVE_VERIFY_BATCH) == 0) {
+	    status = resolve_batch_proto(&resolve_verify, stream);
 	} else {
 	    msg_warn("bad command %.30s", printable(vstring_str(command), '?'));
 	}
@@ -528,6 +545,10 @@ static void check_table_stats(int unused_event, void *unused_context)
 	msg_info("table %s has changed -- restarting", table);
 	exit(0);
     }
+    if (resolve_regular.transport_info)
+	transport_stat_log(resolve_regular.transport_info);
+    if (resolve_verify.transport_info)
+	transport_stat_log(resolve_verify.transport_info);
     event_request_timer(check_table_stats, (void *) 0, 10);
 }
 
@@ -616,6 +637,10 @@ int     main(int argc, char **argv)
 	VAR_VRFY_SND_DEF_XPORT_MAPS, DEF_VRFY_SND_DEF_XPORT_MAPS, &var_vrfy_snd_def_xport_maps, 0, 0,
 	0,
     };
+    static const CONFIG_INT_TABLE int_table[] = {
+	VAR_TRANSPORT_CACHE_SIZE, DEF_TRANSPORT_CACHE_SIZE, &var_transport_cache_size, 0, 0,
+	0,
+    };
     static const CONFIG_BOOL_TABLE bool_table[] = {
 	VAR_SWAP_BANGPATH, DEF_SWAP_BANGPATH, &var_swap_bangpath,
 	VAR_APP_AT_MYORIGIN, DEF_APP_AT_MYORIGIN, &var_append_at_myorigin,
@@ -639,6 +664,7 @@ int     main(int argc, char **argv)
 
     multi_server_main(argc, argv, rewrite_service,
 		      CA_MAIL_SERVER_STR_TABLE(str_table),
+		      CA_MAIL_SERVER_INT_TABLE(int_table),
 		      CA_MAIL_SERVER_BOOL_TABLE(bool_table),
 		      CA_MAIL_SERVER_NBOOL_TABLE(nbool_table),
 		      CA_MAIL_SERVER_PRE_INIT(pre_jail_init),
@@ -0,0 +1,366 @@
+/*++
+/* NAME
+/*	arena 3
+/* SUMMARY
+/*	region-based memory management
+/* SYNOPSIS
+/*	#include <arena.h>
+/*
+/*	ARENA	*arena_create(chunk_size)
+/*	ssize_t	chunk_size;
+/*
+/*	void	*arena_alloc(arena, len)
+/*	ARENA	*arena;
+/*	ssize_t	len;
+/*
+/*	char	*arena_strdup(arena, str)
+/*	ARENA	*arena;
+/*	const char *str;
+/*
+/*	char	*arena_strndup(arena, str, len)
+/*	ARENA	*arena;
+/*	const char *str;
+/*	ssize_t	len;
+/*
+/*	char	*arena_memdup(arena, ptr, len)
+/*	ARENA	*arena;
+/*	const void *ptr;
+/*	ssize_t	len;
+/*
+/*	void	arena_reset(arena)
+/*	ARENA	*arena;
+/*
+/*	void	arena_free(arena)
+/*	ARENA	*arena;
+/* DESCRIPTION
+/*	This module allocates memory for objects that have the same
+/*	lifetime, such as the strings that belong to one message or
+/*	one mail transaction. Memory is taken from large chunks, and
+/*	is released all at once. Compared to mymalloc(3), this makes
+/*	fewer calls into the system memory allocator, and causes less
+/*	fragmentation in long-running processes.
+/*
+/*	arena_create() creates an empty arena. The chunk_size argument
+/*	specifies the size of the memory chunks that the arena gets
+/*	from mymalloc(); specify ARENA_CHUNK_SIZE for a reasonable
+/*	default. Requests larger than a quarter chunk are given their
+/*	own chunk.
+/*
+/*	arena_alloc() allocates the requested amount of memory. The
+/*	memory is not set to zero. The result has the same alignment
+/*	as the result from mymalloc().
+/*
+/*	arena_strdup(), arena_strndup() and arena_memdup() are the
+/*	arena counterparts of mystrdup(), mystrndup() and mymemdup().
+/*	As with mystrdup(), zero-length strings are shared and
+/*	read-only, unless NO_SHARED_EMPTY_STRINGS is defined at
+/*	compile time.
+/*
+/*	arena_reset() releases all memory that was allocated from
+/*	the arena, and keeps one chunk for re-use.
+/*
+/*	arena_free() releases all memory that was allocated from
+/*	the arena, and destroys the arena.
+/*
+/*	Memory from an arena must not be passed to myrealloc() or
+/*	myfree().
+/*
+/*	The mymalloc(3) debugging features apply to arena memory:
+/*	new memory is filled with a non-zero pattern, released memory
+/*	is overwritten before it is returned to the system, and
+/*	MYMALLOC_FUZZ adds extra bytes to each request. When the
+/*	NO_ARENA macro is defined at compile time, each arena_alloc()
+/*	request is satisfied with a separate mymalloc() call, so that
+/*	memory debugging tools can find access outside an object.
+/* DIAGNOSTICS
+/*	Problems are reported via the msg(3) diagnostics routines:
+/*	the requested amount of memory is not available; improper use
+/*	is detected; other fatal errors.
+/* SEE ALSO
+/*	mymalloc(3) memory management
+/* LICENSE
+/* .ad
+/* .fi
+/*	The Secure Mailer license must be distributed with this software.
+/* AUTHOR(S)
+/*	Wietse Venema
+/*	Google, Inc.
+/*	111 8th Avenue
+/*	New York, NY 10011, USA
+/*--*/
+
+/* System libraries. */
+
+#include "sys_defs.h"
+#include <stddef.h>
+#include <string.h>
+
+/* Application-specific. */
+
+#include "msg.h"
+#include "mymalloc.h"
+#include "arena.h"
+
+ /*
+  * Each chunk starts with a header. The first chunk in the list is the one
+  * that we allocate from; the other chunks are full, or contain one large
+  * object.
+  */
+typedef struct ARENA_CHUNK {
+    struct ARENA_CHUNK *next;		/* older chunk */
+    ssize_t size;			/* payload size */
+    ssize_t used;			/* payload in use */
+    union {
+	ALIGN_TYPE align;
+	char    payload[1];		/* actually a bunch of bytes */
+    }       u;
+} ARENA_CHUNK;
+
+struct ARENA {
+    ARENA_CHUNK *chunks;		/* current chunk first */
+    ssize_t chunk_size;			/* preferred chunk size */
+};
+
+#define SPACE_FOR(len)	(offsetof(ARENA_CHUNK, u.payload[0]) + (len))
+#define ALIGN_UP(len) \
+    (((len) + sizeof(ALIGN_TYPE) - 1) & ~(sizeof(ALIGN_TYPE) - 1))
+
+#define FILLER		0xff
+
+#ifdef NO_ARENA
+#define ARENA_LARGE(arena, len)	1
+#else
+#define ARENA_LARGE(arena, len)	((len) > (arena)->chunk_size / 4)
+#endif
+
+#ifndef NO_SHARED_EMPTY_STRINGS
+static const char empty_string[] = "";
+#endif
+
+/* arena_chunk_alloc - allocate one chunk */
+
+static ARENA_CHUNK *arena_chunk_alloc(ssize_t size)
+{
+    ARENA_CHUNK *chunk;
+
+    chunk = (ARENA_CHUNK *) mymalloc(SPACE_FOR(size));
+    chunk->size = size;
+    chunk->used = 0;
+    return (chunk);
+}
+
+/* arena_create - create empty arena */
+
+ARENA  *arena_create(ssize_t chunk_size)
+{
+    ARENA  *arena;
+
+    if (chunk_size < 1)
+	msg_panic("arena_create: bad chunk size %ld", (long) chunk_size);
+    arena = (ARENA *) mymalloc(sizeof(*arena));
+    arena->chunks = 0;
+    arena->chunk_size = ALIGN_UP(chunk_size);
+    return (arena);
+}
+
+/* arena_alloc - allocate memory or bust */
+
+void   *arena_alloc(ARENA *arena, ssize_t len)
+{
+    ARENA_CHUNK *chunk;
+    void   *ptr;
+
+    /*
+     * Note: for safety reasons the request length is a signed type. This
+     * allows us to catch integer overflow problems that weren't already
+     * caught up-stream.
+     */
+    if (len < 1)
+	msg_panic("arena_alloc: requested length %ld", (long) len);
+#ifdef MYMALLOC_FUZZ
+    len += MYMALLOC_FUZZ;
+#endif
+    if (len > SSIZE_T_MAX - SPACE_FOR(sizeof(ALIGN_TYPE)))
+	msg_panic("arena_alloc: requested length %ld", (long) len);
+    len = ALIGN_UP(len);
+
+    /*
+     * Give a large object its own chunk, behind the current chunk, so that
+     * we don't waste the remainder of the current chunk.
+     */
+    if (ARENA_LARGE(arena, len)) {
+	chunk = arena_chunk_alloc(len);
+	if (arena->chunks != 0) {
+	    chunk->next = arena->chunks->next;
+	    arena->chunks->next = chunk;
+	} else {
+	    chunk->next = 0;
+	    arena->chunks = chunk;
+	}
+    }
+
+    /*
+     * Otherwise, start a new chunk when the current one is full.
+     */
+    else if ((chunk = arena->chunks) == 0 || chunk->size - chunk->used < len) {
+	chunk = arena_chunk_alloc(arena->chunk_size);
+	chunk->next = arena->chunks;
+	arena->chunks = chunk;
+    }
+    ptr = chunk->u.payload + chunk->used;
+    chunk->used += len;
+    return (ptr);
+}
+
+/* arena_strdup - save string to arena */
+
+char   *arena_strdup(ARENA *arena, const char *str)
+{
+    size_t  len;
+
+    if (str == 0)
+	msg_panic("arena_strdup: null pointer argument");
+#ifndef NO_SHARED_EMPTY_STRINGS
+    if (*str == 0)
+	return ((char *) empty_string);
+#endif
+    if ((len = strlen(str) + 1) > SSIZE_T_MAX)
+	msg_panic("arena_strdup: string length >= SSIZE_T_MAX");
+    return (memcpy(arena_alloc(arena, len), str, len));
+}
+
+/* arena_strndup - save substring to arena */
+
+char   *arena_strndup(ARENA *arena, const char *str, ssize_t len)
+{
+    char   *result;
+    char   *cp;
+
+    if (str == 0)
+	msg_panic("arena_strndup: null pointer argument");
+    if (len < 0)
+	msg_panic("arena_strndup: requested length %ld", (long) len);
+#ifndef NO_SHARED_EMPTY_STRINGS
+    if (*str == 0)
+	return ((char *) empty_string);
+#endif
+    if ((cp = memchr(str, 0, len)) != 0)
+	len = cp - str;
+    result = memcpy(arena_alloc(arena, len + 1), str, len);
+    result[len] = 0;
+    return (result);
+}
+
+/* arena_memdup - copy memory to arena */
+
+char   *arena_memdup(ARENA *arena, const void *ptr, ssize_t len)
+{
+    if (ptr == 0)
+	msg_panic("arena_memdup: null pointer argument");
+    return (memcpy(arena_alloc(arena, len), ptr, len));
+}
+
+/* arena_reset - release all objects, keep one chunk */
+
+void    arena_reset(ARENA *arena)
+{
+    ARENA_CHUNK *chunk;
+    ARENA_CHUNK *keep = 0;
+
+    while ((chunk = arena->chunks) != 0) {
+	arena->chunks = chunk->next;
+	if (keep == 0 && chunk->size == arena->chunk_size) {
+	    memset(chunk->u.payload, FILLER, chunk->used);
+	    chunk->used = 0;
+	    keep = chunk;
+	} else {
+	    myfree((void *) chunk);
+	}
+    }
+    if ((arena->chunks = keep) != 0)
+	keep->next = 0;
+}
+
+/* arena_free - release all objects and the arena */
+
+void    arena_free(ARENA *arena)
+{
+    ARENA_CHUNK *chunk;
+
+    while ((chunk = arena->chunks) != 0) {
+	arena->chunks = chunk->next;
+	myfree((void *) chunk);
+    }
+    myfree((void *) arena);
+}
+
+#ifdef TEST
+
+ /*
+  * Proof-of-concept test program. Allocate and release the strings for a
+  * number of "messages", first with mystrdup() and myfree(), then with an
+  * arena, and report the time per message.
+  */
+#include <stdlib.h>
+#include <time.h>
+#include <vstream.h>
+
+#define STRINGS_PER_MESSAGE	40
+
+static const char *sample[] = {
+    "", "localhost", "127.0.0.1", "25", "ESMTP", "user@example.com",
+    "some.long.host.name.example.com", "smtp:[relay.example.com]:587",
+    "Received: from localhost (localhost [127.0.0.1])",
+};
+
+#define SAMPLES	(sizeof(sample) / sizeof(sample[0]))
+
+static double elapsed(clock_t start)
+{
+    return ((double) (clock() - start) / CLOCKS_PER_SEC);
+}
+
+int     main(int argc, char **argv)
+{
+    char   *strings[STRINGS_PER_MESSAGE];
+    ARENA  *arena;
+    long    messages = (argc > 1 ? atol(argv[1]) : 1000000);
+    long    n;
+    int     i;
+    clock_t start;
+
+    start = clock();
+    for (n = 0; n < messages; n++) {
+	for (i = 0; i < STRINGS_PER_MESSAGE; i++)
+	    strings[i] = mystrdup(sample[(n + i) % SAMPLES]);
+	for (i = 0; i < STRINGS_PER_MESSAGE; i++)
+	    myfree(strings[i]);
+    }
+    vstream_printf("mystrdup:   %ld messages, %.3f usec/message\n",
+		   messages, 1e6 * elapsed(start) / messages);
+
+    start = clock();
+    for (n = 0; n < messages; n++) {
+	arena = arena_create(ARENA_CHUNK_SIZE);
+	for (i = 0; i < STRINGS_PER_MESSAGE; i++)
+	    strings[i] = arena_strdup(arena, sample[(n + i) % SAMPLES]);
+	arena_free(arena);
+    }
+    vstream_printf("arena:      %ld messages, %.3f usec/message\n",
+		   messages, 1e6 * elapsed(start) / messages);
+
+    arena = arena_create(ARENA_CHUNK_SIZE);
+    start = clock();
+    for (n = 0; n < messages; n++) {
+	for (i = 0; i < STRINGS_PER_MESSAGE; i++)
+	    strings[i] = arena_strdup(arena, sample[(n + i) % SAMPLES]);
+	arena_reset(arena);
+    }
+    vstream_printf("arena/reset: %ld messages, %.3f usec/message\n",
+		   messages, 1e6 * elapsed(start) / messages);
+    arena_free(arena);
+    vstream_fflush(VSTREAM_OUT);
+    return (0);
+}
+
+#endif
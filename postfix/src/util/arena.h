@@ -0,0 +1,40 @@
+#ifndef _ARENA_H_INCLUDED_
+#define _ARENA_H_INCLUDED_
+
+/*++
+/* NAME
+/*	arena 3h
+/* SUMMARY
+/*	region-based memory management
+/* SYNOPSIS
+/*	#include "arena.h"
+/* DESCRIPTION
+/* .nf
+
+ /*
+  * External interface.
+  */
+typedef struct ARENA ARENA;
+
+extern ARENA *arena_create(ssize_t);
+extern void *arena_alloc(ARENA *, ssize_t);
+extern char *arena_strdup(ARENA *, const char *);
+extern char *arena_strndup(ARENA *, const char *, ssize_t);
+extern char *arena_memdup(ARENA *, const void *, ssize_t);
+extern void arena_reset(ARENA *);
+extern void arena_free(ARENA *);
+
+#define ARENA_CHUNK_SIZE	2048
+
+/* LICENSE
+/* .ad
+/* .fi
+/*	The Secure Mailer license must be distributed with this software.
+/* AUTHOR(S)
+/*	Wietse Venema
+/*	Google, Inc.
+/*	111 8th Avenue
+/*	New York, NY 10011, USA
+/*--*/
+
+#endif
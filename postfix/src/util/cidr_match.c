@@ -22,6 +22,12 @@
 /*
 /*	void	cidr_match_endif(info)
 /*	CIDR_MATCH *info;
+/*
+/*	void	cidr_match_compile(list)
+/*	CIDR_MATCH *list;
+/*
+/*	void	cidr_match_compile_free(list)
+/*	CIDR_MATCH *list;
 /* DESCRIPTION
 /*	This module parses address or address/length patterns and
 /*	provides simple address matching. The implementation is
@@ -50,6 +56,20 @@
 /*	cidr_match_execute() matches the specified address against
 /*	a list of parsed expressions, and returns the matching
 /*	expression's data structure.
+/*
+/*	cidr_match_compile() speeds up cidr_match_execute() for
+/*	long lists. It finds each run of at least CIDR_MATCH_TRIE_MIN
+/*	consecutive positive patterns (a run ends at IF, ENDIF or
+/*	a negative pattern), and stores the run in a path-compressed
+/*	binary trie per address family. A trie lookup returns the
+/*	first pattern in the run that matches, so that the result
+/*	is the same as with a linear search, in time proportional
+/*	to the address length instead of the run length.
+/*	cidr_match_compile() must be called after the list is
+/*	complete, and the list must not be changed afterwards.
+/*
+/*	cidr_match_compile_free() destroys the tries that were
+/*	created with cidr_match_compile().
 /* SEE ALSO
 /*	dict_cidr(3) CIDR-style lookup table
 /* AUTHOR(S)
@@ -78,6 +98,8 @@
 /* Utility library. */
 
 #include <msg.h>
+#include <mymalloc.h>
+#include <arena.h>
 #include <vstring.h>
 #include <stringops.h>
 #include <split_at.h>
@@ -111,6 +133,208 @@
      (msg_panic("%s: bad address family %d", myname, (f)), 0))
 #endif
 
+#define CIDR_MATCH_FAMILY_INDEX(f)	((f) == AF_INET ? 0 : 1)
+
+ /*
+  * A compiled run of positive patterns. Each trie node has a prefix of
+  * "bits" bits. A node that corresponds to a pattern has a pointer to the
+  * first pattern in the run with that network and mask, and that pattern's
+  * position in the run; other nodes exist only to join two subtrees.
+  */
+typedef struct CIDR_MATCH_NODE {
+    unsigned char key[CIDR_MATCH_ABYTES];	/* network portion */
+    int     bits;			/* prefix length */
+    int     order;			/* position in run */
+    CIDR_MATCH *entry;			/* pattern or null */
+    struct CIDR_MATCH_NODE *child[2];	/* next bit 0, 1 */
+} CIDR_MATCH_NODE;
+
+typedef struct CIDR_MATCH_TRIE {
+    CIDR_MATCH_NODE *root[2];		/* IPv4, IPv6 */
+    CIDR_MATCH *last;			/* last pattern in run */
+    ARENA  *arena;			/* node storage */
+} CIDR_MATCH_TRIE;
+
+#define CIDR_MATCH_TRIE_CHUNK	(64 * 1024)
+
+#define CIDR_MATCH_BIT(bytes, n) \
+	(((bytes)[(n) / CHAR_BIT] >> (CHAR_BIT - 1 - (n) % CHAR_BIT)) & 1)
+
+/* cidr_match_prefix_len - number of leading bits that are equal */
+
+static int cidr_match_prefix_len(const unsigned char *a,
+				         const unsigned char *b, int max_bits)
+{
+    int     bits;
+    int     diff;
+
+    for (bits = 0; bits < max_bits; bits += CHAR_BIT, a++, b++) {
+	if ((diff = *a ^ *b) != 0) {
+	    while ((diff & (1 << (CHAR_BIT - 1))) == 0) {
+		diff <<= 1;
+		bits++;
+	    }
+	    break;
+	}
+    }
+    return (bits < max_bits ? bits : max_bits);
+}
+
+/* cidr_match_node_alloc - create trie node */
+
+static CIDR_MATCH_NODE *cidr_match_node_alloc(CIDR_MATCH_TRIE *trie,
+					           const unsigned char *key,
+					           int bits, int byte_count)
+{
+    CIDR_MATCH_NODE *node;
+
+    node = (CIDR_MATCH_NODE *) arena_alloc(trie->arena, sizeof(*node));
+    memcpy(node->key, key, byte_count);
+    if (bits < byte_count * CHAR_BIT)
+	mask_addr(node->key, byte_count, bits);
+    node->bits = bits;
+    node->order = 0;
+    node->entry = 0;
+    node->child[0] = node->child[1] = 0;
+    return (node);
+}
+
+/* cidr_match_trie_add - add one pattern to a trie */
+
+static void cidr_match_trie_add(CIDR_MATCH_TRIE *trie, CIDR_MATCH *entry,
+				        int order)
+{
+    CIDR_MATCH_NODE **link;
+    CIDR_MATCH_NODE *node;
+    CIDR_MATCH_NODE *fork;
+    CIDR_MATCH_NODE *leaf;
+    int     bits = entry->mask_shift;
+    int     common;
+
+    link = trie->root + CIDR_MATCH_FAMILY_INDEX(entry->addr_family);
+    while ((node = *link) != 0) {
+	common = cidr_match_prefix_len(node->key, entry->net_bytes,
+				       node->bits < bits ? node->bits : bits);
+
+	/*
+	 * The node prefix is longer than the common prefix. Insert a node
+	 * for the common prefix above it.
+	 */
+	if (common < node->bits) {
+	    fork = cidr_match_node_alloc(trie, entry->net_bytes, common,
+					 entry->addr_byte_count);
+	    fork->child[CIDR_MATCH_BIT(node->key, common)] = node;
+	    if (common == bits) {
+		fork->entry = entry;
+		fork->order = order;
+	    } else {
+		leaf = cidr_match_node_alloc(trie, entry->net_bytes, bits,
+					     entry->addr_byte_count);
+		leaf->entry = entry;
+		leaf->order = order;
+		fork->child[CIDR_MATCH_BIT(entry->net_bytes, common)] = leaf;
+	    }
+	    *link = fork;
+	    return;
+	}
+
+	/*
+	 * Same prefix. The first pattern in the run wins.
+	 */
+	if (node->bits == bits) {
+	    if (node->entry == 0) {
+		node->entry = entry;
+		node->order = order;
+	    }
+	    return;
+	}
+
+	/*
+	 * The node prefix is a prefix of the pattern. Go down.
+	 */
+	link = node->child + CIDR_MATCH_BIT(entry->net_bytes, node->bits);
+    }
+    leaf = cidr_match_node_alloc(trie, entry->net_bytes, bits,
+				 entry->addr_byte_count);
+    leaf->entry = entry;
+    leaf->order = order;
+    *link = leaf;
+}
+
+/* cidr_match_trie_find - find first matching pattern in run */
+
+static CIDR_MATCH *cidr_match_trie_find(CIDR_MATCH_TRIE *trie,
+					        unsigned addr_family,
+					        unsigned char *addr_bytes)
+{
+    CIDR_MATCH_NODE *node;
+    CIDR_MATCH_NODE *best = 0;
+    int     addr_bits;
+
+    addr_bits = (addr_family == AF_INET ? MAI_V4ADDR_BITS : MAI_V6ADDR_BITS);
+    node = trie->root[CIDR_MATCH_FAMILY_INDEX(addr_family)];
+    while (node != 0
+	   && cidr_match_prefix_len(node->key, addr_bytes,
+				    node->bits) == node->bits) {
+	if (node->entry != 0 && (best == 0 || node->order < best->order))
+	    best = node;
+	if (node->bits >= addr_bits)
+	    break;
+	node = node->child[CIDR_MATCH_BIT(addr_bytes, node->bits)];
+    }
+    return (best ? best->entry : 0);
+}
+
+/* cidr_match_compile - compile runs of positive patterns */
+
+void    cidr_match_compile(CIDR_MATCH *list)
+{
+    CIDR_MATCH *first;
+    CIDR_MATCH *entry;
+    CIDR_MATCH_TRIE *trie;
+    int     count;
+
+#define CIDR_MATCH_IN_RUN(e) \
+	((e) != 0 && (e)->op == CIDR_MATCH_OP_MATCH && (e)->match)
+
+    for (first = list; first != 0; first = entry->next) {
+	entry = first;
+	if (!CIDR_MATCH_IN_RUN(first))
+	    continue;
+	for (count = 1; CIDR_MATCH_IN_RUN(entry->next); entry = entry->next)
+	    count++;
+	if (count < CIDR_MATCH_TRIE_MIN)
+	    continue;
+	if (first->trie != 0)
+	    msg_panic("cidr_match_compile: list is already compiled");
+	trie = (CIDR_MATCH_TRIE *) mymalloc(sizeof(*trie));
+	trie->root[0] = trie->root[1] = 0;
+	trie->last = entry;
+	trie->arena = arena_create(CIDR_MATCH_TRIE_CHUNK);
+	for (count = 0, entry = first; /* void */ ; entry = entry->next) {
+	    cidr_match_trie_add(trie, entry, count++);
+	    if (entry == trie->last)
+		break;
+	}
+	first->trie = trie;
+    }
+}
+
+/* cidr_match_compile_free - destroy compiled runs */
+
+void    cidr_match_compile_free(CIDR_MATCH *list)
+{
+    CIDR_MATCH *entry;
+
+    for (entry = list; entry != 0; entry = entry->next) {
+	if (entry->trie != 0) {
+	    arena_free(entry->trie->arena);
+	    myfree((void *) entry->trie);
+	    entry->trie = 0;
+	}
+    }
+}
+
 /* cidr_match_entry - match one entry */
 
 static inline int cidr_match_entry(CIDR_MATCH *entry,
@@ -157,6 +381,19 @@ CIDR_MATCH *cidr_match_execute(CIDR_MATCH *list, const char *addr)
 
     for (entry = list; entry; entry = entry->next) {
 
+	/*
+	 * A compiled run of positive patterns. Skip to the end of the run if
+	 * there is no match.
+	 */
+	if (entry->trie != 0) {
+	    CIDR_MATCH *match;
+
+	    if ((match = cidr_match_trie_find(entry->trie, addr_family,
+					      addr_bytes)) != 0)
+		return (match);
+	    entry = entry->trie->last;
+	    continue;
+	}
 	switch (entry->op) {
 
 	case CIDR_MATCH_OP_MATCH:
@@ -280,6 +517,7 @@ VSTRING *cidr_match_parse(CIDR_MATCH *ip, char *pattern, int match,
     ip->match = match;
     ip->next = 0;
     ip->block_end = 0;
+    ip->trie = 0;
 
     return (0);
 }
@@ -304,4 +542,112 @@ void    cidr_match_endif(CIDR_MATCH *ip)
     ip->op = CIDR_MATCH_OP_ENDIF;
     ip->next = 0;				/* maybe not all bits 0 */
     ip->block_end = 0;
+    ip->trie = 0;
 }
+
+#ifdef TEST
+
+ /*
+  * Proof-of-concept test program. Generate a table with random IPv4
+  * patterns, look up random addresses with a linear search and with the
+  * compiled table, verify that the results are the same, and report the
+  * time per lookup.
+  */
+#include <time.h>
+#include <vstream.h>
+
+static double elapsed(clock_t start)
+{
+    return ((double) (clock() - start) / CLOCKS_PER_SEC);
+}
+
+static CIDR_MATCH **lookup(CIDR_MATCH *list, char **addrs, long count)
+{
+    CIDR_MATCH **result;
+    long    n;
+
+    result = (CIDR_MATCH **) mymalloc(sizeof(*result) * count);
+    for (n = 0; n < count; n++)
+	result[n] = cidr_match_execute(list, addrs[n]);
+    return (result);
+}
+
+int     main(int argc, char **argv)
+{
+    long    patterns = (argc > 1 ? atol(argv[1]) : 10000);
+    long    lookups = (argc > 2 ? atol(argv[2]) : 100000);
+    CIDR_MATCH *list = 0;
+    CIDR_MATCH *entry;
+    CIDR_MATCH **slow;
+    CIDR_MATCH **fast;
+    CIDR_MATCH **tail = &list;
+    VSTRING *buf = vstring_alloc(100);
+    VSTRING *why;
+    char  **addrs;
+    clock_t start;
+    double  list_time;
+    double  trie_time;
+    unsigned long net;
+    long    len;
+    long    n;
+    long    hits;
+
+    srandom(1);
+    for (n = 0; n < patterns; n++) {
+	entry = (CIDR_MATCH *) mymalloc(sizeof(*entry));
+	len = 8 + random() % 25;
+	net = (unsigned long) random() & (0xffffffffUL << (32 - len));
+	vstring_sprintf(buf, "%lu.%lu.%lu.%lu/%ld",
+			(net >> 24) & 0xff, (net >> 16) & 0xff,
+			(net >> 8) & 0xff, net & 0xff, len);
+	if ((why = cidr_match_parse(entry, vstring_str(buf), CIDR_MATCH_TRUE,
+				    (VSTRING *) 0)) != 0)
+	    msg_fatal("%s", vstring_str(why));
+	*tail = entry;
+	tail = &entry->next;
+    }
+    addrs = (char **) mymalloc(sizeof(*addrs) * lookups);
+    for (n = 0; n < lookups; n++) {
+	vstring_sprintf(buf, "%ld.%ld.%ld.%ld",
+			random() % 256, random() % 256,
+			random() % 256, random() % 256);
+	addrs[n] = mystrdup(vstring_str(buf));
+    }
+
+    start = clock();
+    slow = lookup(list, addrs, lookups);
+    list_time = elapsed(start);
+
+    cidr_match_compile(list);
+    start = clock();
+    fast = lookup(list, addrs, lookups);
+    trie_time = elapsed(start);
+
+    for (hits = n = 0; n < lookups; n++) {
+	if (slow[n] != fast[n])
+	    msg_fatal("%s: list result %p, trie result %p",
+		      addrs[n], (void *) slow[n], (void *) fast[n]);
+	if (slow[n] != 0)
+	    hits++;
+    }
+    vstream_printf("%ld patterns, %ld lookups, %ld matches\n",
+		   patterns, lookups, hits);
+    vstream_printf("list: %.3f usec/lookup\n", 1e6 * list_time / lookups);
+    vstream_printf("trie: %.3f usec/lookup\n", 1e6 * trie_time / lookups);
+    vstream_fflush(VSTREAM_OUT);
+
+    cidr_match_compile_free(list);
+    while ((entry = list) != 0) {
+	list = entry->next;
+	myfree((void *) entry);
+    }
+    for (n = 0; n < lookups; n++)
+	myfree(addrs[n]);
+    myfree((void *) addrs);
+    myfree((void *) slow);
+    myfree((void *) fast);
+    vstring_free(buf);
+    return (0);
+}
+
+#endif
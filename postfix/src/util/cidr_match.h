@@ -48,6 +48,7 @@ typedef struct CIDR_MATCH {
     unsigned char mask_shift;		/* optimization */
     struct CIDR_MATCH *next;		/* next entry */
     struct CIDR_MATCH *block_end;	/* block terminator */
+    struct CIDR_MATCH_TRIE *trie;	/* compiled run of entries */
 } CIDR_MATCH;
 
 #define CIDR_MATCH_OP_MATCH	1	/* Match this pattern */
@@ -62,6 +63,15 @@ extern VSTRING *cidr_match_parse_if(CIDR_MATCH *, char *, int, VSTRING *);
 extern void cidr_match_endif(CIDR_MATCH *);
 
 extern CIDR_MATCH *cidr_match_execute(CIDR_MATCH *, const char *);
+extern void cidr_match_compile(CIDR_MATCH *);
+extern void cidr_match_compile_free(CIDR_MATCH *);
+
+ /*
+  * Runs of fewer entries are not worth compiling.
+  */
+#ifndef CIDR_MATCH_TRIE_MIN
+#define CIDR_MATCH_TRIE_MIN	16
+#endif
 
 /* LICENSE
 /* .ad
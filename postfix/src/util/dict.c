@@ -572,9 +572,11 @@ void    dict_walk(DICT_WALK_ACTION action, void *ptr)
     HTABLE_INFO **ht;
     HTABLE_INFO *h;
 
+    if (dict_table == 0)
+	return;
     ht_info_list = htable_list(dict_table);
     for (ht = ht_info_list; (h = *ht) != 0; ht++)
-	action(h->key, (DICT *) h->value, ptr);
+	action(h->key, ((DICT_NODE *) h->value)->dict, ptr);
     myfree((void *) ht_info_list);
 }
 
@@ -640,6 +642,7 @@ static const NAME_MASK dict_mask[] = {
     "utf8_request", DICT_FLAG_UTF8_REQUEST,	/* request UTF-8 activation */
     "utf8_active", DICT_FLAG_UTF8_ACTIVE,	/* UTF-8 is activated */
     "src_rhs_is_file", DICT_FLAG_SRC_RHS_IS_FILE,	/* value from file */
+    "no_cache", DICT_FLAG_NO_CACHE,	/* disallow cached results */
     0,
 };
 
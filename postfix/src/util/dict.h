@@ -105,6 +105,9 @@ extern DICT *dict_debug(DICT *);
 
 #define DICT_DEBUG(d) ((d)->flags & DICT_FLAG_DEBUG ? dict_debug(d) : (d))
 
+extern DICT *dict_memo(DICT *, int, int, int);
+extern void dict_memo_stat_log(void);
+
  /*
   * See dict_open.c embedded manpage for flag definitions.
   */
@@ -133,6 +136,7 @@ extern DICT *dict_debug(DICT *);
 #define DICT_FLAG_UTF8_ACTIVE	(1<<20)	/* UTF-8 proxy layer is present */
 #define DICT_FLAG_SRC_RHS_IS_FILE \
 				(1<<21)	/* Map source RHS is a file */
+#define DICT_FLAG_NO_CACHE	(1<<22)	/* disallow cached lookup results */
 
 #define DICT_FLAG_UTF8_MASK	(DICT_FLAG_UTF8_REQUEST)
 
@@ -166,7 +170,8 @@ extern DICT *dict_debug(DICT *);
 #define DICT_FLAG_RQST_MASK	(DICT_FLAG_FOLD_ANY | DICT_FLAG_LOCK | \
 				DICT_FLAG_DUP_REPLACE | DICT_FLAG_DUP_WARN | \
 				DICT_FLAG_DUP_IGNORE | DICT_FLAG_SYNC_UPDATE | \
-				DICT_FLAG_PARANOID | DICT_FLAG_UTF8_MASK)
+				DICT_FLAG_PARANOID | DICT_FLAG_UTF8_MASK | \
+				DICT_FLAG_NO_CACHE)
 #define DICT_FLAG_INST_MASK	~(DICT_FLAG_IMPL_MASK | DICT_FLAG_RQST_MASK)
 
  /*
@@ -14,6 +14,9 @@
 /*	dict_cidr_open() opens the named file and stores
 /*	the key/value pairs where the key must be either a
 /*	"naked" IP address or a netblock in CIDR notation.
+/*	Long runs of positive patterns are compiled into a trie
+/*	with cidr_match_compile(), so that lookups in large tables
+/*	don't have to examine every pattern.
 /* SEE ALSO
 /*	dict(3) generic dictionary manager
 /* AUTHOR(S)
@@ -103,6 +106,8 @@ static void dict_cidr_close(DICT *dict)
     DICT_CIDR_ENTRY *entry;
     DICT_CIDR_ENTRY *next;
 
+    if (dict_cidr->head)
+	cidr_match_compile_free(&(dict_cidr->head->cidr_info));
     for (entry = dict_cidr->head; entry; entry = next) {
 	next = (DICT_CIDR_ENTRY *) entry->cidr_info.next;
 	myfree(entry->value);
@@ -358,6 +363,12 @@ DICT   *dict_cidr_open(const char *mapname, int open_flags, int dict_flags)
     if (rule_stack)
 	(void) mvect_free(&mvect);
 
+    /*
+     * Speed up lookups in large tables.
+     */
+    if (dict_cidr->head)
+	cidr_match_compile(&(dict_cidr->head->cidr_info));
+
     dict_file_purge_buffers(&dict_cidr->dict);
     DICT_CIDR_OPEN_RETURN(DICT_DEBUG (&dict_cidr->dict));
 }
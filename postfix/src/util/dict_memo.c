@@ -0,0 +1,412 @@
+/*++
+/* NAME
+/*	dict_memo 3
+/* SUMMARY
+/*	dictionary manager, lookup result cache
+/* SYNOPSIS
+/*	#include <dict.h>
+/*
+/*	DICT	*dict_memo(dict_handle, size, ttl, negative_ttl)
+/*	DICT	*dict_handle;
+/*	int	size;
+/*	int	ttl;
+/*	int	negative_ttl;
+/*
+/*	void	dict_memo_stat_log()
+/* DESCRIPTION
+/*	dict_memo() encapsulates the given dictionary object and
+/*	returns a proxy object that remembers the results of recent
+/*	lookups. This avoids repeated queries for the same key when
+/*	the encapsulated object is a network-based table (LDAP, SQL,
+/*	socketmap, and so on).
+/*
+/*	Successful lookup results are remembered for \fIttl\fR
+/*	seconds, and "not found" results are remembered for
+/*	\fInegative_ttl\fR seconds. A zero value disables caching
+/*	of the corresponding result. Lookup errors are never
+/*	remembered. At most \fIsize\fR results are kept; the least
+/*	recently used result is discarded first.
+/*
+/*	Update and delete requests are passed to the encapsulated
+/*	object, and discard all cached results. Sequence requests
+/*	are passed to the encapsulated object without caching.
+/*
+/*	The cache is maintained per process and per table instance.
+/*	Callers that open a table with different flags (for example,
+/*	DICT_FLAG_NO_UNAUTH) get a different instance with its own
+/*	cache. Callers that must not see cached results should
+/*	open the table with DICT_FLAG_NO_CACHE and should not use
+/*	dict_memo().
+/*
+/*	dict_memo_stat_log() logs, for each registered table that
+/*	was encapsulated with dict_memo(), the number of cache hits
+/*	and misses since the previous call, if any, and resets the
+/*	counters. This is typically called when a process terminates.
+/* DIAGNOSTICS
+/*	Fatal errors: out of memory.
+/* SEE ALSO
+/*	ctable(3) least-recently-used cache manager
+/*	dict_debug(3) dictionary manager, logging proxy
+/* LICENSE
+/* .ad
+/* .fi
+/*	The Secure Mailer license must be distributed with this software.
+/* AUTHOR(S)
+/*	Wietse Venema
+/*	Google, Inc.
+/*	111 8th Avenue
+/*	New York, NY 10011, USA
+/*--*/
+
+/* System libraries. */
+
+#include <sys_defs.h>
+#include <time.h>
+
+/* Utility library. */
+
+#include <msg.h>
+#include <mymalloc.h>
+#include <ctable.h>
+#include <dict.h>
+
+/* Application-specific. */
+
+typedef struct {
+    DICT    dict;			/* the proxy service */
+    DICT   *real_dict;			/* encapsulated object */
+    CTABLE *cache;			/* recent lookup results */
+    int     size;			/* cache size */
+    int     ttl;			/* positive result time to live */
+    int     negative_ttl;		/* negative result time to live */
+    int     hits;			/* cache hits */
+    int     negative_hits;		/* cache hits, not found */
+    int     miss;			/* cache misses */
+} DICT_MEMO;
+
+typedef struct {
+    time_t  expire;			/* time of expiration */
+    int     error;			/* lookup error, if any */
+    char   *value;			/* lookup result or null */
+} DICT_MEMO_ENTRY;
+
+/* dict_memo_pagein - query the encapsulated object for the cache */
+
+static void *dict_memo_pagein(const char *key, void *context)
+{
+    DICT_MEMO *dict_memo = (DICT_MEMO *) context;
+    DICT   *real_dict = dict_memo->real_dict;
+    DICT_MEMO_ENTRY *entry;
+    const char *value;
+
+    dict_memo->miss++;
+    entry = (DICT_MEMO_ENTRY *) mymalloc(sizeof(*entry));
+    value = dict_get(real_dict, key);
+    entry->value = value ? mystrdup(value) : 0;
+    if ((entry->error = real_dict->error) != 0)
+	entry->expire = 0;
+    else
+	entry->expire = time((time_t *) 0)
+	    + (value ? dict_memo->ttl : dict_memo->negative_ttl);
+    return ((void *) entry);
+}
+
+/* dict_memo_pageout - discard a cache entry */
+
+static void dict_memo_pageout(void *data, void *unused_context)
+{
+    DICT_MEMO_ENTRY *entry = (DICT_MEMO_ENTRY *) data;
+
+    if (entry->value)
+	myfree(entry->value);
+    myfree((void *) entry);
+}
+
+/* dict_memo_flush - discard all cache entries */
+
+static void dict_memo_flush(DICT_MEMO *dict_memo)
+{
+    if (dict_memo->cache) {
+	ctable_free(dict_memo->cache);
+	dict_memo->cache = 0;
+    }
+}
+
+/* dict_memo_lookup - cached lookup operation */
+
+static const char *dict_memo_lookup(DICT *dict, const char *key)
+{
+    DICT_MEMO *dict_memo = (DICT_MEMO *) dict;
+    DICT   *real_dict = dict_memo->real_dict;
+    const DICT_MEMO_ENTRY *entry;
+    int     miss = dict_memo->miss;
+
+    if (dict_memo->cache == 0)
+	dict_memo->cache = ctable_create(dict_memo->size, dict_memo_pagein,
+					 dict_memo_pageout,
+					 (void *) dict_memo);
+    real_dict->flags = dict->flags;
+    entry = (const DICT_MEMO_ENTRY *) ctable_locate(dict_memo->cache, key);
+    if (dict_memo->miss == miss) {
+	if (entry->expire <= time((time_t *) 0)) {
+	    entry = (const DICT_MEMO_ENTRY *)
+		ctable_refresh(dict_memo->cache, key);
+	} else {
+	    dict_memo->hits++;
+	    if (entry->value == 0)
+		dict_memo->negative_hits++;
+	}
+    }
+    dict->flags = real_dict->flags;
+    DICT_ERR_VAL_RETURN(dict, entry->error, entry->value);
+}
+
+/* dict_memo_update - update operation, discard cached results */
+
+static int dict_memo_update(DICT *dict, const char *key, const char *value)
+{
+    DICT_MEMO *dict_memo = (DICT_MEMO *) dict;
+    DICT   *real_dict = dict_memo->real_dict;
+    int     result;
+
+    dict_memo_flush(dict_memo);
+    real_dict->flags = dict->flags;
+    result = dict_put(real_dict, key, value);
+    dict->flags = real_dict->flags;
+    DICT_ERR_VAL_RETURN(dict, real_dict->error, result);
+}
+
+/* dict_memo_delete - delete operation, discard cached results */
+
+static int dict_memo_delete(DICT *dict, const char *key)
+{
+    DICT_MEMO *dict_memo = (DICT_MEMO *) dict;
+    DICT   *real_dict = dict_memo->real_dict;
+    int     result;
+
+    dict_memo_flush(dict_memo);
+    real_dict->flags = dict->flags;
+    result = dict_del(real_dict, key);
+    dict->flags = real_dict->flags;
+    DICT_ERR_VAL_RETURN(dict, real_dict->error, result);
+}
+
+/* dict_memo_sequence - sequence operation, not cached */
+
+static int dict_memo_sequence(DICT *dict, int function,
+			              const char **key, const char **value)
+{
+    DICT_MEMO *dict_memo = (DICT_MEMO *) dict;
+    DICT   *real_dict = dict_memo->real_dict;
+    int     result;
+
+    real_dict->flags = dict->flags;
+    result = dict_seq(real_dict, function, key, value);
+    dict->flags = real_dict->flags;
+    DICT_ERR_VAL_RETURN(dict, real_dict->error, result);
+}
+
+/* dict_memo_close - close operation */
+
+static void dict_memo_close(DICT *dict)
+{
+    DICT_MEMO *dict_memo = (DICT_MEMO *) dict;
+
+    dict_memo_flush(dict_memo);
+    dict_close(dict_memo->real_dict);
+    dict_free(dict);
+}
+
+/* dict_memo_stat_log_one - log and reset statistics for one table */
+
+static void dict_memo_stat_log_one(const char *unused_name, DICT *dict,
+				           void *unused_context)
+{
+    DICT_MEMO *dict_memo;
+
+    if (dict->lookup != dict_memo_lookup)
+	return;
+    dict_memo = (DICT_MEMO *) dict;
+    if (dict_memo->hits || dict_memo->miss) {
+	msg_info("statistics: table %s:%s cache hits=%d negative=%d miss=%d success=%d%%",
+		 dict->type, dict->name, dict_memo->hits,
+		 dict_memo->negative_hits, dict_memo->miss,
+		 (int) (dict_memo->hits * 100.0
+			/ ((double) dict_memo->hits + dict_memo->miss)));
+	dict_memo->hits = dict_memo->negative_hits = dict_memo->miss = 0;
+    }
+}
+
+/* dict_memo_stat_log - log and reset statistics for all cached tables */
+
+void    dict_memo_stat_log(void)
+{
+    dict_walk(dict_memo_stat_log_one, (void *) 0);
+}
+
+/* dict_memo - encapsulate dictionary object and install proxies */
+
+DICT   *dict_memo(DICT *real_dict, int size, int ttl, int negative_ttl)
+{
+    DICT_MEMO *dict_memo;
+
+    if (size <= 0)
+	msg_panic("dict_memo: bad cache size: %d", size);
+
+    dict_memo = (DICT_MEMO *) dict_alloc(real_dict->type,
+				       real_dict->name, sizeof(*dict_memo));
+    dict_memo->dict.flags = real_dict->flags;	/* XXX not synchronized */
+    dict_memo->dict.lookup = dict_memo_lookup;
+    dict_memo->dict.update = dict_memo_update;
+    dict_memo->dict.delete = dict_memo_delete;
+    dict_memo->dict.sequence = dict_memo_sequence;
+    dict_memo->dict.close = dict_memo_close;
+    dict_memo->dict.owner = real_dict->owner;
+    dict_memo->dict.mtime = real_dict->mtime;
+    dict_memo->real_dict = real_dict;
+    dict_memo->cache = 0;
+    dict_memo->size = size;
+    dict_memo->ttl = ttl;
+    dict_memo->negative_ttl = negative_ttl;
+    dict_memo->hits = dict_memo->negative_hits = dict_memo->miss = 0;
+    return (&dict_memo->dict);
+}
+
+#ifdef TEST
+
+ /*
+  * Proof-of-concept test program. The encapsulated object is an in-memory
+  * table that counts the lookups that reach it, and that reports an error
+  * for the key "error".
+  */
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <htable.h>
+#include <msg_vstream.h>
+
+typedef struct {
+    DICT    dict;
+    HTABLE *table;
+    int     lookups;
+} DICT_COUNT;
+
+static const char *dict_count_lookup(DICT *dict, const char *key)
+{
+    DICT_COUNT *dict_count = (DICT_COUNT *) dict;
+
+    dict_count->lookups++;
+    if (strcmp(key, "error") == 0)
+	DICT_ERR_VAL_RETURN(dict, DICT_ERR_RETRY, (char *) 0);
+    DICT_ERR_VAL_RETURN(dict, DICT_STAT_SUCCESS,
+			(char *) htable_find(dict_count->table, key));
+}
+
+static int dict_count_update(DICT *dict, const char *key, const char *value)
+{
+    DICT_COUNT *dict_count = (DICT_COUNT *) dict;
+    HTABLE_INFO *ht;
+
+    if ((ht = htable_locate(dict_count->table, key)) != 0) {
+	myfree(ht->value);
+	ht->value = mystrdup(value);
+    } else {
+	htable_enter(dict_count->table, key, mystrdup(value));
+    }
+    DICT_ERR_VAL_RETURN(dict, DICT_STAT_SUCCESS, DICT_STAT_SUCCESS);
+}
+
+static void dict_count_close(DICT *dict)
+{
+    DICT_COUNT *dict_count = (DICT_COUNT *) dict;
+
+    htable_free(dict_count->table, myfree);
+    dict_free(dict);
+}
+
+static DICT_COUNT *dict_count_open(void)
+{
+    DICT_COUNT *dict_count;
+
+    dict_count = (DICT_COUNT *) dict_alloc("count", "test",
+					   sizeof(*dict_count));
+    dict_count->dict.lookup = dict_count_lookup;
+    dict_count->dict.update = dict_count_update;
+    dict_count->dict.close = dict_count_close;
+    dict_count->table = htable_create(1);
+    dict_count->lookups = 0;
+    return (dict_count);
+}
+
+int     main(int argc, char **argv)
+{
+    struct test_info {
+	const char *comment;
+	int     sleep;			/* delay before request */
+	const char *key;		/* lookup or update key */
+	const char *update;		/* update value, or lookup */
+	const char *expect_value;	/* lookup result */
+	int     expect_error;		/* lookup error */
+	int     expect_lookups;		/* total lookups in real table */
+    };
+    static const struct test_info test_info[] = {
+	{"initial update", 0, "a", "1", 0, 0, 0},
+	{"positive miss", 0, "a", 0, "1", 0, 1},
+	{"positive hit", 0, "a", 0, "1", 0, 1},
+	{"negative miss", 0, "b", 0, 0, 0, 2},
+	{"negative hit", 0, "b", 0, 0, 0, 2},
+	{"error miss", 0, "error", 0, 0, DICT_ERR_RETRY, 3},
+	{"error is not cached", 0, "error", 0, 0, DICT_ERR_RETRY, 4},
+	{"update flushes cache", 0, "b", "2", 0, 0, 4},
+	{"new positive miss", 0, "b", 0, "2", 0, 5},
+	{"flushed positive miss", 0, "a", 0, "1", 0, 6},
+	{"positive hit", 0, "a", 0, "1", 0, 6},
+	{"positive expired", 2, "a", 0, "1", 0, 7},
+	{0},
+    };
+    const struct test_info *tp;
+    DICT_COUNT *dict_count;
+    DICT   *dict;
+    const char *value;
+    int     errs = 0;
+
+    msg_vstream_init(argv[0], VSTREAM_ERR);
+    dict_count = dict_count_open();
+    dict = dict_memo(&dict_count->dict, 10, 1, 60);
+    dict_register("memo", dict);
+
+    for (tp = test_info; tp->comment != 0; tp++) {
+	if (tp->sleep)
+	    sleep(tp->sleep);
+	if (tp->update) {
+	    if (dict_put(dict, tp->key, tp->update) != 0) {
+		msg_warn("test \"%s\": update failed", tp->comment);
+		errs++;
+	    }
+	} else {
+	    value = dict_get(dict, tp->key);
+	    if ((tp->expect_value == 0) != (value == 0)
+		|| (value && strcmp(value, tp->expect_value) != 0)) {
+		msg_warn("test \"%s\": value mis-match: expect='%s', real='%s'",
+			 tp->comment, tp->expect_value ? tp->expect_value :
+			 "(null)", value ? value : "(null)");
+		errs++;
+	    }
+	    if (dict->error != tp->expect_error) {
+		msg_warn("test \"%s\": error mis-match: expect=%d, real=%d",
+			 tp->comment, tp->expect_error, dict->error);
+		errs++;
+	    }
+	}
+	if (dict_count->lookups != tp->expect_lookups) {
+	    msg_warn("test \"%s\": lookup count mis-match: expect=%d, real=%d",
+		     tp->comment, tp->expect_lookups, dict_count->lookups);
+	    errs++;
+	}
+    }
+    dict_memo_stat_log();
+    dict_unregister("memo");
+    exit(errs);
+}
+
+#endif
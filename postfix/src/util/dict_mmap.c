@@ -0,0 +1,549 @@
+/*++
+/* NAME
+/*	dict_mmap 3
+/* SUMMARY
+/*	dictionary manager interface to shared memory-mapped tables
+/* SYNOPSIS
+/*	#include <dict_mmap.h>
+/*
+/*	DICT	*dict_mmap_open(path, open_flags, dict_flags)
+/*	const char *path;
+/*	int	open_flags;
+/*	int	dict_flags;
+/* DESCRIPTION
+/*	dict_mmap_open() opens the specified memory-mapped table.
+/*	The result is a pointer to a structure that can be used to
+/*	access the dictionary using the generic methods documented
+/*	in dict_open(3).
+/*
+/*	A memory-mapped table is an immutable file that contains a
+/*	ready-to-use hash table. In query mode, the file is mapped
+/*	read-only with mmap(2), and lookups are done directly in the
+/*	mapped memory. There is no parsing at open time and no
+/*	per-process copy of the table: all processes that open the
+/*	same table share the same physical memory.
+/*
+/*	In create mode, entries are collected in memory. When the
+/*	table is closed, the file is written as \fIpath\fR.mmap.tmp
+/*	and renamed to \fIpath\fR.mmap. A process that has the old
+/*	file open keeps using it until it notices the change with
+/*	dict_changed_name(3), and then reopens the table.
+/*
+/*	The file uses the host byte order. A table created on a
+/*	host with a different byte order is rejected.
+/*
+/*	Arguments:
+/* .IP path
+/*	The database pathname, not including the ".mmap" suffix.
+/* .IP open_flags
+/*	Flags passed to open(). Specify O_RDONLY or O_WRONLY|O_CREAT|O_TRUNC.
+/* .IP dict_flags
+/*	Flags used by the dictionary interface.
+/* SEE ALSO
+/*	dict(3) generic dictionary manager
+/* DIAGNOSTICS
+/*	Fatal errors: cannot open file, write error, corrupt file,
+/*	out of memory.
+/* LICENSE
+/* .ad
+/* .fi
+/*	The Secure Mailer license must be distributed with this software.
+/* AUTHOR(S)
+/*	Wietse Venema
+/*	Google, Inc.
+/*	111 8th Avenue
+/*	New York, NY 10011, USA
+/*--*/
+
+#include "sys_defs.h"
+
+/* System library. */
+
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <string.h>
+#include <stdio.h>			/* rename() */
+#include <unistd.h>
+#include <time.h>
+
+/* Utility library. */
+
+#include "msg.h"
+#include "mymalloc.h"
+#include "htable.h"
+#include "vstream.h"
+#include "vstring.h"
+#include "stringops.h"
+#include "iostuff.h"
+#include "myflock.h"
+#include "dict.h"
+#include "dict_mmap.h"
+#include "warn_stat.h"
+
+#ifndef MAP_FAILED
+#define MAP_FAILED	((void *) -1)
+#endif
+
+#define DICT_MMAP_SUFFIX	".mmap"
+#define DICT_MMAP_TMP_SUFFIX	DICT_MMAP_SUFFIX ".tmp"
+
+ /*
+  * File layout: header, bucket array, and "key\0value\0" records. Offsets
+  * are relative to the start of the file. A bucket with a zero offset is
+  * empty. The hash table is at most half full, so that a search for a
+  * missing key terminates quickly.
+  */
+#define DICT_MMAP_MAGIC		"PFXMMAP1"
+#define DICT_MMAP_BYTE_ORDER	0x01020304
+
+typedef struct {
+    char    magic[8];			/* DICT_MMAP_MAGIC */
+    UINT32_TYPE byte_order;		/* DICT_MMAP_BYTE_ORDER */
+    UINT32_TYPE buckets;		/* hash table size, power of 2 */
+    UINT32_TYPE entries;		/* number of records */
+    UINT32_TYPE size;			/* file size */
+} DICT_MMAP_HEADER;
+
+typedef struct {
+    UINT32_TYPE hash;			/* key hash value */
+    UINT32_TYPE offset;			/* record offset, or zero */
+} DICT_MMAP_BUCKET;
+
+#define DICT_MMAP_MIN_BUCKETS	8
+#define DICT_MMAP_DATA_OFFSET(n) \
+	(sizeof(DICT_MMAP_HEADER) + (n) * sizeof(DICT_MMAP_BUCKET))
+#define DICT_MMAP_MAX_SIZE	((UINT32_TYPE) ~0)
+
+/* Application-specific. */
+
+typedef struct {
+    DICT    dict;			/* generic members */
+    char   *map;			/* mmap() result */
+    size_t  map_len;			/* mapped file size */
+    DICT_MMAP_BUCKET *bucket;		/* hash table */
+    UINT32_TYPE mask;			/* hash table size - 1 */
+    char   *data;			/* first record */
+    char   *seq_ptr;			/* next record for dict_seq() */
+} DICT_MMAPQ;				/* query interface */
+
+typedef struct {
+    DICT    dict;			/* generic members */
+    HTABLE *table;			/* entries so far */
+    int     fd;				/* locked temporary file */
+    char   *mmap_path;			/* pathname (.mmap) */
+    char   *tmp_path;			/* temporary pathname (.tmp) */
+} DICT_MMAPM;				/* rebuild interface */
+
+/* dict_mmap_hash - FNV-1a hash, part of the file format */
+
+static UINT32_TYPE dict_mmap_hash(const char *key)
+{
+    UINT32_TYPE h = 2166136261U;
+
+    while (*key) {
+	h ^= *(const unsigned char *) key++;
+	h *= 16777619U;
+    }
+    return (h);
+}
+
+/* dict_mmapq_lookup - find database entry, query mode */
+
+static const char *dict_mmapq_lookup(DICT *dict, const char *name)
+{
+    DICT_MMAPQ *dict_mmapq = (DICT_MMAPQ *) dict;
+    DICT_MMAP_BUCKET *bp;
+    UINT32_TYPE hash;
+    UINT32_TYPE idx;
+    UINT32_TYPE probes;
+    char   *key;
+    char   *value;
+
+    dict->error = 0;
+
+    /* The file is constant, so do not try to acquire a lock. */
+
+    /*
+     * Optionally fold the key.
+     */
+    if (dict->flags & DICT_FLAG_FOLD_FIX) {
+	if (dict->fold_buf == 0)
+	    dict->fold_buf = vstring_alloc(10);
+	vstring_strcpy(dict->fold_buf, name);
+	name = lowercase(vstring_str(dict->fold_buf));
+    }
+
+    /*
+     * Linear probing. The open-time sanity checks guarantee that the last
+     * byte of the file is null, so that strcmp() stays within the mapping.
+     */
+    hash = dict_mmap_hash(name);
+    for (idx = hash & dict_mmapq->mask, probes = 0;
+	 probes <= dict_mmapq->mask;
+	 idx = (idx + 1) & dict_mmapq->mask, probes++) {
+	bp = dict_mmapq->bucket + idx;
+	if (bp->offset == 0)
+	    return (0);
+	if (bp->hash != hash)
+	    continue;
+	if (bp->offset < dict_mmapq->data - dict_mmapq->map
+	    || bp->offset >= dict_mmapq->map_len)
+	    msg_fatal("%s: corrupt database: bad record offset %lu",
+		      dict->name, (unsigned long) bp->offset);
+	key = dict_mmapq->map + bp->offset;
+	if (strcmp(key, name) == 0) {
+	    value = key + strlen(key) + 1;
+	    if (value >= dict_mmapq->map + dict_mmapq->map_len)
+		msg_fatal("%s: corrupt database: missing value", dict->name);
+	    return (value);
+	}
+    }
+    return (0);
+}
+
+/* dict_mmapq_sequence - traverse the records in file order */
+
+static int dict_mmapq_sequence(DICT *dict, int function,
+			               const char **key, const char **value)
+{
+    DICT_MMAPQ *dict_mmapq = (DICT_MMAPQ *) dict;
+    char   *end = dict_mmapq->map + dict_mmapq->map_len;
+    char   *cp;
+
+    dict->error = 0;
+
+    switch (function) {
+    case DICT_SEQ_FUN_FIRST:
+	dict_mmapq->seq_ptr = dict_mmapq->data;
+	break;
+    case DICT_SEQ_FUN_NEXT:
+	if (dict_mmapq->seq_ptr == 0)
+	    msg_panic("%s: sequence NEXT without FIRST", dict->name);
+	break;
+    default:
+	msg_panic("%s: invalid sequence function: %d",
+		  dict->name, function);
+    }
+    if ((cp = dict_mmapq->seq_ptr) >= end)
+	return (1);
+    *key = cp;
+    cp += strlen(cp) + 1;
+    if (cp >= end)
+	msg_fatal("%s: corrupt database: missing value", dict->name);
+    *value = cp;
+    dict_mmapq->seq_ptr = cp + strlen(cp) + 1;
+    return (0);
+}
+
+/* dict_mmapq_close - close data base, query mode */
+
+static void dict_mmapq_close(DICT *dict)
+{
+    DICT_MMAPQ *dict_mmapq = (DICT_MMAPQ *) dict;
+
+    if (munmap(dict_mmapq->map, dict_mmapq->map_len) < 0)
+	msg_warn("munmap %s: %m", dict->name);
+    close(dict->stat_fd);
+    if (dict->fold_buf)
+	vstring_free(dict->fold_buf);
+    dict_free(dict);
+}
+
+/* dict_mmapq_open - open data base, query mode */
+
+static DICT *dict_mmapq_open(const char *path, int dict_flags)
+{
+    DICT_MMAPQ *dict_mmapq;
+    DICT_MMAP_HEADER *hp;
+    struct stat st;
+    char   *mmap_path;
+    char   *map;
+    size_t  size;
+    int     fd;
+
+    /*
+     * Let the optimizer worry about eliminating redundant code.
+     */
+#define DICT_MMAPQ_OPEN_RETURN(d) do { \
+	DICT *__d = (d); \
+	myfree(mmap_path); \
+	return (__d); \
+    } while (0)
+
+    mmap_path = concatenate(path, DICT_MMAP_SUFFIX, (char *) 0);
+
+    if ((fd = open(mmap_path, O_RDONLY)) < 0)
+	DICT_MMAPQ_OPEN_RETURN(dict_surrogate(DICT_TYPE_MMAP, path,
+					      O_RDONLY, dict_flags,
+					  "open database %s: %m", mmap_path));
+    if (fstat(fd, &st) < 0)
+	msg_fatal("dict_mmapq_open: fstat %s: %m", mmap_path);
+
+    /*
+     * Sanity check the file before we trust any offsets in it.
+     */
+    if (st.st_size < (off_t) DICT_MMAP_DATA_OFFSET(DICT_MMAP_MIN_BUCKETS)
+	|| st.st_size > (off_t) DICT_MMAP_MAX_SIZE)
+	msg_fatal("%s: corrupt database: bad file size %ld",
+		  mmap_path, (long) st.st_size);
+    size = st.st_size;
+    if ((map = mmap((void *) 0, size, PROT_READ, MAP_SHARED,
+		    fd, (off_t) 0)) == MAP_FAILED)
+	msg_fatal("mmap %s: %m", mmap_path);
+    hp = (DICT_MMAP_HEADER *) map;
+    if (memcmp(hp->magic, DICT_MMAP_MAGIC, sizeof(hp->magic)) != 0)
+	msg_fatal("%s: not a memory-mapped table", mmap_path);
+    if (hp->byte_order != DICT_MMAP_BYTE_ORDER)
+	msg_fatal("%s: table was created on a host with different byte order",
+		  mmap_path);
+    if (hp->size != size
+	|| hp->buckets < DICT_MMAP_MIN_BUCKETS
+	|| (hp->buckets & (hp->buckets - 1)) != 0
+	|| hp->entries >= hp->buckets
+	|| DICT_MMAP_DATA_OFFSET((size_t) hp->buckets) > size
+	|| (DICT_MMAP_DATA_OFFSET((size_t) hp->buckets) < size
+	    && map[size - 1] != 0))
+	msg_fatal("%s: corrupt database: bad header", mmap_path);
+
+    dict_mmapq = (DICT_MMAPQ *) dict_alloc(DICT_TYPE_MMAP,
+					   mmap_path, sizeof(*dict_mmapq));
+    dict_mmapq->map = map;
+    dict_mmapq->map_len = size;
+    dict_mmapq->bucket = (DICT_MMAP_BUCKET *) (map + sizeof(*hp));
+    dict_mmapq->mask = hp->buckets - 1;
+    dict_mmapq->data = map + DICT_MMAP_DATA_OFFSET((size_t) hp->buckets);
+    dict_mmapq->seq_ptr = 0;
+    dict_mmapq->dict.lookup = dict_mmapq_lookup;
+    dict_mmapq->dict.sequence = dict_mmapq_sequence;
+    dict_mmapq->dict.close = dict_mmapq_close;
+    dict_mmapq->dict.stat_fd = fd;
+    dict_mmapq->dict.mtime = st.st_mtime;
+    dict_mmapq->dict.owner.uid = st.st_uid;
+    dict_mmapq->dict.owner.status = (st.st_uid != 0);
+    close_on_exec(fd, CLOSE_ON_EXEC);
+
+    /*
+     * Warn if the source file is newer than the indexed file, except when
+     * the source file changed only seconds ago.
+     */
+    if (stat(path, &st) == 0
+	&& st.st_mtime > dict_mmapq->dict.mtime
+	&& st.st_mtime < time((time_t *) 0) - 100)
+	msg_warn("database %s is older than source file %s", mmap_path, path);
+
+    dict_mmapq->dict.flags = dict_flags | DICT_FLAG_FIXED;
+    if (dict_flags & DICT_FLAG_FOLD_FIX)
+	dict_mmapq->dict.fold_buf = vstring_alloc(10);
+
+    DICT_MMAPQ_OPEN_RETURN(DICT_DEBUG (&dict_mmapq->dict));
+}
+
+/* dict_mmapm_update - add database entry, create mode */
+
+static int dict_mmapm_update(DICT *dict, const char *name, const char *value)
+{
+    DICT_MMAPM *dict_mmapm = (DICT_MMAPM *) dict;
+    HTABLE_INFO *ht;
+
+    dict->error = 0;
+
+    /*
+     * Optionally fold the key.
+     */
+    if (dict->flags & DICT_FLAG_FOLD_FIX) {
+	if (dict->fold_buf == 0)
+	    dict->fold_buf = vstring_alloc(10);
+	vstring_strcpy(dict->fold_buf, name);
+	name = lowercase(vstring_str(dict->fold_buf));
+    }
+
+    /*
+     * Do the add operation. No locking is done.
+     */
+    if ((ht = htable_locate(dict_mmapm->table, name)) == 0) {
+	(void) htable_enter(dict_mmapm->table, name, mystrdup(value));
+	return (0);
+    }
+    if (dict->flags & DICT_FLAG_DUP_IGNORE)
+	 /* void */ ;
+    else if (dict->flags & DICT_FLAG_DUP_REPLACE) {
+	myfree(ht->value);
+	ht->value = mystrdup(value);
+	return (0);
+    } else if (dict->flags & DICT_FLAG_DUP_WARN)
+	msg_warn("%s: duplicate entry: \"%s\"", dict->name, name);
+    else
+	msg_fatal("%s: duplicate entry: \"%s\"", dict->name, name);
+    return (1);
+}
+
+/* dict_mmapm_close - write file.tmp and rename to file.mmap */
+
+static void dict_mmapm_close(DICT *dict)
+{
+    DICT_MMAPM *dict_mmapm = (DICT_MMAPM *) dict;
+    DICT_MMAP_HEADER header;
+    DICT_MMAP_BUCKET *bucket;
+    HTABLE_INFO **list;
+    HTABLE_INFO **ht;
+    VSTREAM *fp;
+    size_t  buckets;
+    size_t  offset;
+    size_t  idx;
+
+    /*
+     * Size the hash table so that it is at most half full.
+     */
+    if (dict_mmapm->table->used > DICT_MMAP_MAX_SIZE / 4)
+	msg_fatal("%s: too many entries", dict_mmapm->tmp_path);
+    for (buckets = DICT_MMAP_MIN_BUCKETS;
+	 buckets < 2 * dict_mmapm->table->used; buckets <<= 1)
+	 /* void */ ;
+    bucket = (DICT_MMAP_BUCKET *) mymalloc(buckets * sizeof(*bucket));
+    memset((void *) bucket, 0, buckets * sizeof(*bucket));
+
+    /*
+     * Assign record offsets in the order that we will write the records.
+     */
+    list = htable_list(dict_mmapm->table);
+    offset = DICT_MMAP_DATA_OFFSET(buckets);
+    for (ht = list; *ht; ht++) {
+	UINT32_TYPE hash = dict_mmap_hash(ht[0]->key);
+
+	for (idx = hash & (buckets - 1); bucket[idx].offset != 0;
+	     idx = (idx + 1) & (buckets - 1))
+	     /* void */ ;
+	bucket[idx].hash = hash;
+	bucket[idx].offset = offset;
+	offset += strlen(ht[0]->key) + strlen(ht[0]->value) + 2;
+	if (offset > DICT_MMAP_MAX_SIZE)
+	    msg_fatal("%s: database too large", dict_mmapm->tmp_path);
+    }
+    memset((void *) &header, 0, sizeof(header));
+    memcpy(header.magic, DICT_MMAP_MAGIC, sizeof(header.magic));
+    header.byte_order = DICT_MMAP_BYTE_ORDER;
+    header.buckets = buckets;
+    header.entries = dict_mmapm->table->used;
+    header.size = offset;
+
+    /*
+     * Write the file through the locked descriptor.
+     */
+    fp = vstream_fdopen(dict_mmapm->fd, O_WRONLY);
+    vstream_fwrite(fp, (void *) &header, sizeof(header));
+    vstream_fwrite(fp, (void *) bucket, buckets * sizeof(*bucket));
+    for (ht = list; *ht; ht++) {
+	vstream_fwrite(fp, ht[0]->key, strlen(ht[0]->key) + 1);
+	vstream_fwrite(fp, ht[0]->value, strlen(ht[0]->value) + 1);
+    }
+    if (vstream_fflush(fp) != 0)
+	msg_fatal("write database %s: %m", dict_mmapm->tmp_path);
+    myfree((void *) list);
+    myfree((void *) bucket);
+
+    /*
+     * Note: if FCNTL locking is used, closing any file descriptor on a
+     * locked file cancels all locks that the process may have on that file.
+     * Therefore, rename the file before the stream closes the descriptor.
+     */
+    if (rename(dict_mmapm->tmp_path, dict_mmapm->mmap_path) < 0)
+	msg_fatal("rename database from %s to %s: %m",
+		  dict_mmapm->tmp_path, dict_mmapm->mmap_path);
+    if (vstream_fclose(fp) != 0)		/* releases a lock */
+	msg_fatal("close database %s: %m", dict_mmapm->mmap_path);
+    htable_free(dict_mmapm->table, myfree);
+    myfree(dict_mmapm->mmap_path);
+    myfree(dict_mmapm->tmp_path);
+    if (dict->fold_buf)
+	vstring_free(dict->fold_buf);
+    dict_free(dict);
+}
+
+/* dict_mmapm_open - create database as file.tmp */
+
+static DICT *dict_mmapm_open(const char *path, int dict_flags)
+{
+    DICT_MMAPM *dict_mmapm;
+    char   *mmap_path;
+    char   *tmp_path;
+    int     fd;
+    struct stat st0, st1;
+
+    /*
+     * Let the optimizer worry about eliminating redundant code.
+     */
+#define DICT_MMAPM_OPEN_RETURN(d) do { \
+	DICT *__d = (d); \
+	if (mmap_path) \
+	    myfree(mmap_path); \
+	if (tmp_path) \
+	    myfree(tmp_path); \
+	return (__d); \
+    } while (0)
+
+    mmap_path = concatenate(path, DICT_MMAP_SUFFIX, (char *) 0);
+    tmp_path = concatenate(path, DICT_MMAP_TMP_SUFFIX, (char *) 0);
+
+    /*
+     * Repeat until we have opened *and* locked *existing* file, as with
+     * dict_cdb(3). We can't open the file with O_TRUNC, because another
+     * process may be creating it at the same time.
+     */
+    for (;;) {
+	if ((fd = open(tmp_path, O_RDWR | O_CREAT, 0644)) < 0)
+	    DICT_MMAPM_OPEN_RETURN(dict_surrogate(DICT_TYPE_MMAP, path,
+						  O_RDWR, dict_flags,
+						  "open database %s: %m",
+						  tmp_path));
+	if (fstat(fd, &st0) < 0)
+	    msg_fatal("fstat(%s): %m", tmp_path);
+	if (myflock(fd, INTERNAL_LOCK, MYFLOCK_OP_EXCLUSIVE) < 0)
+	    msg_fatal("lock %s: %m", tmp_path);
+	if (stat(tmp_path, &st1) < 0)
+	    msg_fatal("stat(%s): %m", tmp_path);
+	if (st0.st_ino == st1.st_ino && st0.st_dev == st1.st_dev
+	    && st0.st_rdev == st1.st_rdev && st0.st_nlink == st1.st_nlink
+	    && st0.st_nlink > 0)
+	    break;
+	close(fd);
+    }
+    if (st0.st_size && ftruncate(fd, 0) < 0)
+	msg_fatal("truncate %s: %m", tmp_path);
+
+    dict_mmapm = (DICT_MMAPM *) dict_alloc(DICT_TYPE_MMAP, path,
+					   sizeof(*dict_mmapm));
+    dict_mmapm->dict.close = dict_mmapm_close;
+    dict_mmapm->dict.update = dict_mmapm_update;
+    dict_mmapm->table = htable_create(100);
+    dict_mmapm->fd = fd;
+    dict_mmapm->mmap_path = mmap_path;
+    dict_mmapm->tmp_path = tmp_path;
+    mmap_path = tmp_path = 0;			/* DICT_MMAPM_OPEN_RETURN() */
+    dict_mmapm->dict.owner.uid = st1.st_uid;
+    dict_mmapm->dict.owner.status = (st1.st_uid != 0);
+    close_on_exec(fd, CLOSE_ON_EXEC);
+
+    dict_mmapm->dict.flags = dict_flags | DICT_FLAG_FIXED;
+    if (dict_flags & DICT_FLAG_FOLD_FIX)
+	dict_mmapm->dict.fold_buf = vstring_alloc(10);
+
+    DICT_MMAPM_OPEN_RETURN(DICT_DEBUG (&dict_mmapm->dict));
+}
+
+/* dict_mmap_open - open data base for query mode or create mode */
+
+DICT   *dict_mmap_open(const char *path, int open_flags, int dict_flags)
+{
+    switch (open_flags & (O_RDONLY | O_RDWR | O_WRONLY | O_CREAT | O_TRUNC)) {
+    case O_RDONLY:				/* query mode */
+	return (dict_mmapq_open(path, dict_flags));
+    case O_WRONLY | O_CREAT | O_TRUNC:		/* create mode */
+    case O_RDWR | O_CREAT | O_TRUNC:		/* sloppiness */
+	return (dict_mmapm_open(path, dict_flags));
+    default:
+	return (dict_surrogate(DICT_TYPE_MMAP, path, open_flags, dict_flags,
+			       "%s:%s map requires O_RDONLY or "
+			       "O_WRONLY|O_CREAT|O_TRUNC access mode",
+			       DICT_TYPE_MMAP, path));
+    }
+}
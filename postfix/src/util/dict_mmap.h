@@ -0,0 +1,37 @@
+#ifndef _DICT_MMAP_H_INCLUDED_
+#define _DICT_MMAP_H_INCLUDED_
+
+/*++
+/* NAME
+/*	dict_mmap 3h
+/* SUMMARY
+/*	dictionary manager interface to shared memory-mapped tables
+/* SYNOPSIS
+/*	#include <dict_mmap.h>
+/* DESCRIPTION
+/* .nf
+
+ /*
+  * Utility library.
+  */
+#include <dict.h>
+
+ /*
+  * External interface.
+  */
+#define DICT_TYPE_MMAP	"mmap"
+
+extern DICT *dict_mmap_open(const char *, int, int);
+
+/* LICENSE
+/* .ad
+/* .fi
+/*	The Secure Mailer license must be distributed with this software.
+/* AUTHOR(S)
+/*	Wietse Venema
+/*	Google, Inc.
+/*	111 8th Avenue
+/*	New York, NY 10011, USA
+/*--*/
+
+#endif
@@ -147,6 +147,10 @@
 /*	to block privilege escalation attacks (example: tcp_table;
 /*	even NIS can be secured to some extent by requiring that
 /*	the server binds to a privileged port).
+/* .IP DICT_FLAG_NO_CACHE
+/*	Disallow the use of remembered lookup results (see
+/*	dict_memo(3)), for requestors that must see the current
+/*	table content.
 /* .IP DICT_FLAG_PARANOID
 /*	A combination of all the paranoia flags: DICT_FLAG_NO_REGSUB,
 /*	DICT_FLAG_NO_PROXY and DICT_FLAG_NO_UNAUTH.
@@ -208,6 +212,8 @@
 /*	POSIX-compatible regular expressions.
 /* .IP texthash
 /*	Flat text in postmap(1) input format.
+/* .IP mmap
+/*	Immutable hash table file that is shared through mmap(2).
 /* .PP
 /*	dict_open3() takes separate arguments for dictionary type and
 /*	name, but otherwise performs the same functions as dict_open().
@@ -338,6 +344,7 @@
 #include <dict_cidr.h>
 #include <dict_ht.h>
 #include <dict_thash.h>
+#include <dict_mmap.h>
 #include <dict_sockmap.h>
 #include <dict_fail.h>
 #include <dict_pipe.h>
@@ -384,6 +391,7 @@ static const DICT_OPEN_INFO dict_open_info[] = {
     DICT_TYPE_STATIC, dict_static_open,
     DICT_TYPE_CIDR, dict_cidr_open,
     DICT_TYPE_THASH, dict_thash_open,
+    DICT_TYPE_MMAP, dict_mmap_open,
     DICT_TYPE_SOCKMAP, dict_sockmap_open,
     DICT_TYPE_FAIL, dict_fail_open,
     DICT_TYPE_PIPE, dict_pipe_open,
@@ -420,6 +428,7 @@ static DICT_MAPNAMES_EXTEND_FN dict_mapnames_extend_hook;
   */
 DEFINE_DICT_LMDB_MAP_SIZE;
 DEFINE_DICT_DB_CACHE_SIZE;
+DEFINE_DICT_PCRE_JIT_STACK_SIZE;
 
 /* dict_open_init - one-off initialization */
 
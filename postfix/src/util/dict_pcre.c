@@ -14,8 +14,21 @@
 /*	dict_pcre_open() opens the named file and compiles the contained
 /*	regular expressions. The result object can be used to match strings
 /*	against the table.
+/*
+/*	Tables with many patterns use a lit_filter(3) pre-filter. Each
+/*	lookup string is scanned once for the literal text that the
+/*	patterns require, and a pattern whose literals are absent is
+/*	not executed. This does not change the result.
+/*
+/*	When built with PCRE2 (HAS_PCRE=2), patterns are JIT compiled
+/*	where the platform supports it, and are interpreted otherwise.
+/*	Each table has one match data block that is reused for all
+/*	lookups. All tables share one JIT stack; its maximal size is
+/*	specified with the dict_pcre_jit_stack_size variable (zero
+/*	means use the small PCRE2 default stack).
 /* SEE ALSO
 /*	dict(3) generic dictionary manager
+/*	lit_filter(3) regular expression pre-filter
 /* AUTHOR(S)
 /*	Andrew McNamara
 /*	andrewm@connect.com.au
@@ -63,9 +76,21 @@
 #include "dict.h"
 #include "dict_pcre.h"
 #include "mac_parse.h"
-#include "pcre.h"
 #include "warn_stat.h"
 #include "mvect.h"
+#include "lit_filter.h"
+
+ /*
+  * PCRE library. HAS_PCRE=1 (or plain HAS_PCRE) selects the legacy PCRE
+  * API; HAS_PCRE=2 selects PCRE2. With PCRE2, JIT-compiled code is part of
+  * the compiled pattern, so that there are no separate hints.
+  */
+#if HAS_PCRE == 1
+#include "pcre.h"
+
+#define DICT_PCRE_CODE		pcre
+#define DICT_PCRE_HINTS		pcre_extra
+#define DICT_PCRE_FREE_CODE(x)	myfree((void *) (x))
 
  /*
   * Backwards compatibility.
@@ -74,6 +99,43 @@
 #define DICT_PCRE_FREE_STUDY(x)	pcre_free_study(x)
 #else
 #define DICT_PCRE_FREE_STUDY(x)	pcre_free((char *) (x))
+#endif
+
+#else
+#define PCRE2_CODE_UNIT_WIDTH	8
+#include <pcre2.h>
+
+#define DICT_PCRE_CODE		pcre2_code
+#define DICT_PCRE_HINTS		void
+#define DICT_PCRE_FREE_CODE(x)	pcre2_code_free(x)
+#define DICT_PCRE_FREE_STUDY(x)	((void) 0)
+
+ /*
+  * Map the pcre_table(5) options to PCRE2. PCRE2 always behaves as if
+  * PCRE_EXTRA was specified.
+  */
+#define PCRE_CASELESS		PCRE2_CASELESS
+#define PCRE_MULTILINE		PCRE2_MULTILINE
+#define PCRE_DOTALL		PCRE2_DOTALL
+#define PCRE_EXTENDED		PCRE2_EXTENDED
+#define PCRE_ANCHORED		PCRE2_ANCHORED
+#define PCRE_DOLLAR_ENDONLY	PCRE2_DOLLAR_ENDONLY
+#define PCRE_UNGREEDY		PCRE2_UNGREEDY
+#define PCRE_EXTRA		0
+#define PCRE_ERROR_NOMATCH	PCRE2_ERROR_NOMATCH
+#define PCRE_INFO_CAPTURECOUNT	PCRE2_INFO_CAPTURECOUNT
+
+ /*
+  * The JIT stack starts small, and grows as needed up to the configured
+  * limit.
+  */
+#define DICT_PCRE_JIT_STACK_START	(32 * 1024)
+
+static pcre2_general_context *dict_pcre_general_context;
+static pcre2_compile_context *dict_pcre_compile_context;
+static pcre2_match_context *dict_pcre_match_context;
+static pcre2_jit_stack *dict_pcre_jit_stack;
+
 #endif
 
  /*
@@ -98,8 +160,8 @@ typedef struct {
 } DICT_PCRE_REGEXP;
 
 typedef struct {
-    pcre   *pattern;			/* the compiled pattern */
-    pcre_extra *hints;			/* hints to speed pattern execution */
+    DICT_PCRE_CODE *pattern;		/* the compiled pattern */
+    DICT_PCRE_HINTS *hints;		/* hints to speed pattern execution */
 } DICT_PCRE_ENGINE;
 
  /*
@@ -113,18 +175,20 @@ typedef struct DICT_PCRE_RULE {
 
 typedef struct {
     DICT_PCRE_RULE rule;		/* generic part */
-    pcre   *pattern;			/* compiled pattern */
-    pcre_extra *hints;			/* hints to speed pattern execution */
+    DICT_PCRE_CODE *pattern;		/* compiled pattern */
+    DICT_PCRE_HINTS *hints;		/* hints to speed pattern execution */
     char   *replacement;		/* replacement string */
     int     match;			/* positive or negative match */
+    int     lit;			/* pre-filter pattern id */
     size_t  max_sub;			/* largest $number in replacement */
 } DICT_PCRE_MATCH_RULE;
 
 typedef struct {
     DICT_PCRE_RULE rule;		/* generic members */
-    pcre   *pattern;			/* compiled pattern */
-    pcre_extra *hints;			/* hints to speed pattern execution */
+    DICT_PCRE_CODE *pattern;		/* compiled pattern */
+    DICT_PCRE_HINTS *hints;		/* hints to speed pattern execution */
     int     match;			/* positive or negative match */
+    int     lit;			/* pre-filter pattern id */
     struct DICT_PCRE_RULE *endif_rule;	/* matching endif rule */
 } DICT_PCRE_IF_RULE;
 
@@ -135,6 +199,10 @@ typedef struct {
     DICT    dict;			/* generic members */
     DICT_PCRE_RULE *head;
     VSTRING *expansion_buf;		/* lookup result */
+    LIT_FILTER *filter;			/* pattern pre-filter */
+#if HAS_PCRE > 1
+    pcre2_match_data *match_data;	/* reused for each lookup */
+#endif
 } DICT_PCRE;
 
 static int dict_pcre_init = 0;		/* flag need to init pcre library */
@@ -146,7 +214,11 @@ typedef struct {
     DICT_PCRE *dict_pcre;		/* the dictionary handle */
     DICT_PCRE_MATCH_RULE *match_rule;	/* the rule we matched */
     const char *lookup_string;		/* string against which we match */
+#if HAS_PCRE == 1
     int     offsets[PCRE_MAX_CAPTURE * 3];	/* Cut substrings */
+#else
+    pcre2_match_data *match_data;	/* Cut substrings */
+#endif
     int     matches;			/* Count of cuts */
 } DICT_PCRE_EXPAND_CONTEXT;
 
@@ -180,17 +252,24 @@ typedef struct {
 static int dict_pcre_expand(int type, VSTRING *buf, void *ptr)
 {
     DICT_PCRE_EXPAND_CONTEXT *ctxt = (DICT_PCRE_EXPAND_CONTEXT *) ptr;
-    DICT_PCRE_MATCH_RULE *match_rule = ctxt->match_rule;
     DICT_PCRE *dict_pcre = ctxt->dict_pcre;
+#if HAS_PCRE == 1
+    DICT_PCRE_MATCH_RULE *match_rule = ctxt->match_rule;
     const char *pp;
-    int     n;
     int     ret;
 
+#else
+    PCRE2_SIZE *ovector;
+
+#endif
+    int     n;
+
     /*
      * Replace $0-${99} with strings cut from matched text.
      */
     if (type == MAC_PARSE_VARNAME) {
 	n = atoi(vstring_str(buf));
+#if HAS_PCRE == 1
 	ret = pcre_get_substring(ctxt->lookup_string, ctxt->offsets,
 				 ctxt->matches, n, &pp);
 	if (ret < 0) {
@@ -206,6 +285,15 @@ static int dict_pcre_expand(int type, VSTRING *buf, void *ptr)
 	}
 	vstring_strcat(dict_pcre->expansion_buf, pp);
 	myfree((void *) pp);
+#else
+	ovector = pcre2_get_ovector_pointer(ctxt->match_data);
+	if (n >= ctxt->matches || ovector[2 * n] == PCRE2_UNSET
+	    || ovector[2 * n + 1] <= ovector[2 * n])
+	    return (MAC_PARSE_UNDEF);
+	vstring_strncat(dict_pcre->expansion_buf,
+			ctxt->lookup_string + ovector[2 * n],
+			ovector[2 * n + 1] - ovector[2 * n]);
+#endif
 	return (MAC_PARSE_OK);
     }
 
@@ -220,6 +308,8 @@ static int dict_pcre_expand(int type, VSTRING *buf, void *ptr)
 
 /* dict_pcre_exec_error - report matching error */
 
+#if HAS_PCRE == 1
+
 static void dict_pcre_exec_error(const char *mapname, int lineno, int errval)
 {
     switch (errval) {
@@ -268,16 +358,53 @@ static void dict_pcre_exec_error(const char *mapname, int lineno, int errval)
     }
 }
 
+#else
+
+static void dict_pcre_exec_error(const char *mapname, int lineno, int errval)
+{
+    PCRE2_UCHAR errbuf[256];
+
+    if (errval == 0)
+	msg_warn("pcre map %s, line %d: too many (...)",
+		 mapname, lineno);
+    else if (pcre2_get_error_message(errval, errbuf, sizeof(errbuf)) < 0)
+	msg_warn("pcre map %s, line %d: unknown pcre2_match error: %d",
+		 mapname, lineno, errval);
+    else
+	msg_warn("pcre map %s, line %d: matching error: %s",
+		 mapname, lineno, (char *) errbuf);
+}
+
+#endif
+
  /*
-  * Inlined to reduce function call overhead in the time-critical loop.
+  * Inlined to reduce function call overhead in the time-critical loop. A
+  * pattern cannot match when the pre-filter did not find its literals.
   */
-#define DICT_PCRE_EXEC(ctxt, map, line, pattern, hints, match, str, len) \
-    ((ctxt).matches = pcre_exec((pattern), (hints), (str), (len), \
-				NULL_STARTOFFSET, NULL_EXEC_OPTIONS, \
-				(ctxt).offsets, PCRE_MAX_CAPTURE * 3), \
-     (ctxt).matches > 0 ? (match) : \
-     (ctxt).matches == PCRE_ERROR_NOMATCH ? !(match) : \
-     (dict_pcre_exec_error((map), (line), (ctxt).matches), 0))
+#if HAS_PCRE == 1
+#define DICT_PCRE_EXEC(ctxt, map, line, filter, lit, pattern, hints, match, \
+		       str, len) \
+    ((filter) != 0 && (lit) != LIT_FILTER_NONE \
+     && !lit_filter_found((filter), (lit)) ? !(match) : \
+     ((ctxt).matches = pcre_exec((pattern), (hints), (str), (len), \
+				 NULL_STARTOFFSET, NULL_EXEC_OPTIONS, \
+				 (ctxt).offsets, PCRE_MAX_CAPTURE * 3), \
+      (ctxt).matches > 0 ? (match) : \
+      (ctxt).matches == PCRE_ERROR_NOMATCH ? !(match) : \
+      (dict_pcre_exec_error((map), (line), (ctxt).matches), 0)))
+#else
+#define DICT_PCRE_EXEC(ctxt, map, line, filter, lit, pattern, hints, match, \
+		       str, len) \
+    ((filter) != 0 && (lit) != LIT_FILTER_NONE \
+     && !lit_filter_found((filter), (lit)) ? !(match) : \
+     ((ctxt).matches = pcre2_match((pattern), (PCRE2_SPTR) (str), (len), \
+				   NULL_STARTOFFSET, NULL_EXEC_OPTIONS, \
+				   (ctxt).match_data, \
+				   dict_pcre_match_context), \
+      (ctxt).matches > 0 ? (match) : \
+      (ctxt).matches == PCRE_ERROR_NOMATCH ? !(match) : \
+      (dict_pcre_exec_error((map), (line), (ctxt).matches), 0)))
+#endif
 
 /* dict_pcre_lookup - match string and perform optional substitution */
 
@@ -304,6 +431,11 @@ static const char *dict_pcre_lookup(DICT *dict, const char *lookup_string)
 	vstring_strcpy(dict->fold_buf, lookup_string);
 	lookup_string = lowercase(vstring_str(dict->fold_buf));
     }
+    if (dict_pcre->filter)
+	lit_filter_scan(dict_pcre->filter, lookup_string);
+#if HAS_PCRE > 1
+    ctxt.match_data = dict_pcre->match_data;
+#endif
     for (rule = dict_pcre->head; rule; rule = rule->next) {
 
 	switch (rule->op) {
@@ -314,6 +446,7 @@ static const char *dict_pcre_lookup(DICT *dict, const char *lookup_string)
 	case DICT_PCRE_OP_MATCH:
 	    match_rule = (DICT_PCRE_MATCH_RULE *) rule;
 	    if (!DICT_PCRE_EXEC(ctxt, dict->name, rule->lineno,
+				dict_pcre->filter, match_rule->lit,
 				match_rule->pattern, match_rule->hints,
 			      match_rule->match, lookup_string, lookup_len))
 		continue;
@@ -353,6 +486,7 @@ static const char *dict_pcre_lookup(DICT *dict, const char *lookup_string)
 	case DICT_PCRE_OP_IF:
 	    if_rule = (DICT_PCRE_IF_RULE *) rule;
 	    if (DICT_PCRE_EXEC(ctxt, dict->name, rule->lineno,
+			       dict_pcre->filter, if_rule->lit,
 			       if_rule->pattern, if_rule->hints,
 			       if_rule->match, lookup_string, lookup_len))
 		continue;
@@ -390,7 +524,7 @@ static void dict_pcre_close(DICT *dict)
 	case DICT_PCRE_OP_MATCH:
 	    match_rule = (DICT_PCRE_MATCH_RULE *) rule;
 	    if (match_rule->pattern)
-		myfree((void *) match_rule->pattern);
+		DICT_PCRE_FREE_CODE(match_rule->pattern);
 	    if (match_rule->hints)
 		DICT_PCRE_FREE_STUDY(match_rule->hints);
 	    if (match_rule->replacement)
@@ -399,7 +533,7 @@ static void dict_pcre_close(DICT *dict)
 	case DICT_PCRE_OP_IF:
 	    if_rule = (DICT_PCRE_IF_RULE *) rule;
 	    if (if_rule->pattern)
-		myfree((void *) if_rule->pattern);
+		DICT_PCRE_FREE_CODE(if_rule->pattern);
 	    if (if_rule->hints)
 		DICT_PCRE_FREE_STUDY(if_rule->hints);
 	    break;
@@ -412,6 +546,12 @@ static void dict_pcre_close(DICT *dict)
     }
     if (dict_pcre->expansion_buf)
 	vstring_free(dict_pcre->expansion_buf);
+    if (dict_pcre->filter)
+	lit_filter_free(dict_pcre->filter);
+#if HAS_PCRE > 1
+    if (dict_pcre->match_data)
+	pcre2_match_data_free(dict_pcre->match_data);
+#endif
     if (dict->fold_buf)
 	vstring_free(dict->fold_buf);
     dict_free(dict);
@@ -546,6 +686,8 @@ static int dict_pcre_prescan(int type, VSTRING *buf, void *context)
 
 /* dict_pcre_compile - compile pattern */
 
+#if HAS_PCRE == 1
+
 static int dict_pcre_compile(const char *mapname, int lineno,
 			             DICT_PCRE_REGEXP *pattern,
 			             DICT_PCRE_ENGINE *engine)
@@ -570,6 +712,72 @@ static int dict_pcre_compile(const char *mapname, int lineno,
     return (1);
 }
 
+#else
+
+static int dict_pcre_compile(const char *mapname, int lineno,
+			             DICT_PCRE_REGEXP *pattern,
+			             DICT_PCRE_ENGINE *engine)
+{
+    PCRE2_UCHAR errbuf[256];
+    int     error;
+    PCRE2_SIZE errptr;
+
+    engine->pattern = pcre2_compile((PCRE2_SPTR) pattern->regexp,
+				    PCRE2_ZERO_TERMINATED, pattern->options,
+				    &error, &errptr,
+				    dict_pcre_compile_context);
+    if (engine->pattern == 0) {
+	if (pcre2_get_error_message(error, errbuf, sizeof(errbuf)) < 0)
+	    sprintf((char *) errbuf, "error code %d", error);
+	msg_warn("pcre map %s, line %d: error in regex at offset %ld: %s",
+		 mapname, lineno, (long) errptr, (char *) errbuf);
+	return (0);
+    }
+    engine->hints = 0;
+
+    /*
+     * JIT compilation is an optimization. Without JIT support, or when the
+     * pattern is too complex, pcre2_match() uses the interpreter.
+     */
+    if ((error = pcre2_jit_compile(engine->pattern, PCRE2_JIT_COMPLETE)) != 0
+	&& msg_verbose)
+	msg_info("pcre map %s, line %d: no JIT compilation: error %d",
+		 mapname, lineno, error);
+    return (1);
+}
+
+/* dict_pcre_malloc - PCRE2 memory allocation wrapper */
+
+static void *dict_pcre_malloc(PCRE2_SIZE len, void *unused_context)
+{
+    return (mymalloc(len));
+}
+
+/* dict_pcre_free - PCRE2 memory release wrapper */
+
+static void dict_pcre_free(void *ptr, void *unused_context)
+{
+    if (ptr)
+	myfree(ptr);
+}
+
+#endif
+
+/* dict_pcre_filter_add - add pattern to pre-filter */
+
+static int dict_pcre_filter_add(DICT *dict, DICT_PCRE_REGEXP *pattern)
+{
+    DICT_PCRE *dict_pcre = (DICT_PCRE *) dict;
+
+    /*
+     * With the "x" option, white space and #comments are not literal text.
+     */
+    if (pattern->options & PCRE_EXTENDED)
+	return (LIT_FILTER_NONE);
+    return (lit_filter_add(dict_pcre->filter, pattern->regexp,
+			   LIT_FILTER_FLAG_PCRE));
+}
+
 /* dict_pcre_rule_alloc - fill in a generic rule structure */
 
 static DICT_PCRE_RULE *dict_pcre_rule_alloc(int op, int lineno, size_t size)
@@ -677,9 +885,14 @@ static DICT_PCRE_RULE *dict_pcre_parse_rule(DICT *dict, const char *mapname,
 	if (dict_pcre_compile(mapname, lineno, &regexp, &engine) == 0)
 	    CREATE_MATCHOP_ERROR_RETURN(0);
 #ifdef PCRE_INFO_CAPTURECOUNT
+#if HAS_PCRE == 1
 	if (pcre_fullinfo(engine.pattern, engine.hints,
 			  PCRE_INFO_CAPTURECOUNT,
 			  (void *) &actual_sub) != 0)
+#else
+	if (pcre2_pattern_info(engine.pattern, PCRE_INFO_CAPTURECOUNT,
+			       (void *) &actual_sub) != 0)
+#endif
 	    msg_panic("pcre map %s, line %d: pcre_fullinfo failed",
 		      mapname, lineno);
 	if (prescan_context.max_sub > actual_sub) {
@@ -687,7 +900,7 @@ static DICT_PCRE_RULE *dict_pcre_parse_rule(DICT *dict, const char *mapname,
 		     "skipping this rule", mapname, lineno,
 		     (int) prescan_context.max_sub);
 	    if (engine.pattern)
-		myfree((void *) engine.pattern);
+		DICT_PCRE_FREE_CODE(engine.pattern);
 	    if (engine.hints)
 		DICT_PCRE_FREE_STUDY(engine.hints);
 	    CREATE_MATCHOP_ERROR_RETURN(0);
@@ -701,6 +914,7 @@ static DICT_PCRE_RULE *dict_pcre_parse_rule(DICT *dict, const char *mapname,
 	    dict_pcre_rule_alloc(DICT_PCRE_OP_MATCH, lineno,
 				 sizeof(DICT_PCRE_MATCH_RULE));
 	match_rule->match = regexp.match;
+	match_rule->lit = dict_pcre_filter_add(dict, &regexp);
 	match_rule->max_sub = prescan_context.max_sub;
 	if (prescan_context.literal)
 	    match_rule->replacement = prescan_context.literal;
@@ -754,6 +968,7 @@ static DICT_PCRE_RULE *dict_pcre_parse_rule(DICT *dict, const char *mapname,
 	    dict_pcre_rule_alloc(DICT_PCRE_OP_IF, lineno,
 				 sizeof(DICT_PCRE_IF_RULE));
 	if_rule->match = regexp.match;
+	if_rule->lit = dict_pcre_filter_add(dict, &regexp);
 	if_rule->pattern = engine.pattern;
 	if_rule->hints = engine.hints;
 	if_rule->endif_rule = 0;
@@ -864,12 +1079,41 @@ DICT   *dict_pcre_open(const char *mapname, int open_flags, int dict_flags)
 	dict_pcre->dict.fold_buf = vstring_alloc(10);
     dict_pcre->head = 0;
     dict_pcre->expansion_buf = 0;
+    dict_pcre->filter = lit_filter_create();
 
     if (dict_pcre_init == 0) {
+#if HAS_PCRE == 1
 	pcre_malloc = (void *(*) (size_t)) mymalloc;
 	pcre_free = (void (*) (void *)) myfree;
+#else
+	dict_pcre_general_context =
+	    pcre2_general_context_create(dict_pcre_malloc, dict_pcre_free,
+					 (void *) 0);
+	dict_pcre_compile_context =
+	    pcre2_compile_context_create(dict_pcre_general_context);
+	dict_pcre_match_context =
+	    pcre2_match_context_create(dict_pcre_general_context);
+	if (dict_pcre_jit_stack_size > 0) {
+	    int     start = DICT_PCRE_JIT_STACK_START;
+
+	    if (start > dict_pcre_jit_stack_size)
+		start = dict_pcre_jit_stack_size;
+	    if ((dict_pcre_jit_stack =
+		 pcre2_jit_stack_create(start, dict_pcre_jit_stack_size,
+					dict_pcre_general_context)) == 0)
+		msg_fatal("%s: cannot allocate %d-byte PCRE2 JIT stack",
+			  myname, dict_pcre_jit_stack_size);
+	    pcre2_jit_stack_assign(dict_pcre_match_context,
+				   (pcre2_jit_callback) 0,
+				   (void *) dict_pcre_jit_stack);
+	}
+#endif
 	dict_pcre_init = 1;
     }
+#if HAS_PCRE > 1
+    dict_pcre->match_data =
+	pcre2_match_data_create(PCRE_MAX_CAPTURE, dict_pcre_general_context);
+#endif
     dict_pcre->dict.owner.uid = st.st_uid;
     dict_pcre->dict.owner.status = (st.st_uid != 0);
 
@@ -921,6 +1165,12 @@ DICT   *dict_pcre_open(const char *mapname, int open_flags, int dict_flags)
     if (rule_stack)
 	(void) mvect_free(&mvect);
 
+    /*
+     * Speed up lookups in large tables.
+     */
+    if (lit_filter_compile(dict_pcre->filter) < LIT_FILTER_MIN)
+	dict_pcre->filter = lit_filter_free(dict_pcre->filter);
+
     dict_file_purge_buffers(&dict_pcre->dict);
     DICT_PCRE_OPEN_RETURN(DICT_DEBUG (&dict_pcre->dict));
 }
@@ -23,6 +23,16 @@
 
 extern DICT *dict_pcre_open(const char *, int, int);
 
+ /*
+  * XXX Should be part of the DICT interface.
+  * 
+  * The maximal PCRE2 JIT stack size, shared by all pcre: tables. Zero means
+  * use the small PCRE2 default stack. Ignored with the legacy PCRE library.
+  */
+extern int dict_pcre_jit_stack_size;
+
+#define DEFINE_DICT_PCRE_JIT_STACK_SIZE int dict_pcre_jit_stack_size = (1024 * 1024)
+
 /* LICENSE
 /* .ad
 /* .fi
@@ -14,8 +14,14 @@
 /*	dict_regexp_open() opens the named file and compiles the contained
 /*	regular expressions. The result object can be used to match strings
 /*	against the table.
+/*
+/*	Tables with many extended regular expressions use a lit_filter(3)
+/*	pre-filter. Each lookup string is scanned once for the literal
+/*	text that the patterns require, and a pattern whose literals
+/*	are absent is not executed. This does not change the result.
 /* SEE ALSO
 /*	dict(3) generic dictionary manager
+/*	lit_filter(3) regular expression pre-filter
 /*	regexp_table(5) format of Postfix regular expression tables
 /* AUTHOR(S)
 /*	LaMont Jones
@@ -68,6 +74,7 @@
 #include "mac_parse.h"
 #include "warn_stat.h"
 #include "mvect.h"
+#include "lit_filter.h"
 
  /*
   * Support for IF/ENDIF based on an idea by Bert Driehuis.
@@ -98,8 +105,10 @@ typedef struct {
     DICT_REGEXP_RULE rule;		/* generic part */
     regex_t *first_exp;			/* compiled primary pattern */
     int     first_match;		/* positive or negative match */
+    int     first_lit;			/* pre-filter pattern id */
     regex_t *second_exp;		/* compiled secondary pattern */
     int     second_match;		/* positive or negative match */
+    int     second_lit;			/* pre-filter pattern id */
     char   *replacement;		/* replacement text */
     size_t  max_sub;			/* largest $number in replacement */
 } DICT_REGEXP_MATCH_RULE;
@@ -108,6 +117,7 @@ typedef struct {
     DICT_REGEXP_RULE rule;		/* generic members */
     regex_t *expr;			/* the condition */
     int     match;			/* positive or negative match */
+    int     lit;			/* pre-filter pattern id */
     struct DICT_REGEXP_RULE *endif_rule;/* matching endif rule */
 } DICT_REGEXP_IF_RULE;
 
@@ -119,6 +129,7 @@ typedef struct {
     regmatch_t *pmatch;			/* matched substring info */
     DICT_REGEXP_RULE *head;		/* first rule */
     VSTRING *expansion_buf;		/* lookup result */
+    LIT_FILTER *filter;			/* pattern pre-filter */
 } DICT_REGEXP;
 
  /*
@@ -204,13 +215,17 @@ static void dict_regexp_regerror(const char *mapname, int lineno, int error,
 }
 
  /*
-  * Inlined to reduce function call overhead in the time-critical loop.
+  * Inlined to reduce function call overhead in the time-critical loop. A
+  * pattern cannot match when the pre-filter did not find its literals.
   */
-#define DICT_REGEXP_REGEXEC(err, map, line, expr, match, str, nsub, pmatch) \
-    ((err) = regexec((expr), (str), (nsub), (pmatch), 0), \
-     ((err) == REG_NOMATCH ? !(match) : \
-      (err) == 0 ? (match) : \
-      (dict_regexp_regerror((map), (line), (err), (expr)), 0)))
+#define DICT_REGEXP_REGEXEC(err, map, line, filter, lit, expr, match, str, \
+			    nsub, pmatch) \
+    ((filter) != 0 && (lit) != LIT_FILTER_NONE \
+     && !lit_filter_found((filter), (lit)) ? !(match) : \
+     ((err) = regexec((expr), (str), (nsub), (pmatch), 0), \
+      ((err) == REG_NOMATCH ? !(match) : \
+       (err) == 0 ? (match) : \
+       (dict_regexp_regerror((map), (line), (err), (expr)), 0))))
 
 /* dict_regexp_lookup - match string and perform optional substitution */
 
@@ -237,6 +252,8 @@ static const char *dict_regexp_lookup(DICT *dict, const char *lookup_string)
 	vstring_strcpy(dict->fold_buf, lookup_string);
 	lookup_string = lowercase(vstring_str(dict->fold_buf));
     }
+    if (dict_regexp->filter)
+	lit_filter_scan(dict_regexp->filter, lookup_string);
     for (rule = dict_regexp->head; rule; rule = rule->next) {
 
 	switch (rule->op) {
@@ -248,6 +265,8 @@ static const char *dict_regexp_lookup(DICT *dict, const char *lookup_string)
 	case DICT_REGEXP_OP_MATCH:
 	    match_rule = (DICT_REGEXP_MATCH_RULE *) rule;
 	    if (!DICT_REGEXP_REGEXEC(error, dict->name, rule->lineno,
+				     dict_regexp->filter,
+				     match_rule->first_lit,
 				     match_rule->first_exp,
 				     match_rule->first_match,
 				     lookup_string,
@@ -257,6 +276,8 @@ static const char *dict_regexp_lookup(DICT *dict, const char *lookup_string)
 		continue;
 	    if (match_rule->second_exp
 		&& !DICT_REGEXP_REGEXEC(error, dict->name, rule->lineno,
+					dict_regexp->filter,
+					match_rule->second_lit,
 					match_rule->second_exp,
 					match_rule->second_match,
 					lookup_string,
@@ -298,6 +319,7 @@ static const char *dict_regexp_lookup(DICT *dict, const char *lookup_string)
 	case DICT_REGEXP_OP_IF:
 	    if_rule = (DICT_REGEXP_IF_RULE *) rule;
 	    if (DICT_REGEXP_REGEXEC(error, dict->name, rule->lineno,
+				    dict_regexp->filter, if_rule->lit,
 			       if_rule->expr, if_rule->match, lookup_string,
 				    NULL_SUBSTITUTIONS, NULL_MATCH_RESULT))
 		continue;
@@ -363,6 +385,8 @@ static void dict_regexp_close(DICT *dict)
 	myfree((void *) dict_regexp->pmatch);
     if (dict_regexp->expansion_buf)
 	vstring_free(dict_regexp->expansion_buf);
+    if (dict_regexp->filter)
+	lit_filter_free(dict_regexp->filter);
     if (dict->fold_buf)
 	vstring_free(dict->fold_buf);
     dict_free(dict);
@@ -530,6 +554,21 @@ static regex_t *dict_regexp_compile_pat(const char *mapname, int lineno,
     return (expr);
 }
 
+/* dict_regexp_filter_add - add pattern to pre-filter */
+
+static int dict_regexp_filter_add(DICT *dict, DICT_REGEXP_PATTERN *pat)
+{
+    DICT_REGEXP *dict_regexp = (DICT_REGEXP *) dict;
+
+    /*
+     * The pre-filter does not understand basic regular expressions.
+     */
+    if ((pat->options & REG_EXTENDED) == 0)
+	return (LIT_FILTER_NONE);
+    return (lit_filter_add(dict_regexp->filter, pat->regexp,
+			   LIT_FILTER_FLAG_NONE));
+}
+
 /* dict_regexp_rule_alloc - fill in a generic rule structure */
 
 static DICT_REGEXP_RULE *dict_regexp_rule_alloc(int op, int lineno, size_t size)
@@ -668,9 +707,12 @@ static DICT_REGEXP_RULE *dict_regexp_parseline(DICT *dict, const char *mapname,
 				   sizeof(DICT_REGEXP_MATCH_RULE));
 	match_rule->first_exp = first_exp;
 	match_rule->first_match = first_pat.match;
+	match_rule->first_lit = dict_regexp_filter_add(dict, &first_pat);
 	match_rule->max_sub = prescan_context.max_sub;
 	match_rule->second_exp = second_exp;
 	match_rule->second_match = second_pat.match;
+	match_rule->second_lit = (second_exp == 0 ? LIT_FILTER_NONE :
+				  dict_regexp_filter_add(dict, &second_pat));
 	if (prescan_context.literal)
 	    match_rule->replacement = prescan_context.literal;
 	else
@@ -706,6 +748,7 @@ static DICT_REGEXP_RULE *dict_regexp_parseline(DICT *dict, const char *mapname,
 				   sizeof(DICT_REGEXP_IF_RULE));
 	if_rule->expr = expr;
 	if_rule->match = pattern.match;
+	if_rule->lit = dict_regexp_filter_add(dict, &pattern);
 	if_rule->endif_rule = 0;
 	return ((DICT_REGEXP_RULE *) if_rule);
     }
@@ -804,6 +847,7 @@ DICT   *dict_regexp_open(const char *mapname, int open_flags, int dict_flags)
     dict_regexp->head = 0;
     dict_regexp->pmatch = 0;
     dict_regexp->expansion_buf = 0;
+    dict_regexp->filter = lit_filter_create();
     dict_regexp->dict.owner.uid = st.st_uid;
     dict_regexp->dict.owner.status = (st.st_uid != 0);
 
@@ -858,6 +902,12 @@ DICT   *dict_regexp_open(const char *mapname, int open_flags, int dict_flags)
     if (rule_stack)
 	(void) mvect_free(&mvect);
 
+    /*
+     * Speed up lookups in large tables.
+     */
+    if (lit_filter_compile(dict_regexp->filter) < LIT_FILTER_MIN)
+	dict_regexp->filter = lit_filter_free(dict_regexp->filter);
+
     /*
      * Allocate space for only as many matched substrings as used in the
      * replacement text.
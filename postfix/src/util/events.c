@@ -25,6 +25,11 @@
 /*	void	(*callback)(int event, void *context);
 /*	void	*context;
 /*
+/*	void	event_enable_read_excl(fd, callback, context)
+/*	int	fd;
+/*	void	(*callback)(int event, void *context);
+/*	void	*context;
+/*
 /*	void	event_enable_write(fd, callback, context)
 /*	int	fd;
 /*	void	(*callback)(int event, void *context);
@@ -37,6 +42,8 @@
 /*	int	time_limit;
 /*
 /*	void	event_fork(void)
+/*
+/*	int	event_lazy_unregister;
 /* DESCRIPTION
 /*	This module delivers I/O and timer events.
 /*	Multiple I/O streams and timers can be monitored simultaneously.
@@ -85,6 +92,14 @@
 /*	kernel-based event filters this is preferred usage, because
 /*	each disable and enable request would cost a system call.
 /*
+/*	event_enable_read_excl() is like event_enable_read(), but
+/*	asks for exclusive wake-up when multiple processes wait
+/*	for events on the same descriptor, such as a listening
+/*	socket that is shared by server processes. The descriptor
+/*	must not already be enabled. On systems without exclusive
+/*	wake-up support (currently, anything but Linux epoll with
+/*	EPOLLEXCLUSIVE) this is the same as event_enable_read().
+/*
 /*	The manifest constants EVENT_NULL_CONTEXT and EVENT_NULL_TYPE
 /*	provide convenient null values.
 /*
@@ -116,6 +131,17 @@
 /*
 /*	event_fork() must be called by a child process after it is
 /*	created with fork(), to re-initialize event processing.
+/*
+/*	event_lazy_unregister (default: 0) enables an optimization
+/*	for kernel-based filters that support in-place updates
+/*	(currently, Linux epoll). event_disable_readwrite() then
+/*	defers the request to unregister a descriptor until the
+/*	next event_loop() call, so that a later event_enable_read()
+/*	or event_enable_write() request for the same descriptor
+/*	costs one system call to update the kernel filter, instead
+/*	of one to unregister and one to register the descriptor.
+/*	Descriptors that were enabled with event_enable_read_excl()
+/*	are always unregistered immediately.
 /* DIAGNOSTICS
 /*	Panics: interface violations. Fatal errors: out of memory,
 /*	system call failure. Warnings: the number of available
@@ -156,7 +182,6 @@
 #include "mymalloc.h"
 #include "msg.h"
 #include "iostuff.h"
-#include "ring.h"
 #include "events.h"
 
 #if !defined(EVENTS_STYLE)
@@ -243,6 +268,7 @@ struct EVENT_FDTABLE {
 static EVENT_MASK event_rmask;		/* enabled read events */
 static EVENT_MASK event_wmask;		/* enabled write events */
 static EVENT_MASK event_xmask;		/* for bad news mostly */
+static EVENT_MASK event_emask;		/* exclusive wake-up requested */
 static int event_fdlimit;		/* per-process open file limit */
 static EVENT_FDTABLE *event_fdtable;	/* one slot per file descriptor */
 static int event_fdslots;		/* number of file descriptor slots */
@@ -437,7 +463,8 @@ typedef struct pollfd EVENT_BUFFER;
   * unregister a file descriptor before it is closed, to avoid errors on
   * systems that are built with EVENTS_STYLE == EVENTS_STYLE_SELECT.
   */
-#if (EVENTS_STYLE == EVENTS_STYLE_EPOLL)
+#if (EVENTS_STYLE == EVENTS_STYLE_EPOLL) \
+	|| (EVENTS_STYLE == EVENTS_STYLE_IOURING)
 #include <sys/epoll.h>
 
  /*
@@ -477,6 +504,27 @@ static int event_epollfd;		/* epoll handle */
 #define EVENT_REG_DEL_WRITE(e, f)  EVENT_REG_DEL_OP((e), (f), EPOLLOUT)
 #define EVENT_REG_DEL_TEXT         "epoll_ctl EPOLL_CTL_DEL"
 
+ /*
+  * Linux epoll can change the events of interest for a registered
+  * descriptor in place. This allows event_disable_readwrite() to defer the
+  * EPOLL_CTL_DEL request, and to replace an EPOLL_CTL_DEL plus
+  * EPOLL_CTL_ADD pair by one EPOLL_CTL_MOD request; see event_reg_add().
+  */
+#define EVENT_REG_MOD_OP(e, f, ev) EVENT_REG_FD_OP((e), (f), (ev), EPOLL_CTL_MOD)
+#define EVENT_REG_MOD_READ(e, f)   EVENT_REG_MOD_OP((e), (f), EPOLLIN)
+#define EVENT_REG_MOD_WRITE(e, f)  EVENT_REG_MOD_OP((e), (f), EPOLLOUT)
+#define EVENT_REG_MOD_TEXT         "epoll_ctl EPOLL_CTL_MOD"
+
+ /*
+  * Linux 4.5 and later support exclusive wake-up, so that only one of the
+  * processes that wait for a shared listening socket is woken up. Older
+  * kernels reject the request with EINVAL.
+  */
+#ifdef EPOLLEXCLUSIVE
+#define EVENT_REG_ADD_READ_EXCL(e, f) \
+	EVENT_REG_ADD_OP((e), (f), EPOLLIN | EPOLLEXCLUSIVE)
+#endif
+
  /*
   * Macros to retrieve event buffers from the kernel; see event_loop().
   */
@@ -499,8 +547,502 @@ typedef struct epoll_event EVENT_BUFFER;
 #endif
 
  /*
-  * Timer events. Timer requests are kept sorted, in a circular list. We use
-  * the RING abstraction, so we get to use a couple ugly macros.
+  * Linux io_uring. Poll requests are queued in the submission ring, and are
+  * handed to the kernel with the io_uring_enter() call that also waits for
+  * completions with the event_loop() time limit. Thus, one system call
+  * handles all registration changes plus the wait for an event_loop() call.
+  * 
+  * Poll requests are one-shot: after a descriptor is reported, we queue a new
+  * poll request if the application is still interested. This gives the same
+  * level-triggered semantics as select(), /dev/poll and epoll.
+  * 
+  * A poll request is labeled with the descriptor number and a per-descriptor
+  * generation number. The generation number changes when a poll request is
+  * canceled, so that we can ignore completions for requests that were
+  * canceled after the kernel completed them.
+  * 
+  * Unlike epoll, a pending poll request holds a reference to the open file.
+  * Therefore, event_disable_readwrite() submits the cancel request right
+  * away, and never defers it with event_lazy_unregister. Otherwise, a
+  * process that closes a socket and then blocks (for example, after passing
+  * the socket to another process) would delay the peer's FIN until the next
+  * event_loop() call.
+  * 
+  * We need IORING_FEAT_EXT_ARG (Linux 5.11) to wait with a time limit in
+  * io_uring_enter(). When the kernel does not support io_uring or this
+  * feature, we use the epoll implementation above.
+  */
+#if (EVENTS_STYLE == EVENTS_STYLE_IOURING)
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#define EVENT_URING_ENTRIES	256	/* submission ring size */
+#define EVENT_URING_CANCEL	(~(__u64) 0)	/* cancel request label */
+
+#define EVENT_URING_LABEL(fd, gen)	(((__u64) (gen) << 32) | (unsigned) (fd))
+#define EVENT_URING_LABEL_FD(label)	((int) ((label) & 0xffffffff))
+#define EVENT_URING_LABEL_GEN(label)	((unsigned) ((label) >> 32))
+
+typedef struct {
+    unsigned gen;			/* poll request generation */
+    unsigned events;			/* POLLIN etc., zero if disabled */
+    int     armed;			/* poll request is queued */
+} EVENT_URING_FD;
+
+typedef struct {
+    int     fd;				/* ring handle */
+    unsigned *sq_head;			/* kernel: submissions consumed */
+    unsigned *sq_tail;			/* user: submissions produced */
+    unsigned sq_mask;
+    unsigned *sq_array;
+    struct io_uring_sqe *sqes;
+    unsigned *cq_head;			/* user: completions consumed */
+    unsigned *cq_tail;			/* kernel: completions produced */
+    unsigned cq_mask;
+    struct io_uring_cqe *cqes;
+    void   *sq_ring;			/* mmap() result */
+    size_t  sq_ring_len;
+    void   *cq_ring;			/* mmap() result, or sq_ring */
+    size_t  cq_ring_len;
+    size_t  sqes_len;
+    EVENT_URING_FD *fdinfo;		/* one slot per file descriptor */
+    int     fdslots;			/* number of fdinfo slots */
+    int    *rearm;			/* descriptors to poll again */
+    int     rearm_count;
+    int     rearm_slots;
+    int     excl_unsupported;		/* EPOLLEXCLUSIVE was rejected */
+} EVENT_URING;
+
+static EVENT_URING event_uring = {-1};
+
+#define EVENT_URING_ACTIVE()	(event_uring.fd >= 0)
+
+#define EVENT_URING_LOAD(p)	__atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define EVENT_URING_STORE(p, v)	__atomic_store_n((p), (v), __ATOMIC_RELEASE)
+
+/* event_uring_close - destroy ring */
+
+static void event_uring_close(void)
+{
+    if (event_uring.sqes)
+	(void) munmap((void *) event_uring.sqes, event_uring.sqes_len);
+    if (event_uring.cq_ring && event_uring.cq_ring != event_uring.sq_ring)
+	(void) munmap(event_uring.cq_ring, event_uring.cq_ring_len);
+    if (event_uring.sq_ring)
+	(void) munmap(event_uring.sq_ring, event_uring.sq_ring_len);
+    if (event_uring.fd >= 0)
+	(void) close(event_uring.fd);
+    event_uring.fd = -1;
+    event_uring.sqes = 0;
+    event_uring.sq_ring = event_uring.cq_ring = 0;
+}
+
+/* event_uring_extend - make room for more descriptor slots */
+
+static int event_uring_extend(int slots)
+{
+    EVENT_URING_FD *fip;
+
+    if (slots > event_uring.fdslots) {
+	if (event_uring.fdinfo == 0)
+	    event_uring.fdinfo = (EVENT_URING_FD *)
+		mymalloc(sizeof(*event_uring.fdinfo) * slots);
+	else
+	    event_uring.fdinfo = (EVENT_URING_FD *)
+		myrealloc((void *) event_uring.fdinfo,
+			  sizeof(*event_uring.fdinfo) * slots);
+	for (fip = event_uring.fdinfo + event_uring.fdslots;
+	     fip < event_uring.fdinfo + slots; fip++) {
+	    fip->gen = 0;
+	    fip->events = 0;
+	    fip->armed = 0;
+	}
+	event_uring.fdslots = slots;
+    }
+    return (0);
+}
+
+/* event_uring_open - create ring, or use epoll */
+
+static int event_uring_open(int slots)
+{
+    struct io_uring_params params;
+    EVENT_URING_FD *fip;
+    int     saved_errno;
+
+#define EVENT_URING_NEED_FEATURES (IORING_FEAT_EXT_ARG | IORING_FEAT_NODROP)
+
+    /*
+     * Start with a clean slate; after fork() the fdinfo table describes
+     * requests in a ring that we no longer use.
+     */
+    (void) event_uring_extend(slots);
+    for (fip = event_uring.fdinfo;
+	 fip < event_uring.fdinfo + event_uring.fdslots; fip++) {
+	fip->events = 0;
+	fip->armed = 0;
+    }
+    event_uring.rearm_count = 0;
+
+    memset((void *) &params, 0, sizeof(params));
+    if ((event_uring.fd = syscall(__NR_io_uring_setup, EVENT_URING_ENTRIES,
+				  &params)) < 0) {
+	if (msg_verbose)
+	    msg_info("io_uring_setup: %m -- using epoll");
+	return (-1);
+    }
+    if ((params.features & EVENT_URING_NEED_FEATURES)
+	!= EVENT_URING_NEED_FEATURES) {
+	if (msg_verbose)
+	    msg_info("io_uring features 0x%x -- using epoll", params.features);
+	event_uring_close();
+	return (-1);
+    }
+
+    /*
+     * Map the submission and completion rings, and the submission queue
+     * entries. With IORING_FEAT_SINGLE_MMAP, one mapping covers both rings.
+     */
+    event_uring.sq_ring_len = params.sq_off.array
+	+ params.sq_entries * sizeof(unsigned);
+    event_uring.cq_ring_len = params.cq_off.cqes
+	+ params.cq_entries * sizeof(struct io_uring_cqe);
+    if ((params.features & IORING_FEAT_SINGLE_MMAP)
+	&& event_uring.cq_ring_len > event_uring.sq_ring_len)
+	event_uring.sq_ring_len = event_uring.cq_ring_len;
+    event_uring.sqes_len = params.sq_entries * sizeof(struct io_uring_sqe);
+    if ((event_uring.sq_ring = mmap((void *) 0, event_uring.sq_ring_len,
+				    PROT_READ | PROT_WRITE,
+				    MAP_SHARED | MAP_POPULATE,
+				    event_uring.fd,
+				    IORING_OFF_SQ_RING)) == MAP_FAILED) {
+	event_uring.sq_ring = 0;
+    } else if (params.features & IORING_FEAT_SINGLE_MMAP) {
+	event_uring.cq_ring = event_uring.sq_ring;
+    } else if ((event_uring.cq_ring = mmap((void *) 0,
+					   event_uring.cq_ring_len,
+					   PROT_READ | PROT_WRITE,
+					   MAP_SHARED | MAP_POPULATE,
+					   event_uring.fd,
+					   IORING_OFF_CQ_RING)) == MAP_FAILED) {
+	event_uring.cq_ring = 0;
+    }
+    if (event_uring.cq_ring != 0
+	&& (event_uring.sqes = (struct io_uring_sqe *)
+	    mmap((void *) 0, event_uring.sqes_len, PROT_READ | PROT_WRITE,
+		 MAP_SHARED | MAP_POPULATE, event_uring.fd,
+		 IORING_OFF_SQES)) == MAP_FAILED)
+	event_uring.sqes = 0;
+    if (event_uring.sqes == 0) {
+	saved_errno = errno;
+	event_uring_close();
+	errno = saved_errno;
+	msg_warn("io_uring mmap: %m -- using epoll");
+	return (-1);
+    }
+#define EVENT_URING_SQ_PTR(off) \
+	((unsigned *) ((char *) event_uring.sq_ring + (off)))
+#define EVENT_URING_CQ_PTR(off) \
+	((unsigned *) ((char *) event_uring.cq_ring + (off)))
+
+    event_uring.sq_head = EVENT_URING_SQ_PTR(params.sq_off.head);
+    event_uring.sq_tail = EVENT_URING_SQ_PTR(params.sq_off.tail);
+    event_uring.sq_mask = *EVENT_URING_SQ_PTR(params.sq_off.ring_mask);
+    event_uring.sq_array = EVENT_URING_SQ_PTR(params.sq_off.array);
+    event_uring.cq_head = EVENT_URING_CQ_PTR(params.cq_off.head);
+    event_uring.cq_tail = EVENT_URING_CQ_PTR(params.cq_off.tail);
+    event_uring.cq_mask = *EVENT_URING_CQ_PTR(params.cq_off.ring_mask);
+    event_uring.cqes = (struct io_uring_cqe *)
+	((char *) event_uring.cq_ring + params.cq_off.cqes);
+    close_on_exec(event_uring.fd, CLOSE_ON_EXEC);
+    return (0);
+}
+
+/* event_uring_enter - submit requests, optionally wait for completions */
+
+static int event_uring_enter(int wait, int delay)
+{
+    struct io_uring_getevents_arg arg;
+    struct __kernel_timespec ts;
+    unsigned to_submit;
+    unsigned flags = IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+
+    /*
+     * The kernel advances the submission ring head as it consumes requests,
+     * including requests that were submitted by an interrupted call.
+     */
+    to_submit = *event_uring.sq_tail - EVENT_URING_LOAD(event_uring.sq_head);
+    memset((void *) &arg, 0, sizeof(arg));
+    if (wait && delay >= 0) {
+	ts.tv_sec = delay;
+	ts.tv_nsec = 0;
+	arg.ts = (__u64) (unsigned long) &ts;
+    }
+    if (syscall(__NR_io_uring_enter, event_uring.fd, to_submit,
+		wait ? 1 : 0, flags, &arg, sizeof(arg)) < 0
+	&& errno != ETIME)
+	return (-1);
+    return (0);
+}
+
+/* event_uring_get_sqe - allocate submission queue entry */
+
+static struct io_uring_sqe *event_uring_get_sqe(void)
+{
+    struct io_uring_sqe *sqe;
+    unsigned tail = *event_uring.sq_tail;
+
+    /*
+     * When the submission ring is full, hand its content to the kernel.
+     */
+    while (tail - EVENT_URING_LOAD(event_uring.sq_head)
+	   > event_uring.sq_mask)
+	if (event_uring_enter(0, 0) < 0 && errno != EINTR)
+	    msg_fatal("io_uring_enter: %m");
+    sqe = event_uring.sqes + (tail & event_uring.sq_mask);
+    memset((void *) sqe, 0, sizeof(*sqe));
+    event_uring.sq_array[tail & event_uring.sq_mask] = tail & event_uring.sq_mask;
+    return (sqe);
+}
+
+/* event_uring_put_sqe - make submission queue entry visible */
+
+static void event_uring_put_sqe(void)
+{
+    EVENT_URING_STORE(event_uring.sq_tail, *event_uring.sq_tail + 1);
+}
+
+/* event_uring_poll_add - queue poll request */
+
+static void event_uring_poll_add(int fd, unsigned events)
+{
+    EVENT_URING_FD *fip = event_uring.fdinfo + fd;
+    struct io_uring_sqe *sqe;
+
+    if (event_uring.excl_unsupported)
+	events &= ~EPOLLEXCLUSIVE;
+    sqe = event_uring_get_sqe();
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = events;
+    sqe->user_data = EVENT_URING_LABEL(fd, fip->gen);
+    event_uring_put_sqe();
+    fip->events = events;
+    fip->armed = 1;
+}
+
+/* event_uring_poll_remove - queue cancel request, if needed */
+
+static int event_uring_poll_remove(int fd)
+{
+    EVENT_URING_FD *fip = event_uring.fdinfo + fd;
+    struct io_uring_sqe *sqe;
+    int     queued = 0;
+
+    if (fip->armed) {
+	sqe = event_uring_get_sqe();
+	sqe->opcode = IORING_OP_POLL_REMOVE;
+	sqe->fd = -1;
+	sqe->addr = EVENT_URING_LABEL(fd, fip->gen);
+	sqe->user_data = EVENT_URING_CANCEL;
+	event_uring_put_sqe();
+	fip->armed = 0;
+	queued = 1;
+    }
+    fip->gen += 1;
+    fip->events = 0;
+    return (queued);
+}
+
+/* event_uring_ctl - epoll_ctl() lookalike */
+
+static int event_uring_ctl(int op, int fd, unsigned events)
+{
+    struct epoll_event dummy;
+
+    if (!EVENT_URING_ACTIVE()) {
+	dummy.events = events;
+	dummy.data.fd = fd;
+	return (epoll_ctl(event_epollfd, op, fd, &dummy));
+    }
+    switch (op) {
+    case EPOLL_CTL_ADD:
+	event_uring_poll_add(fd, events);
+	break;
+    case EPOLL_CTL_MOD:
+	(void) event_uring_poll_remove(fd);
+	event_uring_poll_add(fd, events);
+	break;
+    case EPOLL_CTL_DEL:
+	if (event_uring_poll_remove(fd))
+	    while (event_uring_enter(0, 0) < 0)
+		if (errno != EINTR)
+		    msg_fatal("io_uring_enter: %m");
+	break;
+    default:
+	msg_panic("event_uring_ctl: unknown operation: %d", op);
+    }
+    return (0);
+}
+
+/* event_uring_wait - epoll_wait() lookalike */
+
+static int event_uring_wait(struct epoll_event *event_buf, int buflen,
+			            int delay)
+{
+    struct io_uring_cqe *cqe;
+    EVENT_URING_FD *fip;
+    unsigned head;
+    int     event_count = 0;
+    int     fd;
+    int     n;
+
+    if (!EVENT_URING_ACTIVE())
+	return (epoll_wait(event_epollfd, event_buf, buflen,
+			   delay < 0 ? -1 : delay * 1000));
+
+    /*
+     * Poll again for descriptors that were reported in the previous round,
+     * unless the application lost interest.
+     */
+    for (n = 0; n < event_uring.rearm_count; n++) {
+	fd = event_uring.rearm[n];
+	fip = event_uring.fdinfo + fd;
+	if (fip->armed == 0 && fip->events != 0)
+	    event_uring_poll_add(fd, fip->events);
+    }
+    event_uring.rearm_count = 0;
+    if (event_uring.rearm_slots < buflen) {
+	if (event_uring.rearm)
+	    myfree((void *) event_uring.rearm);
+	event_uring.rearm = (int *) mymalloc(sizeof(int) * buflen);
+	event_uring.rearm_slots = buflen;
+    }
+
+    /*
+     * Submit all queued requests, and wait for the first completion.
+     */
+    if (event_uring_enter(delay != 0, delay) < 0)
+	return (-1);
+
+    /*
+     * Convert completions into epoll events. Skip completions for requests
+     * that were canceled.
+     */
+    head = *event_uring.cq_head;
+    while (event_count < buflen
+	   && head != EVENT_URING_LOAD(event_uring.cq_tail)) {
+	cqe = event_uring.cqes + (head & event_uring.cq_mask);
+	head++;
+	if (cqe->user_data == EVENT_URING_CANCEL)
+	    continue;
+	fd = EVENT_URING_LABEL_FD(cqe->user_data);
+	if (fd < 0 || fd >= event_uring.fdslots)
+	    msg_panic("event_uring_wait: bad file descriptor: %d", fd);
+	fip = event_uring.fdinfo + fd;
+	if (fip->armed == 0 || fip->gen != EVENT_URING_LABEL_GEN(cqe->user_data))
+	    continue;
+	fip->armed = 0;
+	event_uring.rearm[event_uring.rearm_count++] = fd;
+	if (cqe->res < 0) {
+	    if (cqe->res == -EINVAL && (fip->events & EPOLLEXCLUSIVE)) {
+		if (msg_verbose)
+		    msg_info("io_uring: exclusive wake-up is not supported");
+		event_uring.excl_unsupported = 1;
+		fip->events &= ~EPOLLEXCLUSIVE;
+	    } else if (cqe->res == -EBADF) {
+		/* Closed before we could poll it. */
+		fip->events = 0;
+	    } else if (cqe->res != -ECANCELED) {
+		errno = -cqe->res;
+		msg_fatal("io_uring poll fd %d: %m", fd);
+	    }
+	    continue;
+	}
+	event_buf[event_count].events = cqe->res;
+	event_buf[event_count].data.fd = fd;
+	event_count++;
+    }
+    EVENT_URING_STORE(event_uring.cq_head, head);
+    return (event_count);
+}
+
+ /*
+  * Replace the epoll macros above, with the epoll implementation as
+  * fall-back.
+  */
+#undef EVENT_REG_INIT_HANDLE
+#define EVENT_REG_INIT_HANDLE(er, n) do { \
+	if (event_uring_open(n) == 0) { \
+	    er = 0; \
+	} else { \
+	    er = event_epollfd = epoll_create(n); \
+	    if (event_epollfd >= 0) \
+		close_on_exec(event_epollfd, CLOSE_ON_EXEC); \
+	} \
+    } while (0)
+#undef EVENT_REG_INIT_TEXT
+#define EVENT_REG_INIT_TEXT	"io_uring_setup or epoll_create"
+
+#undef EVENT_REG_FORK_HANDLE
+#define EVENT_REG_FORK_HANDLE(er, n) do { \
+	if (EVENT_URING_ACTIVE()) \
+	    event_uring_close(); \
+	else \
+	    (void) close(event_epollfd); \
+	EVENT_REG_INIT_HANDLE(er, (n)); \
+    } while (0)
+
+#define EVENT_REG_UPD_HANDLE(er, n) do { \
+	er = event_uring_extend(n); \
+    } while (0)
+#define EVENT_REG_UPD_TEXT	"io_uring"
+
+#undef EVENT_REG_FD_OP
+#define EVENT_REG_FD_OP(er, fh, ev, op) do { \
+	(er) = event_uring_ctl((op), (fh), (ev)); \
+    } while (0)
+
+#undef EVENT_BUFFER_READ
+#define EVENT_BUFFER_READ(event_count, event_buf, buflen, delay) do { \
+	(event_count) = event_uring_wait((event_buf), (buflen), (delay)); \
+    } while (0)
+#undef EVENT_BUFFER_READ_TEXT
+#define EVENT_BUFFER_READ_TEXT	"io_uring_enter or epoll_wait"
+
+#define EVENT_REG_LAZY_DEL_OK()	(!EVENT_URING_ACTIVE())
+
+#endif
+
+ /*
+  * Lazy unregistration, for kernel-based filters that support in-place
+  * updates. A descriptor in event_pmask is disabled, but is still registered
+  * with the kernel-based filter. See event_disable_readwrite(),
+  * event_reg_add() and event_reg_flush().
+  */
+#ifdef EVENT_REG_MOD_OP
+static EVENT_MASK event_pmask;		/* unregister requests pending */
+static int event_pending_count;		/* number of pending requests */
+
+#ifndef EVENT_REG_LAZY_DEL_OK
+#define EVENT_REG_LAZY_DEL_OK()	1
+#endif
+#endif
+int     event_lazy_unregister;		/* defer unregister requests */
+
+ /*
+  * Timer events. Timer requests are kept in a binary min-heap that is
+  * ordered by (expiration time, request sequence number), so that adding,
+  * resetting or canceling a request costs O(log n) instead of O(n) with the
+  * sorted list that was used before Postfix 3.5. A hash table indexed by
+  * (callback, context) finds an existing request without a linear search.
+  * We don't use BINHASH for this: its byte-string hash function distributes
+  * pointer-valued keys poorly, and it would cost two extra memory
+  * allocations per request.
+  * 
+  * The sequence number preserves the old first-come, first-served order for
+  * requests with the same expiration time.
   * 
   * When a call-back function adds a timer request, we label the request with
   * the event_loop() call instance that invoked the call-back. We use this to
@@ -514,20 +1056,25 @@ struct EVENT_TIMER {
     EVENT_NOTIFY_TIME_FN callback;	/* callback function */
     char   *context;			/* callback context */
     long    loop_instance;		/* event_loop() call instance */
-    RING    ring;			/* linkage */
+    unsigned long seqno;		/* request order within time slot */
+    int     heap_index;			/* position in timer heap */
+    EVENT_TIMER *next;			/* (callback, context) hash chain */
 };
 
-static RING event_timer_head;		/* timer queue head */
+static EVENT_TIMER **event_timer_heap;	/* timer queue */
+static int event_timer_count;		/* number of pending requests */
+static int event_timer_slots;		/* allocated heap slots */
+static EVENT_TIMER **event_timer_table;	/* (callback, context) index */
+static size_t event_timer_buckets;	/* hash table size, power of 2 */
+static unsigned long event_timer_seqno;	/* request sequence number */
 static long event_loop_instance;	/* event_loop() call instance */
 
-#define RING_TO_TIMER(r) \
-	((EVENT_TIMER *) ((void *) (r) - offsetof(EVENT_TIMER, ring)))
+#define EVENT_TIMER_BEFORE(a, b) \
+	((a)->when < (b)->when \
+	 || ((a)->when == (b)->when && (a)->seqno < (b)->seqno))
 
-#define FOREACH_QUEUE_ENTRY(entry, head) \
-	for (entry = ring_succ(head); entry != (head); entry = ring_succ(entry))
-
-#define FIRST_TIMER(head) \
-	(ring_succ(head) != (head) ? RING_TO_TIMER(ring_succ(head)) : 0)
+#define FIRST_TIMER() \
+	(event_timer_count > 0 ? event_timer_heap[0] : 0)
 
  /*
   * Other private data structures.
@@ -575,10 +1122,15 @@ static void event_init(void)
     EVENT_MASK_ZERO(&event_rmask);
     EVENT_MASK_ZERO(&event_wmask);
     EVENT_MASK_ZERO(&event_xmask);
+    EVENT_MASK_ZERO(&event_emask);
 #else
     EVENT_MASK_ALLOC(&event_rmask, event_fdslots);
     EVENT_MASK_ALLOC(&event_wmask, event_fdslots);
     EVENT_MASK_ALLOC(&event_xmask, event_fdslots);
+    EVENT_MASK_ALLOC(&event_emask, event_fdslots);
+#ifdef EVENT_REG_MOD_OP
+    EVENT_MASK_ALLOC(&event_pmask, event_fdslots);
+#endif
 
     /*
      * Initialize the kernel-based filter.
@@ -591,7 +1143,14 @@ static void event_init(void)
     /*
      * Initialize timer stuff.
      */
-    ring_init(&event_timer_head);
+    event_timer_slots = EVENT_ALLOC_INCR;
+    event_timer_heap = (EVENT_TIMER **)
+	mymalloc(sizeof(*event_timer_heap) * event_timer_slots);
+    event_timer_buckets = 16;
+    event_timer_table = (EVENT_TIMER **)
+	mymalloc(sizeof(*event_timer_table) * event_timer_buckets);
+    memset((void *) event_timer_table, 0,
+	   sizeof(*event_timer_table) * event_timer_buckets);
     (void) time(&event_present);
 
     /*
@@ -634,6 +1193,10 @@ static void event_extend(int fd)
     EVENT_MASK_REALLOC(&event_rmask, new_slots);
     EVENT_MASK_REALLOC(&event_wmask, new_slots);
     EVENT_MASK_REALLOC(&event_xmask, new_slots);
+    EVENT_MASK_REALLOC(&event_emask, new_slots);
+#ifdef EVENT_REG_MOD_OP
+    EVENT_MASK_REALLOC(&event_pmask, new_slots);
+#endif
 #endif
 #ifdef EVENT_REG_UPD_HANDLE
     EVENT_REG_UPD_HANDLE(err, new_slots);
@@ -670,7 +1233,7 @@ void    event_drain(int time_limit)
     (void) time(&event_present);
     max_time = event_present + time_limit;
     while (event_present < max_time
-	   && (event_timer_head.pred != &event_timer_head
+	   && (event_timer_count > 0
 	       || EVENT_MASK_CMP(&zero_mask, &event_xmask) != 0)) {
 	event_loop(1);
 #if (EVENTS_STYLE != EVENTS_STYLE_SELECT)
@@ -684,21 +1247,16 @@ void    event_drain(int time_limit)
 #endif
 }
 
-/* event_fork - resume event processing after fork() */
+#if (EVENTS_STYLE != EVENTS_STYLE_SELECT)
 
-void    event_fork(void)
+/* event_reg_rebuild - replace kernel-based filter */
+
+static void event_reg_rebuild(void)
 {
-#if (EVENTS_STYLE != EVENTS_STYLE_SELECT)
     EVENT_FDTABLE *fdp;
     int     err;
     int     fd;
 
-    /*
-     * No event was ever registered, so there's nothing to be done.
-     */
-    if (EVENT_INIT_NEEDED())
-	return;
-
     /*
      * Close the existing filter handle and open a new kernel-based filter.
      */
@@ -706,9 +1264,19 @@ void    event_fork(void)
     if (err < 0)
 	msg_fatal("%s: %m", EVENT_REG_INIT_TEXT);
 
+    /*
+     * Nothing is registered with the new filter.
+     */
+#ifdef EVENT_REG_MOD_OP
+    if (event_pending_count > 0) {
+	EVENT_MASK_ZERO(&event_pmask);
+	event_pending_count = 0;
+    }
+#endif
+
     /*
      * Populate the new kernel-based filter with events that were registered
-     * in the parent process.
+     * with the old one.
      */
     for (fd = 0; fd <= event_max_fd; fd++) {
 	if (EVENT_MASK_ISSET(fd, &event_wmask)) {
@@ -721,6 +1289,113 @@ void    event_fork(void)
 	    event_enable_read(fd, fdp->callback, fdp->context);
 	}
     }
+}
+
+#ifdef EVENT_REG_MOD_OP
+
+/* event_reg_flush - carry out deferred unregister request */
+
+static int event_reg_flush(int fd)
+{
+    int     err;
+
+    if (EVENT_MASK_ISSET(fd, &event_pmask)) {
+	EVENT_MASK_CLR(fd, &event_pmask);
+	event_pending_count--;
+    }
+
+    /*
+     * Don't complain when the descriptor was closed (and perhaps reused)
+     * after it was disabled. Closing a descriptor may silently remove it
+     * from the kernel-based filter.
+     */
+    EVENT_REG_DEL_OP(err, fd, 0);
+    if (err < 0 && errno != ENOENT && errno != EBADF)
+	msg_fatal("event_reg_flush: %s: %m", EVENT_REG_DEL_TEXT);
+    return (err);
+}
+
+#endif
+
+/* event_reg_add - register descriptor with kernel-based filter */
+
+static void event_reg_add(const char *myname, int fd, int type)
+{
+    int     err;
+
+#ifdef EVENT_REG_MOD_OP
+
+    /*
+     * The descriptor may still be registered after a lazy
+     * event_disable_readwrite() request. If so, update the registration in
+     * place. We can't skip the update when the events of interest are
+     * unchanged: the descriptor may have been closed and reused in the mean
+     * time, and closing a descriptor may silently remove it from the
+     * kernel-based filter. Then, register the descriptor as usual.
+     */
+    if (EVENT_MASK_ISSET(fd, &event_pmask)) {
+	if (EVENT_MASK_ISSET(fd, &event_emask)) {
+	    (void) event_reg_flush(fd);
+	} else {
+	    EVENT_MASK_CLR(fd, &event_pmask);
+	    event_pending_count--;
+	    if (type == EVENT_READ)
+		EVENT_REG_MOD_READ(err, fd);
+	    else
+		EVENT_REG_MOD_WRITE(err, fd);
+	    if (err == 0)
+		return;
+	    if (errno != ENOENT)
+		msg_fatal("%s: %s: %m", myname, EVENT_REG_MOD_TEXT);
+	}
+    }
+#endif
+#ifdef EVENT_REG_ADD_READ_EXCL
+
+    /*
+     * Don't ask again for exclusive wake-up after the kernel said no.
+     */
+    if (type == EVENT_READ && EVENT_MASK_ISSET(fd, &event_emask)) {
+	static int excl_unsupported;
+
+	if (excl_unsupported == 0) {
+	    EVENT_REG_ADD_READ_EXCL(err, fd);
+	    if (err == 0)
+		return;
+	    if (errno != EINVAL)
+		msg_fatal("%s: %s: %m", myname, EVENT_REG_ADD_TEXT);
+	    if (msg_verbose)
+		msg_info("%s: exclusive wake-up is not supported", myname);
+	    excl_unsupported = 1;
+	}
+    }
+#endif
+    if (type == EVENT_READ)
+	EVENT_REG_ADD_READ(err, fd);
+    else
+	EVENT_REG_ADD_WRITE(err, fd);
+    if (err < 0)
+	msg_fatal("%s: %s: %m", myname, EVENT_REG_ADD_TEXT);
+}
+
+#endif
+
+/* event_fork - resume event processing after fork() */
+
+void    event_fork(void)
+{
+#if (EVENTS_STYLE != EVENTS_STYLE_SELECT)
+
+    /*
+     * No event was ever registered, so there's nothing to be done.
+     */
+    if (EVENT_INIT_NEEDED())
+	return;
+
+    /*
+     * Replace the kernel-based filter that we share with the parent process.
+     */
+    event_reg_rebuild();
 #endif
 }
 
@@ -730,7 +1405,6 @@ void    event_enable_read(int fd, EVENT_NOTIFY_RDWR_FN callback, void *context)
 {
     const char *myname = "event_enable_read";
     EVENT_FDTABLE *fdp;
-    int     err;
 
     if (EVENT_INIT_NEEDED())
 	event_init();
@@ -767,9 +1441,7 @@ void    event_enable_read(int fd, EVENT_NOTIFY_RDWR_FN callback, void *context)
 	if (event_max_fd < fd)
 	    event_max_fd = fd;
 #if (EVENTS_STYLE != EVENTS_STYLE_SELECT)
-	EVENT_REG_ADD_READ(err, fd);
-	if (err < 0)
-	    msg_fatal("%s: %s: %m", myname, EVENT_REG_ADD_TEXT);
+	event_reg_add(myname, fd, EVENT_READ);
 #endif
     }
     fdp = event_fdtable + fd;
@@ -779,13 +1451,42 @@ void    event_enable_read(int fd, EVENT_NOTIFY_RDWR_FN callback, void *context)
     }
 }
 
+/* event_enable_read_excl - enable read events, exclusive wake-up */
+
+void    event_enable_read_excl(int fd, EVENT_NOTIFY_RDWR_FN callback,
+			               void *context)
+{
+    const char *myname = "event_enable_read_excl";
+
+    if (EVENT_INIT_NEEDED())
+	event_init();
+
+    /*
+     * Sanity checks.
+     */
+    if (fd < 0 || fd >= event_fdlimit)
+	msg_panic("%s: bad file descriptor: %d", myname, fd);
+
+    if (fd >= event_fdslots)
+	event_extend(fd);
+
+    /*
+     * Exclusive wake-up can be requested only when a descriptor is
+     * registered with the kernel-based filter.
+     */
+    if (EVENT_MASK_ISSET(fd, &event_rmask) || EVENT_MASK_ISSET(fd, &event_wmask))
+	msg_panic("%s: fd %d: I/O request is already enabled", myname, fd);
+
+    EVENT_MASK_SET(fd, &event_emask);
+    event_enable_read(fd, callback, context);
+}
+
 /* event_enable_write - enable write events */
 
 void    event_enable_write(int fd, EVENT_NOTIFY_RDWR_FN callback, void *context)
 {
     const char *myname = "event_enable_write";
     EVENT_FDTABLE *fdp;
-    int     err;
 
     if (EVENT_INIT_NEEDED())
 	event_init();
@@ -822,9 +1523,7 @@ void    event_enable_write(int fd, EVENT_NOTIFY_RDWR_FN callback, void *context)
 	if (event_max_fd < fd)
 	    event_max_fd = fd;
 #if (EVENTS_STYLE != EVENTS_STYLE_SELECT)
-	EVENT_REG_ADD_WRITE(err, fd);
-	if (err < 0)
-	    msg_fatal("%s: %s: %m", myname, EVENT_REG_ADD_TEXT);
+	event_reg_add(myname, fd, EVENT_WRITE);
 #endif
     }
     fdp = event_fdtable + fd;
@@ -861,6 +1560,21 @@ void    event_disable_readwrite(int fd)
     if (fd >= event_fdslots)
 	return;
 #if (EVENTS_STYLE != EVENTS_STYLE_SELECT)
+#ifdef EVENT_REG_MOD_OP
+
+    /*
+     * Optionally, defer the unregister request until the next event_loop()
+     * call, so that an enable request in the mean time can update the
+     * registration in place. Exclusive wake-up can't be updated in place.
+     */
+    if (event_lazy_unregister && EVENT_REG_LAZY_DEL_OK()
+	&& EVENT_MASK_ISSET(fd, &event_emask) == 0
+	&& (EVENT_MASK_ISSET(fd, &event_rmask)
+	    || EVENT_MASK_ISSET(fd, &event_wmask))) {
+	EVENT_MASK_SET(fd, &event_pmask);
+	event_pending_count++;
+    } else
+#endif
 #ifdef EVENT_REG_DEL_BOTH
     /* XXX Can't seem to disable READ and WRITE events selectively. */
     if (EVENT_MASK_ISSET(fd, &event_rmask)
@@ -884,17 +1598,193 @@ void    event_disable_readwrite(int fd)
     EVENT_MASK_CLR(fd, &event_xmask);
     EVENT_MASK_CLR(fd, &event_rmask);
     EVENT_MASK_CLR(fd, &event_wmask);
+    EVENT_MASK_CLR(fd, &event_emask);
     fdp = event_fdtable + fd;
     fdp->callback = 0;
     fdp->context = 0;
 }
 
+/* event_timer_swap - exchange two timer heap slots */
+
+static void event_timer_swap(int i, int j)
+{
+    EVENT_TIMER *tmp = event_timer_heap[i];
+
+    event_timer_heap[i] = event_timer_heap[j];
+    event_timer_heap[j] = tmp;
+    event_timer_heap[i]->heap_index = i;
+    event_timer_heap[j]->heap_index = j;
+}
+
+/* event_timer_sift_up - restore heap order towards the root */
+
+static void event_timer_sift_up(int i)
+{
+    int     parent;
+
+    while (i > 0) {
+	parent = (i - 1) / 2;
+	if (!EVENT_TIMER_BEFORE(event_timer_heap[i], event_timer_heap[parent]))
+	    break;
+	event_timer_swap(i, parent);
+	i = parent;
+    }
+}
+
+/* event_timer_sift_down - restore heap order towards the leaves */
+
+static void event_timer_sift_down(int i)
+{
+    int     child;
+
+    while ((child = 2 * i + 1) < event_timer_count) {
+	if (child + 1 < event_timer_count
+	    && EVENT_TIMER_BEFORE(event_timer_heap[child + 1],
+				  event_timer_heap[child]))
+	    child += 1;
+	if (!EVENT_TIMER_BEFORE(event_timer_heap[child], event_timer_heap[i]))
+	    break;
+	event_timer_swap(i, child);
+	i = child;
+    }
+}
+
+/* event_timer_insert - add request to timer heap */
+
+static void event_timer_insert(EVENT_TIMER *timer)
+{
+    if (event_timer_count >= event_timer_slots) {
+	event_timer_slots *= 2;
+	event_timer_heap = (EVENT_TIMER **)
+	    myrealloc((void *) event_timer_heap,
+		      sizeof(*event_timer_heap) * event_timer_slots);
+    }
+    timer->heap_index = event_timer_count++;
+    event_timer_heap[timer->heap_index] = timer;
+    event_timer_sift_up(timer->heap_index);
+}
+
+/* event_timer_remove - take request out of timer heap */
+
+static void event_timer_remove(EVENT_TIMER *timer)
+{
+    int     i = timer->heap_index;
+
+    if (i < 0 || i >= event_timer_count || event_timer_heap[i] != timer)
+	msg_panic("event_timer_remove: corrupt timer heap");
+    if (i != --event_timer_count) {
+	event_timer_heap[i] = event_timer_heap[event_timer_count];
+	event_timer_heap[i]->heap_index = i;
+	event_timer_sift_up(i);
+	event_timer_sift_down(event_timer_heap[i]->heap_index);
+    }
+    timer->heap_index = -1;
+}
+
+/* event_timer_hash - hash (callback, context) pair */
+
+static size_t event_timer_hash(EVENT_NOTIFY_TIME_FN callback, void *context)
+{
+    unsigned long h;
+
+    /*
+     * Integer hash finalizer. Heap pointers differ mostly in the middle
+     * bits, so they must be mixed before we use the low-order bits.
+     */
+    h = (unsigned long) context ^ ((unsigned long) callback >> 4);
+    h ^= h >> 17;
+    h *= 0xed5ad4bbUL;
+    h ^= h >> 11;
+    h *= 0xac4c1b51UL;
+    h ^= h >> 15;
+    h *= 0x31848babUL;
+    return ((h ^ (h >> 14)) & (event_timer_buckets - 1));
+}
+
+/* event_timer_find - look up request by (callback, context) */
+
+static EVENT_TIMER *event_timer_find(EVENT_NOTIFY_TIME_FN callback,
+				             void *context)
+{
+    EVENT_TIMER *timer;
+
+    for (timer = event_timer_table[event_timer_hash(callback, context)];
+	 timer != 0; timer = timer->next)
+	if (timer->callback == callback && timer->context == context)
+	    return (timer);
+    return (0);
+}
+
+/* event_timer_link - add request to (callback, context) index */
+
+static void event_timer_link(EVENT_TIMER *timer)
+{
+    EVENT_TIMER **old_table;
+    size_t  old_buckets;
+    EVENT_TIMER **hp;
+    EVENT_TIMER *next;
+    size_t  i;
+
+    /*
+     * Keep the load factor at or below one.
+     */
+    if (event_timer_count >= event_timer_buckets) {
+	old_table = event_timer_table;
+	old_buckets = event_timer_buckets;
+	event_timer_buckets *= 2;
+	event_timer_table = (EVENT_TIMER **)
+	    mymalloc(sizeof(*event_timer_table) * event_timer_buckets);
+	memset((void *) event_timer_table, 0,
+	       sizeof(*event_timer_table) * event_timer_buckets);
+	for (i = 0; i < old_buckets; i++) {
+	    for (next = old_table[i]; next != 0; /* void */ ) {
+		EVENT_TIMER *tp = next;
+
+		next = tp->next;
+		hp = event_timer_table + event_timer_hash(tp->callback,
+							  tp->context);
+		tp->next = *hp;
+		*hp = tp;
+	    }
+	}
+	myfree((void *) old_table);
+    }
+    hp = event_timer_table + event_timer_hash(timer->callback, timer->context);
+    timer->next = *hp;
+    *hp = timer;
+}
+
+/* event_timer_unlink - remove request from (callback, context) index */
+
+static void event_timer_unlink(EVENT_TIMER *timer)
+{
+    EVENT_TIMER **hp;
+
+    for (hp = event_timer_table + event_timer_hash(timer->callback,
+						   timer->context);
+	 *hp != 0; hp = &(*hp)->next) {
+	if (*hp == timer) {
+	    *hp = timer->next;
+	    return;
+	}
+    }
+    msg_panic("event_timer_unlink: corrupt timer index");
+}
+
+/* event_timer_free - take request out of timer queue and index */
+
+static void event_timer_free(EVENT_TIMER *timer)
+{
+    event_timer_remove(timer);
+    event_timer_unlink(timer);
+    myfree((void *) timer);
+}
+
 /* event_request_timer - (re)set timer */
 
 time_t  event_request_timer(EVENT_NOTIFY_TIME_FN callback, void *context, int delay)
 {
     const char *myname = "event_request_timer";
-    RING   *ring;
     EVENT_TIMER *timer;
 
     if (EVENT_INIT_NEEDED())
@@ -916,46 +1806,37 @@ time_t  event_request_timer(EVENT_NOTIFY_TIME_FN callback, void *context, int de
      * request away from the timer queue so that it can be inserted at the
      * right place.
      */
-    FOREACH_QUEUE_ENTRY(ring, &event_timer_head) {
-	timer = RING_TO_TIMER(ring);
-	if (timer->callback == callback && timer->context == context) {
-	    timer->when = event_present + delay;
-	    timer->loop_instance = event_loop_instance;
-	    ring_detach(ring);
-	    if (msg_verbose > 2)
-		msg_info("%s: reset 0x%lx 0x%lx %d", myname,
-			 (long) callback, (long) context, delay);
-	    break;
-	}
+    if ((timer = event_timer_find(callback, context)) != 0) {
+	timer->when = event_present + delay;
+	timer->loop_instance = event_loop_instance;
+	event_timer_remove(timer);
+	if (msg_verbose > 2)
+	    msg_info("%s: reset 0x%lx 0x%lx %d", myname,
+		     (long) callback, (long) context, delay);
     }
 
     /*
      * If not found, schedule a new timer request.
      */
-    if (ring == &event_timer_head) {
+    else {
 	timer = (EVENT_TIMER *) mymalloc(sizeof(EVENT_TIMER));
 	timer->when = event_present + delay;
 	timer->callback = callback;
 	timer->context = context;
 	timer->loop_instance = event_loop_instance;
+	event_timer_link(timer);
 	if (msg_verbose > 2)
 	    msg_info("%s: set 0x%lx 0x%lx %d", myname,
 		     (long) callback, (long) context, delay);
     }
 
     /*
-     * Timer requests are kept sorted to reduce lookup overhead in the event
-     * loop.
-     * 
-     * XXX Append the new request after existing requests for the same time
+     * XXX Order the new request after existing requests for the same time
      * slot. The event_loop() routine depends on this to avoid starving I/O
      * events when a call-back function schedules a zero-delay timer request.
      */
-    FOREACH_QUEUE_ENTRY(ring, &event_timer_head) {
-	if (timer->when < RING_TO_TIMER(ring)->when)
-	    break;
-    }
-    ring_prepend(ring, &timer->ring);
+    timer->seqno = event_timer_seqno++;
+    event_timer_insert(timer);
 
     return (timer->when);
 }
@@ -965,7 +1846,6 @@ time_t  event_request_timer(EVENT_NOTIFY_TIME_FN callback, void *context, int de
 int     event_cancel_timer(EVENT_NOTIFY_TIME_FN callback, void *context)
 {
     const char *myname = "event_cancel_timer";
-    RING   *ring;
     EVENT_TIMER *timer;
     int     time_left = -1;
 
@@ -977,15 +1857,10 @@ int     event_cancel_timer(EVENT_NOTIFY_TIME_FN callback, void *context)
      * when the request is not found. It might have been canceled from some
      * other thread.
      */
-    FOREACH_QUEUE_ENTRY(ring, &event_timer_head) {
-	timer = RING_TO_TIMER(ring);
-	if (timer->callback == callback && timer->context == context) {
-	    if ((time_left = timer->when - event_present) < 0)
-		time_left = 0;
-	    ring_detach(ring);
-	    myfree((void *) timer);
-	    break;
-	}
+    if ((timer = event_timer_find(callback, context)) != 0) {
+	if ((time_left = timer->when - event_present) < 0)
+	    time_left = 0;
+	event_timer_free(timer);
     }
     if (msg_verbose > 2)
 	msg_info("%s: 0x%lx 0x%lx %d", myname,
@@ -1012,9 +1887,15 @@ void    event_loop(int delay)
     EVENT_BUFFER event_buf[100];
     EVENT_BUFFER *bp;
 
+#ifdef EVENT_REG_MOD_OP
+    int     rebuild = 0;
+
+#endif
 #endif
     int     event_count;
     EVENT_TIMER *timer;
+    EVENT_NOTIFY_TIME_FN callback;
+    char   *context;
     int     fd;
     EVENT_FDTABLE *fdp;
     int     select_delay;
@@ -1026,10 +1907,10 @@ void    event_loop(int delay)
      * XXX Also print the select() masks?
      */
     if (msg_verbose > 2) {
-	RING   *ring;
+	int     i;
 
-	FOREACH_QUEUE_ENTRY(ring, &event_timer_head) {
-	    timer = RING_TO_TIMER(ring);
+	for (i = 0; i < event_timer_count; i++) {
+	    timer = event_timer_heap[i];
 	    msg_info("%s: time left %3d for 0x%lx 0x%lx", myname,
 		     (int) (timer->when - event_present),
 		     (long) timer->callback, (long) timer->context);
@@ -1037,10 +1918,11 @@ void    event_loop(int delay)
     }
 
     /*
-     * Find out when the next timer would go off. Timer requests are sorted.
+     * Find out when the next timer would go off. The heap root is the first
+     * timer request.
      * If any timer is scheduled, adjust the delay appropriately.
      */
-    if ((timer = FIRST_TIMER(&event_timer_head)) != 0) {
+    if ((timer = FIRST_TIMER()) != 0) {
 	event_present = time((time_t *) 0);
 	if ((select_delay = timer->when - event_present) < 0) {
 	    select_delay = 0;
@@ -1082,6 +1964,17 @@ void    event_loop(int delay)
 	return;
     }
 #else
+#ifdef EVENT_REG_MOD_OP
+
+    /*
+     * Carry out deferred unregister requests, so that the kernel won't
+     * report events that the application is no longer interested in.
+     */
+    if (event_pending_count > 0)
+	for (fd = 0; fd <= event_max_fd && event_pending_count > 0; fd++)
+	    if (EVENT_MASK_ISSET(fd, &event_pmask))
+		(void) event_reg_flush(fd);
+#endif
     EVENT_BUFFER_READ(event_count, event_buf,
 		      sizeof(event_buf) / sizeof(event_buf[0]),
 		      select_delay);
@@ -1102,15 +1995,16 @@ void    event_loop(int delay)
 
     /*
      * Deliver timer events. Allow the application to add/delete timer queue
-     * requests while it is being called back. Requests are sorted: we keep
-     * running over the timer request queue from the start, and stop when we
-     * reach the future or the list end. We also stop when we reach a timer
+     * requests while it is being called back. Requests are ordered: we keep
+     * taking the first request from the timer queue, and stop when we reach
+     * the future or the queue end. We also stop when we reach a timer
      * request that was added by a call-back that was invoked from this
      * event_loop() call instance, for reasons that are explained below.
      * 
      * To avoid dangling pointer problems 1) we must remove a request from the
-     * timer queue before delivering its event to the application and 2) we
-     * must look up the next timer request *after* calling the application.
+     * timer queue and index before delivering its event to the application
+     * and 2) we must look up the next timer request *after* calling the
+     * application.
      * The latter complicates the handling of zero-delay timer requests that
      * are added by event_loop() call-back functions.
      * 
@@ -1119,23 +2013,24 @@ void    event_loop(int delay)
      * instance that invoked the timer event call-back. We use this instance
      * label here to prevent zero-delay timer requests from running in a
      * tight loop and starving I/O events. To make this solution work,
-     * event_request_timer() appends a new request after existing requests
+     * event_request_timer() orders a new request after existing requests
      * for the same time slot.
      */
     event_present = time((time_t *) 0);
     event_loop_instance += 1;
 
-    while ((timer = FIRST_TIMER(&event_timer_head)) != 0) {
+    while ((timer = FIRST_TIMER()) != 0) {
 	if (timer->when > event_present)
 	    break;
 	if (timer->loop_instance == event_loop_instance)
 	    break;
-	ring_detach(&timer->ring);		/* first this */
+	callback = timer->callback;
+	context = timer->context;
+	event_timer_free(timer);		/* first this */
 	if (msg_verbose > 2)
 	    msg_info("%s: timer 0x%lx 0x%lx", myname,
-		     (long) timer->callback, (long) timer->context);
-	timer->callback(EVENT_TIME, timer->context);	/* then this */
-	myfree((void *) timer);
+		     (long) callback, (long) context);
+	callback(EVENT_TIME, context);		/* then this */
     }
 
     /*
@@ -1197,7 +2092,28 @@ void    event_loop(int delay)
 		fdp->callback(EVENT_XCPT, fdp->context);
 	    }
 	}
+#ifdef EVENT_REG_MOD_OP
+
+	/*
+	 * With lazy unregistration, a descriptor may be closed while it is
+	 * still registered. When the underlying open file is shared with
+	 * another descriptor or process, the kernel-based filter keeps
+	 * reporting events for a descriptor that we can no longer
+	 * unregister. Replace the kernel-based filter when that happens.
+	 */
+	else if (event_lazy_unregister
+		 && EVENT_MASK_ISSET(fd, &event_pmask) == 0
+		 && event_reg_flush(fd) < 0)
+	    rebuild = 1;
+#endif
+    }
+#ifdef EVENT_REG_MOD_OP
+    if (rebuild) {
+	if (msg_verbose)
+	    msg_info("%s: replacing kernel-based filter", myname);
+	event_reg_rebuild();
     }
+#endif
 #endif
     nested--;
 }
@@ -1208,6 +2124,10 @@ void    event_loop(int delay)
   * Proof-of-concept test program for the event manager. Schedule a series of
   * events at one-second intervals and let them happen, while echoing any
   * lines read from stdin.
+  * 
+  * With "-b count" as arguments, run a timer queue benchmark instead: arm,
+  * re-arm and cancel the specified number of timers (default: 100000), and
+  * report the time spent in each phase.
   */
 #include <stdio.h>
 #include <ctype.h>
@@ -1248,8 +2168,62 @@ static void request(int unused_event, void *unused_context)
     event_request_timer(timer_event, "0 second", 0);
 }
 
-int     main(int argc, void **argv)
+/* bench_event - benchmark timer call-back, never called */
+
+static void bench_event(int unused_event, void *unused_context)
+{
+    msg_panic("bench_event: unexpected timer event");
+}
+
+/* bench_elapsed - report and reset the elapsed time */
+
+static void bench_elapsed(const char *what, int count, struct timeval * start)
+{
+    struct timeval now;
+    double  elapsed;
+
+    gettimeofday(&now, (struct timezone *) 0);
+    elapsed = (now.tv_sec - start->tv_sec)
+	+ (now.tv_usec - start->tv_usec) / 1000000.0;
+    printf("%-8s %d timers in %.3f s (%.0f/s)\n", what, count, elapsed,
+	   elapsed > 0 ? count / elapsed : 0.0);
+    *start = now;
+}
+
+/* bench - arm, re-arm and cancel a large number of timers */
+
+static void bench(int count)
+{
+    char   *contexts = mymalloc(count);
+    struct timeval start;
+    int     i;
+
+    gettimeofday(&start, (struct timezone *) 0);
+    for (i = 0; i < count; i++)
+	event_request_timer(bench_event, contexts + i, 100 + (i * 7919L) % 3600);
+    bench_elapsed("arm", count, &start);
+    for (i = 0; i < count; i++)
+	event_request_timer(bench_event, contexts + i, 100 + (i * 104729L) % 3600);
+    bench_elapsed("re-arm", count, &start);
+    for (i = 0; i < count; i++)
+	if (event_cancel_timer(bench_event, contexts + i) < 0)
+	    msg_panic("bench: timer %d not found", i);
+    bench_elapsed("cancel", count, &start);
+    if (event_timer_count != 0)
+	msg_panic("bench: %d timers left", event_timer_count);
+    myfree(contexts);
+}
+
+int     main(int argc, char **argv)
 {
+    int     count;
+
+    if (argc > 1 && strcmp(argv[1], "-b") == 0) {
+	if ((count = (argc > 2 ? atoi(argv[2]) : 100000)) <= 0)
+	    msg_fatal("usage: %s -b count (count must be > 0)", argv[0]);
+	bench(count);
+	exit(0);
+    }
     if (argv[1])
 	msg_verbose = atoi(argv[1]);
     event_request_timer(request, (void *) 0, 0);
@@ -26,6 +26,7 @@ typedef void (*EVENT_NOTIFY_FN) (int, void *);
 
 extern time_t event_time(void);
 extern void event_enable_read(int, EVENT_NOTIFY_RDWR_FN, void *);
+extern void event_enable_read_excl(int, EVENT_NOTIFY_RDWR_FN, void *);
 extern void event_enable_write(int, EVENT_NOTIFY_RDWR_FN, void *);
 extern void event_disable_readwrite(int);
 extern time_t event_request_timer(EVENT_NOTIFY_TIME_FN, void *, int);
@@ -33,6 +34,7 @@ extern int event_cancel_timer(EVENT_NOTIFY_TIME_FN, void *);
 extern void event_loop(int);
 extern void event_drain(int);
 extern void event_fork(void);
+extern int event_lazy_unregister;
 
  /*
   * Event codes.
@@ -10,6 +10,11 @@
 /*	#include <iostuff.h>
 /* DESCRIPTION
 
+ /*
+  * System library.
+  */
+#include <sys/uio.h>
+
  /*
   * External interface.
   */
@@ -23,6 +28,7 @@ extern ssize_t peekfd(int);
 extern ssize_t write_buf(int, const char *, ssize_t, int);
 extern ssize_t timed_read(int, void *, size_t, int, void *);
 extern ssize_t timed_write(int, const void *, size_t, int, void *);
+extern ssize_t timed_writev(int, const struct iovec *, int, int);
 extern void doze(unsigned);
 extern void rand_sleep(unsigned, unsigned);
 extern int duplex_pipe(int *);
@@ -0,0 +1,760 @@
+/*++
+/* NAME
+/*	lit_filter 3
+/* SUMMARY
+/*	regular expression pre-filter
+/* SYNOPSIS
+/*	#include <lit_filter.h>
+/*
+/*	LIT_FILTER *lit_filter_create()
+/*
+/*	int	lit_filter_add(filter, pattern, flags)
+/*	LIT_FILTER *filter;
+/*	const char *pattern;
+/*	int	flags;
+/*
+/*	int	lit_filter_compile(filter)
+/*	LIT_FILTER *filter;
+/*
+/*	void	lit_filter_scan(filter, string)
+/*	LIT_FILTER *filter;
+/*	const char *string;
+/*
+/*	int	lit_filter_found(filter, id)
+/*	LIT_FILTER *filter;
+/*	int	id;
+/*
+/*	LIT_FILTER *lit_filter_free(filter)
+/*	LIT_FILTER *filter;
+/* AUXILIARY FUNCTIONS
+/*	int	lit_filter_extract(result, pattern, flags)
+/*	ARGV	*result;
+/*	const char *pattern;
+/*	int	flags;
+/* DESCRIPTION
+/*	This module speeds up tables with many regular expressions.
+/*	Most patterns contain a literal string that must be present
+/*	in the input before the pattern can match. The literals of
+/*	all patterns in a table are searched with one pass over the
+/*	input, using an Aho-Corasick automaton, and a pattern with
+/*	a literal that is absent need not be executed. Literals are compared
+/*	without regard to ASCII case, so that the same filter works
+/*	for case-sensitive and case-insensitive patterns.
+/*
+/*	lit_filter_create() creates an empty filter.
+/*
+/*	lit_filter_add() extracts the required literals from the
+/*	specified pattern, and adds them to the filter. The result
+/*	is an identifier for lit_filter_found(), or LIT_FILTER_NONE
+/*	when no literal was found; such a pattern must always be
+/*	executed.
+/*
+/*	lit_filter_compile() prepares the filter for scanning, after
+/*	all patterns have been added. The result is the number of
+/*	patterns with literals. A caller may decide that fewer than
+/*	LIT_FILTER_MIN patterns are not worth the trouble.
+/*
+/*	lit_filter_scan() searches the specified string for all
+/*	literals in the filter.
+/*
+/*	lit_filter_found() returns non-zero when all literals of the
+/*	pattern with the specified identifier were found by the most
+/*	recent lit_filter_scan() call. When the result is zero, the
+/*	pattern cannot match the string.
+/*
+/*	lit_filter_free() destroys a filter. The result is a null
+/*	pointer.
+/*
+/*	lit_filter_extract() finds literals that any match of the
+/*	specified pattern must contain. It replaces the content of
+/*	the result argument with up to LIT_FILTER_MAX_LIT literals,
+/*	longest first, and returns their number. The analysis is
+/*	conservative: a pattern with top-level alternation, or with
+/*	syntax that is not understood, has no literals. The pattern
+/*	is not validated.
+/*
+/*	Arguments:
+/* .IP flags
+/*	LIT_FILTER_FLAG_NONE for POSIX extended regular expressions,
+/*	or LIT_FILTER_FLAG_PCRE for Perl-compatible regular expressions.
+/*	Patterns with other syntax (for example, POSIX basic regular
+/*	expressions, or PCRE with the "x" option) must not be given
+/*	to this module.
+/* DIAGNOSTICS
+/*	Panic: lit_filter_scan() before lit_filter_compile(),
+/*	lit_filter_add() after lit_filter_compile().
+/* SEE ALSO
+/*	dict_regexp(3), POSIX regular expression table
+/*	dict_pcre(3), Perl-compatible regular expression table
+/* LICENSE
+/* .ad
+/* .fi
+/*	The Secure Mailer license must be distributed with this software.
+/* AUTHOR(S)
+/*	Wietse Venema
+/*	Google, Inc.
+/*	111 8th Avenue
+/*	New York, NY 10011, USA
+/*--*/
+
+/* System library. */
+
+#include <sys_defs.h>
+#include <string.h>
+#include <ctype.h>
+
+/* Utility library. */
+
+#include <msg.h>
+#include <mymalloc.h>
+#include <vstring.h>
+#include <argv.h>
+#include <lit_filter.h>
+
+ /*
+  * The automaton is a trie of case-folded literals, plus failure
+  * transitions. Node 0 is the root; it is never a child, so that 0 can
+  * mean "none".
+  */
+typedef struct LIT_FILTER_NODE {
+    int     child;			/* first child, or 0 */
+    int     sibling;			/* next child of parent, or 0 */
+    int     fail;			/* longest proper suffix state */
+    int     out;			/* next literal on the fail chain */
+    unsigned seen;			/* last scan that found this literal */
+    unsigned char ch;			/* case-folded input byte */
+    unsigned char terminal;		/* this state ends a literal */
+} LIT_FILTER_NODE;
+
+typedef struct LIT_FILTER_PATTERN {
+    int     count;			/* number of literals */
+    int     lits[LIT_FILTER_MAX_LIT];	/* their final states */
+} LIT_FILTER_PATTERN;
+
+struct LIT_FILTER {
+    LIT_FILTER_NODE *nodes;		/* automaton states, root first */
+    int     node_count;			/* states in use */
+    int     node_limit;			/* states allocated */
+    LIT_FILTER_PATTERN *patterns;	/* patterns with literals */
+    int     pattern_count;		/* patterns in use */
+    int     pattern_limit;		/* patterns allocated */
+    int     compiled;			/* lit_filter_compile() was called */
+    unsigned generation;		/* current scan */
+    int     root_next[256];		/* root transitions */
+};
+
+ /*
+  * ASCII case folding.
+  */
+static unsigned char lit_filter_fold[256];
+
+#define LIT_FILTER_FOLD(c)	lit_filter_fold[(unsigned char) (c)]
+
+/* lit_filter_skip_escape - skip escape sequence, null means give up */
+
+static const char *lit_filter_skip_escape(const char *cp, int flags)
+{
+    const char *end;
+    int     ch = cp[1];
+
+    /*
+     * Skip the arguments of PCRE escapes such as \x{263a}, \p{L}, \k<name>
+     * or \12. A literal that follows may be lost; that is harmless.
+     */
+    if (ch == 0)
+	return (0);
+    cp += 2;
+    if (flags & LIT_FILTER_FLAG_PCRE) {
+	if (ch == 'Q')
+	    return (0);
+	if (ch == 'c')
+	    return (*cp ? cp + 1 : 0);
+	if (strchr("xopPNgk", ch) != 0 || ISDIGIT(ch)) {
+	    if (*cp == '{' || *cp == '<' || *cp == '\'') {
+		end = strchr(cp + 1, *cp == '{' ? '}' : *cp == '<' ? '>' : '\'');
+		return (end ? end + 1 : 0);
+	    }
+	    while (ISALNUM(*cp) || *cp == '-')
+		cp++;
+	}
+    }
+    return (cp);
+}
+
+/* lit_filter_skip_class - skip bracket expression, null means give up */
+
+static const char *lit_filter_skip_class(const char *cp, int flags)
+{
+    const char *end;
+
+    cp += 1;
+    if (*cp == '^')
+	cp++;
+    if (*cp == ']')
+	cp++;
+    for (;;) {
+	if (*cp == 0) {
+	    return (0);
+	} else if (*cp == ']') {
+	    return (cp + 1);
+	} else if (*cp == '[' && (cp[1] == '.' || cp[1] == '=')) {
+	    return (0);
+	} else if (*cp == '[' && cp[1] == ':') {
+	    for (end = cp + 2; ISALPHA(*end); end++)
+		 /* void */ ;
+	    if (end[0] != ':' || end[1] != ']')
+		return (0);
+	    cp = end + 2;
+	} else if (*cp == '\\' && (flags & LIT_FILTER_FLAG_PCRE)) {
+	    if ((cp = lit_filter_skip_escape(cp, flags)) == 0)
+		return (0);
+	} else {
+	    cp++;
+	}
+    }
+}
+
+/* lit_filter_skip_group - skip parenthesized group, null means give up */
+
+static const char *lit_filter_skip_group(const char *cp, int flags)
+{
+    if ((flags & LIT_FILTER_FLAG_PCRE) && cp[1] == '?' && cp[2] == '#')
+	return (0);
+    for (cp += 1; /* void */ ; /* void */ ) {
+	if (*cp == 0)
+	    return (0);
+	else if (*cp == ')')
+	    return (cp + 1);
+	else if (*cp == '\\')
+	    cp = lit_filter_skip_escape(cp, flags);
+	else if (*cp == '[')
+	    cp = lit_filter_skip_class(cp, flags);
+	else if (*cp == '(')
+	    cp = lit_filter_skip_group(cp, flags);
+	else
+	    cp++;
+	if (cp == 0)
+	    return (0);
+    }
+}
+
+/* lit_filter_pcre_unsafe - look for syntax that changes the rules */
+
+static int lit_filter_pcre_unsafe(const char *pattern)
+{
+    const char *cp;
+    const char *opt;
+
+    /*
+     * Start-of-pattern verbs such as (*UTF8) change how bytes are matched,
+     * and the "x" option (ignore white space and #comments) changes what a
+     * literal is. Don't bother finding out where these apply.
+     */
+    for (cp = pattern; (cp = strchr(cp, '(')) != 0; cp++) {
+	if (cp[1] == '*')
+	    return (1);
+	if (cp[1] == '?')
+	    for (opt = cp + 2; ISALPHA(*opt) || *opt == '-' || *opt == '^'; opt++)
+		if (*opt == 'x')
+		    return (1);
+    }
+    return (0);
+}
+
+/* lit_filter_extract - find literals that a match must contain */
+
+int     lit_filter_extract(ARGV *result, const char *pattern, int flags)
+{
+    static VSTRING *run;
+    const char *cp;
+    int     ch;
+    int     last_literal = 0;
+    ssize_t n;
+
+    if (run == 0)
+	run = vstring_alloc(100);
+    argv_truncate(result, 0);
+    VSTRING_RESET(run);
+
+    /*
+     * A quantifier that allows zero repetitions removes the last byte from
+     * the current run of literal bytes. Any other non-literal syntax ends
+     * the run. Top-level alternation means there are no required literals.
+     * Keep the longest runs, longest first.
+     */
+#define LIT_FILTER_END_RUN() do { \
+	if (VSTRING_LEN(run) > 0) { \
+	    VSTRING_TERMINATE(run); \
+	    for (n = 0; n < result->argc; n++) \
+		if (strlen(result->argv[n]) < VSTRING_LEN(run)) \
+		    break; \
+	    if (n < LIT_FILTER_MAX_LIT) { \
+		argv_insert_one(result, n, vstring_str(run)); \
+		if (result->argc > LIT_FILTER_MAX_LIT) \
+		    argv_truncate(result, LIT_FILTER_MAX_LIT); \
+	    } \
+	    VSTRING_RESET(run); \
+	} \
+	last_literal = 0; \
+    } while (0)
+
+#define LIT_FILTER_GIVE_UP() do { \
+	argv_truncate(result, 0); \
+	return (0); \
+    } while (0)
+
+    if ((flags & LIT_FILTER_FLAG_PCRE) && lit_filter_pcre_unsafe(pattern))
+	LIT_FILTER_GIVE_UP();
+
+    for (cp = pattern; *cp != 0; /* void */ ) {
+	switch (ch = *(unsigned char *) cp) {
+	case '|':
+	    LIT_FILTER_GIVE_UP();
+	case '*':
+	case '?':
+	case '{':
+	    if (last_literal)
+		vstring_truncate(run, VSTRING_LEN(run) - 1);
+	    LIT_FILTER_END_RUN();
+	    if (ch == '{' && (cp = strchr(cp, '}')) == 0)
+		LIT_FILTER_GIVE_UP();
+	    cp++;
+	    continue;
+	case '+':
+	    /* POSIX a+? is (a+)?, and PCRE a+? is lazy. */
+	    while (*++cp == '+')
+		 /* void */ ;
+	    if (last_literal && *cp && strchr("*?{", *cp) != 0)
+		vstring_truncate(run, VSTRING_LEN(run) - 1);
+	    LIT_FILTER_END_RUN();
+	    continue;
+	case '^':
+	case '$':
+	case '.':
+	case ')':
+	    LIT_FILTER_END_RUN();
+	    cp++;
+	    continue;
+	case '[':
+	    LIT_FILTER_END_RUN();
+	    if ((cp = lit_filter_skip_class(cp, flags)) == 0)
+		LIT_FILTER_GIVE_UP();
+	    continue;
+	case '(':
+	    LIT_FILTER_END_RUN();
+	    if ((cp = lit_filter_skip_group(cp, flags)) == 0)
+		LIT_FILTER_GIVE_UP();
+	    continue;
+	case '\\':
+	    ch = *(unsigned char *) (cp + 1);
+
+	    /*
+	     * Backslash followed by a letter or digit is a character class,
+	     * anchor or back reference. GNU regex also has \< \> \` \'.
+	     */
+	    if (ch == 0 || ISALNUM(ch) || strchr("<>`'", ch) != 0) {
+		LIT_FILTER_END_RUN();
+		if ((cp = lit_filter_skip_escape(cp, flags)) == 0)
+		    LIT_FILTER_GIVE_UP();
+		continue;
+	    }
+	    cp += 2;
+	    break;
+	default:
+	    cp += 1;
+	    break;
+	}
+	VSTRING_ADDCH(run, ch);
+	last_literal = 1;
+    }
+    LIT_FILTER_END_RUN();
+
+    /*
+     * A single byte is a poor filter; use one only if there is nothing
+     * better.
+     */
+    for (n = 1; n < result->argc; n++) {
+	if (result->argv[n][1] == 0) {
+	    argv_truncate(result, n);
+	    break;
+	}
+    }
+    return (result->argc);
+}
+
+/* lit_filter_create - create empty filter */
+
+LIT_FILTER *lit_filter_create(void)
+{
+    LIT_FILTER *filter;
+    int     ch;
+
+    if (lit_filter_fold['A'] == 0)
+	for (ch = 0; ch < 256; ch++)
+	    lit_filter_fold[ch] = TOLOWER(ch);
+
+    filter = (LIT_FILTER *) mymalloc(sizeof(*filter));
+    filter->node_limit = 64;
+    filter->nodes = (LIT_FILTER_NODE *)
+	mymalloc(sizeof(*filter->nodes) * filter->node_limit);
+    memset((void *) filter->nodes, 0, sizeof(*filter->nodes));
+    filter->node_count = 1;
+    filter->pattern_limit = 16;
+    filter->patterns = (LIT_FILTER_PATTERN *)
+	mymalloc(sizeof(*filter->patterns) * filter->pattern_limit);
+    filter->pattern_count = 0;
+    filter->compiled = 0;
+    filter->generation = 0;
+    memset((void *) filter->root_next, 0, sizeof(filter->root_next));
+    return (filter);
+}
+
+/* lit_filter_child - find transition in trie */
+
+static inline int lit_filter_child(LIT_FILTER_NODE *nodes, int state, int ch)
+{
+    int     next;
+
+    for (next = nodes[state].child; next != 0; next = nodes[next].sibling)
+	if (nodes[next].ch == ch)
+	    break;
+    return (next);
+}
+
+/* lit_filter_insert - add one literal to the trie */
+
+static int lit_filter_insert(LIT_FILTER *filter, const char *literal)
+{
+    LIT_FILTER_NODE *node;
+    const char *cp;
+    int     state;
+    int     next;
+    int     ch;
+
+    /*
+     * Patterns with the same literal share the same final state.
+     */
+    for (state = 0, cp = literal; *cp != 0; cp++, state = next) {
+	ch = LIT_FILTER_FOLD(*cp);
+	if ((next = lit_filter_child(filter->nodes, state, ch)) != 0)
+	    continue;
+	if (filter->node_count >= filter->node_limit) {
+	    filter->node_limit *= 2;
+	    filter->nodes = (LIT_FILTER_NODE *)
+		myrealloc((void *) filter->nodes,
+			  sizeof(*filter->nodes) * filter->node_limit);
+	}
+	next = filter->node_count++;
+	node = filter->nodes + next;
+	node->child = 0;
+	node->sibling = filter->nodes[state].child;
+	node->fail = 0;
+	node->out = 0;
+	node->seen = 0;
+	node->ch = ch;
+	node->terminal = 0;
+	filter->nodes[state].child = next;
+    }
+    filter->nodes[state].terminal = 1;
+    return (state);
+}
+
+/* lit_filter_add - add required literals of pattern */
+
+int     lit_filter_add(LIT_FILTER *filter, const char *pattern, int flags)
+{
+    static ARGV *literals;
+    LIT_FILTER_PATTERN *pp;
+    int     n;
+
+    if (filter->compiled)
+	msg_panic("lit_filter_add: filter is already compiled");
+    if (literals == 0)
+	literals = argv_alloc(LIT_FILTER_MAX_LIT + 1);
+    if (lit_filter_extract(literals, pattern, flags) == 0)
+	return (LIT_FILTER_NONE);
+
+    if (filter->pattern_count >= filter->pattern_limit) {
+	filter->pattern_limit *= 2;
+	filter->patterns = (LIT_FILTER_PATTERN *)
+	    myrealloc((void *) filter->patterns,
+		      sizeof(*filter->patterns) * filter->pattern_limit);
+    }
+    pp = filter->patterns + filter->pattern_count;
+    for (n = 0; n < literals->argc; n++)
+	pp->lits[n] = lit_filter_insert(filter, literals->argv[n]);
+    pp->count = literals->argc;
+    return (filter->pattern_count++);
+}
+
+/* lit_filter_compile - compute failure transitions */
+
+int     lit_filter_compile(LIT_FILTER *filter)
+{
+    LIT_FILTER_NODE *nodes = filter->nodes;
+    int    *queue;
+    int     head;
+    int     tail;
+    int     state;
+    int     next;
+    int     fail;
+    int     found = 0;
+
+    if (filter->compiled)
+	msg_panic("lit_filter_compile: filter is already compiled");
+    filter->compiled = 1;
+
+    /*
+     * Breadth-first, so that the failure state of a state's parent is
+     * known before the state itself.
+     */
+    queue = (int *) mymalloc(sizeof(*queue) * filter->node_count);
+    head = tail = 0;
+    for (next = nodes[0].child; next != 0; next = nodes[next].sibling) {
+	filter->root_next[nodes[next].ch] = next;
+	queue[tail++] = next;
+    }
+    while (head < tail) {
+	state = queue[head++];
+	for (next = nodes[state].child; next != 0; next = nodes[next].sibling) {
+	    for (fail = nodes[state].fail; fail != 0; fail = nodes[fail].fail)
+		if ((found = lit_filter_child(nodes, fail, nodes[next].ch)) != 0)
+		    break;
+	    nodes[next].fail = (fail != 0 ? found :
+				filter->root_next[nodes[next].ch]);
+	    fail = nodes[next].fail;
+	    nodes[next].out = (nodes[fail].terminal ? fail : nodes[fail].out);
+	    queue[tail++] = next;
+	}
+    }
+    myfree((void *) queue);
+    return (filter->pattern_count);
+}
+
+/* lit_filter_scan - find all literals in string */
+
+void    lit_filter_scan(LIT_FILTER *filter, const char *string)
+{
+    LIT_FILTER_NODE *nodes = filter->nodes;
+    const unsigned char *cp;
+    unsigned generation;
+    int     state = 0;
+    int     next;
+    int     ch;
+    int     n;
+
+    if (filter->compiled == 0)
+	msg_panic("lit_filter_scan: filter is not compiled");
+
+    /*
+     * Instead of clearing the "found" state of each literal before a scan,
+     * bump the scan generation number.
+     */
+    if ((generation = ++filter->generation) == 0) {
+	for (n = 0; n < filter->node_count; n++)
+	    nodes[n].seen = 0;
+	generation = filter->generation = 1;
+    }
+    for (cp = (const unsigned char *) string; *cp != 0; cp++) {
+	ch = LIT_FILTER_FOLD(*cp);
+	while (state != 0 && (next = lit_filter_child(nodes, state, ch)) == 0)
+	    state = nodes[state].fail;
+	if (state == 0)
+	    next = filter->root_next[ch];
+	state = next;
+
+	/*
+	 * Report this state and shorter literals that end here. Stop at a
+	 * literal that was already found; so were the ones that follow it.
+	 */
+	for (next = (nodes[state].terminal ? state : nodes[state].out);
+	     next != 0 && nodes[next].seen != generation;
+	     next = nodes[next].out)
+	    nodes[next].seen = generation;
+    }
+}
+
+/* lit_filter_found - were all literals of a pattern found */
+
+int     lit_filter_found(LIT_FILTER *filter, int id)
+{
+    LIT_FILTER_PATTERN *pp = filter->patterns + id;
+    int     n;
+
+    if (id < 0 || id >= filter->pattern_count)
+	msg_panic("lit_filter_found: bad pattern id %d", id);
+    for (n = 0; n < pp->count; n++)
+	if (filter->nodes[pp->lits[n]].seen != filter->generation)
+	    return (0);
+    return (1);
+}
+
+/* lit_filter_free - destroy filter */
+
+LIT_FILTER *lit_filter_free(LIT_FILTER *filter)
+{
+    myfree((void *) filter->patterns);
+    myfree((void *) filter->nodes);
+    myfree((void *) filter);
+    return (0);
+}
+
+#ifdef TEST
+
+ /*
+  * Benchmark. Generate a header_checks-like table of POSIX regular
+  * expressions and a corpus of header and body lines, then find the first
+  * matching pattern for each line, with and without the filter. The
+  * results must be the same. With an argument "-" the program reads
+  * patterns from standard input and prints their required literal.
+  */
+#include <stdlib.h>
+#include <time.h>
+#include <regex.h>
+#include <vstream.h>
+#include <vstring_vstream.h>
+
+static const char *syllables[] = {
+    "ka", "lo", "mi", "nu", "pe", "ra", "so", "ti", "ve", "zu", "an", "el",
+    "in", "or", "us", "qua", "bri", "sta", "tor", "gen", "ex", "ly", "ph",
+};
+
+#define SYLLABLES (sizeof(syllables) / sizeof(syllables[0]))
+
+static const char *word(VSTRING *buf)
+{
+    int     n;
+
+    VSTRING_RESET(buf);
+    for (n = 2 + random() % 3; n > 0; n--)
+	vstring_strcat(buf, syllables[random() % SYLLABLES]);
+    return (vstring_str(buf));
+}
+
+static const char *rule_templates[] = {
+    "^Subject:.*%s",
+    "^Subject: +\\[?%s\\]? %s",
+    "^From:.*@%s\\.(com|net|org)",
+    "^X-Mailer: %s [0-9.]+",
+    "^Received: from [^ ]+ \\(%s",
+    "^Content-Type:.*name=\"?[^\"]*\\.%s\"?",
+    "%s[-_ ]%s",
+    "https?://[a-z0-9.]*%s\\.",
+    "(^|[^a-z])%s([^a-z]|$)",
+    "^(To|Cc):.*%s@",
+};
+
+#define RULE_TEMPLATES (sizeof(rule_templates) / sizeof(rule_templates[0]))
+
+static const char *line_templates[] = {
+    "Subject: Re: %s %s meeting notes",
+    "From: \"%s\" <%s@example.com>",
+    "Received: from mail.%s.example (mail.%s.example [192.0.2.1])",
+    "X-Mailer: %s %s 4.2",
+    "Content-Type: text/plain; charset=us-ascii",
+    "To: %s@example.org, %s@example.net",
+    "Please find the %s report attached, see https://www.%s.example/x",
+    "The quick brown fox jumps over the lazy dog %s %s",
+};
+
+#define LINE_TEMPLATES (sizeof(line_templates) / sizeof(line_templates[0]))
+
+static double elapsed(clock_t start)
+{
+    return ((double) (clock() - start) / CLOCKS_PER_SEC);
+}
+
+int     main(int argc, char **argv)
+{
+    long    rule_count = (argc > 1 ? atol(argv[1]) : 3000);
+    long    line_count = (argc > 2 ? atol(argv[2]) : 10000);
+    VSTRING *buf = vstring_alloc(100);
+    VSTRING *w1 = vstring_alloc(10);
+    VSTRING *w2 = vstring_alloc(10);
+    ARGV   *literals = argv_alloc(LIT_FILTER_MAX_LIT + 1);
+    LIT_FILTER *filter;
+    regex_t *exprs;
+    int    *ids;
+    char  **lines;
+    long   *plain_result;
+    long   *filter_result;
+    long    hits;
+    long    n;
+    long    r;
+    clock_t start;
+    double  plain_time;
+    double  filter_time;
+
+    if (argc > 1 && strcmp(argv[1], "-") == 0) {
+	while (vstring_get_nonl(buf, VSTREAM_IN) != VSTREAM_EOF) {
+	    lit_filter_extract(literals, vstring_str(buf), LIT_FILTER_FLAG_NONE);
+	    vstream_printf("%s ->", vstring_str(buf));
+	    for (n = 0; n < literals->argc; n++)
+		vstream_printf(" \"%s\"", literals->argv[n]);
+	    vstream_printf("\n");
+	    vstream_fflush(VSTREAM_OUT);
+	}
+	return (0);
+    }
+    srandom(1);
+    filter = lit_filter_create();
+    exprs = (regex_t *) mymalloc(sizeof(*exprs) * rule_count);
+    ids = (int *) mymalloc(sizeof(*ids) * rule_count);
+    for (r = 0; r < rule_count; r++) {
+	vstring_sprintf(buf, rule_templates[random() % RULE_TEMPLATES],
+			word(w1), word(w2));
+	if (regcomp(exprs + r, vstring_str(buf),
+		    REG_EXTENDED | REG_ICASE | REG_NOSUB) != 0)
+	    msg_fatal("bad pattern: %s", vstring_str(buf));
+	ids[r] = lit_filter_add(filter, vstring_str(buf), LIT_FILTER_FLAG_NONE);
+    }
+    n = lit_filter_compile(filter);
+    vstream_printf("%ld rules, %ld with literals, %d states\n",
+		   rule_count, n, filter->node_count);
+
+    lines = (char **) mymalloc(sizeof(*lines) * line_count);
+    for (n = 0; n < line_count; n++) {
+	vstring_sprintf(buf, line_templates[random() % LINE_TEMPLATES],
+			word(w1), word(w2));
+	lines[n] = mystrdup(vstring_str(buf));
+    }
+    plain_result = (long *) mymalloc(sizeof(*plain_result) * line_count);
+    filter_result = (long *) mymalloc(sizeof(*filter_result) * line_count);
+
+    start = clock();
+    for (n = 0; n < line_count; n++) {
+	for (r = 0; r < rule_count; r++)
+	    if (regexec(exprs + r, lines[n], 0, (regmatch_t *) 0, 0) == 0)
+		break;
+	plain_result[n] = r;
+    }
+    plain_time = elapsed(start);
+
+    start = clock();
+    for (n = 0; n < line_count; n++) {
+	lit_filter_scan(filter, lines[n]);
+	for (r = 0; r < rule_count; r++)
+	    if ((ids[r] == LIT_FILTER_NONE || lit_filter_found(filter, ids[r]))
+	     && regexec(exprs + r, lines[n], 0, (regmatch_t *) 0, 0) == 0)
+		break;
+	filter_result[n] = r;
+    }
+    filter_time = elapsed(start);
+
+    for (hits = n = 0; n < line_count; n++) {
+	if (plain_result[n] != filter_result[n])
+	    msg_fatal("\"%s\": first match %ld without filter, %ld with filter",
+		      lines[n], plain_result[n], filter_result[n]);
+	if (plain_result[n] < rule_count)
+	    hits++;
+    }
+    vstream_printf("%ld lines, %ld matched\n", line_count, hits);
+    vstream_printf("regexec only: %.3f usec/line\n",
+		   1e6 * plain_time / line_count);
+    vstream_printf("with filter:  %.3f usec/line\n",
+		   1e6 * filter_time / line_count);
+    vstream_fflush(VSTREAM_OUT);
+    return (0);
+}
+
+#endif
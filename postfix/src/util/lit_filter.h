@@ -0,0 +1,57 @@
+#ifndef _LIT_FILTER_H_INCLUDED_
+#define _LIT_FILTER_H_INCLUDED_
+
+/*++
+/* NAME
+/*	lit_filter 3h
+/* SUMMARY
+/*	regular expression pre-filter
+/* SYNOPSIS
+/*	#include <lit_filter.h>
+/* DESCRIPTION
+/* .nf
+
+ /*
+  * Utility library.
+  */
+#include <argv.h>
+
+ /*
+  * External interface.
+  */
+typedef struct LIT_FILTER LIT_FILTER;
+
+#define LIT_FILTER_FLAG_NONE	0
+#define LIT_FILTER_FLAG_PCRE	(1<<0)	/* Perl-compatible syntax */
+
+#define LIT_FILTER_NONE		(-1)	/* pattern has no literal */
+
+extern LIT_FILTER *lit_filter_create(void);
+extern int lit_filter_extract(ARGV *, const char *, int);
+extern int lit_filter_add(LIT_FILTER *, const char *, int);
+extern int lit_filter_compile(LIT_FILTER *);
+extern void lit_filter_scan(LIT_FILTER *, const char *);
+extern int lit_filter_found(LIT_FILTER *, int);
+extern LIT_FILTER *lit_filter_free(LIT_FILTER *);
+
+#define LIT_FILTER_MAX_LIT	4	/* literals per pattern */
+
+ /*
+  * Tables with fewer literals are not worth filtering.
+  */
+#ifndef LIT_FILTER_MIN
+#define LIT_FILTER_MIN		8
+#endif
+
+/* LICENSE
+/* .ad
+/* .fi
+/*	The Secure Mailer license must be distributed with this software.
+/* AUTHOR(S)
+/*	Wietse Venema
+/*	Google, Inc.
+/*	111 8th Avenue
+/*	New York, NY 10011, USA
+/*--*/
+
+#endif
@@ -815,8 +815,26 @@ extern int initgroups(const char *, int);
 #endif
 #define PREFERRED_RAND_SOURCE	"dev:/dev/urandom"	/* introduced in 1.1 */
 #ifndef NO_EPOLL
+#ifdef HAS_IO_URING
+#define EVENTS_STYLE	EVENTS_STYLE_IOURING	/* epoll as fall-back */
+#else
 #define EVENTS_STYLE	EVENTS_STYLE_EPOLL	/* introduced in 2.5 */
 #endif
+#endif
+#ifndef NO_INOTIFY
+#define HAS_INOTIFY				/* introduced in 3.5 */
+#endif
+#ifndef NO_SYNCFS
+#if HAVE_GLIBC_API_VERSION_SUPPORT(2, 14)
+#define HAS_SYNCFS				/* introduced in 3.5 */
+#define SYNCFS_MIN_KERNEL	"5.8"	/* reports write-back errors */
+#endif
+#endif
+#ifndef NO_GETRANDOM
+#if HAVE_GLIBC_API_VERSION_SUPPORT(2, 25)
+#define HAS_GETRANDOM			/* Linux 3.17, glibc 2.25 */
+#endif
+#endif
 #define USE_SYSV_POLL
 #ifndef NO_POSIX_GETPW_R
 #if (defined(_POSIX_C_SOURCE) && _POSIX_C_SOURCE >= 1) \
@@ -1382,6 +1400,7 @@ extern int inet_pton(int, const char *, void *);
 #define EVENTS_STYLE_KQUEUE	2	/* FreeBSD kqueue */
 #define EVENTS_STYLE_DEVPOLL	3	/* Solaris /dev/poll */
 #define EVENTS_STYLE_EPOLL	4	/* Linux epoll */
+#define EVENTS_STYLE_IOURING	5	/* Linux io_uring */
 
  /*
   * We use poll() for read/write time limit enforcement on modern systems. We
@@ -0,0 +1,82 @@
+/*++
+/* NAME
+/*	timed_writev 3
+/* SUMMARY
+/*	gather write operation with pre-write timeout
+/* SYNOPSIS
+/*	#include <iostuff.h>
+/*
+/*	ssize_t	timed_writev(fd, iov, iovcnt, timeout)
+/*	int	fd;
+/*	const struct iovec *iov;
+/*	int	iovcnt;
+/*	int	timeout;
+/* DESCRIPTION
+/*	timed_writev() performs a writev() operation when the specified
+/*	descriptor becomes writable within a user-specified deadline.
+/*
+/*	Arguments:
+/* .IP fd
+/*	File descriptor in the range 0..FD_SETSIZE.
+/* .IP iov
+/*	Array of write buffer pointers and sizes.
+/* .IP iovcnt
+/*	The number of elements in the iov array.
+/* .IP timeout
+/*	The deadline in seconds. If this is <= 0, the deadline feature
+/*	is disabled.
+/* DIAGNOSTICS
+/*	When the operation does not complete within the deadline, the
+/*	result value is -1, and errno is set to ETIMEDOUT.
+/*	All other returns are identical to those of a writev(2) operation.
+/* SEE ALSO
+/*	timed_write(3), write with deadline
+/* LICENSE
+/* .ad
+/* .fi
+/*	The Secure Mailer license must be distributed with this software.
+/* AUTHOR(S)
+/*	Wietse Venema
+/*	IBM T.J. Watson Research
+/*	P.O. Box 704
+/*	Yorktown Heights, NY 10598, USA
+/*--*/
+
+/* System library. */
+
+#include <sys_defs.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <errno.h>
+
+/* Utility library. */
+
+#include <msg.h>
+#include <iostuff.h>
+
+/* timed_writev - gather write with deadline */
+
+ssize_t timed_writev(int fd, const struct iovec *iov, int iovcnt,
+		             int timeout)
+{
+    ssize_t ret;
+
+    /*
+     * Same as timed_write(), including the workaround for systems that
+     * report EAGAIN after select() says that the descriptor is writable.
+     */
+    for (;;) {
+	if (timeout > 0 && write_wait(fd, timeout) < 0)
+	    return (-1);
+	if ((ret = writev(fd, iov, iovcnt)) < 0 && timeout > 0 && errno == EAGAIN) {
+	    msg_warn("writev() returns EAGAIN on a writable file descriptor!");
+	    msg_warn("pausing to avoid going into a tight select/write loop!");
+	    sleep(1);
+	    continue;
+	} else if (ret < 0 && errno == EINTR) {
+	    continue;
+	} else {
+	    return (ret);
+	}
+    }
+}
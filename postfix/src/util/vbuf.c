@@ -31,6 +31,11 @@
 /*	const void *buf;
 /*	ssize_t	len;
 /*
+/*	ssize_t	vbuf_copy(src, dst, len)
+/*	VBUF	*src;
+/*	VBUF	*dst;
+/*	ssize_t	len;
+/*
 /*	int	vbuf_err(bp)
 /*	VBUF	*bp;
 /*
@@ -93,6 +98,10 @@
 /*	number of bytes transferred. A short count is returned in case of
 /*	an error.
 /*
+/*	vbuf_copy() moves data from one buffer into another, without
+/*	an intermediate copy in application memory. The result value
+/*	is as with vbuf_read(). The buffers must be different.
+/*
 /*	vbuf_timeout() is a macro that returns non-zero if a timeout error
 /*	condition was detected while reading or writing the buffer. The
 /*	error status can be reset by calling vbuf_clearerr().
@@ -236,3 +245,27 @@ ssize_t vbuf_write(VBUF *bp, const void *buf, ssize_t len)
     return (len - count);
 #endif
 }
+
+/* vbuf_copy - bulk copy from buffer to buffer */
+
+ssize_t vbuf_copy(VBUF *src, VBUF *dst, ssize_t len)
+{
+    ssize_t count;
+    ssize_t n;
+
+    for (count = len; count > 0; count -= n) {
+	if (src->cnt >= 0 && src->get_ready(src))
+	    break;
+	if (dst->cnt <= 0 && dst->put_ready(dst) != 0)
+	    break;
+	n = (count < -src->cnt ? count : -src->cnt);
+	if (n > dst->cnt)
+	    n = dst->cnt;
+	memcpy(dst->ptr, src->ptr, n);
+	src->ptr += n;
+	src->cnt += n;
+	dst->ptr += n;
+	dst->cnt -= n;
+    }
+    return (len - count);
+}
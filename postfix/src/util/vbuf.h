@@ -95,6 +95,7 @@ extern int vbuf_put(VBUF *, int);
 extern int vbuf_unget(VBUF *, int);
 extern ssize_t vbuf_read(VBUF *, void *, ssize_t);
 extern ssize_t vbuf_write(VBUF *, const void *, ssize_t);
+extern ssize_t vbuf_copy(VBUF *, VBUF *, ssize_t);
 
 /* LICENSE
 /* .ad
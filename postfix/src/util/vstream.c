@@ -81,6 +81,11 @@
 /*	void *buf;
 /*	ssize_t	len;
 /*
+/*	ssize_t	vstream_fcopy(src, dst, len)
+/*	VSTREAM	*src;
+/*	VSTREAM	*dst;
+/*	ssize_t	len;
+/*
 /*	ssize_t	vstream_fread_app(stream, buf, len)
 /*	VSTREAM	*stream;
 /*	VSTRING	*buf;
@@ -297,6 +302,18 @@
 /*	transferred. A short count is returned in case of end-of-file
 /*	or error conditions.
 /*
+/*	When vstream_fwrite() is given at least one buffer full of
+/*	data, and the stream uses the default timed_write(3) write
+/*	function, it writes the buffered data and the new data with
+/*	one writev(2) call, instead of copying the new data through
+/*	the stream buffer one buffer full at a time.
+/*
+/*	vstream_fcopy() reads up to \fIlen\fR bytes from the \fIsrc\fR
+/*	stream and writes them to the \fIdst\fR stream, copying
+/*	directly from one stream buffer into the other. The result
+/*	value is as with vstream_fread(); use vstream_ferror() to
+/*	find out which stream had a problem.
+/*
 /*	vstream_fread_buf() resets the buffer write position,
 /*	allocates space for the specified number of bytes in the
 /*	buffer, reads the bytes from the specified VSTREAM, and
@@ -384,6 +401,14 @@
 /*	NOTE: the vstream_*printf() routines may silently expand a
 /*	buffer, so that the result of some %letter specifiers can
 /*	be written to contiguous memory.
+/* .IP "CA_VSTREAM_CTL_BUFSIZE_LIMIT(ssize_t)"
+/*	Enable adaptive buffer sizing. When a stream fills its buffer
+/*	with two consecutive read(2) operations, or flushes a full
+/*	buffer with two consecutive write(2) operations, the buffer
+/*	size is doubled, up to the specified limit. Specify zero
+/*	to disable (the default). This reduces the number of system
+/*	calls for large transfers without wasting memory on streams
+/*	that carry only small amounts of data.
 /* .IP CA_VSTREAM_CTL_START_DEADLINE (no arguments)
 /*	Change the VSTREAM_CTL_TIMEOUT behavior, to limit the total
 /*	time for all subsequent file descriptor read or write
@@ -516,6 +541,7 @@
 #include <time.h>
 #include <errno.h>
 #include <string.h>
+#include <sys/uio.h>
 
 /* Utility library. */
 
@@ -706,58 +732,57 @@ static void vstream_buf_wipe(VBUF *bp)
     VSTREAM_BUF_ACTIONS(bp, 0, 0, 0);
 }
 
-/* vstream_fflush_some - flush some buffered data */
+/* vstream_buf_adapt - grow buffer after repeated full reads or writes */
 
-static int vstream_fflush_some(VSTREAM *stream, ssize_t to_flush)
+static void vstream_buf_adapt(VSTREAM *stream, ssize_t count)
 {
-    const char *myname = "vstream_fflush_some";
+    const char *myname = "vstream_buf_adapt";
+    ssize_t new_size;
+
+#define VSTREAM_GROW_AFTER	2	/* consecutive full buffers */
+
+    if (stream->max_bufsize <= stream->req_bufsize)
+	return;
+    if (count < stream->buf.len) {
+	stream->full_count = 0;
+	return;
+    }
+    if (++stream->full_count >= VSTREAM_GROW_AFTER) {
+	stream->full_count = 0;
+	new_size = stream->req_bufsize * 2;
+	if (new_size > stream->max_bufsize || new_size <= 0)
+	    new_size = stream->max_bufsize;
+	if (msg_verbose > 2)
+	    msg_info("%s: fd %d: buffer size %ld -> %ld", myname,
+		     stream->fd, (long) stream->req_bufsize, (long) new_size);
+	stream->req_bufsize = new_size;
+    }
+}
+
+/* vstream_write_iov - write data from one or more buffers */
+
+static int vstream_write_iov(VSTREAM *stream, struct iovec *iov, int iovcnt)
+{
+    const char *myname = "vstream_write_iov";
     VBUF   *bp = &stream->buf;
-    ssize_t used;
-    ssize_t left_over;
-    void   *data;
     ssize_t len;
     ssize_t n;
+    int     first;
     int     timeout;
     struct timeval before;
     struct timeval elapsed;
 
     /*
-     * Sanity checks. It is illegal to flush a read-only stream. Otherwise,
-     * if there is buffered input, discard the input. If there is buffered
-     * output, require that the amount to flush is larger than the amount to
-     * keep, so that we can memcpy() the residue.
+     * Sanity check. Only the default write function has a writev()
+     * counterpart.
      */
-    if (bp->put_ready == 0)
-	msg_panic("%s: read-only stream", myname);
-    switch (bp->flags & (VSTREAM_FLAG_WRITE | VSTREAM_FLAG_READ)) {
-    case VSTREAM_FLAG_READ:			/* discard input */
-	VSTREAM_BUF_AT_END(bp);
-	/* FALLTHROUGH */
-    case 0:					/* flush after seek? */
-	return ((bp->flags & VSTREAM_FLAG_ERR) ? VSTREAM_EOF : 0);
-    case VSTREAM_FLAG_WRITE:			/* output buffered */
-	break;
-    case VSTREAM_FLAG_WRITE | VSTREAM_FLAG_READ:
-	msg_panic("%s: read/write stream", myname);
-    }
-    used = bp->len - bp->cnt;
-    left_over = used - to_flush;
-
-    if (msg_verbose > 2 && stream != VSTREAM_ERR)
-	msg_info("%s: fd %d flush %ld", myname, stream->fd, (long) to_flush);
-    if (to_flush < 0 || left_over < 0)
-	msg_panic("%s: bad to_flush %ld", myname, (long) to_flush);
-    if (to_flush < left_over)
-	msg_panic("%s: to_flush < left_over", myname);
-    if (to_flush == 0)
-	return ((bp->flags & VSTREAM_FLAG_ERR) ? VSTREAM_EOF : 0);
-    if (bp->flags & VSTREAM_FLAG_ERR)
-	return (VSTREAM_EOF);
+    if (iovcnt > 1 && stream->write_fn != (VSTREAM_RW_FN) timed_write)
+	msg_panic("%s: fd %d: non-default write function", myname, stream->fd);
 
     /*
      * When flushing a buffer, allow for partial writes. These can happen
-     * while talking to a network. Update the cached file seek position, if
-     * any.
+     * while talking to a network. The caller updates the cached file seek
+     * position, if any.
      * 
      * When deadlines are enabled, we count the elapsed time for each write
      * operation instead of simply comparing the time-of-day clock with a
@@ -766,7 +791,7 @@ static int vstream_fflush_some(VSTREAM *stream, ssize_t to_flush)
      * mind that a receiver may not be able to keep up when a sender suddenly
      * floods it with a lot of data as it tries to catch up with a deadline.
      */
-    for (data = (void *) bp->data, len = to_flush; len > 0; len -= n, data += n) {
+    for (first = 1; iovcnt > 0; first = 0) {
 	if (bp->flags & VSTREAM_FLAG_DEADLINE) {
 	    timeout = stream->time_limit.tv_sec + (stream->time_limit.tv_usec > 0);
 	    if (timeout <= 0) {
@@ -774,13 +799,22 @@ static int vstream_fflush_some(VSTREAM *stream, ssize_t to_flush)
 		errno = ETIMEDOUT;
 		return (VSTREAM_EOF);
 	    }
-	    if (len == to_flush)
+	    if (first)
 		GETTIMEOFDAY(&before);
 	    else
 		before = stream->iotime;
 	} else
 	    timeout = stream->timeout;
-	if ((n = stream->write_fn(stream->fd, data, len, timeout, stream->context)) <= 0) {
+	if (iovcnt == 1) {
+	    len = iov->iov_len;
+	    n = stream->write_fn(stream->fd, iov->iov_base, len, timeout,
+				 stream->context);
+	} else {
+	    for (len = 0, n = 0; n < iovcnt; n++)
+		len += iov[n].iov_len;
+	    n = timed_writev(stream->fd, iov, iovcnt, timeout);
+	}
+	if (n <= 0) {
 	    bp->flags |= VSTREAM_FLAG_WR_ERR;
 	    if (errno == ETIMEDOUT) {
 		bp->flags |= VSTREAM_FLAG_WR_TIMEOUT;
@@ -795,12 +829,76 @@ static int vstream_fflush_some(VSTREAM *stream, ssize_t to_flush)
 		VSTREAM_SUB_TIME(stream->time_limit, stream->time_limit, elapsed);
 	    }
 	}
-	if (msg_verbose > 2 && stream != VSTREAM_ERR && n != to_flush)
+	if (msg_verbose > 2 && stream != VSTREAM_ERR && n != len)
 	    msg_info("%s: %d flushed %ld/%ld", myname, stream->fd,
-		     (long) n, (long) to_flush);
+		     (long) n, (long) len);
+
+	/*
+	 * Skip the buffers that were written completely.
+	 */
+	while (iovcnt > 0 && n >= (ssize_t) iov->iov_len) {
+	    n -= iov->iov_len;
+	    iov++;
+	    iovcnt--;
+	}
+	if (n > 0) {
+	    iov->iov_base = (char *) iov->iov_base + n;
+	    iov->iov_len -= n;
+	}
+    }
+    return (0);
+}
+
+/* vstream_fflush_some - flush some buffered data */
+
+static int vstream_fflush_some(VSTREAM *stream, ssize_t to_flush)
+{
+    const char *myname = "vstream_fflush_some";
+    VBUF   *bp = &stream->buf;
+    ssize_t used;
+    ssize_t left_over;
+    struct iovec iov;
+
+    /*
+     * Sanity checks. It is illegal to flush a read-only stream. Otherwise,
+     * if there is buffered input, discard the input. If there is buffered
+     * output, require that the amount to flush is larger than the amount to
+     * keep, so that we can memcpy() the residue.
+     */
+    if (bp->put_ready == 0)
+	msg_panic("%s: read-only stream", myname);
+    switch (bp->flags & (VSTREAM_FLAG_WRITE | VSTREAM_FLAG_READ)) {
+    case VSTREAM_FLAG_READ:			/* discard input */
+	VSTREAM_BUF_AT_END(bp);
+	/* FALLTHROUGH */
+    case 0:					/* flush after seek? */
+	return ((bp->flags & VSTREAM_FLAG_ERR) ? VSTREAM_EOF : 0);
+    case VSTREAM_FLAG_WRITE:			/* output buffered */
+	break;
+    case VSTREAM_FLAG_WRITE | VSTREAM_FLAG_READ:
+	msg_panic("%s: read/write stream", myname);
     }
+    used = bp->len - bp->cnt;
+    left_over = used - to_flush;
+
+    if (msg_verbose > 2 && stream != VSTREAM_ERR)
+	msg_info("%s: fd %d flush %ld", myname, stream->fd, (long) to_flush);
+    if (to_flush < 0 || left_over < 0)
+	msg_panic("%s: bad to_flush %ld", myname, (long) to_flush);
+    if (to_flush < left_over)
+	msg_panic("%s: to_flush < left_over", myname);
+    if (to_flush == 0)
+	return ((bp->flags & VSTREAM_FLAG_ERR) ? VSTREAM_EOF : 0);
+    if (bp->flags & VSTREAM_FLAG_ERR)
+	return (VSTREAM_EOF);
+
+    iov.iov_base = (void *) bp->data;
+    iov.iov_len = to_flush;
+    if (vstream_write_iov(stream, &iov, 1) != 0)
+	return (VSTREAM_EOF);
     if (bp->flags & VSTREAM_FLAG_SEEK)
 	stream->offset += to_flush;
+    vstream_buf_adapt(stream, to_flush);
 
     /*
      * Allow for partial buffer flush requests. We use memcpy() for reasons
@@ -966,6 +1064,7 @@ static int vstream_buf_get_ready(VBUF *bp)
 	bp->ptr = bp->data;
 	if (bp->flags & VSTREAM_FLAG_SEEK)
 	    stream->offset += n;
+	vstream_buf_adapt(stream, n);
 	return (0);
     }
 }
@@ -1298,6 +1397,8 @@ static VSTREAM *vstream_subopen(void)
     stream->time_limit.tv_sec = stream->time_limit.tv_usec = 0;
     stream->req_bufsize = 0;
     stream->vstring = 0;
+    stream->max_bufsize = 0;
+    stream->full_count = 0;
     return (stream);
 }
 
@@ -1481,6 +1582,44 @@ int     vstream_fputs(const char *str, VSTREAM *stream)
     return (0);
 }
 
+/* vstream_fwrite - unformatted write */
+
+ssize_t vstream_fwrite(VSTREAM *stream, const void *buf, ssize_t len)
+{
+    const char *myname = "vstream_fwrite";
+    VBUF   *bp = &stream->buf;
+    struct iovec iov[2];
+    ssize_t used;
+
+    /*
+     * Copy small amounts through the stream buffer. Otherwise, save a
+     * memcpy() and some write() calls: write the buffered data and the new
+     * data at once. This requires that the stream is already in write mode,
+     * so that we don't have to deal with a change of I/O direction.
+     */
+    if (len <= 0 || len < bp->len
+	|| (bp->flags & (VSTREAM_FLAG_WRITE | VSTREAM_FLAG_READ
+			 | VSTREAM_FLAG_ERR)) != VSTREAM_FLAG_WRITE
+	|| stream->write_fn != (VSTREAM_RW_FN) timed_write)
+	return (vbuf_write(bp, buf, len));
+
+    used = bp->len - bp->cnt;
+    if (msg_verbose > 2 && stream != VSTREAM_ERR)
+	msg_info("%s: fd %d flush %ld write %ld",
+		 myname, stream->fd, (long) used, (long) len);
+    iov[0].iov_base = (void *) bp->data;
+    iov[0].iov_len = used;
+    iov[1].iov_base = (void *) buf;
+    iov[1].iov_len = len;
+    if (vstream_write_iov(stream, used > 0 ? iov : iov + 1,
+			  used > 0 ? 2 : 1) != 0)
+	return (0);
+    if (bp->flags & VSTREAM_FLAG_SEEK)
+	stream->offset += used + len;
+    VSTREAM_BUF_AT_START(bp);
+    return (len);
+}
+
 /* vstream_fread_buf - unformatted read to VSTRING */
 
 ssize_t vstream_fread_buf(VSTREAM *fp, VSTRING *vp, ssize_t len)
@@ -1646,6 +1785,19 @@ void    vstream_control(VSTREAM *stream, int name,...)
 	    }
 	    break;
 
+	    /*
+	     * Grow the buffer later, in vstream_buf_adapt().
+	     */
+	case VSTREAM_CTL_BUFSIZE_LIMIT:
+	    req_bufsize = va_arg(ap, ssize_t);
+	    /* Heuristic to detect missing (ssize_t) type cast on LP64 hosts. */
+	    if (req_bufsize < 0 || req_bufsize > INT_MAX)
+		msg_panic("unreasonable VSTREAM_CTL_BUFSIZE_LIMIT request: %ld",
+			  (long) req_bufsize);
+	    if ((stream->buf.flags & VSTREAM_FLAG_FIXED) == 0)
+		stream->max_bufsize = req_bufsize;
+	    break;
+
 	    /*
 	     * Make no gettimeofday() etc. system call until we really know
 	     * that we need to do I/O. This avoids a performance hit when
@@ -60,6 +60,8 @@ typedef struct VSTREAM {
     struct timeval iotime;		/* time of last fill/flush */
     struct timeval time_limit;		/* read/write time limit */
     struct VSTRING *vstring;		/* memory-backed stream */
+    ssize_t max_bufsize;		/* adaptive buffer size limit */
+    int     full_count;			/* consecutive full reads/writes */
 } VSTREAM;
 
 extern VSTREAM vstream_fstd[];		/* pre-defined streams */
@@ -105,7 +107,7 @@ extern VSTREAM *vstream_fdopen(int, int);
 extern int vstream_fdclose(VSTREAM *);
 
 #define vstream_fread(v, b, n)	vbuf_read(&(v)->buf, (b), (n))
-#define vstream_fwrite(v, b, n)	vbuf_write(&(v)->buf, (b), (n))
+#define vstream_fcopy(s, d, n)	vbuf_copy(&(s)->buf, &(d)->buf, (n))
 
 #define VSTREAM_PUTC(ch, vp)	VBUF_PUT(&(vp)->buf, (ch))
 #define VSTREAM_GETC(vp)	VBUF_GET(&(vp)->buf)
@@ -132,6 +134,7 @@ extern int vstream_fdclose(VSTREAM *);
 
 #define vstream_fstat(vp, fl)	((vp)->buf.flags & (fl))
 
+extern ssize_t vstream_fwrite(VSTREAM *, const void *, ssize_t);
 extern ssize_t vstream_fread_buf(VSTREAM *, struct VSTRING *, ssize_t);
 extern ssize_t vstream_fread_app(VSTREAM *, struct VSTRING *, ssize_t);
 extern void vstream_control(VSTREAM *, int,...);
@@ -155,6 +158,7 @@ extern void vstream_control(VSTREAM *, int,...);
 #define VSTREAM_CTL_SWAP_FD	13
 #define VSTREAM_CTL_START_DEADLINE 14
 #define VSTREAM_CTL_STOP_DEADLINE 15
+#define VSTREAM_CTL_BUFSIZE_LIMIT 16
 
 /* Safer API: type-checked arguments, external use. */
 #define CA_VSTREAM_CTL_END		VSTREAM_CTL_END
@@ -175,6 +179,7 @@ extern void vstream_control(VSTREAM *, int,...);
 #define CA_VSTREAM_CTL_SWAP_FD(v)	VSTREAM_CTL_SWAP_FD, CHECK_PTR(VSTREAM_CTL, VSTREAM, (v))
 #define CA_VSTREAM_CTL_START_DEADLINE	VSTREAM_CTL_START_DEADLINE
 #define CA_VSTREAM_CTL_STOP_DEADLINE	VSTREAM_CTL_STOP_DEADLINE
+#define CA_VSTREAM_CTL_BUFSIZE_LIMIT(v)	VSTREAM_CTL_BUFSIZE_LIMIT, CHECK_VAL(VSTREAM_CTL, ssize_t, (v))
 
 CHECK_VAL_HELPER_DCL(VSTREAM_CTL, ssize_t);
 CHECK_VAL_HELPER_DCL(VSTREAM_CTL, int);